@@ -76,6 +76,10 @@ function(vpvl2_find_bullet)
   find_library(BULLET_MULTITHREADED_LIB BulletMultiThreaded PATH_SUFFIXES lib64 lib32 lib PATHS ${BULLET_INSTALL_DIR} NO_DEFAULT_PATH)
   find_library(BULLET_SOFTBODY_LIB BulletSoftBody PATH_SUFFIXES lib64 lib32 lib PATHS ${BULLET_INSTALL_DIR} NO_DEFAULT_PATH)
   include_directories(${BULLET_INCLUDE_DIR})
+  if(VPVL2_LINK_BULLET_NO_PROFILE)
+    # must be same as Bullet Physics, the profiler of Bullet is global and not thread safe
+    add_definitions(-DBT_NO_PROFILE)
+  endif()
 endfunction()
 
 function(vpvl2_link_assimp target)
@@ -180,6 +184,14 @@ function(vpvl2_find_openmp)
   endif()
 endfunction()
 
+function(vpvl2_link_threads target)
+  # the built-in thread pool (internal::ThreadPool) uses pthread except Windows
+  find_package(Threads)
+  if(CMAKE_THREAD_LIBS_INIT)
+    target_link_libraries(${target} ${CMAKE_THREAD_LIBS_INIT})
+  endif()
+endfunction()
+
 function(vpvl2_link_icu target)
   if(ICU_LIBRARY_DATA AND ICU_LIBRARY_I18N AND ICU_LIBRARY_UC)
     target_link_libraries(${target} ${ICU_LIBRARY_I18N} ${ICU_LIBRARY_UC} ${ICU_LIBRARY_DATA})
@@ -424,6 +436,7 @@ function(vpvl2_link_all target)
   vpvl2_link_zlib(${target})
   vpvl2_link_libxml2(${target})
   vpvl2_link_tbb(${target})
+  vpvl2_link_threads(${target})
   vpvl2_link_bullet(${target})
   vpvl2_link_assimp(${target})
   vpvl2_link_glew(${target})
@@ -35,6 +35,7 @@
 /* ----------------------------------------------------------------- */
 
 #include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/MappedFile.h"
 
 #include "vpvl2/asset/Model.h"
 #include "vpvl2/mvd/Motion.h"
@@ -374,6 +375,21 @@ struct Factory::PrivateContext
         return motion;
     }
 
+    internal::MappedFile *mapFile(const IString *path) const {
+        if (!path) {
+            return 0;
+        }
+        internal::MappedFile *file = new internal::MappedFile();
+        uint8_t *bytes = encoding->toByteArray(path, IString::kUTF8);
+        bool ok = bytes && file->open(reinterpret_cast<const char *>(bytes));
+        encoding->disposeByteArray(bytes);
+        if (!ok) {
+            delete file;
+            file = 0;
+        }
+        return file;
+    }
+
     IEncoding *encoding;
     IMotion *motionPtr;
     mutable mvd::Motion *mvdPtr;
@@ -390,7 +406,7 @@ struct Factory::PrivateContext
 
 IModel::Type Factory::findModelType(const uint8_t *data, size_t size)
 {
-    if (size >= 4 && memcmp(data, "PMX ", 4) == 0) {
+    if ((size >= 4 && memcmp(data, "PMX ", 4) == 0) || pmx::Model::isCompiled(data, size)) {
         return IModel::kPMXModel;
     }
     else if (size >= 3 && memcmp(data, "Pmd", 3) == 0) {
@@ -463,6 +479,26 @@ IModel *Factory::createModel(const uint8_t *data, size_t size, bool &ok) const
     return model;
 }
 
+IModel *Factory::createModel(const IString *path, bool &ok) const
+{
+    internal::MappedFile *file = m_context->mapFile(path);
+    if (!file) {
+        ok = false;
+        return 0;
+    }
+    const IModel::Type type = findModelType(file->data(), file->size());
+    if (type == IModel::kPMXModel) {
+        /* the model owns the mapped file to refer names in it */
+        pmx::Model *model = new pmx::Model(m_context->encoding);
+        ok = model->loadMapped(file);
+        return model;
+    }
+    IModel *model = newModel(type);
+    ok = model ? model->load(file->data(), file->size()) : false;
+    delete file;
+    return model;
+}
+
 IMotion *Factory::newMotion(IMotion::Type type, IModel *modelRef) const
 {
     switch (type) {
@@ -482,6 +518,19 @@ IMotion *Factory::createMotion(const uint8_t *data, size_t size, IModel *model,
     return motion;
 }
 
+IMotion *Factory::createMotion(const IString *path, IModel *model, bool &ok) const
+{
+    internal::MappedFile *file = m_context->mapFile(path);
+    if (!file) {
+        ok = false;
+        return 0;
+    }
+    IMotion *motion = newMotion(findMotionType(file->data(), file->size()), model);
+    ok = motion ? motion->load(file->data(), file->size()) : false;
+    delete file;
+    return motion;
+}
+
 IBoneKeyframe *Factory::createBoneKeyframe(const IMotion *motion) const
 {
     if (motion) {
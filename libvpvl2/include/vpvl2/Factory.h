@@ -95,6 +95,19 @@ public:
      */
     IModel *createModel(const uint8_t *data, size_t size, bool &ok) const;
 
+    /**
+     * path のファイルをメモリマップして読み込み済みの Model インスタンスを作成します.
+     * ファイルの内容はコピーされずにそのまま読み込まれます。PMX の場合は名前やコメントを
+     * 最初に参照されるまで文字列に変換せず、モデルが解放されるまでファイルをマップしたままにします。
+     * pmx::Model#saveCompiled で保存したコンパイル済みモデルも PMX として読み込みます。
+     * 読み込みに成功した場合第２引数の ok が true に、失敗した場合は false にセットされます。
+     * ファイルを開けなかった場合は 0 を返し、それ以外は読み込みの成功可否にかかわらず IModel インスタンスを返します。
+     * @param path
+     * @param ok
+     * @return IModel
+     */
+    IModel *createModel(const IString *path, bool &ok) const;
+
     /**
      * 空の Motion インスタンスを返します.
      *
@@ -121,6 +134,18 @@ public:
      */
     IMotion *createMotion(const uint8_t *data, size_t size, IModel *model, bool &ok) const;
 
+    /**
+     * path のファイルをメモリマップして読み込み済みの Motion インスタンスを作成します.
+     * ファイルの内容はコピーされずにそのまま読み込まれ、読み込み後にファイルのマップは解除されます。
+     * ok 及び model の扱いは createMotion(const uint8_t *, size_t, IModel *, bool &) と同じです。
+     * ファイルを開けなかった場合は 0 を返します。
+     * @param path
+     * @param model
+     * @param ok
+     * @return IMotion
+     */
+    IMotion *createMotion(const IString *path, IModel *model, bool &ok) const;
+
     /**
      * IBoneKeyframe (ボーンのキーフレーム) のインスタンスを返します.
      *
@@ -73,6 +73,9 @@ public:
             kVertexIndexStride,
             kBoneIndexStride,
             kBoneWeightStride,
+            kSdefCStride,
+            kSdefR0Stride,
+            kSdefR1Stride,
             kUVA0Stride,
             kUVA1Stride,
             kUVA2Stride,
@@ -94,9 +97,30 @@ public:
                             Vector3 &aabbMax) const = 0;
         virtual void setParallelUpdateEnable(bool value) = 0;
         virtual void setSkinningEnable(bool value) = 0;
+        virtual bool isDirty(const Vector3 &cameraPosition) const = 0;
     };
     struct StaticVertexBuffer : Buffer {
+        /**
+         * 頂点属性の各成分の型です。
+         *
+         * kNormalizedUnsignedShortComponent は 0.0 から 1.0 に正規化されます。
+         */
+        enum ComponentType {
+            kFloatComponent,
+            kUnsignedByteComponent,
+            kUnsignedShortComponent,
+            kNormalizedUnsignedShortComponent,
+            kMaxComponentType
+        };
         virtual void update(void *address) const = 0;
+        /**
+         * 指定された頂点属性の成分の型を返します。
+         *
+         * @brief componentType
+         * @param type
+         * @return ComponentType
+         */
+        virtual ComponentType componentType(StrideType type) const = 0;
     };
     struct IndexBuffer : Buffer {
         enum Type {
@@ -112,8 +136,11 @@ public:
     struct MatrixBuffer {
         virtual ~MatrixBuffer() {}
         virtual void update(void *address) = 0;
-        virtual const float *bytes(int materialIndex) const = 0;
-        virtual size_t size(int materialIndex) const = 0;
+        virtual int countMeshes(int materialIndex) const = 0;
+        virtual int countIndices(int materialIndex, int meshIndex) const = 0;
+        virtual const float *bytes(int materialIndex, int meshIndex) const = 0;
+        virtual size_t size(int materialIndex, int meshIndex) const = 0;
+        virtual bool isDirty() const = 0;
     };
 
     /**
@@ -655,6 +682,8 @@ public:
      * IIndexBuffer は同じ型で取得したインスタンスを渡す必要があります。
      * 条件を満たさない場合は dynamicBuffer に 0 が入ります。
      *
+     * isDirty が false を返す場合は前回の update の内容から変化がないため、update を省略できます。
+     *
      * @brief getDynamicVertexBuffer
      * @param dynamicBuffer
      * @param indexBuffer
@@ -669,6 +698,11 @@ public:
      * IDynamicVertexBuffer と IIndexBuffer は同じ型で取得したインスタンスを渡す必要があります。
      * 条件を満たさない場合は matrixBuffer に 0 が入ります。
      *
+     * 各材質はシェーダのボーン行列の上限数を超えないようにメッシュに分割されます。
+     * メッシュ毎に countIndices で返される数のインデックスを描画してください。
+     * 分割できないモデルの場合も matrixBuffer に 0 が入ります。
+     * isDirty が false を返す場合は update を省略できます。
+     *
      * @brief getMatrixBuffer
      * @param matrixBuffer
      * @param dynamicBuffer
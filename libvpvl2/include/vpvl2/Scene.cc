@@ -36,6 +36,7 @@
 
 #include "vpvl2/vpvl2.h"
 #include "vpvl2/internal/util.h"
+#include "vpvl2/internal/ParallelProcessors.h"
 
 #ifdef VPVL2_LINK_GLEW
 #include <GL/glew.h>
@@ -443,10 +444,14 @@ struct Scene::PrivateContext
     }
     void updateModels() {
         const int nmodels = models.count();
+        Array<IModel *> modelRefs;
+        modelRefs.reserve(nmodels);
         for (int i = 0; i < nmodels; i++) {
             IModel *model = models[i]->value;
-            model->performUpdate();
+            modelRefs.append(model);
         }
+        internal::ParallelUpdateModelProcessor<IModel> processor(&modelRefs);
+        processor.execute();
     }
     void updateRenderEngines() {
         const int nengines = engines.count();
@@ -628,6 +633,16 @@ bool Scene::isSelfShadowSupported()
 #endif
 }
 
+void Scene::setWorkerThreads(int nworkers, bool enableAffinity)
+{
+    internal::ThreadPool::sharedInstance()->setup(nworkers, enableAffinity);
+}
+
+int Scene::countWorkerThreads()
+{
+    return internal::ThreadPool::sharedInstance()->countWorkers();
+}
+
 Scalar Scene::defaultFPS()
 {
     static const Scalar kDefaultFPS = 30;
@@ -128,6 +128,29 @@ public:
      */
     static bool isSelfShadowSupported();
 
+    /**
+     * 頂点のスキニングやボーン及びモデルの更新に使うワーカースレッドの数を設定します.
+     *
+     * nworkers は呼び出し元のスレッドを含めた数で、1 を指定すると並列処理を行いません。0 以下の場合は 1 として、
+     * 64 を超える場合は 64 として扱います。enableAffinity が true の場合は各ワーカースレッドを CPU に固定します
+     * (Windows と Linux のみ有効)。設定は次の更新処理から反映され、更新処理中に呼び出してはいけません。
+     *
+     * 初期値は論理 CPU の数です。Intel TBB つきでビルドした場合は TBB のスケジューラが使われるため効果はありません。
+     *
+     * @brief setWorkerThreads
+     * @param nworkers
+     * @param enableAffinity
+     */
+    static void setWorkerThreads(int nworkers, bool enableAffinity);
+
+    /**
+     * 呼び出し元のスレッドを含めたワーカースレッドの数を返します.
+     *
+     * @brief countWorkerThreads
+     * @return
+     */
+    static int countWorkerThreads();
+
     /**
      * 標準の FPS (Frames Per Second) を返します.
      *
@@ -124,7 +124,7 @@ PMXRenderEngine::PMXRenderEngine(IRenderContext *renderContextRef,
       m_aabbMin(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY),
       m_aabbMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY),
       m_cullFaceState(true),
-      m_updateEvenBuffer(true),
+      m_updateIndex(0),
       m_isVertexShaderSkinning(false)
 {
     m_modelRef->getIndexBuffer(m_indexBuffer);
@@ -166,8 +166,9 @@ bool PMXRenderEngine::upload(const IString *dir)
     if (!uploadMaterials(dir, userData)) {
         return releaseUserData0(userData);
     }
-    m_bundle.create(VertexBundle::kVertexBuffer, kModelDynamicVertexBufferEven, GL_DYNAMIC_DRAW, 0, m_dynamicBuffer->size());
-    m_bundle.create(VertexBundle::kVertexBuffer, kModelDynamicVertexBufferOdd, GL_DYNAMIC_DRAW, 0, m_dynamicBuffer->size());
+    for (int i = 0; i < kMaxDynamicVertexBuffers; i++) {
+        m_bundle.createStream(kModelDynamicVertexBuffer0 + i, m_dynamicBuffer->size());
+    }
     VPVL2_VLOG(2, "Binding model dynamic vertex buffer to the vertex buffer object: size=" << m_dynamicBuffer->size());
     m_bundle.create(VertexBundle::kVertexBuffer, kModelStaticVertexBuffer, GL_STATIC_DRAW, 0, m_staticBuffer->size());
     m_bundle.bind(VertexBundle::kVertexBuffer, kModelStaticVertexBuffer);
@@ -178,25 +179,17 @@ bool PMXRenderEngine::upload(const IString *dir)
     m_bundle.unbind(VertexBundle::kVertexBuffer);
     m_bundle.create(VertexBundle::kIndexBuffer, kModelIndexBuffer, GL_STATIC_DRAW, m_indexBuffer->bytes(), m_indexBuffer->size());
     VPVL2_VLOG(2, "Binding indices to the vertex buffer object: ptr=" << m_indexBuffer->bytes() << " size=" << m_indexBuffer->size());
-    VertexBundleLayout &bundleME = m_layouts[kVertexArrayObjectEven];
-    if (bundleME.create() && bundleME.bind()) {
-        VPVL2_VLOG(2, "Binding an vertex array object for even frame: " << bundleME.name());
-        createVertexBundle(kModelDynamicVertexBufferEven);
-    }
-    VertexBundleLayout &bundleMO = m_layouts[kVertexArrayObjectOdd];
-    if (bundleMO.create() && bundleMO.bind()) {
-        VPVL2_VLOG(2, "Binding an vertex array object for odd frame: " << bundleMO.name());
-        createVertexBundle(kModelDynamicVertexBufferOdd);
-    }
-    VertexBundleLayout &bundleEE = m_layouts[kEdgeVertexArrayObjectEven];
-    if (bundleEE.create() && bundleEE.bind()) {
-        VPVL2_VLOG(2, "Binding an edge vertex array object for even frame: " << bundleEE.name());
-        createEdgeBundle(kModelDynamicVertexBufferEven);
-    }
-    VertexBundleLayout &bundleEO = m_layouts[kEdgeVertexArrayObjectOdd];
-    if (bundleEO.create() && bundleEO.bind()) {
-        VPVL2_VLOG(2, "Binding an edge vertex array object for odd frame: " << bundleEO.name());
-        createEdgeBundle(kModelDynamicVertexBufferOdd);
+    for (int i = 0; i < kMaxDynamicVertexBuffers; i++) {
+        VertexBundleLayout &bundleM = m_layouts[kVertexArrayObject0 + i];
+        if (bundleM.create() && bundleM.bind()) {
+            VPVL2_VLOG(2, "Binding an vertex array object for frame " << i << ": " << bundleM.name());
+            createVertexBundle(kModelDynamicVertexBuffer0 + i);
+        }
+        VertexBundleLayout &bundleE = m_layouts[kEdgeVertexArrayObject0 + i];
+        if (bundleE.create() && bundleE.bind()) {
+            VPVL2_VLOG(2, "Binding an edge vertex array object for frame " << i << ": " << bundleE.name());
+            createEdgeBundle(kModelDynamicVertexBuffer0 + i);
+        }
     }
     VertexBundleLayout::unbindVertexArrayObject();
     m_bundle.unbind(VertexBundle::kVertexBuffer);
@@ -204,15 +197,15 @@ bool PMXRenderEngine::upload(const IString *dir)
 #ifdef VPVL2_ENABLE_OPENCL
     if (m_accelerator && m_accelerator->isAvailable()) {
         m_accelerator->release(m_accelerationBuffers);
-        m_accelerationBuffers.append(cl::PMXAccelerator::Buffer(m_bundle.findName(kModelDynamicVertexBufferEven)));
-        m_accelerationBuffers.append(cl::PMXAccelerator::Buffer(m_bundle.findName(kModelDynamicVertexBufferOdd)));
+        for (int i = 0; i < kMaxDynamicVertexBuffers; i++) {
+            m_accelerationBuffers.append(cl::PMXAccelerator::Buffer(m_bundle.findName(kModelDynamicVertexBuffer0 + i)));
+        }
         m_accelerator->upload(m_accelerationBuffers, m_indexBuffer);
     }
 #endif
     m_sceneRef->updateModel(m_modelRef);
     m_modelRef->setVisible(true);
-    update(); // for updating even frame
-    update(); // for updating odd frame
+    update(); // for updating the first frame
     VPVL2_VLOG(2, "Created the model: " << internal::cstr(m_modelRef->name(), "(null)"));
     m_renderContextRef->stopProfileSession(IRenderContext::kProfileUploadModelProcess, m_modelRef);
     m_renderContextRef->releaseUserData(m_modelRef, userData);
@@ -224,25 +217,29 @@ void PMXRenderEngine::update()
     if (!m_modelRef || !m_modelRef->isVisible() || !m_currentEffectEngineRef) {
         return;
     }
-    VertexBufferObjectType vbo = m_updateEvenBuffer ? kModelDynamicVertexBufferEven : kModelDynamicVertexBufferOdd;
+    const Vector3 &cameraPosition = m_sceneRef->camera()->position();
     m_renderContextRef->startProfileSession(IRenderContext::kProfileUpdateModelProcess, m_modelRef);
-    m_bundle.bind(VertexBundle::kVertexBuffer, vbo);
-    if (void *address = m_bundle.map(VertexBundle::kVertexBuffer, 0, m_dynamicBuffer->size())) {
-        m_dynamicBuffer->update(address, m_sceneRef->camera()->position(), m_aabbMin, m_aabbMax);
-        m_bundle.unmap(VertexBundle::kVertexBuffer, address);
-    }
-    m_bundle.unbind(VertexBundle::kVertexBuffer);
+    /* effect parameters are updated even if the last written buffer is still valid */
+    if (m_dynamicBuffer->isDirty(cameraPosition)) {
+        /* all draw commands reading the last written buffer are issued before updating the next one */
+        m_bundle.fenceStream(kModelDynamicVertexBuffer0 + drawIndex());
+        const GLuint vbo = kModelDynamicVertexBuffer0 + m_updateIndex;
+        if (void *address = m_bundle.mapStream(vbo)) {
+            m_dynamicBuffer->update(address, cameraPosition, m_aabbMin, m_aabbMax);
+            m_bundle.unmapStream(vbo);
+        }
 #ifdef VPVL2_ENABLE_OPENCL
-    if (m_accelerator && m_accelerator->isAvailable()) {
-        const cl::PMXAccelerator::Buffer &buffer = m_accelerationBuffers[m_updateEvenBuffer ? 0 : 1];
-        m_accelerator->update(m_dynamicBuffer, m_sceneRef, buffer, m_aabbMin, m_aabbMax);
-    }
+        if (m_accelerator && m_accelerator->isAvailable()) {
+            const cl::PMXAccelerator::Buffer &buffer = m_accelerationBuffers[m_updateIndex];
+            m_accelerator->update(m_dynamicBuffer, m_sceneRef, buffer, m_aabbMin, m_aabbMax);
+        }
 #endif
-    m_modelRef->setAabb(m_aabbMin, m_aabbMax);
+        m_modelRef->setAabb(m_aabbMin, m_aabbMax);
+        m_updateIndex = (m_updateIndex + 1) % kMaxDynamicVertexBuffers;
+    }
     m_currentEffectEngineRef->updateModelLightParameters(m_sceneRef, m_modelRef);
     m_currentEffectEngineRef->updateSceneParameters();
     m_renderContextRef->stopProfileSession(IRenderContext::kProfileUpdateModelProcess, m_modelRef);
-    m_updateEvenBuffer = m_updateEvenBuffer ? false :true;
     if (m_currentEffectEngineRef) {
         m_currentEffectEngineRef->useToon.setValue(true);
         m_currentEffectEngineRef->parthf.setValue(false);
@@ -712,28 +709,24 @@ void PMXRenderEngine::bindStaticVertexAttributePointers()
     glTexCoordPointer(2, GL_FLOAT, size, reinterpret_cast<const GLvoid *>(offset));
 }
 
+int PMXRenderEngine::drawIndex() const
+{
+    /* the last written buffer is drawn */
+    return (m_updateIndex + kMaxDynamicVertexBuffers - 1) % kMaxDynamicVertexBuffers;
+}
+
 void PMXRenderEngine::getVertexBundleType(VertexArrayObjectType &vao, VertexBufferObjectType &vbo) const
 {
-    if (m_updateEvenBuffer) {
-        vao = kVertexArrayObjectOdd;
-        vbo = kModelDynamicVertexBufferOdd;
-    }
-    else {
-        vao = kVertexArrayObjectEven;
-        vbo = kModelDynamicVertexBufferEven;
-    }
+    const int index = drawIndex();
+    vao = VertexArrayObjectType(kVertexArrayObject0 + index);
+    vbo = VertexBufferObjectType(kModelDynamicVertexBuffer0 + index);
 }
 
 void PMXRenderEngine::getEdgeBundleType(VertexArrayObjectType &vao, VertexBufferObjectType &vbo) const
 {
-    if (m_updateEvenBuffer) {
-        vao = kEdgeVertexArrayObjectOdd;
-        vbo = kModelDynamicVertexBufferOdd;
-    }
-    else {
-        vao = kEdgeVertexArrayObjectEven;
-        vbo = kModelDynamicVertexBufferEven;
-    }
+    const int index = drawIndex();
+    vao = VertexArrayObjectType(kEdgeVertexArrayObject0 + index);
+    vbo = VertexBufferObjectType(kModelDynamicVertexBuffer0 + index);
 }
 
 void PMXRenderEngine::getDrawPrimitivesCommand(EffectEngine::DrawPrimitiveCommand &command) const
@@ -94,19 +94,23 @@ public:
 private:
     class PrivateEffectEngine;
     enum VertexBufferObjectType {
-        kModelDynamicVertexBufferEven,
-        kModelDynamicVertexBufferOdd,
+        kModelDynamicVertexBuffer0,
+        kModelDynamicVertexBuffer1,
+        kModelDynamicVertexBuffer2,
         kModelStaticVertexBuffer,
         kModelIndexBuffer,
         kMaxVertexBufferObjectType
     };
     enum VertexArrayObjectType {
-        kVertexArrayObjectEven,
-        kVertexArrayObjectOdd,
-        kEdgeVertexArrayObjectEven,
-        kEdgeVertexArrayObjectOdd,
+        kVertexArrayObject0,
+        kVertexArrayObject1,
+        kVertexArrayObject2,
+        kEdgeVertexArrayObject0,
+        kEdgeVertexArrayObject1,
+        kEdgeVertexArrayObject2,
         kMaxVertexArrayObjectType
     };
+    static const int kMaxDynamicVertexBuffers = extensions::gl::VertexBundle::kMaxStreamBuffers;
     struct MaterialContext {
         MaterialContext()
             : mainTextureRef(0),
@@ -131,6 +135,7 @@ private:
     void unbindVertexBundle();
     void bindDynamicVertexAttributePointers(IModel::Buffer::StrideType type);
     void bindStaticVertexAttributePointers();
+    int drawIndex() const;
     void getVertexBundleType(VertexArrayObjectType &vao, VertexBufferObjectType &vbo) const;
     void getEdgeBundleType(VertexArrayObjectType &vao, VertexBufferObjectType &vbo) const;
     void getDrawPrimitivesCommand(EffectEngine::DrawPrimitiveCommand &command) const;
@@ -159,7 +164,7 @@ private:
     Vector3 m_aabbMin;
     Vector3 m_aabbMax;
     bool m_cullFaceState;
-    bool m_updateEvenBuffer;
+    int m_updateIndex;
     bool m_isVertexShaderSkinning;
 
     VPVL2_DISABLE_COPY_AND_ASSIGN(PMXRenderEngine)
@@ -36,8 +36,27 @@
 
 #include <vpvl2/extensions/World.h>
 
+#include <vpvl2/IBone.h>
+#include <vpvl2/ICamera.h>
+#include <vpvl2/IJoint.h>
 #include <vpvl2/IModel.h>
 #include <vpvl2/Scene.h>
+#include <vpvl2/internal/BaseRigidBody.h>
+#include <vpvl2/internal/ThreadPool.h>
+#include <vpvl2/internal/util.h>
+
+#ifdef VPVL2_LINK_INTEL_TBB
+#include <tbb/tbb.h>
+#endif
+
+#if defined(WIN32) || defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
 
 /* Bullet Physics */
 #ifdef __clang__
@@ -48,55 +67,615 @@
 #include <BulletCollision/CollisionDispatch/btDefaultCollisionConfiguration.h>
 #include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h>
 #include <BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+#include <BulletDynamics/Dynamics/btRigidBody.h>
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
 
+namespace {
+
+using namespace vpvl2;
+
+#pragma pack(push, 1)
+
+struct CheckpointHeader
+{
+    vpvl2::uint8_t signature[8];
+    vpvl2::uint32_t version;
+    vpvl2::float64_t interval;
+    vpvl2::int32_t ncheckpoints;
+    vpvl2::int32_t nRigidBodies;
+};
+
+struct RigidBodyUnit
+{
+    vpvl2::float32_t position[3];
+    vpvl2::float32_t rotation[4];
+    vpvl2::float32_t linearVelocity[3];
+    vpvl2::float32_t angularVelocity[3];
+};
+
+#pragma pack(pop)
+
+static const vpvl2::uint8_t kCheckpointSignature[] = "VPVL2PCK";
+static const vpvl2::uint32_t kCheckpointVersion = 1;
+
+static inline void setUnitVector(const Vector3 &value, vpvl2::float32_t *dst)
+{
+    dst[0] = value.x();
+    dst[1] = value.y();
+    dst[2] = value.z();
+}
+
+static inline const Vector3 getUnitVector(const vpvl2::float32_t *src)
+{
+    return Vector3(src[0], src[1], src[2]);
+}
+
+static inline double currentSeconds()
+{
+#if defined(WIN32) || defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return double(counter.QuadPart) / double(frequency.QuadPart);
+#else
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec * 0.000001;
+#endif
+}
+
+}
+
 namespace vpvl2
 {
 namespace extensions
 {
 
 struct World::PrivateContext {
+    /**
+     * Island is a dynamics world with its own collision configuration, dispatcher, broadphase
+     * and solver, so islands share no state while stepping and can be stepped concurrently.
+     */
+    struct Island {
+        static btDefaultCollisionConstructionInfo createConstructionInfo(bool shared) {
+            btDefaultCollisionConstructionInfo info;
+            if (!shared) {
+                /* a model has a few hundreds of rigid bodies at most, pools overflow to the heap */
+                info.m_defaultMaxPersistentManifoldPoolSize = 1024;
+                info.m_defaultMaxCollisionAlgorithmPoolSize = 1024;
+            }
+            return info;
+        }
+        Island(IModel *modelRef)
+            : config(createConstructionInfo(modelRef == 0)),
+              dispatcher(0),
+              broadphase(0),
+              solver(0),
+              world(0),
+              modelRef(modelRef),
+              maxSubSteps(0),
+              nsubsteps(0)
+        {
+            dispatcher = new btCollisionDispatcher(&config);
+            broadphase = new btDbvtBroadphase();
+            solver = new btSequentialImpulseConstraintSolver();
+            world = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, &config);
+        }
+        ~Island() {
+            delete world;
+            world = 0;
+            delete solver;
+            solver = 0;
+            delete broadphase;
+            broadphase = 0;
+            delete dispatcher;
+            dispatcher = 0;
+            modelRef = 0;
+        }
+
+        btDefaultCollisionConfiguration config;
+        btCollisionDispatcher *dispatcher;
+        btDbvtBroadphase *broadphase;
+        btSequentialImpulseConstraintSolver *solver;
+        btDiscreteDynamicsWorld *world;
+        IModel *modelRef;
+        int maxSubSteps;
+        int nsubsteps;
+    };
+    struct ModelState {
+        ModelState(IModel *modelRef)
+            : modelRef(modelRef),
+              level(kFullLevel),
+              enablePhysics(true)
+        {
+        }
+        IModel *modelRef;
+        LevelOfDetail level;
+        bool enablePhysics;
+    };
+    class StepIslandsTask : public internal::ThreadPool::ITask {
+    public:
+        StepIslandsTask(const Array<Island *> *islandRefs, const Scalar &delta, const Scalar &fixedTimeStep, int maxSubSteps)
+            : m_islandRefs(islandRefs),
+              m_delta(delta),
+              m_fixedTimeStep(fixedTimeStep),
+              m_maxSubSteps(maxSubSteps)
+        {
+        }
+        ~StepIslandsTask() {
+            m_islandRefs = 0;
+        }
+
+#ifdef VPVL2_LINK_INTEL_TBB
+        void operator()(const tbb::blocked_range<int> &range) const {
+            stepIslands(range.begin(), range.end());
+        }
+#endif
+
+        void run(int begin, int end, int /* worker */) {
+            stepIslands(begin, end);
+        }
+        void execute() {
+            const int nislands = m_islandRefs->count();
+#ifdef BT_NO_PROFILE
+            /* islands are independent, one island per chunk to balance different model sizes */
+#ifdef VPVL2_LINK_INTEL_TBB
+            tbb::parallel_for(tbb::blocked_range<int>(0, nislands, 1), *this);
+#else /* VPVL2_LINK_INTEL_TBB */
+            internal::ThreadPool::sharedInstance()->execute(this, 0, nislands, 1);
+#endif /* VPVL2_LINK_INTEL_TBB */
+#else /* BT_NO_PROFILE */
+            /* the built-in profiler of Bullet is global and not thread safe, step islands in order */
+            stepIslands(0, nislands);
+#endif /* BT_NO_PROFILE */
+        }
+
+    private:
+        void stepIslands(int begin, int end) const {
+            for (int i = begin; i < end; i++) {
+                Island *island = m_islandRefs->at(i);
+                const int maxSubSteps = island->maxSubSteps > 0 ? btMin(island->maxSubSteps, m_maxSubSteps) : m_maxSubSteps;
+                island->nsubsteps = island->world->stepSimulation(m_delta, maxSubSteps, m_fixedTimeStep);
+            }
+        }
+
+        const Array<Island *> *m_islandRefs;
+        const Scalar m_delta;
+        const Scalar m_fixedTimeStep;
+        const int m_maxSubSteps;
+    };
+    struct Checkpoint {
+        Checkpoint(const IKeyframe::TimeIndex &timeIndex)
+            : timeIndex(timeIndex)
+        {
+        }
+        IKeyframe::TimeIndex timeIndex;
+        Array<RigidBodyUnit> units;
+    };
+    class StepSimulationTask : public internal::ThreadPool::ITask {
+    public:
+        StepSimulationTask()
+            : contextRef(0),
+              delta(0),
+              fixedTimeStep(0),
+              maxSubSteps(0)
+        {
+        }
+        ~StepSimulationTask() {
+            contextRef = 0;
+        }
+
+        void run(int /* begin */, int /* end */, int /* worker */) {
+            contextRef->stepIslands(delta, fixedTimeStep, maxSubSteps);
+        }
+
+        PrivateContext *contextRef;
+        Scalar delta;
+        Scalar fixedTimeStep;
+        int maxSubSteps;
+    };
+
     PrivateContext()
-        : dispatcher(0),
-          broadphase(0),
-          solver(0),
-          world(0),
+        : sharedIsland(0),
+          thread(0),
           motionFPS(0),
           fixedTimeStep(0),
-          maxSubSteps(0)
+          checkpointInterval(0),
+          stepBudget(0),
+          maxSubSteps(0),
+          budgetSubSteps(0),
+          enableModelIsolation(false)
     {
-        dispatcher = new btCollisionDispatcher(&config);
-        broadphase = new btDbvtBroadphase();
-        solver = new btSequentialImpulseConstraintSolver();
-        world = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, &config);
+        levelOfDetailThresholds[kFullLevel] = 0;
+        levelOfDetailThresholds[kReducedLevel] = 0.25f;
+        levelOfDetailThresholds[kKinematicLevel] = 0.1f;
+        levelOfDetailThresholds[kDisabledLevel] = 0;
+        sharedIsland = new Island(0);
+        islandRefs.append(sharedIsland);
+        task.contextRef = this;
     }
     ~PrivateContext() {
-        delete dispatcher;
-        dispatcher = 0;
-        delete broadphase;
-        broadphase = 0;
-        delete solver;
-        solver = 0;
-        delete world;
-        world = 0;
+        /* the thread must be stopped before destroying the world being stepped */
+        delete thread;
+        thread = 0;
+        modelIslands.releaseAll();
+        modelStates.releaseAll();
+        checkpoints.releaseAll();
+        delete sharedIsland;
+        sharedIsland = 0;
         motionFPS = 0;
         maxSubSteps = 0;
         fixedTimeStep = 0;
+        checkpointInterval = 0;
+        stepBudget = 0;
+        budgetSubSteps = 0;
     }
 
-    btDefaultCollisionConfiguration config;
-    btCollisionDispatcher *dispatcher;
-    btDbvtBroadphase *broadphase;
-    btSequentialImpulseConstraintSolver *solver;
-    btDiscreteDynamicsWorld *world;
+    bool containsModel(const IModel *value) const {
+        const int nmodels = modelRefs.count();
+        for (int i = 0; i < nmodels; i++) {
+            if (modelRefs[i] == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+    bool isModelShared(const IModel *value) const {
+        const int nmodels = sharedModelRefs.count();
+        for (int i = 0; i < nmodels; i++) {
+            if (sharedModelRefs[i] == value) {
+                return true;
+            }
+        }
+        return false;
+    }
+    Island *findModelIsland(const IModel *value) const {
+        const int nislands = modelIslands.count();
+        for (int i = 0; i < nislands; i++) {
+            Island *island = modelIslands[i];
+            if (island->modelRef == value) {
+                return island;
+            }
+        }
+        return 0;
+    }
+    void joinModel(IModel *value) {
+        const ModelState *state = findModelState(value);
+        if (state && state->level == kDisabledLevel) {
+            return;
+        }
+        if (enableModelIsolation && !isModelShared(value)) {
+            Island *island = modelIslands.append(new Island(value));
+            island->world->setGravity(sharedIsland->world->getGravity());
+            island->solver->setRandSeed(sharedIsland->solver->getRandSeed());
+            value->joinWorld(island->world);
+            if (state) {
+                setIslandLevelOfDetail(island, state->level);
+            }
+        }
+        else {
+            value->joinWorld(sharedIsland->world);
+        }
+        rebuildIslandRefs();
+    }
+    void leaveModel(IModel *value) {
+        const ModelState *state = findModelState(value);
+        if (state && state->level == kDisabledLevel) {
+            return;
+        }
+        if (Island *island = findModelIsland(value)) {
+            value->leaveWorld(island->world);
+            modelIslands.remove(island);
+            delete island;
+        }
+        else {
+            value->leaveWorld(sharedIsland->world);
+        }
+        rebuildIslandRefs();
+    }
+    void rebuildIslandRefs() {
+        islandRefs.clear();
+        islandRefs.append(sharedIsland);
+        const int nislands = modelIslands.count();
+        for (int i = 0; i < nislands; i++) {
+            islandRefs.append(modelIslands[i]);
+        }
+    }
+    void stepIslands(const Scalar &delta, const Scalar &fixedTimeStep, int maxSubSteps) {
+        if (stepBudget <= 0) {
+            StepIslandsTask processor(&islandRefs, delta, fixedTimeStep, maxSubSteps);
+            processor.execute();
+            return;
+        }
+        /* substeps are limited to fit the budget, simulation slows down instead of the frame rate */
+        const int nsubsteps = budgetSubSteps > 0 ? btMin(budgetSubSteps, maxSubSteps) : maxSubSteps;
+        const double start = currentSeconds();
+        StepIslandsTask processor(&islandRefs, delta, fixedTimeStep, nsubsteps);
+        processor.execute();
+        const double elapsed = currentSeconds() - start;
+        int performed = 0;
+        const int nislands = islandRefs.count();
+        for (int i = 0; i < nislands; i++) {
+            performed = btMax(performed, islandRefs[i]->nsubsteps);
+        }
+        if (performed > 0 && elapsed > 0) {
+            const double costPerSubStep = elapsed / performed;
+            budgetSubSteps = btMax(int(stepBudget / costPerSubStep), 1);
+        }
+    }
+    ModelState *findModelState(const IModel *value) const {
+        const int nstates = modelStates.count();
+        for (int i = 0; i < nstates; i++) {
+            ModelState *state = modelStates[i];
+            if (state->modelRef == value) {
+                return state;
+            }
+        }
+        return 0;
+    }
+    void setIslandLevelOfDetail(Island *island, LevelOfDetail level) {
+        /* the own world of the model can be stepped coarsely */
+        btContactSolverInfo &info = island->world->getSolverInfo();
+        if (level == kReducedLevel) {
+            info.m_numIterations = kReducedSolverIterations;
+            island->maxSubSteps = 1;
+        }
+        else {
+            info.m_numIterations = btContactSolverInfo().m_numIterations;
+            island->maxSubSteps = 0;
+        }
+    }
+    void setLevelOfDetail(ModelState *state, LevelOfDetail level) {
+        IModel *model = state->modelRef;
+        const LevelOfDetail lastLevel = state->level;
+        if (lastLevel == level) {
+            return;
+        }
+        if (level == kDisabledLevel) {
+            state->enablePhysics = model->isPhysicsEnabled();
+            leaveModel(model);
+            model->setPhysicsEnable(false);
+            state->level = level;
+            return;
+        }
+        state->level = level;
+        if (lastLevel == kDisabledLevel) {
+            /* join again and snap rigid bodies to the current pose */
+            model->setPhysicsEnable(state->enablePhysics);
+            joinModel(model);
+            Island *island = findModelIsland(model);
+            model->resetMotionState(island ? island->world : sharedIsland->world);
+        }
+        Array<IJoint *> jointRefs;
+        model->getJointRefs(jointRefs);
+        const int njoints = jointRefs.count();
+        for (int i = 0; i < njoints; i++) {
+            btTypedConstraint *constraint = static_cast<btTypedConstraint *>(jointRefs[i]->constraintPtr());
+            constraint->setOverrideNumSolverIterations(level == kReducedLevel ? kReducedSolverIterations : -1);
+        }
+        if (Island *island = findModelIsland(model)) {
+            setIslandLevelOfDetail(island, level);
+        }
+        if (level == kKinematicLevel || lastLevel == kKinematicLevel) {
+            /* rigid bodies follow bones in the kinematic level */
+            Array<IRigidBody *> rigidBodyRefs;
+            model->getRigidBodyRefs(rigidBodyRefs);
+            const int nRigidBodies = rigidBodyRefs.count();
+            for (int i = 0; i < nRigidBodies; i++) {
+                rigidBodyRefs[i]->setKinematic(level == kKinematicLevel, kZeroV3);
+            }
+        }
+    }
+    void restoreKinematicLevels() {
+        /* IModel#resetMotionState (Scene::kResetMotionState) makes rigid bodies dynamic again */
+        const int nstates = modelStates.count();
+        for (int i = 0; i < nstates; i++) {
+            const ModelState *state = modelStates[i];
+            if (state->level != kKinematicLevel) {
+                continue;
+            }
+            rigidBodyRefs.clear();
+            state->modelRef->getRigidBodyRefs(rigidBodyRefs);
+            const int nRigidBodies = rigidBodyRefs.count();
+            for (int j = 0; j < nRigidBodies; j++) {
+                internal::BaseRigidBody *rigidBody = static_cast<internal::BaseRigidBody *>(rigidBodyRefs[j]);
+                if (!rigidBody->body()->isKinematicObject()) {
+                    rigidBody->setKinematic(true, kZeroV3);
+                }
+            }
+        }
+    }
+    LevelOfDetail selectLevelOfDetail(const IModel *model, const ICamera *camera) const {
+        /* approximate the model by bones of its rigid bodies as a sphere */
+        Array<IRigidBody *> rigidBodyRefs;
+        model->getRigidBodyRefs(rigidBodyRefs);
+        const int nRigidBodies = rigidBodyRefs.count();
+        if (nRigidBodies == 0) {
+            return kFullLevel;
+        }
+        Vector3 center(kZeroV3);
+        for (int i = 0; i < nRigidBodies; i++) {
+            center += rigidBodyRefs[i]->boneRef()->worldTransform().getOrigin();
+        }
+        center /= Scalar(nRigidBodies);
+        Scalar radius(0);
+        for (int i = 0; i < nRigidBodies; i++) {
+            radius = btMax(radius, rigidBodyRefs[i]->boneRef()->worldTransform().getOrigin().distance(center));
+        }
+        /* ratio of the sphere to the half height of the screen */
+        const Scalar &distance = btMax(camera->position().distance(center), SIMD_EPSILON);
+        const Scalar &coverage = radius / (distance * btTan(btRadians(camera->fov()) * 0.5f));
+        for (int i = kDisabledLevel; i > kFullLevel; i--) {
+            if (coverage < levelOfDetailThresholds[i]) {
+                return static_cast<LevelOfDetail>(i);
+            }
+        }
+        return kFullLevel;
+    }
+    void waitForSimulation() {
+        if (thread) {
+            thread->wait();
+        }
+    }
+    void setModelPipelineEnable(IModel *model, bool value) {
+        /* all of rigid bodies in libvpvl2 models (PMX and PMD2) are BaseRigidBody */
+        Array<IRigidBody *> rigidBodyRefs;
+        model->getRigidBodyRefs(rigidBodyRefs);
+        const int nRigidBodies = rigidBodyRefs.count();
+        for (int i = 0; i < nRigidBodies; i++) {
+            internal::BaseRigidBody *rigidBody = static_cast<internal::BaseRigidBody *>(rigidBodyRefs[i]);
+            rigidBody->setPipelineEnable(value);
+        }
+    }
+    void swapPipelineBuffers() {
+        const int nmodels = modelRefs.count();
+        for (int i = 0; i < nmodels; i++) {
+            IModel *model = modelRefs[i];
+            rigidBodyRefs.clear();
+            model->getRigidBodyRefs(rigidBodyRefs);
+            const int nRigidBodies = rigidBodyRefs.count();
+            for (int j = 0; j < nRigidBodies; j++) {
+                internal::BaseRigidBody *rigidBody = static_cast<internal::BaseRigidBody *>(rigidBodyRefs[j]);
+                /* rigid bodies added after enabling the pipeline are enabled here */
+                rigidBody->setPipelineEnable(true);
+                rigidBody->swapPipelineBuffers();
+            }
+        }
+    }
+
+    void getRigidBodies(Array<internal::BaseRigidBody *> &value) const {
+        /* rigid bodies of all models in order of addModel, checkpoints are bound to the order */
+        Array<IRigidBody *> rigidBodyRefs;
+        const int nmodels = modelRefs.count();
+        for (int i = 0; i < nmodels; i++) {
+            modelRefs[i]->getRigidBodyRefs(rigidBodyRefs);
+        }
+        const int nRigidBodies = rigidBodyRefs.count();
+        value.reserve(nRigidBodies);
+        for (int i = 0; i < nRigidBodies; i++) {
+            value.append(static_cast<internal::BaseRigidBody *>(rigidBodyRefs[i]));
+        }
+    }
+    int findCheckpointIndex(const IKeyframe::TimeIndex &timeIndex) const {
+        /* index of the last checkpoint at or before timeIndex (checkpoints are sorted by time) */
+        const int ncheckpoints = checkpoints.count();
+        int index = -1;
+        for (int i = 0; i < ncheckpoints && checkpoints[i]->timeIndex <= timeIndex; i++) {
+            index = i;
+        }
+        return index;
+    }
+    bool hasCheckpointAt(const IKeyframe::TimeIndex &timeIndex) const {
+        const int index = findCheckpointIndex(timeIndex);
+        if (index >= 0) {
+            /* time indices are not negative, truncation is floor */
+            const int slot = int(timeIndex / checkpointInterval);
+            return int(checkpoints[index]->timeIndex / checkpointInterval) == slot;
+        }
+        return false;
+    }
+    void addCheckpoint(Checkpoint *checkpoint) {
+        checkpoints.append(checkpoint);
+        for (int i = checkpoints.count() - 1; i > 0 && checkpoints[i - 1]->timeIndex > checkpoint->timeIndex; i--) {
+            checkpoints[i] = checkpoints[i - 1];
+            checkpoints[i - 1] = checkpoint;
+        }
+    }
+    bool saveCheckpoint(const IKeyframe::TimeIndex &timeIndex) {
+        Array<internal::BaseRigidBody *> rigidBodies;
+        getRigidBodies(rigidBodies);
+        const int nRigidBodies = rigidBodies.count();
+        /* all of checkpoints must have the same rigid bodies to be serialized */
+        if (checkpoints.count() > 0 && checkpoints[0]->units.count() != nRigidBodies) {
+            VPVL2_LOG(WARNING, "Rigid bodies of models are changed since the first checkpoint: expected=" << checkpoints[0]->units.count() << " actual=" << nRigidBodies);
+            return false;
+        }
+        Checkpoint *checkpoint = new Checkpoint(timeIndex);
+        checkpoint->units.resize(nRigidBodies);
+        for (int i = 0; i < nRigidBodies; i++) {
+            const btRigidBody *body = rigidBodies[i]->body();
+            const Transform &transform = body->getCenterOfMassTransform();
+            const Quaternion &rotation = transform.getRotation();
+            RigidBodyUnit &unit = checkpoint->units[i];
+            setUnitVector(transform.getOrigin(), unit.position);
+            unit.rotation[0] = rotation.x();
+            unit.rotation[1] = rotation.y();
+            unit.rotation[2] = rotation.z();
+            unit.rotation[3] = rotation.w();
+            setUnitVector(body->getLinearVelocity(), unit.linearVelocity);
+            setUnitVector(body->getAngularVelocity(), unit.angularVelocity);
+        }
+        addCheckpoint(checkpoint);
+        return true;
+    }
+    bool restoreCheckpoint(const Checkpoint *checkpoint) {
+        Array<internal::BaseRigidBody *> rigidBodies;
+        getRigidBodies(rigidBodies);
+        const int nRigidBodies = rigidBodies.count();
+        if (checkpoint->units.count() != nRigidBodies) {
+            VPVL2_LOG(WARNING, "The checkpoint doesn't match rigid bodies of models: expected=" << checkpoint->units.count() << " actual=" << nRigidBodies);
+            return false;
+        }
+        for (int i = 0; i < nRigidBodies; i++) {
+            internal::BaseRigidBody *rigidBody = rigidBodies[i];
+            btRigidBody *body = rigidBody->body();
+            const RigidBodyUnit &unit = checkpoint->units[i];
+            const Quaternion rotation(unit.rotation[0], unit.rotation[1], unit.rotation[2], unit.rotation[3]);
+            const Transform transform(rotation, getUnitVector(unit.position));
+            const Vector3 &linearVelocity = getUnitVector(unit.linearVelocity), &angularVelocity = getUnitVector(unit.angularVelocity);
+            body->setCenterOfMassTransform(transform);
+            body->setInterpolationWorldTransform(transform);
+            body->setLinearVelocity(linearVelocity);
+            body->setAngularVelocity(angularVelocity);
+            body->setInterpolationLinearVelocity(linearVelocity);
+            body->setInterpolationAngularVelocity(angularVelocity);
+            body->clearForces();
+            if (thread) {
+                /* publish the restored state */
+                rigidBody->setPipelineEnable(false);
+                rigidBody->setPipelineEnable(true);
+            }
+        }
+        const int nislands = islandRefs.count();
+        for (int i = 0; i < nislands; i++) {
+            btDiscreteDynamicsWorld *world = islandRefs[i]->world;
+            btOverlappingPairCache *cache = world->getPairCache();
+            btDispatcher *dispatcher = world->getDispatcher();
+            const btCollisionObjectArray &objects = world->getCollisionObjectArray();
+            const int nobjects = objects.size();
+            for (int j = 0; j < nobjects; j++) {
+                /* contacts (warm starting impulses) are rebuilt from the restored state */
+                cache->cleanProxyFromPairs(objects[j]->getBroadphaseHandle(), dispatcher);
+            }
+            world->getConstraintSolver()->reset();
+        }
+        return true;
+    }
+
+    Island *sharedIsland;
+    PointerArray<Island> modelIslands;
+    Array<Island *> islandRefs;
+    internal::WorkerThread *thread;
+    StepSimulationTask task;
+    Array<IModel *> modelRefs;
+    Array<IModel *> sharedModelRefs;
+    Array<IRigidBody *> rigidBodyRefs;
+    PointerArray<Checkpoint> checkpoints;
+    PointerArray<ModelState> modelStates;
+    Scalar levelOfDetailThresholds[kMaxLevelOfDetail];
     Scalar motionFPS;
     Scalar fixedTimeStep;
+    IKeyframe::TimeIndex checkpointInterval;
+    Scalar stepBudget;
     int maxSubSteps;
+    int budgetSubSteps;
+    bool enableModelIsolation;
 };
 
 const int World::kDefaultMaxSubSteps = 2;
+const int World::kReducedSolverIterations = 4;
 
 World::World()
     : m_context(0)
@@ -115,22 +694,27 @@ World::~World()
 
 const vpvl2::Vector3 World::gravity() const
 {
-    return m_context->world->getGravity();
+    return m_context->sharedIsland->world->getGravity();
 }
 
 btDiscreteDynamicsWorld *World::dynamicWorldRef() const
 {
-    return m_context->world;
+    return m_context->sharedIsland->world;
 }
 
 void World::setGravity(const vpvl2::Vector3 &value)
 {
-    m_context->world->setGravity(value);
+    m_context->waitForSimulation();
+    const Array<PrivateContext::Island *> &islandRefs = m_context->islandRefs;
+    const int nislands = islandRefs.count();
+    for (int i = 0; i < nislands; i++) {
+        islandRefs[i]->world->setGravity(value);
+    }
 }
 
 unsigned long World::randSeed() const
 {
-    return m_context->solver->getRandSeed();
+    return m_context->sharedIsland->solver->getRandSeed();
 }
 
 Scalar World::motionFPS() const
@@ -148,9 +732,24 @@ int World::maxSubSteps() const
     return m_context->maxSubSteps;
 }
 
+bool World::isModelIsolationEnabled() const
+{
+    return m_context->enableModelIsolation;
+}
+
+bool World::isModelShared(const IModel *value) const
+{
+    return m_context->isModelShared(value);
+}
+
 void World::setRandSeed(unsigned long value)
 {
-    m_context->solver->setRandSeed(value);
+    m_context->waitForSimulation();
+    const Array<PrivateContext::Island *> &islandRefs = m_context->islandRefs;
+    const int nislands = islandRefs.count();
+    for (int i = 0; i < nislands; i++) {
+        islandRefs[i]->solver->setRandSeed(value);
+    }
 }
 
 void World::setPreferredFPS(const Scalar &value)
@@ -164,19 +763,300 @@ void World::setMaxSubSteps(int value)
     m_context->maxSubSteps = value;
 }
 
+void World::setModelIsolationEnable(bool value)
+{
+    if (value == m_context->enableModelIsolation) {
+        return;
+    }
+    m_context->waitForSimulation();
+    const Array<IModel *> &modelRefs = m_context->modelRefs;
+    const int nmodels = modelRefs.count();
+    for (int i = 0; i < nmodels; i++) {
+        m_context->leaveModel(modelRefs[i]);
+    }
+    m_context->enableModelIsolation = value;
+    for (int i = 0; i < nmodels; i++) {
+        m_context->joinModel(modelRefs[i]);
+    }
+}
+
+void World::setModelShared(IModel *value, bool shared)
+{
+    if (!value || shared == m_context->isModelShared(value)) {
+        return;
+    }
+    m_context->waitForSimulation();
+    const bool contains = m_context->containsModel(value);
+    if (contains) {
+        m_context->leaveModel(value);
+    }
+    if (shared) {
+        m_context->sharedModelRefs.append(value);
+    }
+    else {
+        m_context->sharedModelRefs.remove(value);
+    }
+    if (contains) {
+        m_context->joinModel(value);
+    }
+}
+
+void World::addModel(IModel *value)
+{
+    if (value && !m_context->containsModel(value)) {
+        m_context->waitForSimulation();
+        m_context->joinModel(value);
+        m_context->modelRefs.append(value);
+        m_context->modelStates.append(new PrivateContext::ModelState(value));
+        if (m_context->thread) {
+            m_context->setModelPipelineEnable(value, true);
+        }
+        /* checkpoints are bound to rigid bodies of models */
+        m_context->checkpoints.releaseAll();
+    }
+}
+
+void World::removeModel(IModel *value)
+{
+    if (value && m_context->containsModel(value)) {
+        m_context->waitForSimulation();
+        PrivateContext::ModelState *state = m_context->findModelState(value);
+        m_context->setLevelOfDetail(state, kFullLevel);
+        m_context->setModelPipelineEnable(value, false);
+        m_context->leaveModel(value);
+        m_context->modelRefs.remove(value);
+        m_context->modelStates.remove(state);
+        delete state;
+        m_context->checkpoints.releaseAll();
+    }
+}
+
 void World::addRigidBody(btRigidBody *value)
 {
-    m_context->world->addRigidBody(value);
+    m_context->waitForSimulation();
+    m_context->sharedIsland->world->addRigidBody(value);
 }
 
 void World::removeRigidBody(btRigidBody *value)
 {
-    m_context->world->removeRigidBody(value);
+    m_context->waitForSimulation();
+    m_context->sharedIsland->world->removeRigidBody(value);
+}
+
+bool World::isPipelineEnabled() const
+{
+    return m_context->thread != 0;
+}
+
+void World::setPipelineEnable(bool value)
+{
+    if (value == isPipelineEnabled()) {
+        return;
+    }
+    if (value) {
+        m_context->thread = new internal::WorkerThread();
+    }
+    else {
+        delete m_context->thread;
+        m_context->thread = 0;
+    }
+    Array<IModel *> &modelRefs = m_context->modelRefs;
+    const int nmodels = modelRefs.count();
+    for (int i = 0; i < nmodels; i++) {
+        m_context->setModelPipelineEnable(modelRefs[i], value);
+    }
 }
 
 void World::stepSimulation(const vpvl2::Scalar &delta)
 {
-    m_context->world->stepSimulation(delta, m_context->maxSubSteps, m_context->fixedTimeStep);
+    if (internal::WorkerThread *thread = m_context->thread) {
+        /* publish the previous step and inputs captured at the last update, then start the next step */
+        thread->wait();
+        m_context->restoreKinematicLevels();
+        m_context->swapPipelineBuffers();
+        PrivateContext::StepSimulationTask &task = m_context->task;
+        task.delta = delta;
+        task.fixedTimeStep = m_context->fixedTimeStep;
+        task.maxSubSteps = m_context->maxSubSteps;
+        thread->start(&task);
+    }
+    else {
+        m_context->restoreKinematicLevels();
+        m_context->stepIslands(delta, m_context->fixedTimeStep, m_context->maxSubSteps);
+    }
+}
+
+void World::waitForSimulation()
+{
+    m_context->waitForSimulation();
+}
+
+World::LevelOfDetail World::modelLevelOfDetail(const IModel *value) const
+{
+    const PrivateContext::ModelState *state = m_context->findModelState(value);
+    return state ? state->level : kFullLevel;
+}
+
+Scalar World::levelOfDetailThreshold(LevelOfDetail value) const
+{
+    return internal::checkBound(int(value), int(kFullLevel), int(kMaxLevelOfDetail)) ? m_context->levelOfDetailThresholds[value] : 0;
+}
+
+Scalar World::stepBudget() const
+{
+    return m_context->stepBudget;
+}
+
+void World::setModelLevelOfDetail(IModel *model, LevelOfDetail value)
+{
+    PrivateContext::ModelState *state = m_context->findModelState(model);
+    if (state && internal::checkBound(int(value), int(kFullLevel), int(kMaxLevelOfDetail)) && state->level != value) {
+        m_context->waitForSimulation();
+        m_context->setLevelOfDetail(state, value);
+    }
+}
+
+void World::setLevelOfDetailThreshold(LevelOfDetail level, const Scalar &value)
+{
+    if (internal::checkBound(int(level), int(kFullLevel), int(kMaxLevelOfDetail))) {
+        m_context->levelOfDetailThresholds[level] = value;
+    }
+}
+
+void World::updateLevelOfDetails(const ICamera *camera)
+{
+    if (!camera) {
+        return;
+    }
+    const PointerArray<PrivateContext::ModelState> &modelStates = m_context->modelStates;
+    const int nmodels = modelStates.count();
+    for (int i = 0; i < nmodels; i++) {
+        PrivateContext::ModelState *state = modelStates[i];
+        const LevelOfDetail level = m_context->selectLevelOfDetail(state->modelRef, camera);
+        if (level != state->level) {
+            m_context->waitForSimulation();
+            m_context->setLevelOfDetail(state, level);
+        }
+    }
+}
+
+void World::setStepBudget(const Scalar &value)
+{
+    m_context->waitForSimulation();
+    m_context->stepBudget = btMax(value, Scalar(0));
+    m_context->budgetSubSteps = 0;
+}
+
+IKeyframe::TimeIndex World::checkpointInterval() const
+{
+    return m_context->checkpointInterval;
+}
+
+int World::countCheckpoints() const
+{
+    return m_context->checkpoints.count();
+}
+
+void World::setCheckpointInterval(const IKeyframe::TimeIndex &value)
+{
+    m_context->checkpointInterval = btMax(value, IKeyframe::TimeIndex(0));
+}
+
+bool World::recordCheckpoint(const IKeyframe::TimeIndex &timeIndex)
+{
+    if (m_context->checkpointInterval <= 0 || m_context->hasCheckpointAt(timeIndex)) {
+        return false;
+    }
+    m_context->waitForSimulation();
+    return m_context->saveCheckpoint(timeIndex);
+}
+
+bool World::restoreCheckpoint(const IKeyframe::TimeIndex &timeIndex, IKeyframe::TimeIndex &restoredTimeIndex)
+{
+    const int index = m_context->findCheckpointIndex(timeIndex);
+    if (index < 0) {
+        return false;
+    }
+    m_context->waitForSimulation();
+    const PrivateContext::Checkpoint *checkpoint = m_context->checkpoints[index];
+    if (m_context->restoreCheckpoint(checkpoint)) {
+        restoredTimeIndex = checkpoint->timeIndex;
+        return true;
+    }
+    return false;
+}
+
+void World::clearCheckpoints()
+{
+    m_context->checkpoints.releaseAll();
+}
+
+size_t World::estimateCheckpointsSize() const
+{
+    const PointerArray<PrivateContext::Checkpoint> &checkpoints = m_context->checkpoints;
+    const int ncheckpoints = checkpoints.count();
+    const int nRigidBodies = ncheckpoints > 0 ? checkpoints[0]->units.count() : 0;
+    return sizeof(CheckpointHeader) + ncheckpoints * (sizeof(float64_t) + nRigidBodies * sizeof(RigidBodyUnit));
+}
+
+void World::saveCheckpoints(uint8_t *data) const
+{
+    const PointerArray<PrivateContext::Checkpoint> &checkpoints = m_context->checkpoints;
+    const int ncheckpoints = checkpoints.count();
+    CheckpointHeader header;
+    internal::copyBytes(header.signature, kCheckpointSignature, sizeof(header.signature));
+    header.version = kCheckpointVersion;
+    header.interval = m_context->checkpointInterval;
+    header.ncheckpoints = ncheckpoints;
+    header.nRigidBodies = ncheckpoints > 0 ? checkpoints[0]->units.count() : 0;
+    internal::writeBytes(&header, sizeof(header), data);
+    for (int i = 0; i < ncheckpoints; i++) {
+        const PrivateContext::Checkpoint *checkpoint = checkpoints[i];
+        const float64_t timeIndex = checkpoint->timeIndex;
+        internal::writeBytes(&timeIndex, sizeof(timeIndex), data);
+        if (header.nRigidBodies > 0) {
+            internal::writeBytes(&checkpoint->units[0], header.nRigidBodies * sizeof(RigidBodyUnit), data);
+        }
+    }
+}
+
+bool World::loadCheckpoints(const uint8_t *data, size_t size)
+{
+    CheckpointHeader header;
+    uint8_t *ptr = const_cast<uint8_t *>(data);
+    size_t rest = size;
+    if (!data || !internal::getTyped<CheckpointHeader>(ptr, rest, header)) {
+        VPVL2_LOG(WARNING, "Data is too small to read checkpoints: size=" << size);
+        return false;
+    }
+    if (memcmp(header.signature, kCheckpointSignature, sizeof(header.signature)) != 0 || header.version != kCheckpointVersion) {
+        VPVL2_LOG(WARNING, "Invalid signature or version of checkpoints: version=" << header.version);
+        return false;
+    }
+    /* sizes are compared by division not to overflow */
+    const size_t nRigidBodies = size_t(btMax(header.nRigidBodies, 0));
+    const size_t unitSize = sizeof(float64_t) + nRigidBodies * sizeof(RigidBodyUnit);
+    if (header.ncheckpoints < 0 || header.nRigidBodies < 0 || nRigidBodies > rest / sizeof(RigidBodyUnit)
+            || (header.ncheckpoints > 0 && unitSize > rest / size_t(header.ncheckpoints))) {
+        VPVL2_LOG(WARNING, "Invalid size of checkpoints: ncheckpoints=" << header.ncheckpoints << " nRigidBodies=" << header.nRigidBodies << " rest=" << rest);
+        return false;
+    }
+    PointerArray<PrivateContext::Checkpoint> &checkpoints = m_context->checkpoints;
+    checkpoints.releaseAll();
+    for (int i = 0; i < header.ncheckpoints; i++) {
+        float64_t timeIndex;
+        internal::getTyped<float64_t>(ptr, rest, timeIndex);
+        PrivateContext::Checkpoint *checkpoint = new PrivateContext::Checkpoint(IKeyframe::TimeIndex(timeIndex));
+        checkpoint->units.resize(header.nRigidBodies);
+        if (header.nRigidBodies > 0) {
+            const size_t nbytes = header.nRigidBodies * sizeof(RigidBodyUnit);
+            internal::copyBytes(reinterpret_cast<uint8_t *>(&checkpoint->units[0]), ptr, nbytes);
+            internal::drainBytes(nbytes, ptr, rest);
+        }
+        m_context->addCheckpoint(checkpoint);
+    }
+    m_context->checkpointInterval = IKeyframe::TimeIndex(header.interval);
+    return true;
 }
 
 } /* namespace extensions */
@@ -39,12 +39,14 @@
 #define VPVL2_EXTENSIONS_WORLD_H_
 
 #include <vpvl2/Common.h>
+#include <vpvl2/IKeyframe.h>
 
 class btDiscreteDynamicsWorld;
 class btRigidBody;
 
 namespace vpvl2
 {
+class ICamera;
 class IModel;
 
 namespace extensions
@@ -52,7 +54,15 @@ namespace extensions
 
 class VPVL2_API World {
 public:
+    enum LevelOfDetail {
+        kFullLevel,
+        kReducedLevel,
+        kKinematicLevel,
+        kDisabledLevel,
+        kMaxLevelOfDetail
+    };
     static const int kDefaultMaxSubSteps;
+    static const int kReducedSolverIterations;
 
     World();
     ~World();
@@ -64,12 +74,112 @@ public:
     Scalar motionFPS() const;
     Scalar fixedTimeStep() const;
     int maxSubSteps() const;
+    bool isModelIsolationEnabled() const;
+    bool isModelShared(const IModel *value) const;
     void setRandSeed(unsigned long value);
     void setPreferredFPS(const Scalar &value) ;
     void setMaxSubSteps(int value);
+    /**
+     * Enables stepping each model added by addModel in its own dynamics world.
+     *
+     * Rigid bodies and joints of a model are simulated only with the model itself. Models
+     * never collide with each other unless they are shared by setModelShared.
+     *
+     * Worlds of models are stepped concurrently only if BT_NO_PROFILE is defined (the option
+     * VPVL2_LINK_BULLET_NO_PROFILE, Bullet must be built with it too) because the profiler
+     * of Bullet is not thread safe, otherwise they are stepped in order.
+     */
+    void setModelIsolationEnable(bool value);
+    /**
+     * Joins the model to dynamicWorldRef even if the model isolation is enabled, so shared
+     * models (e.g. props) collide with each other and with rigid bodies added by addRigidBody.
+     */
+    void setModelShared(IModel *value, bool shared);
+    void addModel(IModel *value);
+    void removeModel(IModel *value);
     void addRigidBody(btRigidBody *value);
     void removeRigidBody(btRigidBody *value);
+    bool isPipelineEnabled() const;
+    /**
+     * Enables the pipelined mode which steps the world on a dedicated thread.
+     *
+     * stepSimulation returns immediately after starting the step, and the step overlaps
+     * with Scene#update and rendering of the frame. Rigid bodies of models added by
+     * addModel read bone inputs captured at the last update and publish results of the
+     * previous step at IRigidBody#syncLocalTransform, so physics lags one frame behind.
+     *
+     * Call waitForSimulation before accessing dynamicWorldRef directly or calling
+     * Scene#update with Scene::kResetMotionState.
+     */
+    void setPipelineEnable(bool value);
     void stepSimulation(const Scalar &delta);
+    void waitForSimulation();
+
+    LevelOfDetail modelLevelOfDetail(const IModel *value) const;
+    Scalar levelOfDetailThreshold(LevelOfDetail value) const;
+    Scalar stepBudget() const;
+    /**
+     * Sets the physics level of detail of the model added by addModel.
+     *
+     * kReducedLevel solves joints with kReducedSolverIterations (and steps the own world
+     * of the model once a frame if the model isolation is enabled), kKinematicLevel makes
+     * rigid bodies follow bones and kDisabledLevel removes the model from the world.
+     * Rigid bodies are reset to the current pose when the model leaves kDisabledLevel.
+     * kKinematicLevel is applied again at stepSimulation if IModel#resetMotionState (e.g. by
+     * Scene::kResetMotionState) made rigid bodies of the model dynamic.
+     */
+    void setModelLevelOfDetail(IModel *model, LevelOfDetail value);
+    /**
+     * Sets the screen coverage (radius of the model / half height of the screen) below which
+     * updateLevelOfDetails chooses level. Defaults are 0.25 (reduced), 0.1 (kinematic) and
+     * 0 (never disabled).
+     */
+    void setLevelOfDetailThreshold(LevelOfDetail level, const Scalar &value);
+    /**
+     * Chooses levels of detail of all models added by addModel from the camera.
+     */
+    void updateLevelOfDetails(const ICamera *camera);
+    /**
+     * Sets the time budget of stepSimulation in seconds (0 disables). Substeps are reduced
+     * (down to one) by the measured cost of the last steps to fit the budget.
+     */
+    void setStepBudget(const Scalar &value);
+
+    IKeyframe::TimeIndex checkpointInterval() const;
+    int countCheckpoints() const;
+    /**
+     * Sets the interval in frames of checkpoints recorded by recordCheckpoint (0 disables).
+     */
+    void setCheckpointInterval(const IKeyframe::TimeIndex &value);
+    /**
+     * Records positions and velocities of rigid bodies of models added by addModel as
+     * the checkpoint at timeIndex, the time index the world has been stepped to.
+     *
+     * Call this after each step of playback; a checkpoint is recorded only if no
+     * checkpoint exists in the interval containing timeIndex. Checkpoints are cleared by
+     * addModel and removeModel, and nothing is recorded if rigid bodies of models are changed
+     * since the first checkpoint. Returns true if recorded.
+     */
+    bool recordCheckpoint(const IKeyframe::TimeIndex &timeIndex);
+    /**
+     * Restores the nearest checkpoint at or before timeIndex instead of Scene::kResetMotionState.
+     *
+     * Seek the scene to restoredTimeIndex and step frames from there to timeIndex. Positions
+     * and velocities of rigid bodies are restored, but neither impulses of contacts used for
+     * warm starting (contacts are rebuilt from the restored state) nor the time remaining from
+     * the last substep are, so the physics approximates playing from the beginning and may
+     * differ slightly from it. Models must be added in the same order as at recording.
+     * Returns false if there is no such checkpoint.
+     */
+    bool restoreCheckpoint(const IKeyframe::TimeIndex &timeIndex, IKeyframe::TimeIndex &restoredTimeIndex);
+    void clearCheckpoints();
+    /**
+     * Serializes checkpoints to share them (e.g. between processes rendering frame ranges).
+     * saveCheckpoints writes estimateCheckpointsSize bytes to data.
+     */
+    size_t estimateCheckpointsSize() const;
+    void saveCheckpoints(uint8_t *data) const;
+    bool loadCheckpoints(const uint8_t *data, size_t size);
 
 private:
     struct PrivateContext;
@@ -118,6 +118,22 @@
   #endif
 #endif /* GL_EXT_framebuffer_multisample */
 
+#ifndef GLEW_ARB_buffer_storage
+  #ifdef GL_ARB_buffer_storage
+    #define GLEW_ARB_buffer_storage 1
+  #else
+    #define GLEW_ARB_buffer_storage 0
+  #endif
+#endif /* GL_ARB_buffer_storage */
+
+#ifndef GLEW_ARB_sync
+  #ifdef GL_ARB_sync
+    #define GLEW_ARB_sync 1
+  #else
+    #define GLEW_ARB_sync 0
+  #endif
+#endif /* GL_ARB_sync */
+
 #if defined(GL_ARB_texture_float) && !defined(GLEW_ARB_texture_float)
 #define GLEW_ARB_texture_float 1
 #ifndef GL_RGBA32F
@@ -55,12 +55,15 @@ public:
         kIndexBuffer,
         kMaxVertexBufferType
     };
+    /* number of stream buffers to rotate, GPU may still read two of them while CPU writes another */
+    static const int kMaxStreamBuffers = 3;
 
     VertexBundle()
         : m_indexBuffer(0)
     {
     }
     ~VertexBundle() {
+        releaseStreams();
         const int nbuffers = m_vertexBuffers.count();
         for (int i = 0; i < nbuffers; i++) {
             const GLuint *value = m_vertexBuffers.value(i);
@@ -88,9 +91,90 @@ public:
             break;
         }
     }
+    /**
+     * Creates a vertex buffer written every frame by mapStream and unmapStream.
+     *
+     * The buffer is mapped persistently while it's alive if ARB_buffer_storage and ARB_sync are
+     * available, otherwise written by orphaning and glBufferSubData from the CPU side copy.
+     */
+    void createStream(GLuint key, size_t size) {
+        release(kVertexBuffer, key);
+        Stream stream;
+        GLuint name = 0;
+        glGenBuffers(1, &name);
+        glBindBuffer(GL_ARRAY_BUFFER, name);
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+        if (GLEW_ARB_buffer_storage && GLEW_ARB_sync) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, size, 0, flags);
+            stream.address = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+            if (!stream.address) {
+                /* storage of the buffer is immutable, so create the buffer again for the fallback */
+                glDeleteBuffers(1, &name);
+                glGenBuffers(1, &name);
+                glBindBuffer(GL_ARRAY_BUFFER, name);
+            }
+        }
+#endif
+        if (!stream.address) {
+            glBufferData(GL_ARRAY_BUFFER, size, 0, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        stream.size = size;
+        m_vertexBuffers.insert(key, name);
+        m_streams.insert(key, stream);
+    }
+    /* returns the address to write the whole stream buffer, waits until GPU finishes reading it */
+    void *mapStream(GLuint key) {
+        Stream *stream = m_streams[key];
+        if (!stream) {
+            return 0;
+        }
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+        if (stream->fence) {
+            GLenum result = GL_TIMEOUT_EXPIRED;
+            while (result == GL_TIMEOUT_EXPIRED) {
+                result = glClientWaitSync(stream->fence, GL_SYNC_FLUSH_COMMANDS_BIT, kFenceTimeout);
+            }
+            glDeleteSync(stream->fence);
+            stream->fence = 0;
+        }
+#endif
+        if (stream->address) {
+            return stream->address;
+        }
+        m_streamBytes.resize(int(stream->size));
+        return &m_streamBytes[0];
+    }
+    void unmapStream(GLuint key) {
+        const Stream *stream = m_streams.find(key);
+        const GLuint *name = m_vertexBuffers.find(key);
+        if (stream && name && !stream->address) {
+            /* orphans the storage that GPU may still read instead of waiting for it */
+            glBindBuffer(GL_ARRAY_BUFFER, *name);
+            glBufferData(GL_ARRAY_BUFFER, stream->size, 0, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, stream->size, &m_streamBytes[0]);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
+    /* marks commands issued so far as the last ones reading the stream buffer */
+    void fenceStream(GLuint key) {
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+        Stream *stream = m_streams[key];
+        if (stream && stream->address) {
+            if (stream->fence) {
+                glDeleteSync(stream->fence);
+            }
+            stream->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+#else
+        (void) key;
+#endif
+    }
     void release(Type value, GLuint key) {
         switch (value) {
         case kVertexBuffer:
+            releaseStream(key);
             if (const GLuint *buffer = m_vertexBuffers.find(key)) {
                 glDeleteBuffers(1, buffer);
                 m_vertexBuffers.remove(key);
@@ -166,6 +250,48 @@ public:
     }
 
 private:
+    struct Stream {
+        Stream()
+            : address(0),
+              size(0)
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+            , fence(0)
+#endif
+        {
+        }
+        void *address;
+        size_t size;
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+        GLsync fence;
+#endif
+    };
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+    static const GLuint64 kFenceTimeout = 1000000; /* 1ms */
+#endif
+
+    /* deleting the buffer after this also unmaps it */
+    void releaseStream(GLuint key) {
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+        if (const Stream *stream = m_streams.find(key)) {
+            if (stream->fence) {
+                glDeleteSync(stream->fence);
+            }
+        }
+#endif
+        m_streams.remove(key);
+    }
+    void releaseStreams() {
+#if defined(GL_ARB_buffer_storage) && defined(GL_ARB_sync)
+        const int nstreams = m_streams.count();
+        for (int i = 0; i < nstreams; i++) {
+            const Stream *stream = m_streams.value(i);
+            if (stream->fence) {
+                glDeleteSync(stream->fence);
+            }
+        }
+#endif
+        m_streams.clear();
+    }
     static GLuint type2target(Type value) {
         switch (value) {
         case kVertexBuffer:
@@ -179,6 +305,8 @@ private:
     }
 
     Hash<HashInt, GLuint> m_vertexBuffers;
+    Hash<HashInt, Stream> m_streams;
+    Array<uint8_t> m_streamBytes;
     GLuint m_indexBuffer;
 #ifdef VPVL2_ENABLE_GLES2
     Array<uint8_t> m_bytes;
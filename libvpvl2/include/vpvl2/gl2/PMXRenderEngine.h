@@ -103,6 +103,7 @@ private:
     void bindDynamicVertexAttributePointers();
     void bindEdgeVertexAttributePointers();
     void bindStaticVertexAttributePointers();
+    void enableSkinningVertexAttributeArrays();
 
     cl::PMXAccelerator *m_accelerator;
     IRenderContext *m_renderContextRef;
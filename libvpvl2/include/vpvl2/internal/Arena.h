@@ -0,0 +1,105 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#pragma once
+#ifndef VPVL2_INTERNAL_ARENA_H_
+#define VPVL2_INTERNAL_ARENA_H_
+
+#include "vpvl2/Common.h"
+
+namespace vpvl2
+{
+namespace internal
+{
+
+/**
+ * Arena allocates objects of a model from a few large blocks.
+ *
+ * Classes declaring VPVL2_DECLARE_ARENA_ALLOCATOR are allocated from the arena
+ * set to the current thread by Arena::Scope, and from the heap otherwise.
+ * Objects are still deleted one by one with delete (so removed objects may
+ * outlive the model), but freeing them only counts down the arena; blocks are
+ * freed at once after the owner calls retire and all objects are deleted.
+ *
+ * Scopes are per thread and work only if the compiler supports the thread
+ * local storage, objects are allocated from the heap otherwise.
+ */
+class VPVL2_API Arena
+{
+public:
+    class VPVL2_API Scope {
+    public:
+        explicit Scope(Arena *arenaRef);
+        ~Scope();
+
+    private:
+        Arena *m_previousArenaRef;
+
+        VPVL2_DISABLE_COPY_AND_ASSIGN(Scope)
+    };
+    static const size_t kDefaultBlockSize = 262144;
+
+    static Arena *create(size_t blockSize = kDefaultBlockSize);
+    static void *allocate(size_t size);
+    static void deallocate(void *ptr);
+
+    /**
+     * Releases the reference of the owner, the arena must not be used after this.
+     */
+    void retire();
+    int countBlocks() const;
+    int countAllocations() const;
+
+private:
+    explicit Arena(size_t blockSize);
+    ~Arena();
+    void *allocateFromBlocks(size_t size);
+    bool deallocateFromBlocks();
+
+    struct PrivateContext;
+    PrivateContext *m_context;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(Arena)
+};
+
+} /* namespace internal */
+} /* namespace vpvl2 */
+
+#define VPVL2_DECLARE_ARENA_ALLOCATOR() \
+    static void *operator new(size_t size) { return vpvl2::internal::Arena::allocate(size); } \
+    static void operator delete(void *ptr) { vpvl2::internal::Arena::deallocate(ptr); }
+
+#endif
@@ -41,6 +41,7 @@
 #define VPVL2_INTERNAL_BASEJOINT_H_
 
 #include "vpvl2/IJoint.h"
+#include "vpvl2/internal/DeferredString.h"
 
 #ifndef VPVL2_NO_BULLET
 class btTypedConstraint;
@@ -73,8 +74,8 @@ public:
     IRigidBody *rigidBody2Ref() const { return m_rigidBody2Ref; }
     int rigidBodyIndex1() const { return m_rigidBodyIndex1; }
     int rigidBodyIndex2() const { return m_rigidBodyIndex2; }
-    const IString *name() const { return m_name; }
-    const IString *englishName() const { return m_englishName; }
+    const IString *name() const { return m_name.value(); }
+    const IString *englishName() const { return m_englishName.value(); }
     Vector3 position() const { return m_position; }
     Vector3 rotation() const { return m_rotation; }
     Vector3 positionLowerLimit() const { return m_positionLowerLimit; }
@@ -112,8 +113,8 @@ protected:
     IModel *m_parentModelRef;
     IRigidBody *m_rigidBody1Ref;
     IRigidBody *m_rigidBody2Ref;
-    IString *m_name;
-    IString *m_englishName;
+    internal::DeferredString m_name;
+    internal::DeferredString m_englishName;
     Vector3 m_position;
     Vector3 m_rotation;
     Vector3 m_positionLowerLimit;
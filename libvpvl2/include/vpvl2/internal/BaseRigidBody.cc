@@ -52,8 +52,12 @@ namespace internal
 BaseRigidBody::DefaultMotionState::DefaultMotionState(const Transform &startTransform, const IBone *bone)
     : m_boneRef(bone),
       m_startTransform(startTransform),
-      m_worldTransform(startTransform)
+      m_worldTransform(startTransform),
+      m_boneTransformIndex(0),
+      m_captured(false),
+      m_enableBuffer(false)
 {
+    m_boneTransforms[0] = m_boneTransforms[1] = startTransform;
 }
 
 BaseRigidBody::DefaultMotionState::~DefaultMotionState()
@@ -85,6 +89,42 @@ void BaseRigidBody::DefaultMotionState::setBoneRef(const IBone *value)
     m_boneRef = value;
 }
 
+void BaseRigidBody::DefaultMotionState::setBufferEnable(bool value)
+{
+    if (value) {
+        m_boneTransforms[0] = m_boneTransforms[1] = currentBoneTransform();
+    }
+    m_boneTransformIndex = 0;
+    m_captured = false;
+    m_enableBuffer = value;
+}
+
+void BaseRigidBody::DefaultMotionState::captureBoneTransform()
+{
+    if (m_enableBuffer) {
+        m_boneTransforms[1 - m_boneTransformIndex] = currentBoneTransform();
+        m_captured = true;
+    }
+}
+
+void BaseRigidBody::DefaultMotionState::swapBuffers()
+{
+    if (m_captured) {
+        m_boneTransformIndex = 1 - m_boneTransformIndex;
+        m_captured = false;
+    }
+}
+
+const Transform BaseRigidBody::DefaultMotionState::currentBoneTransform() const
+{
+    return m_boneRef ? m_boneRef->worldTransform() : Transform::getIdentity();
+}
+
+const Transform BaseRigidBody::DefaultMotionState::boneTransform() const
+{
+    return m_enableBuffer ? m_boneTransforms[m_boneTransformIndex] : currentBoneTransform();
+}
+
 BaseRigidBody::AlignedMotionState::AlignedMotionState(const Transform &startTransform, const IBone *bone)
     : DefaultMotionState(startTransform, bone)
 {
@@ -97,7 +137,7 @@ BaseRigidBody::AlignedMotionState::~AlignedMotionState()
 void BaseRigidBody::AlignedMotionState::setWorldTransform(const btTransform &worldTransform)
 {
     m_worldTransform = worldTransform;
-    m_worldTransform.setOrigin(m_boneRef->worldTransform().getOrigin());
+    m_worldTransform.setOrigin(boneTransform().getOrigin());
 }
 
 BaseRigidBody::KinematicMotionState::KinematicMotionState(const Transform &startTransform, const IBone *bone)
@@ -111,17 +151,22 @@ BaseRigidBody::KinematicMotionState::~KinematicMotionState()
 
 void BaseRigidBody::KinematicMotionState::getWorldTransform(btTransform &worldTransform) const
 {
-    // Bone#localTransform cannot use at setKinematics because it's called after performTransformBone
-    // (Bone#localTransform will be identity)
-    Transform localTransform;
-    m_boneRef->getLocalTransform(localTransform);
-    worldTransform = localTransform * m_startTransform;
+    worldTransform = boneTransform();
 }
 
 void BaseRigidBody::KinematicMotionState::setWorldTransform(const btTransform & /* worldTransform */)
 {
 }
 
+const Transform BaseRigidBody::KinematicMotionState::currentBoneTransform() const
+{
+    // Bone#localTransform cannot use at setKinematics because it's called after performTransformBone
+    // (Bone#localTransform will be identity)
+    Transform localTransform;
+    m_boneRef->getLocalTransform(localTransform);
+    return localTransform * m_startTransform;
+}
+
 BaseRigidBody::BaseRigidBody(IModel *parentModelRef, IEncoding *encodingRef)
     : m_body(0),
       m_ptr(0),
@@ -130,11 +175,11 @@ BaseRigidBody::BaseRigidBody(IModel *parentModelRef, IEncoding *encodingRef)
       m_kinematicMotionState(0),
       m_worldTransform(Transform::getIdentity()),
       m_world2LocalTransform(Transform::getIdentity()),
+      m_publishedTransform(Transform::getIdentity()),
+      m_pendingTransform(Transform::getIdentity()),
       m_parentModelRef(parentModelRef),
       m_encodingRef(encodingRef),
       m_boneRef(0),
-      m_name(0),
-      m_englishName(0),
       m_boneIndex(-1),
       m_size(kZeroV3),
       m_position(kZeroV3),
@@ -149,7 +194,10 @@ BaseRigidBody::BaseRigidBody(IModel *parentModelRef, IEncoding *encodingRef)
       m_collisionGroupMask(0),
       m_collisionGroupID(0),
       m_shapeType(kUnknownShape),
-      m_type(kStaticObject)
+      m_type(kStaticObject),
+      m_enablePipeline(false),
+      m_enableBatchSync(false),
+      m_hasPendingTransform(false)
 {
 }
 
@@ -165,16 +213,16 @@ BaseRigidBody::~BaseRigidBody()
     m_motionState = 0;
     delete m_kinematicMotionState;
     m_kinematicMotionState = 0;
-    delete m_name;
-    m_name = 0;
-    delete m_englishName;
-    m_englishName = 0;
+    m_name.release();
+    m_englishName.release();
     m_parentModelRef = 0;
     m_encodingRef = 0;
     m_boneRef = 0;
     m_boneIndex = -1;
     m_worldTransform.setIdentity();
     m_world2LocalTransform.setIdentity();
+    m_publishedTransform.setIdentity();
+    m_pendingTransform.setIdentity();
     m_size.setZero();
     m_position.setZero();
     m_rotation.setZero();
@@ -189,15 +237,26 @@ BaseRigidBody::~BaseRigidBody()
     m_collisionGroupID = 0;
     m_shapeType = kUnknownShape;
     m_type = kStaticObject;
+    m_enablePipeline = false;
+    m_enableBatchSync = false;
+    m_hasPendingTransform = false;
 }
 
 void BaseRigidBody::syncLocalTransform()
 {
     if (m_type != kStaticObject && m_boneRef && m_boneRef != Factory::sharedNullBoneRef()) {
-        const Transform &worldTransform = m_body->getCenterOfMassTransform();
+        /* the body may be stepped on the other thread in the pipelined mode, use the published result */
+        const Transform &worldTransform = m_enablePipeline ? m_publishedTransform : m_body->getCenterOfMassTransform();
         const Transform &localTransform = worldTransform * m_world2LocalTransform;
         m_boneRef->setLocalTransform(localTransform);
     }
+    if (m_enablePipeline) {
+        /* bones before physics are already updated, capture them as inputs of the next step */
+        m_motionState->captureBoneTransform();
+        if (m_kinematicMotionState) {
+            m_kinematicMotionState->captureBoneTransform();
+        }
+    }
 }
 
 void BaseRigidBody::joinWorld(void *value)
@@ -239,6 +298,68 @@ void BaseRigidBody::setKinematic(bool value, const Vector3 &basePosition)
         m_body->setMotionState(m_motionState);
         m_body->setInterpolationWorldTransform(transform);
     }
+    if (m_enablePipeline) {
+        resetPipelineBuffers();
+    }
+    m_hasPendingTransform = false;
+    detachMotionState();
+}
+
+void BaseRigidBody::setPipelineEnable(bool value)
+{
+    if (m_enablePipeline != value) {
+        m_enablePipeline = value;
+        resetPipelineBuffers();
+    }
+}
+
+void BaseRigidBody::swapPipelineBuffers()
+{
+    if (m_enablePipeline) {
+        if (m_hasPendingTransform) {
+            m_body->setWorldTransform(m_pendingTransform);
+            m_hasPendingTransform = false;
+        }
+        m_publishedTransform = m_body->getCenterOfMassTransform();
+        m_motionState->swapBuffers();
+        if (m_kinematicMotionState) {
+            m_kinematicMotionState->swapBuffers();
+        }
+    }
+}
+
+void BaseRigidBody::setBatchSyncEnable(bool value)
+{
+    if (m_enableBatchSync != value) {
+        m_enableBatchSync = value;
+        m_hasPendingTransform = false;
+        if (value) {
+            detachMotionState();
+        }
+        else if (m_body) {
+            /* attaching a motion state overwrites the transform of the body, keep it */
+            const Transform worldTransform = m_body->getWorldTransform();
+            const bool kinematic = m_type != kStaticObject && m_body->isKinematicObject();
+            m_body->setMotionState(kinematic ? m_kinematicMotionState : m_motionState);
+            m_body->setWorldTransform(worldTransform);
+        }
+    }
+}
+
+void BaseRigidBody::syncKinematicTransform(const Scalar *boneMatrix)
+{
+    if (m_enableBatchSync && m_type == kStaticObject && m_body) {
+        Transform localTransform;
+        localTransform.setFromOpenGLMatrix(boneMatrix);
+        if (m_enablePipeline) {
+            /* the body may be stepped on the other thread, apply it at swapPipelineBuffers */
+            m_pendingTransform = localTransform * m_worldTransform;
+            m_hasPendingTransform = true;
+        }
+        else {
+            m_body->setWorldTransform(localTransform * m_worldTransform);
+        }
+    }
 }
 
 const Transform BaseRigidBody::createTransform() const
@@ -315,12 +436,12 @@ btRigidBody *BaseRigidBody::createRigidBody(btCollisionShape *shape)
 
 void BaseRigidBody::setName(const IString *value)
 {
-    internal::setString(value, m_name);
+    m_name.setValue(value);
 }
 
 void BaseRigidBody::setEnglishName(const IString *value)
 {
-    internal::setString(value, m_englishName);
+    m_englishName.setValue(value);
 }
 
 void BaseRigidBody::setParentModelRef(IModel *value)
@@ -416,6 +537,31 @@ void BaseRigidBody::build(IBone *boneRef, int index)
     m_body = createRigidBody(m_shape);
     m_ptr = 0;
     m_index = index;
+    if (m_enablePipeline) {
+        resetPipelineBuffers();
+    }
+    detachMotionState();
+}
+
+void BaseRigidBody::resetPipelineBuffers()
+{
+    if (m_body) {
+        m_publishedTransform = m_body->getCenterOfMassTransform();
+    }
+    if (m_motionState) {
+        m_motionState->setBufferEnable(m_enablePipeline);
+    }
+    if (m_kinematicMotionState) {
+        m_kinematicMotionState->setBufferEnable(m_enablePipeline);
+    }
+}
+
+void BaseRigidBody::detachMotionState()
+{
+    /* Bullet reads the transform of the body directly if it has no motion state */
+    if (m_enableBatchSync && m_body && (m_type == kStaticObject || !m_body->isKinematicObject())) {
+        m_body->setMotionState(0);
+    }
 }
 
 BaseRigidBody::DefaultMotionState *BaseRigidBody::createKinematicMotionState() const
@@ -41,6 +41,7 @@
 #define VPVL2_INTERNAL_BASERIGIDBODY_H_
 
 #include "vpvl2/IRigidBody.h"
+#include "vpvl2/internal/DeferredString.h"
 #include "LinearMath/btMotionState.h"
 
 class btCollisionShape;
@@ -71,10 +72,33 @@ public:
         const IBone *boneRef() const;
         void setBoneRef(const IBone *value);
 
+        /**
+         * Enables double buffering of the bone transform read while stepping, so the bone
+         * can be updated by the main thread while the world is stepped on another thread.
+         * Both buffers are filled with the current bone transform.
+         */
+        void setBufferEnable(bool value);
+        /**
+         * Copies the current bone transform into the back buffer (main thread).
+         */
+        void captureBoneTransform();
+        /**
+         * Makes the captured bone transform visible to the next step. Does nothing if
+         * nothing is captured since the last swap. Must not be called while stepping.
+         */
+        void swapBuffers();
+
     protected:
+        virtual const Transform currentBoneTransform() const;
+        const Transform boneTransform() const;
+
         const IBone *m_boneRef;
         Transform m_startTransform;
         Transform m_worldTransform;
+        Transform m_boneTransforms[2];
+        int m_boneTransformIndex;
+        bool m_captured;
+        bool m_enableBuffer;
     };
 
     class AlignedMotionState : public DefaultMotionState {
@@ -92,6 +116,9 @@ public:
 
         void getWorldTransform(btTransform &worldTransform) const;
         void setWorldTransform(const btTransform & /* worldTransform */);
+
+    protected:
+        const Transform currentBoneTransform() const;
     };
 
     BaseRigidBody(IModel *parentModelRef, IEncoding *encodingRef);
@@ -101,6 +128,36 @@ public:
     void joinWorld(void *value);
     void leaveWorld(void *value);
     void setKinematic(bool value, const Vector3 &basePosition);
+    /**
+     * Enables the pipelined mode used by extensions::World to step the world on its own thread.
+     *
+     * Bone inputs of motion states are captured at syncLocalTransform and results of the
+     * step are published at swapPipelineBuffers, so syncLocalTransform reads the result
+     * of the previous step instead of the body being stepped.
+     */
+    void setPipelineEnable(bool value);
+    /**
+     * Publishes the result of the last step and bone inputs captured since the last swap.
+     * Must be called while the world is not being stepped.
+     */
+    void swapPipelineBuffers();
+    bool isPipelineEnabled() const { return m_enablePipeline; }
+    /**
+     * Enables the batched sync driven by the parent model instead of motion state callbacks.
+     *
+     * Motion states are detached from static objects and dynamic bodies, so static objects
+     * are written by syncKinematicTransform and results of dynamic bodies are read from the
+     * body at syncLocalTransform. Dynamic bodies in the kinematic mode keep the kinematic
+     * motion state because their bones are written back by syncLocalTransform.
+     */
+    void setBatchSyncEnable(bool value);
+    /**
+     * Writes the world transform of the static object from the local transform of the bone
+     * as a column major 4x4 matrix (BonePalette#matrixAt). The transform is applied at
+     * swapPipelineBuffers in the pipelined mode. Does nothing unless the batched sync is enabled.
+     */
+    void syncKinematicTransform(const Scalar *boneMatrix);
+    bool isBatchSyncEnabled() const { return m_enableBatchSync; }
 
     virtual const Transform createTransform() const;
     virtual btCollisionShape *createShape() const;
@@ -111,8 +168,8 @@ public:
     IModel *parentModelRef() const { return m_parentModelRef; }
     IBone *boneRef() const { return m_boneRef; }
     int boneIndex() const { return m_boneIndex; }
-    const IString *name() const { return m_name; }
-    const IString *englishName() const { return m_englishName; }
+    const IString *name() const { return m_name.value(); }
+    const IString *englishName() const { return m_englishName.value(); }
     Vector3 size() const { return m_size; }
     Vector3 position() const { return m_position; }
     Vector3 rotation() const { return m_rotation; }
@@ -146,6 +203,8 @@ public:
 
 protected:
     void build(IBone *boneRef, int index);
+    void resetPipelineBuffers();
+    void detachMotionState();
     virtual DefaultMotionState *createKinematicMotionState() const;
     virtual DefaultMotionState *createDefaultMotionState() const;
     virtual DefaultMotionState *createAlignedMotionState() const;
@@ -157,11 +216,13 @@ protected:
     DefaultMotionState *m_kinematicMotionState;
     Transform m_worldTransform;
     Transform m_world2LocalTransform;
+    Transform m_publishedTransform;
+    Transform m_pendingTransform;
     IModel *m_parentModelRef;
     IEncoding *m_encodingRef;
     IBone *m_boneRef;
-    IString *m_name;
-    IString *m_englishName;
+    internal::DeferredString m_name;
+    internal::DeferredString m_englishName;
     int m_boneIndex;
     Vector3 m_size;
     Vector3 m_position;
@@ -177,6 +238,9 @@ protected:
     uint8_t m_collisionGroupID;
     ShapeType m_shapeType;
     ObjectType m_type;
+    bool m_enablePipeline;
+    bool m_enableBatchSync;
+    bool m_hasPendingTransform;
 
     VPVL2_DISABLE_COPY_AND_ASSIGN(BaseRigidBody)
 };
@@ -0,0 +1,282 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#pragma once
+#ifndef VPVL2_INTERNAL_BONEPALETTE_H_
+#define VPVL2_INTERNAL_BONEPALETTE_H_
+
+#include "vpvl2/Common.h"
+#include "vpvl2/internal/util.h"
+
+namespace vpvl2
+{
+namespace internal
+{
+
+/**
+ * BonePalette is a snapshot of local transforms of all bones as column major
+ * 4x4 matrices (same layout as Transform#getOpenGLMatrix) in a 16 bytes
+ * aligned flat array, and rotations of them as quaternions (x, y, z, w) for
+ * SDEF skinning.
+ *
+ * The last matrix is always identity and is used for invalid bone indices.
+ * The serial number is incremented at each update to let buffers built from
+ * the palette detect whether they are stale.
+ */
+class BonePalette {
+public:
+    static const int kMatrixSize = 16;
+    static const int kRotationSize = 4;
+
+    BonePalette()
+        : m_nbones(-1),
+          m_serial(0)
+    {
+        resize(0);
+    }
+    ~BonePalette() {
+        m_nbones = 0;
+        m_serial = 0;
+    }
+
+    template<typename TBone>
+    void update(const Array<TBone *> &bones) {
+        const int nbones = bones.count();
+        resize(nbones);
+        for (int i = 0; i < nbones; i++) {
+            const TBone *bone = bones[i];
+            const Transform &transform = bone->localTransform();
+            const Quaternion &rotation = transform.getRotation();
+            Scalar *rotationPtr = &m_rotations[i * kRotationSize];
+            transform.getOpenGLMatrix(&m_matrices[i * kMatrixSize]);
+            rotationPtr[0] = rotation.x();
+            rotationPtr[1] = rotation.y();
+            rotationPtr[2] = rotation.z();
+            rotationPtr[3] = rotation.w();
+        }
+        m_serial++;
+    }
+    int count() const {
+        return m_nbones;
+    }
+    int serial() const {
+        return m_serial;
+    }
+    const Scalar *bytes() const {
+        return &m_matrices[0];
+    }
+    size_t size() const {
+        return sizeof(Scalar) * kMatrixSize * m_nbones;
+    }
+    const Scalar *matrixAt(int index) const {
+        return &m_matrices[(checkBound(index, 0, m_nbones) ? index : m_nbones) * kMatrixSize];
+    }
+    const Scalar *rotationAt(int index) const {
+        return &m_rotations[(checkBound(index, 0, m_nbones) ? index : m_nbones) * kRotationSize];
+    }
+
+    void transform(int index,
+                   const Vector3 &inPosition,
+                   const Vector3 &inNormal,
+                   Vector3 &outPosition,
+                   Vector3 &outNormal) const
+    {
+        transform(matrixAt(index), inPosition, inNormal, outPosition, outNormal);
+    }
+    void transform(int indexA,
+                   int indexB,
+                   const Scalar &weight,
+                   const Vector3 &inPosition,
+                   const Vector3 &inNormal,
+                   Vector3 &outPosition,
+                   Vector3 &outNormal) const
+    {
+        const Scalar *a = matrixAt(indexA), *b = matrixAt(indexB);
+        const Scalar w = 1 - weight;
+        Scalar m[kMatrixSize];
+        for (int i = 0; i < kMatrixSize; i++) {
+            m[i] = a[i] * weight + b[i] * w;
+        }
+        transform(m, inPosition, inNormal, outPosition, outNormal);
+    }
+    void transform(const int *indices,
+                   const Scalar *weights,
+                   int nweights,
+                   const Vector3 &inPosition,
+                   const Vector3 &inNormal,
+                   Vector3 &outPosition,
+                   Vector3 &outNormal) const
+    {
+        Scalar m[kMatrixSize];
+        zerofill(m, sizeof(m));
+        for (int i = 0; i < nweights; i++) {
+            const Scalar *matrix = matrixAt(indices[i]), &weight = weights[i];
+            for (int j = 0; j < kMatrixSize; j++) {
+                m[j] += matrix[j] * weight;
+            }
+        }
+        transform(m, inPosition, inNormal, outPosition, outNormal);
+    }
+    void transformSdef(int indexA,
+                       int indexB,
+                       const Scalar &weight,
+                       const Vector3 &sdefC,
+                       const Vector3 &sdefCR0,
+                       const Vector3 &sdefCR1,
+                       const Vector3 &inPosition,
+                       const Vector3 &inNormal,
+                       Vector3 &outPosition,
+                       Vector3 &outNormal) const
+    {
+        transformSdef(matrixAt(indexA), rotationAt(indexA), matrixAt(indexB), rotationAt(indexB), weight,
+                      sdefC, sdefCR0, sdefCR1, inPosition, inNormal, outPosition, outNormal);
+    }
+    /**
+     * Performs SDEF (spherical deformation) skinning.
+     *
+     * The rotation is spherical interpolation of two bone rotations and the
+     * translation is linear interpolation of the two centers (sdefCR0 and
+     * sdefCR1, see ModelHelper#getSdefCenters) transformed by each bone.
+     */
+    static inline void transformSdef(const Scalar *matrixA,
+                                     const Scalar *rotationA,
+                                     const Scalar *matrixB,
+                                     const Scalar *rotationB,
+                                     const Scalar &weight,
+                                     const Vector3 &sdefC,
+                                     const Vector3 &sdefCR0,
+                                     const Vector3 &sdefCR1,
+                                     const Vector3 &inPosition,
+                                     const Vector3 &inNormal,
+                                     Vector3 &outPosition,
+                                     Vector3 &outNormal)
+    {
+        Scalar rotation[kRotationSize], m[kMatrixSize];
+        slerp(rotationB, rotationA, weight, rotation);
+        getRotationMatrix(rotation, m);
+        Vector3 centerA, centerB, unused;
+        transform(matrixA, sdefCR0, kZeroV3, centerA, unused);
+        transform(matrixB, sdefCR1, kZeroV3, centerB, unused);
+        transform(m, inPosition - sdefC, inNormal, outPosition, outNormal);
+        outPosition += centerA * weight + centerB * (1 - weight);
+    }
+    /**
+     * Interpolates rotation a to rotation b spherically by t along the
+     * shortest arc. Falls back to normalized linear interpolation if both
+     * are almost same.
+     */
+    static inline void slerp(const Scalar *a, const Scalar *b, const Scalar &t, Scalar *result) {
+        Scalar d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3], sign = 1, s0, s1;
+        if (d < 0) {
+            d = -d;
+            sign = -1;
+        }
+        const bool isLinear = d > Scalar(0.9995);
+        if (isLinear) {
+            s0 = 1 - t;
+            s1 = t;
+        }
+        else {
+            const Scalar theta = btAcos(d), invSin = 1 / btSin(theta);
+            s0 = btSin((1 - t) * theta) * invSin;
+            s1 = btSin(t * theta) * invSin;
+        }
+        s1 *= sign;
+        for (int i = 0; i < kRotationSize; i++) {
+            result[i] = a[i] * s0 + b[i] * s1;
+        }
+        if (isLinear) {
+            const Scalar invLength = 1 / btSqrt(result[0] * result[0] + result[1] * result[1] +
+                                                result[2] * result[2] + result[3] * result[3]);
+            for (int i = 0; i < kRotationSize; i++) {
+                result[i] *= invLength;
+            }
+        }
+    }
+    /**
+     * Converts the unit quaternion q to the column major 4x4 rotation matrix.
+     */
+    static inline void getRotationMatrix(const Scalar *q, Scalar *m) {
+        const Scalar &x = q[0], &y = q[1], &z = q[2], &w = q[3];
+        const Scalar xx = x * x * 2, yy = y * y * 2, zz = z * z * 2;
+        const Scalar xy = x * y * 2, xz = x * z * 2, yz = y * z * 2;
+        const Scalar wx = w * x * 2, wy = w * y * 2, wz = w * z * 2;
+        m[0] = 1 - yy - zz; m[1] = xy + wz;     m[2] = xz - wy;      m[3] = 0;
+        m[4] = xy - wz;     m[5] = 1 - xx - zz; m[6] = yz + wx;      m[7] = 0;
+        m[8] = xz + wy;     m[9] = yz - wx;     m[10] = 1 - xx - yy; m[11] = 0;
+        m[12] = 0;          m[13] = 0;          m[14] = 0;           m[15] = 1;
+    }
+    static inline void transform(const Scalar *m,
+                                 const Vector3 &inPosition,
+                                 const Vector3 &inNormal,
+                                 Vector3 &outPosition,
+                                 Vector3 &outNormal)
+    {
+        const Scalar &x = inPosition.x(), &y = inPosition.y(), &z = inPosition.z();
+        outPosition.setValue(m[0] * x + m[4] * y + m[8]  * z + m[12],
+                             m[1] * x + m[5] * y + m[9]  * z + m[13],
+                             m[2] * x + m[6] * y + m[10] * z + m[14]);
+        const Scalar &nx = inNormal.x(), &ny = inNormal.y(), &nz = inNormal.z();
+        outNormal.setValue(m[0] * nx + m[4] * ny + m[8]  * nz,
+                           m[1] * nx + m[5] * ny + m[9]  * nz,
+                           m[2] * nx + m[6] * ny + m[10] * nz);
+    }
+
+private:
+    void resize(int nbones) {
+        if (nbones != m_nbones) {
+            m_matrices.resize((nbones + 1) * kMatrixSize);
+            m_rotations.resize((nbones + 1) * kRotationSize);
+            Transform::getIdentity().getOpenGLMatrix(&m_matrices[nbones * kMatrixSize]);
+            Scalar *rotationPtr = &m_rotations[nbones * kRotationSize];
+            rotationPtr[0] = rotationPtr[1] = rotationPtr[2] = 0;
+            rotationPtr[3] = 1;
+            m_nbones = nbones;
+        }
+    }
+
+    Array<Scalar> m_matrices;
+    Array<Scalar> m_rotations;
+    int m_nbones;
+    int m_serial;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(BonePalette)
+};
+
+} /* namespace internal */
+} /* namespace vpvl2 */
+
+#endif
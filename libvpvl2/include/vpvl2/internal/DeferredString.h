@@ -0,0 +1,139 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#pragma once
+#ifndef VPVL2_INTERNAL_DEFERREDSTRING_H_
+#define VPVL2_INTERNAL_DEFERREDSTRING_H_
+
+#include "vpvl2/Common.h"
+#include "vpvl2/IEncoding.h"
+#include "vpvl2/IString.h"
+
+namespace vpvl2
+{
+namespace internal
+{
+
+/**
+ * DeferredString owns an IString that can be kept as an encoded byte span
+ * until value() is called at the first time.
+ *
+ * The span is not copied, so the bytes (typically a MappedFile) must outlive
+ * the instance while it's not decoded. value() decodes without lock, the first
+ * call must not race with another thread.
+ */
+class DeferredString
+{
+public:
+    DeferredString()
+        : m_encodingRef(0),
+          m_bytesRef(0),
+          m_size(0),
+          m_codec(IString::kUTF8),
+          m_value(0)
+    {
+    }
+    ~DeferredString() {
+        release();
+    }
+
+    const IString *value() const {
+        if (!m_value && m_bytesRef) {
+            m_value = m_encodingRef->toString(m_bytesRef, m_size, m_codec);
+            m_bytesRef = 0;
+        }
+        return m_value;
+    }
+    bool isDecoded() const {
+        return !m_bytesRef;
+    }
+    /**
+     * Same as internal::setString (copies newValue).
+     */
+    void setValue(const IString *newValue) {
+        if (newValue && newValue != m_value) {
+            reset(newValue->clone());
+        }
+    }
+    /**
+     * Same as internal::setStringDirect (takes the ownership of newValue).
+     */
+    void setValueDirect(IString *newValue) {
+        if (newValue && newValue != m_value) {
+            reset(newValue);
+        }
+    }
+    /**
+     * Decodes bytes immediately unless deferred is true.
+     */
+    void setBytes(const IEncoding *encodingRef, const uint8_t *bytes, size_t size, IString::Codec codec, bool deferred) {
+        if (deferred) {
+            reset(0);
+            m_encodingRef = encodingRef;
+            m_bytesRef = bytes;
+            m_size = size;
+            m_codec = codec;
+        }
+        else {
+            setValueDirect(encodingRef->toString(bytes, size, codec));
+        }
+    }
+    void release() {
+        reset(0);
+    }
+
+private:
+    void reset(IString *newValue) {
+        delete m_value;
+        m_value = newValue;
+        m_encodingRef = 0;
+        m_bytesRef = 0;
+        m_size = 0;
+    }
+
+    const IEncoding *m_encodingRef;
+    mutable const uint8_t *m_bytesRef;
+    size_t m_size;
+    IString::Codec m_codec;
+    mutable IString *m_value;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(DeferredString)
+};
+
+} /* namespace internal */
+} /* namespace vpvl2 */
+
+#endif
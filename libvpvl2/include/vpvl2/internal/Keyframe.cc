@@ -0,0 +1,195 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/Keyframe.h"
+
+#ifdef VPVL2_LINK_INTEL_TBB
+#include <tbb/mutex.h>
+#else
+#include "vpvl2/internal/ThreadPool.h"
+#endif
+
+namespace
+{
+
+using namespace vpvl2;
+
+struct CachedInterpolationTable {
+    CachedInterpolationTable(int k, int s, CachedInterpolationTable *n)
+        : table(new IKeyframe::SmoothPrecision[s + 1]),
+          next(n),
+          key(k),
+          size(s),
+          refcount(0)
+    {
+    }
+    ~CachedInterpolationTable() {
+        delete[] table;
+        table = 0;
+        next = 0;
+        key = 0;
+        size = 0;
+        refcount = 0;
+    }
+    IKeyframe::SmoothPrecision *table;
+    CachedInterpolationTable *next;
+    int key;
+    int size;
+    int refcount;
+};
+
+/* entries sharing the same control points but different sample counts are chained by next */
+static Hash<HashInt, CachedInterpolationTable *> g_tablesByParameter;
+static Hash<HashPtr, CachedInterpolationTable *> g_tablesByPointer;
+static int g_ntables = 0;
+#ifdef VPVL2_LINK_INTEL_TBB
+static tbb::mutex g_tablesLock;
+#else
+static internal::Mutex g_tablesLock;
+#endif
+
+static inline int toParameterKey(const QuadWord &value)
+{
+    const uint32_t x = uint8_t(value.x()), y = uint8_t(value.y()), z = uint8_t(value.z()), w = uint8_t(value.w());
+    return int(x | (y << 8) | (z << 16) | (w << 24));
+}
+
+static const IKeyframe::SmoothPrecision *acquireTableUnlocked(const QuadWord &value, int size)
+{
+    const int parameterKey = toParameterKey(value);
+    const HashInt key(parameterKey);
+    CachedInterpolationTable *const *head = g_tablesByParameter.find(key), *entry = head ? *head : 0;
+    while (entry && entry->size != size) {
+        entry = entry->next;
+    }
+    if (!entry) {
+        entry = new CachedInterpolationTable(parameterKey, size, head ? *head : 0);
+        internal::InterpolationTable::build(value.x() / 127.0, // x1
+                                            value.z() / 127.0, // x2
+                                            value.y() / 127.0, // y1
+                                            value.w() / 127.0, // y2
+                                            size,
+                                            entry->table);
+        g_tablesByParameter.insert(key, entry);
+        g_tablesByPointer.insert(HashPtr(entry->table), entry);
+        g_ntables++;
+    }
+    entry->refcount++;
+    return entry->table;
+}
+
+static void releaseTableUnlocked(const IKeyframe::SmoothPrecision *table)
+{
+    const HashPtr pointerKey(table);
+    CachedInterpolationTable *const *value = g_tablesByPointer.find(pointerKey);
+    if (!value) {
+        return;
+    }
+    CachedInterpolationTable *entry = *value;
+    if (--entry->refcount > 0) {
+        return;
+    }
+    /* unlink the entry from the chain of its control points before freeing */
+    const HashInt key(entry->key);
+    CachedInterpolationTable **head = g_tablesByParameter[key], *prev = 0, *it = head ? *head : 0;
+    while (it && it != entry) {
+        prev = it;
+        it = it->next;
+    }
+    if (prev) {
+        prev->next = entry->next;
+    }
+    else if (entry->next) {
+        *head = entry->next;
+    }
+    else {
+        g_tablesByParameter.remove(key);
+    }
+    g_tablesByPointer.remove(pointerKey);
+    g_ntables--;
+    delete entry;
+}
+
+} /* namespace anonymous */
+
+namespace vpvl2
+{
+namespace internal
+{
+
+const IKeyframe::SmoothPrecision *InterpolationTableCache::acquire(const QuadWord &parameter, int size)
+{
+    const IKeyframe::SmoothPrecision *table = 0;
+#ifdef VPVL2_LINK_INTEL_TBB
+    tbb::mutex::scoped_lock lock(g_tablesLock);
+    table = acquireTableUnlocked(parameter, size);
+#else
+    internal::Mutex::ScopedLock lock(g_tablesLock);
+    table = acquireTableUnlocked(parameter, size);
+#endif
+    return table;
+}
+
+void InterpolationTableCache::release(const IKeyframe::SmoothPrecision *table)
+{
+    if (!table) {
+        return;
+    }
+#ifdef VPVL2_LINK_INTEL_TBB
+    tbb::mutex::scoped_lock lock(g_tablesLock);
+    releaseTableUnlocked(table);
+#else
+    internal::Mutex::ScopedLock lock(g_tablesLock);
+    releaseTableUnlocked(table);
+#endif
+}
+
+int InterpolationTableCache::countTables()
+{
+    int ntables = 0;
+#ifdef VPVL2_LINK_INTEL_TBB
+    tbb::mutex::scoped_lock lock(g_tablesLock);
+    ntables = g_ntables;
+#else
+    internal::Mutex::ScopedLock lock(g_tablesLock);
+    ntables = g_ntables;
+#endif
+    return ntables;
+}
+
+} /* namespace internal */
+} /* namespace vpvl2 */
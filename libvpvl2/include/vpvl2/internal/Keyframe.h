@@ -60,19 +60,38 @@ struct InterpolationPair {
 
 #pragma pack(pop)
 
+/**
+ * Process-wide cache of immutable bezier interpolation tables.
+ *
+ * Tables are keyed by the four control point bytes and the sample count, built once
+ * and shared by reference count so keyframes with the same curve don't allocate and
+ * solve it again. acquire/release are thread safe.
+ */
+class InterpolationTableCache {
+public:
+    static const IKeyframe::SmoothPrecision *acquire(const QuadWord &parameter, int size);
+    static void release(const IKeyframe::SmoothPrecision *table);
+    static int countTables();
+
+private:
+    VPVL2_MAKE_STATIC_CLASS(InterpolationTableCache)
+};
+
 struct InterpolationTable {
-    typedef Array<IKeyframe::SmoothPrecision> Value;
-    Value table;
+    const IKeyframe::SmoothPrecision *table;
     QuadWord parameter;
     bool linear;
     int size;
     InterpolationTable()
-        : parameter(defaultParameter()),
+        : table(0),
+          parameter(defaultParameter()),
           linear(true),
           size(0)
     {
     }
     ~InterpolationTable() {
+        InterpolationTableCache::release(table);
+        table = 0;
         parameter = defaultParameter();
         linear = true;
         size = 0;
@@ -84,23 +103,22 @@ struct InterpolationTable {
         pair.second.y = uint8_t(parameter.w());
     }
     void build(const QuadWord &value, int s) {
+        const IKeyframe::SmoothPrecision *previousTable = table;
         if (!btFuzzyZero(value.x() - value.y()) || !btFuzzyZero(value.z() - value.w())) {
-            table.resize(s + 1);
-            const IKeyframe::SmoothPrecision &x1 = value.x() / 127.0, &x2 = value.z() / 127.0;
-            const IKeyframe::SmoothPrecision &y1 = value.y() / 127.0, &y2 = value.w() / 127.0;
-            IKeyframe::SmoothPrecision *ptr = &table[0];
-            build(x1, x2, y1, y2, s, ptr);
+            table = InterpolationTableCache::acquire(value, s);
             linear = false;
         }
         else {
-            table.clear();
+            table = 0;
             linear = true;
         }
+        InterpolationTableCache::release(previousTable);
         parameter = value;
         size = s;
     }
     void reset() {
-        table.clear();
+        InterpolationTableCache::release(table);
+        table = 0;
         linear = true;
         parameter = defaultParameter();
     }
@@ -149,6 +167,9 @@ struct InterpolationTable {
         }
         table[size] = 1;
     }
+
+private:
+    VPVL2_DISABLE_COPY_AND_ASSIGN(InterpolationTable)
 };
 
 } /* namespace internal */
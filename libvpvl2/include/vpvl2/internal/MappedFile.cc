@@ -0,0 +1,177 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/MappedFile.h"
+
+#if defined(WIN32) || defined(_WIN32)
+#define VPVL2_MAPPEDFILE_WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vpvl2
+{
+namespace internal
+{
+
+struct MappedFile::PrivateContext {
+    PrivateContext()
+        : address(0),
+          size(0)
+    {
+    }
+    ~PrivateContext() {
+        unmap();
+    }
+
+    bool map(const char *path) {
+#ifdef VPVL2_MAPPEDFILE_WIN32
+        int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, 0, 0);
+        if (length <= 0) {
+            return false;
+        }
+        Array<wchar_t> widePath;
+        widePath.resize(length);
+        MultiByteToWideChar(CP_UTF8, 0, path, -1, &widePath[0], length);
+        HANDLE file = CreateFileW(&widePath[0], GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0 || uint64_t(fileSize.QuadPart) > uint64_t(SIZE_MAX)) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingW(file, 0, PAGE_READONLY, 0, 0, 0);
+        CloseHandle(file);
+        if (!mapping) {
+            return false;
+        }
+        address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        size = size_t(fileSize.QuadPart);
+#else
+        int fd = ::open(path, O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == -1 || st.st_size <= 0) {
+            ::close(fd);
+            return false;
+        }
+        void *mapped = ::mmap(0, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        /* the mapping is kept after closing the descriptor */
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        address = mapped;
+        size = size_t(st.st_size);
+#endif
+        return address != 0;
+    }
+    void unmap() {
+        if (address) {
+#ifdef VPVL2_MAPPEDFILE_WIN32
+            UnmapViewOfFile(address);
+#else
+            ::munmap(address, size);
+#endif
+        }
+        address = 0;
+        size = 0;
+    }
+
+    void *address;
+    size_t size;
+};
+
+MappedFile::MappedFile()
+    : m_context(new PrivateContext())
+{
+}
+
+MappedFile::~MappedFile()
+{
+    delete m_context;
+    m_context = 0;
+}
+
+bool MappedFile::open(const char *path)
+{
+    close();
+    if (!path) {
+        return false;
+    }
+    if (!m_context->map(path)) {
+        VPVL2_LOG(WARNING, "Cannot map the file: " << path);
+        m_context->unmap();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+    m_context->unmap();
+}
+
+const uint8_t *MappedFile::data() const
+{
+    return static_cast<const uint8_t *>(m_context->address);
+}
+
+size_t MappedFile::size() const
+{
+    return m_context->size;
+}
+
+bool MappedFile::isOpened() const
+{
+    return m_context->address != 0;
+}
+
+} /* namespace internal */
+} /* namespace vpvl2 */
@@ -87,6 +87,25 @@ public:
         outPosition.setInterpolate3(v2, v1, w);
         outNormal.setInterpolate3(n2, n1, w);
     }
+    /**
+     * Computes two rotation centers of SDEF from C, R0 and R1 of the vertex.
+     *
+     * R0 and R1 are corrected to be weighted center of C before using them.
+     */
+    static inline void getSdefCenters(const Vector3 &sdefC,
+                                      const Vector3 &sdefR0,
+                                      const Vector3 &sdefR1,
+                                      const IVertex::WeightPrecision &weight,
+                                      Vector3 &sdefCR0,
+                                      Vector3 &sdefCR1)
+    {
+        const Scalar &w = Scalar(weight);
+        const Vector3 &rw = sdefR0 * w + sdefR1 * (1 - w);
+        const Vector3 &r0 = sdefC + sdefR0 - rw;
+        const Vector3 &r1 = sdefC + sdefR1 - rw;
+        sdefCR0 = (sdefC + r0) * 0.5f;
+        sdefCR1 = (sdefC + r1) * 0.5f;
+    }
     static inline bool hasBoneLoopChain(const IBone * /* parentBoneRef */, const IModel * /* baseModelRef */) {
         /* FIXME: implement this to stop loop chain */
         return false;
@@ -62,6 +62,23 @@ public:
         }
     };
 
+    template<typename T>
+    static int lowerBoundKeyframeIndex(const IKeyframe::TimeIndex &timeIndex,
+                                       int begin,
+                                       int end,
+                                       const Array<T *> &keyframes)
+    {
+        while (begin < end) {
+            const int mid = begin + (end - begin) / 2;
+            if (keyframes[mid]->timeIndex() < timeIndex) {
+                begin = mid + 1;
+            }
+            else {
+                end = mid;
+            }
+        }
+        return begin;
+    }
     template<typename T>
     static void findKeyframeIndices(const IKeyframe::TimeIndex &seekIndex,
                                     IKeyframe::TimeIndex &currentKeyframe,
@@ -73,23 +90,21 @@ public:
         const int nframes = keyframes.count();
         IKeyframe *lastKeyFrame = keyframes[nframes - 1];
         currentKeyframe = btMin(seekIndex, lastKeyFrame->timeIndex());
+        if (!internal::checkBound(lastIndex, 0, nframes)) {
+            lastIndex = 0;
+        }
         // Find the next frame index bigger than the frame index of last key frame
-        fromIndex = toIndex = 0;
         if (currentKeyframe >= keyframes[lastIndex]->timeIndex()) {
-            for (int i = lastIndex; i < nframes; i++) {
-                if (currentKeyframe <= keyframes[i]->timeIndex()) {
-                    toIndex = i;
-                    break;
-                }
+            // Playback mostly stays on or next to the last keyframe, so probe a few before bisecting
+            const int end = btMin(lastIndex + kMaxKeyframeProbes, nframes);
+            int i = lastIndex;
+            while (i < end && keyframes[i]->timeIndex() < currentKeyframe) {
+                i++;
             }
+            toIndex = i < end ? i : lowerBoundKeyframeIndex(currentKeyframe, end, nframes, keyframes);
         }
         else {
-            for (int i = 0; i <= lastIndex && i < nframes; i++) {
-                if (currentKeyframe <= keyframes[i]->timeIndex()) {
-                    toIndex = i;
-                    break;
-                }
-            }
+            toIndex = lowerBoundKeyframeIndex(currentKeyframe, 0, lastIndex + 1, keyframes);
         }
         if (toIndex >= nframes) {
             toIndex = nframes - 1;
@@ -97,6 +112,59 @@ public:
         fromIndex = toIndex <= 1 ? 0 : toIndex - 1;
         lastIndex = fromIndex;
     }
+    template<typename T>
+    static int findKeyframeIndex(const IKeyframe::TimeIndex &timeIndex,
+                                 const IKeyframe::LayerIndex &layerIndex,
+                                 const Array<T *> &keyframes)
+    {
+        const int nkeyframes = keyframes.count();
+        int min = 0, max = nkeyframes;
+        while (min < max) {
+            const int mid = min + (max - min) / 2;
+            const T *keyframe = keyframes[mid];
+            const IKeyframe::LayerIndex &midLayerIndex = keyframe->layerIndex();
+            if (midLayerIndex < layerIndex || (midLayerIndex == layerIndex && keyframe->timeIndex() < timeIndex)) {
+                min = mid + 1;
+            }
+            else {
+                max = mid;
+            }
+        }
+        if (min < nkeyframes) {
+            const T *keyframe = keyframes[min];
+            if (keyframe->layerIndex() == layerIndex && keyframe->timeIndex() == timeIndex) {
+                return min;
+            }
+        }
+        return -1;
+    }
+    template<typename T>
+    static void insertKeyframe(T *keyframe, PointerArray<T> &keyframes)
+    {
+        // Keep the order of KeyframeTimeIndexPredication so findKeyframeIndex can bisect
+        KeyframeTimeIndexPredication predication;
+        int i = keyframes.count();
+        keyframes.append(keyframe);
+        while (i > 0 && predication(keyframe, keyframes[i - 1])) {
+            keyframes[i] = keyframes[i - 1];
+            i--;
+        }
+        keyframes[i] = keyframe;
+    }
+    template<typename T>
+    static void removeKeyframe(const T *keyframe, PointerArray<T> &keyframes)
+    {
+        const int nkeyframes = keyframes.count();
+        for (int i = 0; i < nkeyframes; i++) {
+            if (keyframes[i] == keyframe) {
+                for (int j = i + 1; j < nkeyframes; j++) {
+                    keyframes[j - 1] = keyframes[j];
+                }
+                keyframes.removeAt(nkeyframes - 1);
+                break;
+            }
+        }
+    }
     template<typename TMotion>
     static inline bool isReachedToDuration(const TMotion &motion, const IKeyframe::TimeIndex &atEnd)
     {
@@ -118,7 +186,7 @@ public:
     static inline IKeyframe::SmoothPrecision calculateInterpolatedWeight(const InterpolationTable &t,
                                                                          const IKeyframe::SmoothPrecision &weight)
     {
-        const internal::InterpolationTable::Value &v = t.table;
+        const IKeyframe::SmoothPrecision *v = t.table;
         const uint16_t index = static_cast<int16_t>(weight * t.size);
         const IKeyframe::SmoothPrecision &value = v[index] + (v[index + 1] - v[index]) * (weight * t.size - index);
         return value;
@@ -142,6 +210,8 @@ public:
     }
 
 private:
+    static const int kMaxKeyframeProbes = 4;
+
     MotionHelper();
     ~MotionHelper();
 };
@@ -33,13 +33,14 @@
 /* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
 /* POSSIBILITY OF SUCH DAMAGE.                                       */
 /* ----------------------------------------------------------------- */
-
 #pragma once
 #ifndef VPVL2_INTERNAL_PARALLELPROCESSORS_H_
 #define VPVL2_INTERNAL_PARALLELPROCESSORS_H_
 
 #include <vpvl2/Common.h>
 #include <vpvl2/IMaterial.h>
+#include <vpvl2/internal/BonePalette.h>
+#include <vpvl2/internal/ThreadPool.h>
 
 #ifdef VPVL2_LINK_INTEL_TBB
 #include <tbb/tbb.h>
@@ -51,24 +52,65 @@ namespace vpvl2
 namespace internal
 {
 
-static inline bool GreaterOMP(const Vector3 &left, const Vector3 &right)
-{
-    return left.x() < right.x() ||  left.y() < right.y() || left.z() < right.z();
-}
+/**
+ * ParallelAabbReduction keeps one AABB per ThreadPool worker. Each worker
+ * expands only its own slot (padded to a cache line) and slots are merged once
+ * after the execution, so no lock is needed while skinning.
+ */
+class ParallelAabbReduction {
+public:
+    ParallelAabbReduction(int nslots = ThreadPool::sharedInstance()->countWorkers()) {
+        nslots = btMax(nslots, 1);
+        m_slots.resize(nslots);
+        for (int i = 0; i < nslots; i++) {
+            Slot &slot = m_slots[i];
+            slot.aabbMin.setValue(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY);
+            slot.aabbMax.setValue(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY);
+        }
+    }
+    ~ParallelAabbReduction() {
+    }
 
-static inline bool LessOMP(const Vector3 &left, const Vector3 &right)
-{
-    return left.x() > right.x() ||  left.y() > right.y() || left.z() > right.z();
-}
+    Vector3 &aabbMin(int worker) {
+        return m_slots[slotIndex(worker)].aabbMin;
+    }
+    Vector3 &aabbMax(int worker) {
+        return m_slots[slotIndex(worker)].aabbMax;
+    }
+    void reduce(Vector3 &aabbMin, Vector3 &aabbMax) const {
+        const int nslots = m_slots.count();
+        for (int i = 0; i < nslots; i++) {
+            const Slot &slot = m_slots[i];
+            aabbMin.setMin(slot.aabbMin);
+            aabbMax.setMax(slot.aabbMax);
+        }
+    }
+
+private:
+    struct Slot {
+        Vector3 aabbMin;
+        Vector3 aabbMax;
+        Vector3 padding[2];
+    };
+    int slotIndex(int worker) const {
+        return btClamped(worker, 0, m_slots.count() - 1);
+    }
+    Array<Slot> m_slots;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(ParallelAabbReduction)
+};
 
 template<typename TModel, typename TVertex, typename TUnit>
-class ParallelSkinningVertexProcessor {
+class ParallelSkinningVertexProcessor : public ThreadPool::ITask {
 public:
     ParallelSkinningVertexProcessor(const TModel *modelRef,
                                     const Array<TVertex *> *verticesRef,
+                                    const BonePalette *paletteRef,
                                     const Vector3 &cameraPosition,
                                     void *address)
         : m_verticesRef(verticesRef),
+          m_paletteRef(paletteRef),
+          m_reductionRef(0),
           m_edgeScaleFactor(modelRef->edgeScaleFactor(cameraPosition)),
           m_aabbMin(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY),
           m_aabbMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY),
@@ -77,6 +119,8 @@ public:
     }
     ~ParallelSkinningVertexProcessor() {
         m_verticesRef = 0;
+        m_paletteRef = 0;
+        m_reductionRef = 0;
         m_bufferPtr = 0;
     }
 
@@ -86,6 +130,8 @@ public:
 #ifdef VPVL2_LINK_INTEL_TBB
     ParallelSkinningVertexProcessor(const ParallelSkinningVertexProcessor &self, tbb::split /* split */)
         : m_verticesRef(self.m_verticesRef),
+          m_paletteRef(self.m_paletteRef),
+          m_reductionRef(0),
           m_edgeScaleFactor(self.m_edgeScaleFactor),
           m_aabbMin(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY),
           m_aabbMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY),
@@ -97,21 +143,16 @@ public:
         m_aabbMax.setMax(self.m_aabbMax);
     }
     void operator()(const tbb::blocked_range<int> &range) const {
-        Vector3 aabbMin(m_aabbMin), aabbMax(m_aabbMax), position;
-        for (int i = range.begin(); i != range.end(); ++i) {
-            const TVertex *vertex = m_verticesRef->at(i);
-            const IMaterial *material = vertex->materialRef();
-            const float materialEdgeSize = material->edgeSize() * m_edgeScaleFactor;
-            TUnit &v = m_bufferPtr[i];
-            v.update(vertex, materialEdgeSize, i, position);
-            aabbMin.setMin(position);
-            aabbMax.setMax(position);
-        }
+        Vector3 aabbMin(m_aabbMin), aabbMax(m_aabbMax);
+        skin(range.begin(), range.end(), aabbMin, aabbMax);
         m_aabbMin = aabbMin;
         m_aabbMax = aabbMax;
     }
 #endif /* VPVL2_LINK_INTEL_TBB */
 
+    void run(int begin, int end, int worker) {
+        skin(begin, end, m_reductionRef->aabbMin(worker), m_reductionRef->aabbMax(worker));
+    }
     void execute(bool enableParallel) {
         const int nvertices = m_verticesRef->count();
 #if defined(VPVL2_LINK_INTEL_TBB)
@@ -119,39 +160,35 @@ public:
             tbb::parallel_reduce(tbb::blocked_range<int>(0, nvertices), *this);
         }
         else {
+            skin(0, nvertices, m_aabbMin, m_aabbMax);
+        }
 #else
-        {
-            (void) enableParallel;
+        (void) enableParallel;
+        ParallelAabbReduction reduction;
+        m_reductionRef = &reduction;
+        ThreadPool::sharedInstance()->execute(this, 0, nvertices, 0);
+        reduction.reduce(m_aabbMin, m_aabbMax);
+        m_reductionRef = 0;
 #endif
-            Vector3 position, aabbMin(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY),
-                    aabbMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY);
-#pragma omp parallel for
-            for (int i = 0; i < nvertices; ++i) {
-                const TVertex *vertex = m_verticesRef->at(i);
-                const IMaterial *material = vertex->materialRef();
-                const IVertex::EdgeSizePrecision &materialEdgeSize = material->edgeSize() * m_edgeScaleFactor;
-                TUnit &v = m_bufferPtr[i];
-                v.update(vertex, materialEdgeSize, i, position);
-#pragma omp flush(aabbMin)
-                if (LessOMP(aabbMin, position)) {
-#pragma omp critical
-                    {
-                        aabbMin.setMin(position);
-                    }
-                }
-#pragma omp flush(aabbMax)
-                if (GreaterOMP(aabbMax, position)) {
-#pragma omp critical
-                    {
-                        aabbMax.setMax(position);
-                    }
-                }
-            }
-        }
     }
 
 private:
+    void skin(int begin, int end, Vector3 &aabbMin, Vector3 &aabbMax) const {
+        Vector3 position;
+        for (int i = begin; i < end; ++i) {
+            const TVertex *vertex = m_verticesRef->at(i);
+            const IMaterial *material = vertex->materialRef();
+            const IVertex::EdgeSizePrecision &materialEdgeSize = material->edgeSize() * m_edgeScaleFactor;
+            TUnit &v = m_bufferPtr[i];
+            v.update(vertex, m_paletteRef, materialEdgeSize, i, position);
+            aabbMin.setMin(position);
+            aabbMax.setMax(position);
+        }
+    }
+
     const Array<TVertex *> *m_verticesRef;
+    const BonePalette *m_paletteRef;
+    ParallelAabbReduction *m_reductionRef;
     const IVertex::EdgeSizePrecision m_edgeScaleFactor;
     mutable Vector3 m_aabbMin;
     mutable Vector3 m_aabbMax;
@@ -159,7 +196,7 @@ private:
 };
 
 template<typename TModel, typename TVertex, typename TUnit>
-class ParallelInitializeVertexProcessor {
+class ParallelInitializeVertexProcessor : public ThreadPool::ITask {
 public:
     ParallelInitializeVertexProcessor(const Array<TVertex *> *verticesRef,
                                       void *address)
@@ -174,42 +211,44 @@ public:
 
 #ifdef VPVL2_LINK_INTEL_TBB
     void operator()(const tbb::blocked_range<int> &range) const {
-        for (int i = range.begin(); i != range.end(); ++i) {
-            const TVertex *vertex = m_verticesRef->at(i);
-            TUnit &v = m_bufferPtr[i];
-            v.update(vertex, i);
-        }
+        initialize(range.begin(), range.end());
     }
 #endif /* VPVL2_LINK_INTEL_TBB */
 
+    void run(int begin, int end, int /* worker */) {
+        initialize(begin, end);
+    }
     void execute(bool enableParallel) {
         const int nvertices = m_verticesRef->count();
 #if defined(VPVL2_LINK_INTEL_TBB)
         if (enableParallel) {
-            static tbb::affinity_partitioner affinityPartitioner;
-            tbb::parallel_for(tbb::blocked_range<int>(0, nvertices), *this, affinityPartitioner);
+            /* models may be updated concurrently (ParallelUpdateModelProcessor), no shared partitioner */
+            tbb::parallel_for(tbb::blocked_range<int>(0, nvertices), *this, tbb::auto_partitioner());
         }
         else {
+            initialize(0, nvertices);
+        }
 #else
-        {
-            (void) enableParallel;
+        (void) enableParallel;
+        ThreadPool::sharedInstance()->execute(this, 0, nvertices, 0);
 #endif
-#pragma omp parallel for
-            for (int i = 0; i < nvertices; ++i) {
-                const TVertex *vertex = m_verticesRef->at(i);
-                TUnit &v = m_bufferPtr[i];
-                v.update(vertex, i);
-            }
-        }
     }
 
 private:
+    void initialize(int begin, int end) const {
+        for (int i = begin; i < end; ++i) {
+            const TVertex *vertex = m_verticesRef->at(i);
+            TUnit &v = m_bufferPtr[i];
+            v.update(vertex, i);
+        }
+    }
+
     const Array<TVertex *> *m_verticesRef;
     TUnit *m_bufferPtr;
 };
 
 template<typename TVertex>
-class ParallelResetVertexProcessor {
+class ParallelResetVertexProcessor : public ThreadPool::ITask {
 public:
     ParallelResetVertexProcessor(const Array<TVertex *> *verticesRef)
         : m_verticesRef(verticesRef)
@@ -221,33 +260,35 @@ public:
 
 #ifdef VPVL2_LINK_INTEL_TBB
     void operator()(const tbb::blocked_range<int> &range) const {
-        for (int i = range.begin(); i != range.end(); ++i) {
-            TVertex *vertex = m_verticesRef->at(i);
-            vertex->reset();
-        }
+        reset(range.begin(), range.end());
     }
 #endif /* VPVL2_LINK_INTEL_TBB */
 
+    void run(int begin, int end, int /* worker */) {
+        reset(begin, end);
+    }
     void execute() {
         const int nvertices = m_verticesRef->count();
 #if defined(VPVL2_LINK_INTEL_TBB)
-        static tbb::affinity_partitioner affinityPartitioner;
-        tbb::parallel_for(tbb::blocked_range<int>(0, nvertices), *this, affinityPartitioner);
+        tbb::parallel_for(tbb::blocked_range<int>(0, nvertices), *this, tbb::auto_partitioner());
 #else
-#pragma omp parallel for
-        for (int i = 0; i < nvertices; ++i) {
+        ThreadPool::sharedInstance()->execute(this, 0, nvertices, 0);
+#endif
+    }
+
+private:
+    void reset(int begin, int end) const {
+        for (int i = begin; i < end; ++i) {
             TVertex *vertex = m_verticesRef->at(i);
             vertex->reset();
         }
-#endif
     }
 
-private:
-const Array<TVertex *> *m_verticesRef;
+    const Array<TVertex *> *m_verticesRef;
 };
 
 template<typename TBone>
-class ParallelUpdateLocalTransformProcessor {
+class ParallelUpdateLocalTransformProcessor : public ThreadPool::ITask {
 public:
     ParallelUpdateLocalTransformProcessor(Array<TBone *> *bonesRef)
         : m_boneRefs(bonesRef)
@@ -259,32 +300,85 @@ public:
 
 #ifdef VPVL2_LINK_INTEL_TBB
     void operator()(const tbb::blocked_range<int> &range) const {
-        for (int i = range.begin(); i != range.end(); ++i) {
-            TBone *bone = m_boneRefs->at(i);
-            bone->updateLocalTransform();
-        }
+        updateLocalTransform(range.begin(), range.end());
     }
 #endif
 
-    void execute() const {
+    void run(int begin, int end, int /* worker */) {
+        updateLocalTransform(begin, end);
+    }
+    void execute() {
         const int nbones = m_boneRefs->count();
 #ifdef VPVL2_LINK_INTEL_TBB
-        static tbb::affinity_partitioner partitioner;
-        tbb::parallel_for(tbb::blocked_range<int>(0, nbones), *this, partitioner);
-#pragma omp parallel for
-        for (int i = 0; i < nbones; i++) {
+        tbb::parallel_for(tbb::blocked_range<int>(0, nbones), *this, tbb::auto_partitioner());
+#else /* VPVL2_LINK_INTEL_TBB */
+        ThreadPool::sharedInstance()->execute(this, 0, nbones, 0);
+#endif /* VPVL2_LINK_INTEL_TBB */
+    }
+
+private:
+    void updateLocalTransform(int begin, int end) const {
+        for (int i = begin; i < end; i++) {
             TBone *bone = m_boneRefs->at(i);
             bone->updateLocalTransform();
         }
+    }
+
+    mutable Array<TBone *> *m_boneRefs;
+};
+
+/**
+ * Runs TBone#performTransform and TBone#solveInverseKinematics of each bone in a level.
+ *
+ * Bones in the level must not depend on each other (see pmx::Bone#sortBones),
+ * the IK chain is solved by the task of the IK bone. A level is not split into
+ * tasks smaller than kGrainSize bones to amortize the cost of the fork/join.
+ */
+template<typename TBone>
+class ParallelPerformTransformProcessor : public ThreadPool::ITask {
+public:
+    static const int kGrainSize = 16;
+
+    ParallelPerformTransformProcessor(Array<TBone *> *bonesRef)
+        : m_boneRefs(bonesRef)
+    {
+    }
+    ~ParallelPerformTransformProcessor() {
+        m_boneRefs = 0;
+    }
+
+#ifdef VPVL2_LINK_INTEL_TBB
+    void operator()(const tbb::blocked_range<int> &range) const {
+        performTransform(range.begin(), range.end());
+    }
+#endif
+
+    void run(int begin, int end, int /* worker */) {
+        performTransform(begin, end);
+    }
+    void execute(int begin, int end) {
+#ifdef VPVL2_LINK_INTEL_TBB
+        tbb::parallel_for(tbb::blocked_range<int>(begin, end, kGrainSize), *this);
+#else /* VPVL2_LINK_INTEL_TBB */
+        /* a level of kGrainSize bones or less is a single chunk and runs on the calling thread */
+        ThreadPool::sharedInstance()->execute(this, begin, end, kGrainSize);
 #endif /* VPVL2_LINK_INTEL_TBB */
     }
 
 private:
+    void performTransform(int begin, int end) const {
+        for (int i = begin; i < end; i++) {
+            TBone *bone = m_boneRefs->at(i);
+            bone->performTransform();
+            bone->solveInverseKinematics();
+        }
+    }
+
     mutable Array<TBone *> *m_boneRefs;
 };
 
 template<typename TRigidBody>
-class ParallelUpdateRigidBodyProcessor {
+class ParallelUpdateRigidBodyProcessor : public ThreadPool::ITask {
 public:
     ParallelUpdateRigidBodyProcessor(Array<TRigidBody *> *rigidBodyRefs)
         : m_rigidBodyRefs(rigidBodyRefs)
@@ -296,28 +390,83 @@ public:
 
 #ifdef VPVL2_LINK_INTEL_TBB
     void operator()(const tbb::blocked_range<int> &range) const {
-        for (int i = range.begin(); i != range.end(); ++i) {
-            TRigidBody *body = m_rigidBodyRefs->at(i);
-            body->syncLocalTransform();
-        }
+        syncLocalTransform(range.begin(), range.end());
     }
 #endif
 
-    void execute() const {
+    void run(int begin, int end, int /* worker */) {
+        syncLocalTransform(begin, end);
+    }
+    void execute() {
         const int nRigidBodies = m_rigidBodyRefs->count();
 #ifdef VPVL2_LINK_INTEL_TBB
         tbb::parallel_for(tbb::blocked_range<int>(0, nRigidBodies), *this);
 #else /* VPVL2_LINK_INTEL_TBB */
-#pragma omp parallel for
-        for (int i = 0; i < nRigidBodies; i++) {
+        ThreadPool::sharedInstance()->execute(this, 0, nRigidBodies, 0);
+#endif /* VPVL2_LINK_INTEL_TBB */
+    }
+
+private:
+    void syncLocalTransform(int begin, int end) const {
+        for (int i = begin; i < end; i++) {
             TRigidBody *rigidBody = m_rigidBodyRefs->at(i);
             rigidBody->syncLocalTransform();
         }
+    }
+
+    mutable Array<TRigidBody *> *m_rigidBodyRefs;
+};
+
+/**
+ * Runs IModel#performUpdate of each model as a task.
+ *
+ * Models don't share any state while updating (morphs, bones before physics,
+ * bones synced from rigid bodies and bones after physics are updated in order
+ * in each model), so a barrier is needed only after all models are updated.
+ * Models are distributed one by one to balance different model sizes.
+ */
+template<typename TModel>
+class ParallelUpdateModelProcessor : public ThreadPool::ITask {
+public:
+    ParallelUpdateModelProcessor(const Array<TModel *> *modelRefs)
+        : m_modelRefs(modelRefs)
+    {
+    }
+    ~ParallelUpdateModelProcessor() {
+        m_modelRefs = 0;
+    }
+
+#ifdef VPVL2_LINK_INTEL_TBB
+    void operator()(const tbb::blocked_range<int> &range) const {
+        performUpdate(range.begin(), range.end());
+    }
+#endif
+
+    void run(int begin, int end, int /* worker */) {
+        performUpdate(begin, end);
+    }
+    void execute() {
+        const int nmodels = m_modelRefs->count();
+#ifdef VPVL2_LINK_INTEL_TBB
+        tbb::parallel_for(tbb::blocked_range<int>(0, nmodels, 1), *this);
+#else /* VPVL2_LINK_INTEL_TBB */
+        /*
+         * a single model runs on the calling thread and keeps the parallel loops
+         * inside of performUpdate, loops of multiple models run inline on each worker
+         */
+        ThreadPool::sharedInstance()->execute(this, 0, nmodels, 1);
 #endif /* VPVL2_LINK_INTEL_TBB */
     }
 
 private:
-    mutable Array<TRigidBody *> *m_rigidBodyRefs;
+    void performUpdate(int begin, int end) const {
+        for (int i = begin; i < end; i++) {
+            TModel *model = m_modelRefs->at(i);
+            model->performUpdate();
+        }
+    }
+
+    const Array<TModel *> *m_modelRefs;
 };
 
 } /* namespace internal */
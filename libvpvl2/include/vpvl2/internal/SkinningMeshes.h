@@ -0,0 +1,386 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#pragma once
+#ifndef VPVL2_INTERNAL_SKINNINGMESHES_H_
+#define VPVL2_INTERNAL_SKINNINGMESHES_H_
+
+#include "vpvl2/Common.h"
+#include "vpvl2/IBone.h"
+#include "vpvl2/IVertex.h"
+#include "vpvl2/internal/util.h"
+
+namespace vpvl2
+{
+namespace internal
+{
+
+/**
+ * SkinningMeshes splits index range of each material into meshes that refer
+ * at most kMaxBones bones so that a mesh can be drawn with one bone matrix
+ * palette of vertex shader skinning.
+ *
+ * Each bone is bound to one slot of the palette for all meshes, so remapped
+ * bone indices of a vertex are same in every mesh referring the vertex and
+ * they can be stored in the static vertex buffer. A new mesh is started when
+ * a triangle refers a bone whose slot is already used by another bone in the
+ * current mesh. Bones referred by the same triangle are never bound to the
+ * same slot as long as the palette has a slot for it. A slot not used by a
+ * mesh refers bone index -1 (BonePalette#matrixAt returns identity).
+ */
+class SkinningMeshes {
+public:
+    /* must be same as kMaxBones of vertex shaders in pmx/skinning */
+    static const int kMaxBones = 128;
+    static const int kMaxBonesPerVertex = 4;
+
+    struct Mesh {
+        int offset;
+        int count;
+        int boneOffset;
+        int nbones;
+    };
+
+    SkinningMeshes() {}
+    ~SkinningMeshes() {
+        clear();
+    }
+
+    static inline int countBoneRefs(IVertex::Type type) {
+        switch (type) {
+        case IVertex::kBdef1:
+            return 1;
+        case IVertex::kBdef2:
+        case IVertex::kSdef:
+            return 2;
+        case IVertex::kBdef4:
+        case IVertex::kQdef:
+            return 4;
+        case IVertex::kMaxType:
+        default:
+            return 0;
+        }
+    }
+    template<typename TVertex>
+    static inline int boneIndexAt(const TVertex *vertex, int index) {
+        const IBone *bone = vertex->boneRef(index);
+        return bone ? bone->index() : -1;
+    }
+
+    /**
+     * Builds meshes from materials and raw index array (invalid vertex index
+     * is treated as zero like IModel::IndexBuffer does).
+     *
+     * Returns false if a triangle refers two bones bound to the same slot,
+     * which cannot be drawn by any mesh. It never happens if the model has
+     * less than kMaxBones bones.
+     */
+    template<typename TMaterial, typename TVertex>
+    bool build(const Array<TMaterial *> &materials, const Array<TVertex *> &vertices, const Array<int> &indices) {
+        const int nmaterials = materials.count(), nvertices = vertices.count(), nindices = indices.count();
+        int nbones = 0;
+        for (int i = 0; i < nvertices; i++) {
+            const TVertex *vertex = vertices[i];
+            const int nrefs = countBoneRefs(vertex->type());
+            for (int j = 0; j < nrefs; j++) {
+                nbones = btMax(nbones, boneIndexAt(vertex, j) + 1);
+            }
+        }
+        clear();
+        if (nbones >= kMaxBones) {
+            buildNeighbors(materials, vertices, indices);
+        }
+        /* boneSlots is indexed by bone index + 1 to handle the null bone */
+        m_boneSlots.resize(nbones + 1);
+        for (int i = 0; i <= nbones; i++) {
+            m_boneSlots[i] = -1;
+        }
+        m_slotBones.resize(kMaxBones);
+        m_slotTimestamps.resize(kMaxBones);
+        for (int i = 0; i < kMaxBones; i++) {
+            m_slotBones[i] = kFreeSlot;
+            m_slotTimestamps[i] = -1;
+        }
+        int offset = 0, triangle[3];
+        for (int i = 0; i < nmaterials; i++) {
+            const int end = btMax(btMin(offset + materials[i]->indexRange().count, nindices), offset);
+            int meshOffset = offset;
+            m_materialOffsets.append(m_meshes.count());
+            for (int j = offset; j < end; j += 3) {
+                const int nrefs = getTriangle(indices, nvertices, j, end, triangle);
+                if (!assignTriangle(vertices, triangle, nrefs, j, meshOffset == j)) {
+                    commitMesh(meshOffset, j);
+                    meshOffset = j;
+                    if (!assignTriangle(vertices, triangle, nrefs, j, true)) {
+                        clear();
+                        return false;
+                    }
+                }
+            }
+            commitMesh(meshOffset, end);
+            offset = end;
+        }
+        m_materialOffsets.append(m_meshes.count());
+        m_remappedBoneIndices.resize(nvertices * kMaxBonesPerVertex);
+        for (int i = 0; i < nvertices; i++) {
+            const TVertex *vertex = vertices[i];
+            const int nrefs = countBoneRefs(vertex->type());
+            int *remappedBoneIndices = &m_remappedBoneIndices[i * kMaxBonesPerVertex];
+            for (int j = 0; j < kMaxBonesPerVertex; j++) {
+                remappedBoneIndices[j] = j < nrefs ? btMax(m_boneSlots[boneIndexAt(vertex, j) + 1], 0) : 0;
+            }
+        }
+        m_boneSlots.clear();
+        m_slotBones.clear();
+        m_slotTimestamps.clear();
+        m_neighbors.releaseAll();
+        return true;
+    }
+    void clear() {
+        m_meshes.clear();
+        m_materialOffsets.clear();
+        m_bones.clear();
+        m_remappedBoneIndices.clear();
+        m_boneSlots.clear();
+        m_slotBones.clear();
+        m_slotTimestamps.clear();
+        m_neighbors.releaseAll();
+    }
+
+    int countMeshes(int materialIndex) const {
+        const int nmaterials = m_materialOffsets.count() - 1;
+        return checkBound(materialIndex, 0, nmaterials)
+                ? m_materialOffsets[materialIndex + 1] - m_materialOffsets[materialIndex] : 0;
+    }
+    const Mesh *meshAt(int materialIndex, int meshIndex) const {
+        return checkBound(meshIndex, 0, countMeshes(materialIndex))
+                ? &m_meshes[m_materialOffsets[materialIndex] + meshIndex] : 0;
+    }
+    const int *bonesAt(const Mesh *mesh) const {
+        return mesh && mesh->nbones > 0 ? &m_bones[mesh->boneOffset] : 0;
+    }
+    /* returns kMaxBonesPerVertex remapped bone indices or 0 if not built */
+    const int *remappedBoneIndicesAt(int vertexIndex) const {
+        const int nvertices = m_remappedBoneIndices.count() / kMaxBonesPerVertex;
+        return checkBound(vertexIndex, 0, nvertices) ? &m_remappedBoneIndices[vertexIndex * kMaxBonesPerVertex] : 0;
+    }
+
+private:
+    static const int kFreeSlot = -2;
+
+    static inline int getTriangle(const Array<int> &indices, int nvertices, int offset, int end, int *triangle) {
+        const int nrefs = btMin(3, end - offset);
+        for (int i = 0; i < nrefs; i++) {
+            const int vertexIndex = indices[offset + i];
+            triangle[i] = checkBound(vertexIndex, 0, nvertices) ? vertexIndex : 0;
+        }
+        return nrefs;
+    }
+    template<typename TVertex>
+    static inline int collectBones(const Array<TVertex *> &vertices, const int *triangle, int nrefs, int *bones) {
+        int nbones = 0;
+        for (int i = 0; i < nrefs; i++) {
+            const TVertex *vertex = vertices[triangle[i]];
+            const int nbonerefs = countBoneRefs(vertex->type());
+            for (int j = 0; j < nbonerefs; j++) {
+                const int boneIndex = boneIndexAt(vertex, j);
+                bool found = false;
+                for (int k = 0; k < nbones && !found; k++) {
+                    found = bones[k] == boneIndex;
+                }
+                if (!found) {
+                    bones[nbones++] = boneIndex;
+                }
+            }
+        }
+        return nbones;
+    }
+    template<typename TMaterial, typename TVertex>
+    void buildNeighbors(const Array<TMaterial *> &materials, const Array<TVertex *> &vertices, const Array<int> &indices) {
+        const int nmaterials = materials.count(), nvertices = vertices.count(), nindices = indices.count();
+        int offset = 0, triangle[3], bones[3 * kMaxBonesPerVertex];
+        for (int i = 0; i < nmaterials; i++) {
+            const int end = btMax(btMin(offset + materials[i]->indexRange().count, nindices), offset);
+            for (int j = offset; j < end; j += 3) {
+                const int nrefs = getTriangle(indices, nvertices, j, end, triangle);
+                const int nbones = collectBones(vertices, triangle, nrefs, bones);
+                for (int k = 0; k < nbones; k++) {
+                    for (int l = 0; l < nbones; l++) {
+                        if (k != l) {
+                            addNeighbor(bones[k], bones[l]);
+                        }
+                    }
+                }
+            }
+            offset = end;
+        }
+    }
+    void addNeighbor(int boneIndex, int neighborBoneIndex) {
+        /* neighbors is indexed by bone index + 1 to handle the null bone */
+        while (m_neighbors.count() <= boneIndex + 1) {
+            m_neighbors.append(new Array<int>());
+        }
+        Array<int> *neighbors = m_neighbors[boneIndex + 1];
+        const int nneighbors = neighbors->count();
+        for (int i = 0; i < nneighbors; i++) {
+            if (neighbors->at(i) == neighborBoneIndex) {
+                return;
+            }
+        }
+        neighbors->append(neighborBoneIndex);
+    }
+    template<typename TVertex>
+    bool assignTriangle(const Array<TVertex *> &vertices, const int *triangle, int nrefs, int timestamp, bool isEmptyMesh) {
+        int bones[3 * kMaxBonesPerVertex], newSlots[3 * kMaxBonesPerVertex];
+        const int nbones = collectBones(vertices, triangle, nrefs, bones);
+        /* bones already bound to slots first so that new bones do not steal their slots */
+        for (int i = 0; i < nbones; i++) {
+            const int slot = m_boneSlots[bones[i] + 1];
+            newSlots[i] = -1;
+            if (slot >= 0 && m_slotBones[slot] != bones[i] && m_slotBones[slot] != kFreeSlot) {
+                return false;
+            }
+        }
+        for (int i = 0; i < nbones; i++) {
+            const int slot = m_boneSlots[bones[i] + 1];
+            for (int j = 0; j < i; j++) {
+                if (slot >= 0 && m_boneSlots[bones[j] + 1] == slot) {
+                    return false;
+                }
+            }
+        }
+        for (int i = 0; i < nbones; i++) {
+            const int slot = m_boneSlots[bones[i] + 1];
+            if (slot >= 0) {
+                m_slotBones[slot] = bones[i];
+                m_slotTimestamps[slot] = timestamp;
+            }
+        }
+        for (int i = 0; i < nbones; i++) {
+            const int boneIndex = bones[i];
+            if (m_boneSlots[boneIndex + 1] < 0) {
+                const int slot = findSlot(boneIndex, isEmptyMesh);
+                if (slot < 0) {
+                    rollback(bones, newSlots, nbones);
+                    return false;
+                }
+                m_boneSlots[boneIndex + 1] = slot;
+                m_slotBones[slot] = boneIndex;
+                m_slotTimestamps[slot] = timestamp;
+                newSlots[i] = slot;
+            }
+        }
+        return true;
+    }
+    int findSlot(int boneIndex, bool isEmptyMesh) const {
+        /* slots bound to bones referred by the same triangle with the bone are excluded */
+        bool excluded[kMaxBones] = { false };
+        if (m_neighbors.count() > boneIndex + 1) {
+            const Array<int> *neighbors = m_neighbors[boneIndex + 1];
+            const int nneighbors = neighbors->count();
+            for (int i = 0; i < nneighbors; i++) {
+                const int slot = m_boneSlots[neighbors->at(i) + 1];
+                if (slot >= 0) {
+                    excluded[slot] = true;
+                }
+            }
+        }
+        int slot = -1, timestamp = 0, nexcluded = 0;
+        for (int i = 0; i < kMaxBones; i++) {
+            if (excluded[i]) {
+                nexcluded++;
+            }
+            else if (m_slotBones[i] == kFreeSlot && (slot < 0 || m_slotTimestamps[i] < timestamp)) {
+                slot = i;
+                timestamp = m_slotTimestamps[i];
+            }
+        }
+        if (slot < 0 && isEmptyMesh && nexcluded == kMaxBones) {
+            /* too many neighbors, the least recently used slot is chosen */
+            for (int i = 0; i < kMaxBones; i++) {
+                if (m_slotBones[i] == kFreeSlot && (slot < 0 || m_slotTimestamps[i] < timestamp)) {
+                    slot = i;
+                    timestamp = m_slotTimestamps[i];
+                }
+            }
+        }
+        return slot;
+    }
+    void rollback(const int *bones, const int *newSlots, int nbones) {
+        for (int i = 0; i < nbones; i++) {
+            const int slot = newSlots[i];
+            if (slot >= 0) {
+                m_boneSlots[bones[i] + 1] = -1;
+                m_slotBones[slot] = kFreeSlot;
+            }
+        }
+    }
+    void commitMesh(int offset, int end) {
+        int nslots = 0;
+        for (int i = 0; i < kMaxBones; i++) {
+            if (m_slotBones[i] != kFreeSlot) {
+                nslots = i + 1;
+            }
+        }
+        if (end > offset) {
+            Mesh mesh = { offset, end - offset, m_bones.count(), nslots };
+            m_meshes.append(mesh);
+            for (int i = 0; i < nslots; i++) {
+                const int boneIndex = m_slotBones[i];
+                m_bones.append(boneIndex == kFreeSlot ? -1 : boneIndex);
+            }
+        }
+        for (int i = 0; i < kMaxBones; i++) {
+            m_slotBones[i] = kFreeSlot;
+        }
+    }
+
+    Array<Mesh> m_meshes;
+    Array<int> m_materialOffsets;
+    Array<int> m_bones;
+    Array<int> m_remappedBoneIndices;
+    Array<int> m_boneSlots;
+    Array<int> m_slotBones;
+    Array<int> m_slotTimestamps;
+    PointerArray<Array<int> > m_neighbors;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(SkinningMeshes)
+};
+
+} /* namespace internal */
+} /* namespace vpvl2 */
+
+#endif
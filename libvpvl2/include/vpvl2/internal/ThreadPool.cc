@@ -0,0 +1,632 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/ThreadPool.h"
+#include "vpvl2/internal/util.h"
+
+#if defined(WIN32) || defined(_WIN32)
+#define VPVL2_THREADPOOL_WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+using namespace vpvl2;
+
+#ifdef VPVL2_THREADPOOL_WIN32
+typedef CRITICAL_SECTION NativeMutex;
+typedef CONDITION_VARIABLE NativeCondition;
+typedef HANDLE NativeThread;
+#else
+typedef pthread_mutex_t NativeMutex;
+typedef pthread_cond_t NativeCondition;
+typedef pthread_t NativeThread;
+#endif
+
+static inline void initializeMutex(NativeMutex &mutex)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    InitializeCriticalSection(&mutex);
+#else
+    pthread_mutex_init(&mutex, 0);
+#endif
+}
+
+static inline void destroyMutex(NativeMutex &mutex)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    DeleteCriticalSection(&mutex);
+#else
+    pthread_mutex_destroy(&mutex);
+#endif
+}
+
+static inline void lockMutex(NativeMutex &mutex)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    EnterCriticalSection(&mutex);
+#else
+    pthread_mutex_lock(&mutex);
+#endif
+}
+
+static inline void unlockMutex(NativeMutex &mutex)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    LeaveCriticalSection(&mutex);
+#else
+    pthread_mutex_unlock(&mutex);
+#endif
+}
+
+static inline void initializeCondition(NativeCondition &condition)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    InitializeConditionVariable(&condition);
+#else
+    pthread_cond_init(&condition, 0);
+#endif
+}
+
+static inline void destroyCondition(NativeCondition &condition)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    (void) condition;
+#else
+    pthread_cond_destroy(&condition);
+#endif
+}
+
+static inline void waitCondition(NativeCondition &condition, NativeMutex &mutex)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    SleepConditionVariableCS(&condition, &mutex, INFINITE);
+#else
+    pthread_cond_wait(&condition, &mutex);
+#endif
+}
+
+static inline void broadcastCondition(NativeCondition &condition)
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    WakeAllConditionVariable(&condition);
+#else
+    pthread_cond_broadcast(&condition);
+#endif
+}
+
+static inline void setThreadAffinity(NativeThread thread, int cpu)
+{
+#if defined(VPVL2_THREADPOOL_WIN32)
+    SetThreadAffinityMask(thread, DWORD_PTR(1) << (cpu % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+    /* no portable affinity API (e.g. OSX), leave scheduling to the kernel */
+    (void) thread;
+    (void) cpu;
+#endif
+}
+
+/* span of chunks owned by a worker, the owner takes the front and thieves take the back */
+struct ChunkQueue {
+    ChunkQueue()
+        : front(0),
+          back(0)
+    {
+        initializeMutex(lock);
+    }
+    ~ChunkQueue() {
+        destroyMutex(lock);
+    }
+    bool takeFront(int &chunk) {
+        bool found = false;
+        lockMutex(lock);
+        if (front < back) {
+            chunk = front++;
+            found = true;
+        }
+        unlockMutex(lock);
+        return found;
+    }
+    bool takeBack(int &chunk) {
+        bool found = false;
+        lockMutex(lock);
+        if (front < back) {
+            chunk = --back;
+            found = true;
+        }
+        unlockMutex(lock);
+        return found;
+    }
+    void reset(int from, int to) {
+        lockMutex(lock);
+        front = from;
+        back = to;
+        unlockMutex(lock);
+    }
+    NativeMutex lock;
+    int front;
+    int back;
+};
+
+}
+
+namespace vpvl2
+{
+namespace internal
+{
+
+struct Mutex::PrivateContext {
+    NativeMutex mutex;
+};
+
+Mutex::Mutex()
+    : m_context(new PrivateContext())
+{
+    initializeMutex(m_context->mutex);
+}
+
+Mutex::~Mutex()
+{
+    destroyMutex(m_context->mutex);
+    delete m_context;
+    m_context = 0;
+}
+
+void Mutex::lock()
+{
+    lockMutex(m_context->mutex);
+}
+
+void Mutex::unlock()
+{
+    unlockMutex(m_context->mutex);
+}
+
+struct ThreadPool::PrivateContext {
+    struct Worker {
+        Worker(PrivateContext *context, int index, int generation)
+            : contextRef(context),
+              index(index),
+              generation(generation)
+        {
+        }
+        PrivateContext *contextRef;
+        NativeThread thread;
+        int index;
+        int generation;
+    };
+
+    PrivateContext()
+        : taskRef(0),
+          begin(0),
+          end(0),
+          grainSize(1),
+          generation(0),
+          nbusy(0),
+          nworkers(btClamped(countHardwareThreads(), 1, int(kMaxWorkers))),
+          nrunningWorkers(1),
+          enableAffinity(false),
+          running(false),
+          quit(false)
+    {
+        initializeMutex(lock);
+        initializeCondition(wakeCondition);
+        initializeCondition(doneCondition);
+    }
+    ~PrivateContext() {
+        stopWorkers();
+        queues.releaseAll();
+        destroyCondition(doneCondition);
+        destroyCondition(wakeCondition);
+        destroyMutex(lock);
+    }
+
+#ifdef VPVL2_THREADPOOL_WIN32
+    static unsigned int __stdcall threadMain(void *opaque) {
+        Worker *worker = static_cast<Worker *>(opaque);
+        worker->contextRef->workerMain(worker->index, worker->generation);
+        return 0;
+    }
+#else
+    static void *threadMain(void *opaque) {
+        Worker *worker = static_cast<Worker *>(opaque);
+        worker->contextRef->workerMain(worker->index, worker->generation);
+        return 0;
+    }
+#endif
+
+    void startWorkers() {
+        const int n = nworkers;
+        while (queues.count() < n) {
+            queues.append(new ChunkQueue());
+        }
+        quit = false;
+        for (int i = 1; i < n; i++) {
+            Worker *worker = workers.append(new Worker(this, i, generation));
+#ifdef VPVL2_THREADPOOL_WIN32
+            worker->thread = reinterpret_cast<HANDLE>(_beginthreadex(0, 0, &PrivateContext::threadMain, worker, 0, 0));
+            bool ok = worker->thread != 0;
+#else
+            bool ok = pthread_create(&worker->thread, 0, &PrivateContext::threadMain, worker) == 0;
+#endif
+            if (!ok) {
+                VPVL2_LOG(WARNING, "Cannot create a worker thread: index=" << i);
+                delete workers[workers.count() - 1];
+                workers.removeAt(workers.count() - 1);
+                break;
+            }
+            if (enableAffinity) {
+                setThreadAffinity(worker->thread, i % countHardwareThreads());
+            }
+        }
+        nrunningWorkers = workers.count() + 1;
+    }
+    void stopWorkers() {
+        lockMutex(lock);
+        quit = true;
+        broadcastCondition(wakeCondition);
+        unlockMutex(lock);
+        const int nthreads = workers.count();
+        for (int i = 0; i < nthreads; i++) {
+            Worker *worker = workers[i];
+#ifdef VPVL2_THREADPOOL_WIN32
+            WaitForSingleObject(worker->thread, INFINITE);
+            CloseHandle(worker->thread);
+#else
+            pthread_join(worker->thread, 0);
+#endif
+        }
+        workers.releaseAll();
+        nrunningWorkers = 1;
+    }
+    void workerMain(int index, int seenGeneration) {
+        /* seenGeneration is taken at creation so a range started before this thread runs is not missed */
+        lockMutex(lock);
+        while (true) {
+            while (!quit && generation == seenGeneration) {
+                waitCondition(wakeCondition, lock);
+            }
+            if (quit) {
+                break;
+            }
+            seenGeneration = generation;
+            unlockMutex(lock);
+            runChunks(index);
+            lockMutex(lock);
+            if (--nbusy == 0) {
+                broadcastCondition(doneCondition);
+            }
+        }
+        unlockMutex(lock);
+    }
+    bool takeChunk(int index, int &chunk) {
+        if (queues[index]->takeFront(chunk)) {
+            return true;
+        }
+        const int n = nrunningWorkers;
+        for (int i = 1; i < n; i++) {
+            if (queues[(index + i) % n]->takeBack(chunk)) {
+                return true;
+            }
+        }
+        return false;
+    }
+    void runChunks(int index) {
+        int chunk = 0;
+        while (takeChunk(index, chunk)) {
+            const int from = begin + chunk * grainSize, to = btMin(from + grainSize, end);
+            taskRef->run(from, to, index);
+        }
+    }
+
+    PointerArray<ChunkQueue> queues;
+    PointerArray<Worker> workers;
+    NativeMutex lock;
+    NativeCondition wakeCondition;
+    NativeCondition doneCondition;
+    ITask *taskRef;
+    int begin;
+    int end;
+    int grainSize;
+    int generation;
+    int nbusy;
+    int nworkers;
+    int nrunningWorkers;
+    bool enableAffinity;
+    bool running;
+    bool quit;
+};
+
+ThreadPool *ThreadPool::sharedInstance()
+{
+    static ThreadPool pool;
+    return &pool;
+}
+
+int ThreadPool::countHardwareThreads()
+{
+#ifdef VPVL2_THREADPOOL_WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return btMax(int(info.dwNumberOfProcessors), 1);
+#else
+    return btMax(int(sysconf(_SC_NPROCESSORS_ONLN)), 1);
+#endif
+}
+
+ThreadPool::ThreadPool()
+    : m_context(new PrivateContext())
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+    delete m_context;
+    m_context = 0;
+}
+
+void ThreadPool::setup(int nworkers, bool enableAffinity)
+{
+    PrivateContext *context = m_context;
+    lockMutex(context->lock);
+    const bool running = context->running;
+    unlockMutex(context->lock);
+    if (running) {
+        VPVL2_LOG(WARNING, "ThreadPool#setup is called while executing, ignored: nworkers=" << nworkers);
+        return;
+    }
+    context->stopWorkers();
+    context->nworkers = btClamped(nworkers, 1, int(kMaxWorkers));
+    context->enableAffinity = enableAffinity;
+}
+
+int ThreadPool::countWorkers() const
+{
+    return m_context->nworkers;
+}
+
+bool ThreadPool::isAffinityEnabled() const
+{
+    return m_context->enableAffinity;
+}
+
+void ThreadPool::execute(ITask *task, int begin, int end, int grainSize)
+{
+    const int nitems = end - begin;
+    if (!task || nitems <= 0) {
+        return;
+    }
+    PrivateContext *context = m_context;
+    const int nworkers = context->nworkers;
+    if (grainSize < 1) {
+        grainSize = btMax((nitems + nworkers * 4 - 1) / (nworkers * 4), 1);
+    }
+    const int nchunks = (nitems + grainSize - 1) / grainSize;
+    bool nested = true;
+    if (nworkers > 1 && nchunks > 1) {
+        lockMutex(context->lock);
+        nested = context->running;
+        context->running = true;
+        unlockMutex(context->lock);
+    }
+    if (nested) {
+        task->run(begin, end, 0);
+        return;
+    }
+    if (context->workers.count() + 1 != nworkers) {
+        context->stopWorkers();
+        context->startWorkers();
+    }
+    const int nrunningWorkers = context->nrunningWorkers;
+    for (int i = 0; i < nrunningWorkers; i++) {
+        context->queues[i]->reset(i * nchunks / nrunningWorkers, (i + 1) * nchunks / nrunningWorkers);
+    }
+    lockMutex(context->lock);
+    context->taskRef = task;
+    context->begin = begin;
+    context->end = end;
+    context->grainSize = grainSize;
+    context->nbusy = nrunningWorkers - 1;
+    context->generation++;
+    broadcastCondition(context->wakeCondition);
+    unlockMutex(context->lock);
+    context->runChunks(0);
+    lockMutex(context->lock);
+    while (context->nbusy > 0) {
+        waitCondition(context->doneCondition, context->lock);
+    }
+    context->taskRef = 0;
+    context->running = false;
+    unlockMutex(context->lock);
+}
+
+struct WorkerThread::PrivateContext {
+    PrivateContext()
+        : taskRef(0),
+          started(false),
+          busy(false),
+          quit(false)
+    {
+        initializeMutex(lock);
+        initializeCondition(wakeCondition);
+        initializeCondition(doneCondition);
+    }
+    ~PrivateContext() {
+        stopThread();
+        destroyCondition(doneCondition);
+        destroyCondition(wakeCondition);
+        destroyMutex(lock);
+    }
+
+#ifdef VPVL2_THREADPOOL_WIN32
+    static unsigned int __stdcall threadMain(void *opaque) {
+        static_cast<PrivateContext *>(opaque)->workerMain();
+        return 0;
+    }
+#else
+    static void *threadMain(void *opaque) {
+        static_cast<PrivateContext *>(opaque)->workerMain();
+        return 0;
+    }
+#endif
+
+    bool startThread() {
+        quit = false;
+#ifdef VPVL2_THREADPOOL_WIN32
+        thread = reinterpret_cast<HANDLE>(_beginthreadex(0, 0, &PrivateContext::threadMain, this, 0, 0));
+        started = thread != 0;
+#else
+        started = pthread_create(&thread, 0, &PrivateContext::threadMain, this) == 0;
+#endif
+        if (!started) {
+            VPVL2_LOG(WARNING, "Cannot create a dedicated worker thread");
+        }
+        return started;
+    }
+    void stopThread() {
+        if (!started) {
+            return;
+        }
+        lockMutex(lock);
+        while (busy) {
+            waitCondition(doneCondition, lock);
+        }
+        quit = true;
+        broadcastCondition(wakeCondition);
+        unlockMutex(lock);
+#ifdef VPVL2_THREADPOOL_WIN32
+        WaitForSingleObject(thread, INFINITE);
+        CloseHandle(thread);
+#else
+        pthread_join(thread, 0);
+#endif
+        started = false;
+    }
+    void workerMain() {
+        lockMutex(lock);
+        while (true) {
+            while (!quit && !busy) {
+                waitCondition(wakeCondition, lock);
+            }
+            if (quit) {
+                break;
+            }
+            ThreadPool::ITask *task = taskRef;
+            unlockMutex(lock);
+            task->run(0, 1, 0);
+            lockMutex(lock);
+            taskRef = 0;
+            busy = false;
+            broadcastCondition(doneCondition);
+        }
+        unlockMutex(lock);
+    }
+
+    NativeMutex lock;
+    NativeCondition wakeCondition;
+    NativeCondition doneCondition;
+    NativeThread thread;
+    ThreadPool::ITask *taskRef;
+    bool started;
+    bool busy;
+    bool quit;
+};
+
+WorkerThread::WorkerThread()
+    : m_context(new PrivateContext())
+{
+}
+
+WorkerThread::~WorkerThread()
+{
+    delete m_context;
+    m_context = 0;
+}
+
+void WorkerThread::start(ThreadPool::ITask *task)
+{
+    if (!task) {
+        return;
+    }
+    wait();
+    PrivateContext *context = m_context;
+    if (!context->started && !context->startThread()) {
+        task->run(0, 1, 0);
+        return;
+    }
+    lockMutex(context->lock);
+    context->taskRef = task;
+    context->busy = true;
+    broadcastCondition(context->wakeCondition);
+    unlockMutex(context->lock);
+}
+
+void WorkerThread::wait()
+{
+    PrivateContext *context = m_context;
+    lockMutex(context->lock);
+    while (context->busy) {
+        waitCondition(context->doneCondition, context->lock);
+    }
+    unlockMutex(context->lock);
+}
+
+bool WorkerThread::isRunning() const
+{
+    PrivateContext *context = m_context;
+    lockMutex(context->lock);
+    const bool busy = context->busy;
+    unlockMutex(context->lock);
+    return busy;
+}
+
+} /* namespace internal */
+} /* namespace vpvl2 */
@@ -0,0 +1,175 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#pragma once
+#ifndef VPVL2_INTERNAL_THREADPOOL_H_
+#define VPVL2_INTERNAL_THREADPOOL_H_
+
+#include "vpvl2/Common.h"
+
+namespace vpvl2
+{
+namespace internal
+{
+
+/**
+ * Mutex is a non recursive lock independent from TBB and OpenMP.
+ */
+class VPVL2_API Mutex
+{
+public:
+    class ScopedLock {
+    public:
+        ScopedLock(Mutex &mutex)
+            : m_mutexRef(mutex)
+        {
+            m_mutexRef.lock();
+        }
+        ~ScopedLock() {
+            m_mutexRef.unlock();
+        }
+
+    private:
+        Mutex &m_mutexRef;
+
+        VPVL2_DISABLE_COPY_AND_ASSIGN(ScopedLock)
+    };
+
+    Mutex();
+    ~Mutex();
+
+    void lock();
+    void unlock();
+
+private:
+    struct PrivateContext;
+    PrivateContext *m_context;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(Mutex)
+};
+
+/**
+ * ThreadPool is the built-in work-stealing thread pool used by ParallelProcessors
+ * when TBB is not linked.
+ *
+ * A range is split into chunks of grainSize items and each worker gets a
+ * contiguous span of the chunks. A worker takes chunks from the front of its
+ * own span and steals chunks from the back of the others when it runs out, so
+ * imbalanced ranges still finish together. The calling thread always runs as
+ * the worker 0 and background workers are created at the first execution.
+ *
+ * Only one range is executed at a time; ranges executed from a task or while
+ * another thread is executing are run on the calling thread as the worker 0.
+ */
+class VPVL2_API ThreadPool
+{
+public:
+    class ITask {
+    public:
+        virtual ~ITask() {}
+        /**
+         * Processes items in [begin, end) on the worker (0 <= worker < countWorkers()).
+         * A worker never runs two chunks concurrently, so per worker states need no lock.
+         */
+        virtual void run(int begin, int end, int worker) = 0;
+    };
+    static const int kMaxWorkers = 64;
+
+    static ThreadPool *sharedInstance();
+    static int countHardwareThreads();
+
+    ThreadPool();
+    ~ThreadPool();
+
+    /**
+     * Sets the number of workers including the calling thread (1 disables
+     * background workers) and whether background workers are pinned to CPUs.
+     *
+     * Takes effect at the next execution; must not be called while another
+     * thread is executing a range.
+     */
+    void setup(int nworkers, bool enableAffinity);
+    int countWorkers() const;
+    bool isAffinityEnabled() const;
+    /**
+     * Runs task for [begin, end) and returns after all chunks are processed.
+     * grainSize less than 1 splits the range into a few chunks per worker.
+     */
+    void execute(ITask *task, int begin, int end, int grainSize);
+
+private:
+    struct PrivateContext;
+    PrivateContext *m_context;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(ThreadPool)
+};
+
+/**
+ * WorkerThread is a dedicated background thread running one task at a time
+ * to overlap a long serial task (e.g. physics simulation) with the calling thread.
+ *
+ * The thread is created at the first start and joined at the destruction.
+ * start and wait must be called from the same (owner) thread.
+ */
+class VPVL2_API WorkerThread
+{
+public:
+    WorkerThread();
+    ~WorkerThread();
+
+    /**
+     * Runs task->run(0, 1, 0) on the background thread and returns immediately.
+     * The previous task is waited first. Runs on the calling thread if the thread
+     * cannot be created.
+     */
+    void start(ThreadPool::ITask *task);
+    /**
+     * Blocks until the task started by start is finished.
+     */
+    void wait();
+    bool isRunning() const;
+
+private:
+    struct PrivateContext;
+    PrivateContext *m_context;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(WorkerThread)
+};
+
+} /* namespace internal */
+} /* namespace vpvl2 */
+
+#endif
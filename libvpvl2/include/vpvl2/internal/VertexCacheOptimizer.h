@@ -0,0 +1,294 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#pragma once
+#ifndef VPVL2_INTERNAL_VERTEXCACHEOPTIMIZER_H_
+#define VPVL2_INTERNAL_VERTEXCACHEOPTIMIZER_H_
+
+#include "vpvl2/Common.h"
+
+namespace vpvl2
+{
+namespace internal
+{
+
+/**
+ * VertexCacheOptimizer reorders triangles for the post-transform vertex cache
+ * with the linear-speed algorithm of Tom Forsyth and vertices in order of the
+ * first fetch of the reordered triangles.
+ *
+ * Each vertex is scored by its position in a simulated LRU cache and by the
+ * number of triangles left to refer it, and the triangle of the highest score
+ * among the triangles referring cached vertices is emitted next. Triangles are
+ * reordered only inside the given index range so index ranges of materials are
+ * kept as they are.
+ */
+class VertexCacheOptimizer {
+public:
+    static const int kCacheSize = 32;
+    static const int kMaxValence = 32;
+
+    VertexCacheOptimizer(int nvertices)
+        : m_nvertices(nvertices)
+    {
+        m_localIndices.resize(nvertices);
+        for (int i = 0; i < nvertices; i++) {
+            m_localIndices[i] = -1;
+        }
+        /* the last triangle was just emitted so its vertices get the fixed score */
+        m_cacheScores.resize(kCacheSize);
+        for (int i = 0; i < kCacheSize; i++) {
+            m_cacheScores[i] = i < 3 ? 0.75f : btPow(1.0f - (i - 3) / float(kCacheSize - 3), 1.5f);
+        }
+        m_valenceScores.resize(kMaxValence + 1);
+        m_valenceScores[0] = 0;
+        for (int i = 1; i <= kMaxValence; i++) {
+            m_valenceScores[i] = 2.0f / btSqrt(float(i));
+        }
+    }
+    ~VertexCacheOptimizer() {
+        m_nvertices = 0;
+    }
+
+    /* returns false and keeps indices as they are if the range refers an invalid vertex */
+    bool reorderTriangles(Array<int> &indices, int offset, int count) {
+        const int ntriangles = count / 3, ncorners = ntriangles * 3;
+        if (offset < 0 || ntriangles < 0 || offset + ncorners > indices.count()) {
+            return false;
+        }
+        else if (ntriangles < 2) {
+            return true;
+        }
+        m_vertices.clear();
+        m_corners.resize(ncorners);
+        bool valid = true;
+        for (int i = 0; i < ncorners; i++) {
+            const int index = indices[offset + i];
+            if (index < 0 || index >= m_nvertices) {
+                valid = false;
+                break;
+            }
+            int &localIndex = m_localIndices[index];
+            if (localIndex < 0) {
+                localIndex = m_vertices.count();
+                m_vertices.append(index);
+            }
+            m_corners[i] = localIndex;
+        }
+        const int nlocals = m_vertices.count();
+        if (valid) {
+            buildAdjacency(nlocals, ntriangles);
+            emitTriangles(ntriangles);
+            for (int i = 0; i < ntriangles; i++) {
+                const int *corners = &m_corners[m_order[i] * 3];
+                for (int j = 0; j < 3; j++) {
+                    indices[offset + i * 3 + j] = m_vertices[corners[j]];
+                }
+            }
+        }
+        for (int i = 0; i < nlocals; i++) {
+            m_localIndices[m_vertices[i]] = -1;
+        }
+        return valid;
+    }
+
+    /* builds the table of new vertex indices by the first reference, unreferred vertices are kept at the end */
+    static void buildVertexRemap(const Array<int> &indices, int nvertices, Array<int> &remap) {
+        const int nindices = indices.count();
+        int nremapped = 0;
+        remap.resize(nvertices);
+        for (int i = 0; i < nvertices; i++) {
+            remap[i] = -1;
+        }
+        for (int i = 0; i < nindices; i++) {
+            const int index = indices[i];
+            if (index >= 0 && index < nvertices && remap[index] < 0) {
+                remap[index] = nremapped++;
+            }
+        }
+        for (int i = 0; i < nvertices; i++) {
+            if (remap[i] < 0) {
+                remap[i] = nremapped++;
+            }
+        }
+    }
+
+private:
+    void buildAdjacency(int nlocals, int ntriangles) {
+        m_valences.resize(nlocals);
+        m_cachePositions.resize(nlocals);
+        m_vertexScores.resize(nlocals);
+        m_triangleOffsets.resize(nlocals + 1);
+        for (int i = 0; i < nlocals; i++) {
+            m_valences[i] = 0;
+            m_cachePositions[i] = -1;
+        }
+        const int ncorners = ntriangles * 3;
+        for (int i = 0; i < ncorners; i++) {
+            m_valences[m_corners[i]]++;
+        }
+        int offset = 0;
+        for (int i = 0; i < nlocals; i++) {
+            m_triangleOffsets[i] = offset;
+            offset += m_valences[i];
+            m_valences[i] = 0;
+        }
+        m_triangleOffsets[nlocals] = offset;
+        m_triangles.resize(ncorners);
+        for (int i = 0; i < ncorners; i++) {
+            const int vertex = m_corners[i];
+            m_triangles[m_triangleOffsets[vertex] + m_valences[vertex]++] = i / 3;
+        }
+        for (int i = 0; i < nlocals; i++) {
+            m_vertexScores[i] = vertexScore(i);
+        }
+        m_triangleScores.resize(ntriangles);
+        m_emitted.resize(ntriangles);
+        for (int i = 0; i < ntriangles; i++) {
+            m_triangleScores[i] = triangleScore(i);
+            m_emitted[i] = false;
+        }
+    }
+    void emitTriangles(int ntriangles) {
+        int best = 0, cursor = 0;
+        for (int i = 1; i < ntriangles; i++) {
+            if (m_triangleScores[i] > m_triangleScores[best]) {
+                best = i;
+            }
+        }
+        m_order.resize(ntriangles);
+        m_cache.clear();
+        for (int i = 0; i < ntriangles; i++) {
+            if (best < 0) {
+                /* no cached vertex refers remaining triangles, pick the next one in the original order */
+                while (m_emitted[cursor]) {
+                    cursor++;
+                }
+                best = cursor;
+            }
+            m_order[i] = best;
+            m_emitted[best] = true;
+            best = emitTriangle(best);
+        }
+    }
+    /* returns the triangle of the highest score referring updated vertices or -1 if none */
+    int emitTriangle(int triangle) {
+        const int *corners = &m_corners[triangle * 3];
+        m_newCache.clear();
+        for (int i = 0; i < 3; i++) {
+            const int vertex = corners[i];
+            removeTriangle(vertex, triangle);
+            m_newCache.append(vertex);
+        }
+        const int ncached = m_cache.count();
+        for (int i = 0; i < ncached; i++) {
+            const int vertex = m_cache[i];
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2]) {
+                m_newCache.append(vertex);
+            }
+        }
+        const int nupdated = m_newCache.count();
+        for (int i = 0; i < nupdated; i++) {
+            const int vertex = m_newCache[i];
+            m_cachePositions[vertex] = i < kCacheSize ? i : -1;
+            m_vertexScores[vertex] = vertexScore(vertex);
+        }
+        int best = -1;
+        float bestScore = -1;
+        for (int i = 0; i < nupdated; i++) {
+            const int vertex = m_newCache[i], begin = m_triangleOffsets[vertex], end = begin + m_valences[vertex];
+            for (int j = begin; j < end; j++) {
+                const int t = m_triangles[j];
+                const float score = m_triangleScores[t] = triangleScore(t);
+                if (score > bestScore) {
+                    best = t;
+                    bestScore = score;
+                }
+            }
+        }
+        m_cache.clear();
+        for (int i = 0; i < nupdated && i < kCacheSize; i++) {
+            m_cache.append(m_newCache[i]);
+        }
+        return best;
+    }
+    void removeTriangle(int vertex, int triangle) {
+        const int begin = m_triangleOffsets[vertex], end = begin + m_valences[vertex];
+        for (int i = begin; i < end; i++) {
+            if (m_triangles[i] == triangle) {
+                m_triangles[i] = m_triangles[end - 1];
+                m_valences[vertex]--;
+                break;
+            }
+        }
+    }
+    float vertexScore(int vertex) const {
+        const int valence = m_valences[vertex], position = m_cachePositions[vertex];
+        if (valence == 0) {
+            return -1;
+        }
+        const float cacheScore = position >= 0 ? m_cacheScores[position] : 0;
+        return cacheScore + m_valenceScores[btMin(valence, int(kMaxValence))];
+    }
+    float triangleScore(int triangle) const {
+        const int *corners = &m_corners[triangle * 3];
+        return m_vertexScores[corners[0]] + m_vertexScores[corners[1]] + m_vertexScores[corners[2]];
+    }
+
+    int m_nvertices;
+    Array<int> m_localIndices;
+    Array<int> m_vertices;
+    Array<int> m_corners;
+    Array<int> m_valences;
+    Array<int> m_cachePositions;
+    Array<int> m_triangleOffsets;
+    Array<int> m_triangles;
+    Array<int> m_order;
+    Array<int> m_cache;
+    Array<int> m_newCache;
+    Array<float> m_cacheScores;
+    Array<float> m_valenceScores;
+    Array<float> m_vertexScores;
+    Array<float> m_triangleScores;
+    Array<bool> m_emitted;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(VertexCacheOptimizer)
+};
+
+} /* namespace internal */
+} /* namespace vpvl2 */
+
+#endif
@@ -0,0 +1,737 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#pragma once
+#ifndef VPVL2_INTERNAL_VERTEXSTORE_H_
+#define VPVL2_INTERNAL_VERTEXSTORE_H_
+
+#include "vpvl2/Common.h"
+#include "vpvl2/IBone.h"
+#include "vpvl2/IMaterial.h"
+#include "vpvl2/IVertex.h"
+#include "vpvl2/internal/BonePalette.h"
+#include "vpvl2/internal/ModelHelper.h"
+#include "vpvl2/internal/ParallelProcessors.h"
+#include "vpvl2/internal/util.h"
+
+#if !defined(BT_USE_DOUBLE_PRECISION) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VPVL2_VERTEXSTORE_ENABLE_SSE
+#include <emmintrin.h>
+#endif
+
+#ifdef VPVL2_LINK_INTEL_TBB
+#include <tbb/tbb.h>
+#endif
+
+namespace vpvl2
+{
+namespace internal
+{
+
+/**
+ * VertexStore keeps skinning inputs of all vertices of a model in contiguous
+ * (16 bytes aligned) arrays and performs skinning per vertex type without
+ * calling IVertex and IBone virtual functions for each vertex.
+ *
+ * The store is the skinning engine of all model types (PMX, PMD and PMD2);
+ * models describe their vertices with Description and the store packs them.
+ *
+ * Vertices attached to the store read and write their morph states (delta
+ * and additional UVs) from the store, so IVertex still works as a view.
+ */
+class VertexStore {
+public:
+    enum GroupType {
+        kBdef1Group,
+        kBdef2Group,
+        kBdef4Group,
+        kSdefGroup,
+        kMaxGroupType
+    };
+    static const int kMaxBones = 4;
+    static const int kMaxUVs = 5;
+    static const int kMatrixSize = 16;
+
+    /**
+     * Packed description of a vertex to build the store. Bone indices out
+     * of range are mapped to the identity matrix of the palette and the
+     * material index out of range means the vertex has no material.
+     */
+    struct Description {
+        Description()
+            : origin(kZeroV3),
+              normal(kZeroV3),
+              sdefC(kZeroV3),
+              sdefR0(kZeroV3),
+              sdefR1(kZeroV3),
+              edgeSize(0),
+              materialIndex(-1),
+              type(IVertex::kBdef1)
+        {
+            for (int i = 0; i < kMaxBones; i++) {
+                weights[i] = 0;
+                boneIndices[i] = -1;
+            }
+        }
+        Vector3 origin;
+        Vector3 normal;
+        Vector3 sdefC;
+        Vector3 sdefR0;
+        Vector3 sdefR1;
+        Scalar weights[kMaxBones];
+        int boneIndices[kMaxBones];
+        Scalar edgeSize;
+        int materialIndex;
+        IVertex::Type type;
+    };
+
+    template<typename TUnit>
+    class SkinningProcessor : public ThreadPool::ITask {
+    public:
+        SkinningProcessor(const VertexStore *storeRef, const BonePalette *paletteRef, void *address)
+            : m_storeRef(storeRef),
+              m_paletteRef(paletteRef),
+              m_bufferPtr(static_cast<TUnit *>(address)),
+              m_reductionRef(0),
+              m_aabbMin(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY),
+              m_aabbMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY)
+        {
+        }
+        ~SkinningProcessor() {
+            m_storeRef = 0;
+            m_paletteRef = 0;
+            m_bufferPtr = 0;
+            m_reductionRef = 0;
+        }
+
+        Vector3 aabbMin() const { return m_aabbMin; }
+        Vector3 aabbMax() const { return m_aabbMax; }
+
+#ifdef VPVL2_LINK_INTEL_TBB
+        SkinningProcessor(const SkinningProcessor &self, tbb::split /* split */)
+            : m_storeRef(self.m_storeRef),
+              m_paletteRef(self.m_paletteRef),
+              m_bufferPtr(self.m_bufferPtr),
+              m_reductionRef(0),
+              m_aabbMin(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY),
+              m_aabbMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY)
+        {
+        }
+        void join(const SkinningProcessor &self) {
+            m_aabbMin.setMin(self.m_aabbMin);
+            m_aabbMax.setMax(self.m_aabbMax);
+        }
+        void operator()(const tbb::blocked_range<int> &range) const {
+            m_storeRef->performSkinning(*m_paletteRef, range.begin(), range.end(), m_bufferPtr, m_aabbMin, m_aabbMax);
+        }
+#endif /* VPVL2_LINK_INTEL_TBB */
+
+        void run(int begin, int end, int worker) {
+            m_storeRef->performSkinning(*m_paletteRef, begin, end, m_bufferPtr, m_reductionRef->aabbMin(worker), m_reductionRef->aabbMax(worker));
+        }
+        void execute(bool enableParallel) {
+            const int nvertices = m_storeRef->count();
+#if defined(VPVL2_LINK_INTEL_TBB)
+            if (enableParallel) {
+                tbb::parallel_reduce(tbb::blocked_range<int>(0, nvertices, kGrainSize), *this);
+            }
+            else {
+                m_storeRef->performSkinning(*m_paletteRef, 0, nvertices, m_bufferPtr, m_aabbMin, m_aabbMax);
+            }
+#else
+            (void) enableParallel;
+            ParallelAabbReduction reduction;
+            m_reductionRef = &reduction;
+            ThreadPool::sharedInstance()->execute(this, 0, nvertices, kGrainSize);
+            reduction.reduce(m_aabbMin, m_aabbMax);
+            m_reductionRef = 0;
+#endif
+        }
+
+    private:
+        static const int kGrainSize = 1024;
+        const VertexStore *m_storeRef;
+        const BonePalette *m_paletteRef;
+        TUnit *m_bufferPtr;
+        ParallelAabbReduction *m_reductionRef;
+        mutable Vector3 m_aabbMin;
+        mutable Vector3 m_aabbMax;
+    };
+
+    VertexStore()
+        : m_nvertices(0),
+          m_nbones(0),
+          m_nmaterials(0),
+          m_enabled(false),
+          m_dirty(true)
+    {
+        zerofill(m_offsets, sizeof(m_offsets));
+    }
+    ~VertexStore() {
+        clear();
+        m_enabled = false;
+    }
+
+    /**
+     * Describes common skinning inputs of vertices through IVertex.
+     *
+     * Returns false if the vertices are not indexed sequentially. SDEF
+     * parameters are not part of IVertex and left to the caller.
+     */
+    template<typename TVertex>
+    static bool describe(const Array<TVertex *> &vertices, Array<Description> &descriptions) {
+        const int nvertices = vertices.count();
+        descriptions.resize(nvertices);
+        for (int i = 0; i < nvertices; i++) {
+            const TVertex *vertex = vertices[i];
+            if (vertex->index() != i) {
+                VPVL2_LOG(WARNING, "Vertex index is not sequential to build the store: index=" << i << " actual=" << vertex->index());
+                return false;
+            }
+            Description &description = descriptions[i];
+            const IMaterial *material = vertex->materialRef();
+            const IVertex::Type type = vertex->type();
+            const int nweights = type == IVertex::kBdef1 ? 1 : (type == IVertex::kBdef2 || type == IVertex::kSdef) ? 2 : kMaxBones;
+            description.origin = vertex->origin();
+            description.normal = vertex->normal();
+            description.edgeSize = Scalar(vertex->edgeSize());
+            description.materialIndex = material ? material->index() : -1;
+            description.type = type;
+            for (int j = 0; j < nweights; j++) {
+                const IBone *bone = vertex->boneRef(j);
+                description.boneIndices[j] = bone ? bone->index() : -1;
+                description.weights[j] = Scalar(vertex->weight(j));
+            }
+        }
+        return true;
+    }
+    /**
+     * Gathers skinning inputs from vertices and attaches them to the store.
+     *
+     * Morph states of vertices already attached are preserved. Returns false
+     * and disables the store if the vertices are not indexed sequentially.
+     */
+    template<typename TVertex>
+    bool build(const Array<TVertex *> &vertices, int nbones, int nmaterials) {
+        Array<Description> descriptions;
+        if (!describe(vertices, descriptions)) {
+            clear();
+            m_enabled = false;
+            return false;
+        }
+        build(descriptions, nbones, nmaterials);
+        attach(vertices);
+        return true;
+    }
+    /**
+     * Packs described vertices into the store and enables it.
+     *
+     * Vertices are grouped by the number of effective bones; BDEF2 vertices
+     * fully weighted to one bone (common in PMD) are skinned as BDEF1.
+     */
+    void build(const Array<Description> &descriptions, int nbones, int nmaterials) {
+        const int nvertices = descriptions.count();
+        Array<int> groups[kMaxGroupType];
+        m_positions.resize(nvertices * 4);
+        m_normals.resize(nvertices * 4);
+        m_weights.resize(nvertices * kMaxBones);
+        m_boneIndices.resize(nvertices * kMaxBones);
+        m_edgeSizes.resize(nvertices);
+        m_materialIndices.resize(nvertices);
+        m_deltas.resize(nvertices * 4);
+        m_uvs.resize(nvertices * kMaxUVs * 4);
+        for (int i = 0; i < nvertices; i++) {
+            const Description &description = descriptions[i];
+            const Vector3 &origin = description.origin, &normal = description.normal;
+            Scalar *positionPtr = &m_positions[i * 4], *normalPtr = &m_normals[i * 4];
+            positionPtr[0] = origin.x();
+            positionPtr[1] = origin.y();
+            positionPtr[2] = origin.z();
+            positionPtr[3] = 1;
+            normalPtr[0] = normal.x();
+            normalPtr[1] = normal.y();
+            normalPtr[2] = normal.z();
+            normalPtr[3] = 0;
+            m_edgeSizes[i] = description.edgeSize;
+            const int materialIndex = description.materialIndex;
+            m_materialIndices[i] = checkBound(materialIndex, 0, nmaterials) ? materialIndex : nmaterials;
+            Scalar *weightsPtr = &m_weights[i * kMaxBones];
+            int *boneIndicesPtr = &m_boneIndices[i * kMaxBones];
+            for (int j = 0; j < kMaxBones; j++) {
+                const int boneIndex = description.boneIndices[j];
+                boneIndicesPtr[j] = checkBound(boneIndex, 0, nbones) ? boneIndex : nbones;
+                weightsPtr[j] = 0;
+            }
+            switch (description.type) {
+            case IVertex::kBdef2: {
+                const Scalar &weight = description.weights[0];
+                if (weight >= 1 || weight <= 0) {
+                    if (weight <= 0) {
+                        boneIndicesPtr[0] = boneIndicesPtr[1];
+                    }
+                    boneIndicesPtr[1] = nbones;
+                    weightsPtr[0] = 1;
+                    groups[kBdef1Group].append(i);
+                }
+                else {
+                    weightsPtr[0] = weight;
+                    weightsPtr[1] = 1 - weight;
+                    groups[kBdef2Group].append(i);
+                }
+                break;
+            }
+            case IVertex::kSdef: {
+                weightsPtr[0] = description.weights[0];
+                weightsPtr[1] = 1 - weightsPtr[0];
+                groups[kSdefGroup].append(i);
+                break;
+            }
+            case IVertex::kBdef4:
+            case IVertex::kQdef: {
+                Scalar sum = 0;
+                for (int j = 0; j < kMaxBones; j++) {
+                    weightsPtr[j] = description.weights[j];
+                    sum += weightsPtr[j];
+                }
+                if (sum > 0) {
+                    for (int j = 0; j < kMaxBones; j++) {
+                        weightsPtr[j] /= sum;
+                    }
+                }
+                else {
+                    weightsPtr[0] = 1;
+                }
+                groups[kBdef4Group].append(i);
+                break;
+            }
+            case IVertex::kBdef1:
+            case IVertex::kMaxType:
+            default:
+                weightsPtr[0] = 1;
+                groups[kBdef1Group].append(i);
+                break;
+            }
+        }
+        m_order.clear();
+        m_order.reserve(nvertices);
+        for (int i = 0; i < kMaxGroupType; i++) {
+            const Array<int> &group = groups[i];
+            const int nitems = group.count();
+            m_offsets[i] = m_order.count();
+            for (int j = 0; j < nitems; j++) {
+                m_order.append(group[j]);
+            }
+        }
+        m_offsets[kMaxGroupType] = m_order.count();
+        const Array<int> &sdefGroup = groups[kSdefGroup];
+        const int nsdefs = sdefGroup.count();
+        m_sdefs.resize(nsdefs * kSdefSize);
+        for (int i = 0; i < nsdefs; i++) {
+            const Description &description = descriptions[sdefGroup[i]];
+            const Vector3 &sdefC = description.sdefC;
+            Vector3 sdefCR0, sdefCR1;
+            ModelHelper::getSdefCenters(sdefC, description.sdefR0, description.sdefR1, description.weights[0], sdefCR0, sdefCR1);
+            Scalar *sdefPtr = &m_sdefs[i * kSdefSize];
+            sdefPtr[0] = sdefC.x();
+            sdefPtr[1] = sdefC.y();
+            sdefPtr[2] = sdefC.z();
+            sdefPtr[3] = 0;
+            sdefPtr[4] = sdefCR0.x();
+            sdefPtr[5] = sdefCR0.y();
+            sdefPtr[6] = sdefCR0.z();
+            sdefPtr[7] = 1;
+            sdefPtr[8] = sdefCR1.x();
+            sdefPtr[9] = sdefCR1.y();
+            sdefPtr[10] = sdefCR1.z();
+            sdefPtr[11] = 1;
+        }
+        m_materialEdgeSizes.resize(nmaterials + 1);
+        m_nvertices = nvertices;
+        m_nbones = nbones;
+        m_nmaterials = nmaterials;
+        m_enabled = true;
+        m_dirty = false;
+    }
+    /**
+     * Attaches vertices to the store to let them read and write morph states
+     * from the store.
+     */
+    template<typename TVertex>
+    void attach(const Array<TVertex *> &vertices) {
+        const int nvertices = vertices.count();
+        for (int i = 0; i < nvertices; i++) {
+            vertices[i]->setVertexStoreRef(this);
+        }
+    }
+    /**
+     * Detaches vertices from the store and releases all arrays.
+     *
+     * Morph states are written back to the vertices before detaching.
+     */
+    template<typename TVertex>
+    void release(const Array<TVertex *> &vertices) {
+        const int nvertices = vertices.count();
+        for (int i = 0; i < nvertices; i++) {
+            vertices[i]->setVertexStoreRef(0);
+        }
+        clear();
+        m_enabled = false;
+    }
+    void clear() {
+        m_positions.clear();
+        m_normals.clear();
+        m_weights.clear();
+        m_boneIndices.clear();
+        m_edgeSizes.clear();
+        m_materialIndices.clear();
+        m_deltas.clear();
+        m_uvs.clear();
+        m_order.clear();
+        m_sdefs.clear();
+        m_materialEdgeSizes.clear();
+        zerofill(m_offsets, sizeof(m_offsets));
+        m_nvertices = 0;
+        m_nbones = 0;
+        m_nmaterials = 0;
+        m_dirty = true;
+    }
+    void invalidate() {
+        m_dirty = true;
+    }
+    bool isDirty() const {
+        return m_dirty;
+    }
+    bool isEnabled() const {
+        return m_enabled;
+    }
+    void setEnable(bool value) {
+        m_enabled = value;
+    }
+    bool contains(int index) const {
+        return checkBound(index, 0, m_nvertices);
+    }
+    int count() const {
+        return m_nvertices;
+    }
+
+    void setOrigin(int index, const Vector3 &value) {
+        Scalar *v = &m_positions[index * 4];
+        v[0] = value.x();
+        v[1] = value.y();
+        v[2] = value.z();
+    }
+
+    void resetMorphs() {
+        if (m_nvertices > 0) {
+            zerofill(&m_deltas[0], sizeof(Scalar) * m_deltas.count());
+            zerofill(&m_uvs[0], sizeof(Scalar) * m_uvs.count());
+        }
+    }
+    void resetMorph(int index) {
+        zerofill(&m_deltas[index * 4], sizeof(Scalar) * 4);
+        zerofill(&m_uvs[index * kMaxUVs * 4], sizeof(Scalar) * kMaxUVs * 4);
+    }
+    Vector3 delta(int index) const {
+        const Scalar *v = &m_deltas[index * 4];
+        return Vector3(v[0], v[1], v[2]);
+    }
+    void setDelta(int index, const Vector3 &value) {
+        Scalar *v = &m_deltas[index * 4];
+        v[0] = value.x();
+        v[1] = value.y();
+        v[2] = value.z();
+        v[3] = 0;
+    }
+    void addDelta(int index, const Vector3 &value, const Scalar &weight) {
+        Scalar *v = &m_deltas[index * 4];
+        v[0] += value.x() * weight;
+        v[1] += value.y() * weight;
+        v[2] += value.z() * weight;
+    }
+    Vector4 uv(int index, int offset) const {
+        const Scalar *v = &m_uvs[(index * kMaxUVs + offset) * 4];
+        return Vector4(v[0], v[1], v[2], v[3]);
+    }
+    void setUV(int index, int offset, const Vector4 &value) {
+        Scalar *v = &m_uvs[(index * kMaxUVs + offset) * 4];
+        v[0] = value.x();
+        v[1] = value.y();
+        v[2] = value.z();
+        v[3] = value.w();
+    }
+    void addUV(int index, int offset, const Vector4 &value, const Scalar &weight) {
+        Scalar *v = &m_uvs[(index * kMaxUVs + offset) * 4];
+        v[0] += value.x() * weight;
+        v[1] += value.y() * weight;
+        v[2] += value.z() * weight;
+        v[3] += value.w() * weight;
+    }
+    const Scalar *deltaPtr(int index) const {
+        return &m_deltas[index * 4];
+    }
+    const Scalar *uvPtr(int index) const {
+        return &m_uvs[index * kMaxUVs * 4];
+    }
+
+    template<typename TMaterial>
+    void updateMaterialEdgeSizes(const Array<TMaterial *> &materials, const IVertex::EdgeSizePrecision &edgeScaleFactor) {
+        const int nmaterials = btMin(materials.count(), m_nmaterials);
+        for (int i = 0; i < nmaterials; i++) {
+            const TMaterial *material = materials[i];
+            m_materialEdgeSizes[i] = Scalar(material->edgeSize() * edgeScaleFactor);
+        }
+        /* the last one is for vertices without material (edge size of null material is 1) */
+        m_materialEdgeSizes[m_nmaterials] = Scalar(edgeScaleFactor);
+    }
+
+    /**
+     * Performs skinning of vertices in [begin, end) of the skinning order
+     * and writes them to the buffer. aabbMin and aabbMax are expanded by the
+     * skinned positions.
+     */
+    template<typename TUnit>
+    void performSkinning(const BonePalette &palette, int begin, int end, TUnit *bufferPtr, Vector3 &aabbMin, Vector3 &aabbMax) const {
+        for (int i = 0; i < kMaxGroupType; i++) {
+            const int from = btMax(begin, m_offsets[i]), to = btMin(end, m_offsets[i + 1]);
+            if (from >= to) {
+                continue;
+            }
+            switch (i) {
+            case kBdef1Group:
+                performSkinningGroup<1>(palette, from, to, bufferPtr, aabbMin, aabbMax);
+                break;
+            case kBdef2Group:
+                performSkinningGroup<2>(palette, from, to, bufferPtr, aabbMin, aabbMax);
+                break;
+            case kBdef4Group:
+                performSkinningGroup<4>(palette, from, to, bufferPtr, aabbMin, aabbMax);
+                break;
+            case kSdefGroup:
+                performSkinningSdef(palette, from, to, bufferPtr, aabbMin, aabbMax);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+private:
+    static const int kSdefSize = 12;
+
+    template<int N, typename TUnit>
+    void performSkinningGroup(const BonePalette &palette, int from, int to, TUnit *bufferPtr, Vector3 &aabbMin, Vector3 &aabbMax) const {
+#ifdef VPVL2_VERTEXSTORE_ENABLE_SSE
+        const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        __m128 minValue = _mm_loadu_ps(static_cast<const Scalar *>(aabbMin));
+        __m128 maxValue = _mm_loadu_ps(static_cast<const Scalar *>(aabbMax));
+        for (int i = from; i < to; i++) {
+            const int index = m_order[i];
+            const int *boneIndicesPtr = &m_boneIndices[index * kMaxBones];
+            const Scalar *weightsPtr = &m_weights[index * kMaxBones];
+            const Scalar *matrixPtr = palette.matrixAt(boneIndicesPtr[0]);
+            __m128 c0 = _mm_load_ps(matrixPtr),
+                    c1 = _mm_load_ps(matrixPtr + 4),
+                    c2 = _mm_load_ps(matrixPtr + 8),
+                    c3 = _mm_load_ps(matrixPtr + 12);
+            if (N > 1) {
+                const __m128 w = _mm_set1_ps(weightsPtr[0]);
+                c0 = _mm_mul_ps(c0, w);
+                c1 = _mm_mul_ps(c1, w);
+                c2 = _mm_mul_ps(c2, w);
+                c3 = _mm_mul_ps(c3, w);
+                for (int j = 1; j < N; j++) {
+                    const Scalar *m = palette.matrixAt(boneIndicesPtr[j]);
+                    const __m128 w = _mm_set1_ps(weightsPtr[j]);
+                    c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_load_ps(m), w));
+                    c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_load_ps(m + 4), w));
+                    c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_load_ps(m + 8), w));
+                    c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_load_ps(m + 12), w));
+                }
+            }
+            const __m128 p = _mm_add_ps(_mm_load_ps(&m_positions[index * 4]), _mm_load_ps(&m_deltas[index * 4]));
+            const __m128 n = _mm_load_ps(&m_normals[index * 4]);
+            __m128 position = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))),
+                                         _mm_mul_ps(c1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+            position = _mm_add_ps(position, _mm_mul_ps(c2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+            position = _mm_and_ps(_mm_add_ps(position, c3), mask);
+            __m128 normal = _mm_add_ps(_mm_mul_ps(c0, _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0))),
+                                       _mm_mul_ps(c1, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1))));
+            normal = _mm_and_ps(_mm_add_ps(normal, _mm_mul_ps(c2, _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2)))), mask);
+            writeUnit(index, position, normal, bufferPtr[index]);
+            minValue = _mm_min_ps(minValue, position);
+            maxValue = _mm_max_ps(maxValue, position);
+        }
+        _mm_storeu_ps(static_cast<Scalar *>(aabbMin), minValue);
+        _mm_storeu_ps(static_cast<Scalar *>(aabbMax), maxValue);
+#else
+        for (int i = from; i < to; i++) {
+            const int index = m_order[i];
+            const int *boneIndicesPtr = &m_boneIndices[index * kMaxBones];
+            const Scalar *weightsPtr = &m_weights[index * kMaxBones];
+            Scalar m[kMatrixSize];
+            const Scalar *matrixPtr = palette.matrixAt(boneIndicesPtr[0]);
+            for (int k = 0; k < kMatrixSize; k++) {
+                m[k] = N > 1 ? matrixPtr[k] * weightsPtr[0] : matrixPtr[k];
+            }
+            for (int j = 1; j < N; j++) {
+                const Scalar *m2 = palette.matrixAt(boneIndicesPtr[j]), &w = weightsPtr[j];
+                for (int k = 0; k < kMatrixSize; k++) {
+                    m[k] += m2[k] * w;
+                }
+            }
+            const Scalar *p = &m_positions[index * 4], *d = &m_deltas[index * 4], *n = &m_normals[index * 4];
+            const Scalar x = p[0] + d[0], y = p[1] + d[1], z = p[2] + d[2];
+            const Vector3 position(m[0] * x + m[4] * y + m[8]  * z + m[12],
+                                   m[1] * x + m[5] * y + m[9]  * z + m[13],
+                                   m[2] * x + m[6] * y + m[10] * z + m[14]);
+            const Vector3 normal(m[0] * n[0] + m[4] * n[1] + m[8]  * n[2],
+                                 m[1] * n[0] + m[5] * n[1] + m[9]  * n[2],
+                                 m[2] * n[0] + m[6] * n[1] + m[10] * n[2]);
+            writeUnit(index, position, normal, bufferPtr[index]);
+            aabbMin.setMin(position);
+            aabbMax.setMax(position);
+        }
+#endif /* VPVL2_VERTEXSTORE_ENABLE_SSE */
+    }
+    template<typename TUnit>
+    void performSkinningSdef(const BonePalette &palette, int from, int to, TUnit *bufferPtr, Vector3 &aabbMin, Vector3 &aabbMax) const {
+        const int offset = m_offsets[kSdefGroup];
+#ifdef VPVL2_VERTEXSTORE_ENABLE_SSE
+        const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        __m128 minValue = _mm_loadu_ps(static_cast<const Scalar *>(aabbMin));
+        __m128 maxValue = _mm_loadu_ps(static_cast<const Scalar *>(aabbMax));
+        for (int i = from; i < to; i++) {
+            const int index = m_order[i];
+            const int *boneIndicesPtr = &m_boneIndices[index * kMaxBones];
+            const Scalar *sdefPtr = &m_sdefs[(i - offset) * kSdefSize];
+            const Scalar &weight = m_weights[index * kMaxBones];
+            Scalar rotation[BonePalette::kRotationSize], m[kMatrixSize];
+            BonePalette::slerp(palette.rotationAt(boneIndicesPtr[1]), palette.rotationAt(boneIndicesPtr[0]), weight, rotation);
+            BonePalette::getRotationMatrix(rotation, m);
+            const __m128 r0 = _mm_loadu_ps(m), r1 = _mm_loadu_ps(m + 4), r2 = _mm_loadu_ps(m + 8);
+            const __m128 centerA = transformPoint(palette.matrixAt(boneIndicesPtr[0]), _mm_load_ps(sdefPtr + 4));
+            const __m128 centerB = transformPoint(palette.matrixAt(boneIndicesPtr[1]), _mm_load_ps(sdefPtr + 8));
+            const __m128 p = _mm_sub_ps(_mm_add_ps(_mm_load_ps(&m_positions[index * 4]), _mm_load_ps(&m_deltas[index * 4])),
+                                        _mm_load_ps(sdefPtr));
+            const __m128 n = _mm_load_ps(&m_normals[index * 4]);
+            __m128 position = _mm_add_ps(_mm_mul_ps(r0, _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0))),
+                                         _mm_mul_ps(r1, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))));
+            position = _mm_add_ps(position, _mm_mul_ps(r2, _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+            position = _mm_add_ps(position, _mm_mul_ps(centerA, _mm_set1_ps(weight)));
+            position = _mm_and_ps(_mm_add_ps(position, _mm_mul_ps(centerB, _mm_set1_ps(1 - weight))), mask);
+            __m128 normal = _mm_add_ps(_mm_mul_ps(r0, _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0))),
+                                       _mm_mul_ps(r1, _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1))));
+            normal = _mm_and_ps(_mm_add_ps(normal, _mm_mul_ps(r2, _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2)))), mask);
+            writeUnit(index, position, normal, bufferPtr[index]);
+            minValue = _mm_min_ps(minValue, position);
+            maxValue = _mm_max_ps(maxValue, position);
+        }
+        _mm_storeu_ps(static_cast<Scalar *>(aabbMin), minValue);
+        _mm_storeu_ps(static_cast<Scalar *>(aabbMax), maxValue);
+#else
+        for (int i = from; i < to; i++) {
+            const int index = m_order[i];
+            const int *boneIndicesPtr = &m_boneIndices[index * kMaxBones];
+            const Scalar *sdefPtr = &m_sdefs[(i - offset) * kSdefSize];
+            const Scalar *p = &m_positions[index * 4], *d = &m_deltas[index * 4], *n = &m_normals[index * 4];
+            const Vector3 sdefC(sdefPtr[0], sdefPtr[1], sdefPtr[2]),
+                    sdefCR0(sdefPtr[4], sdefPtr[5], sdefPtr[6]),
+                    sdefCR1(sdefPtr[8], sdefPtr[9], sdefPtr[10]);
+            Vector3 position, normal;
+            palette.transformSdef(boneIndicesPtr[0], boneIndicesPtr[1], m_weights[index * kMaxBones], sdefC, sdefCR0, sdefCR1,
+                                  Vector3(p[0] + d[0], p[1] + d[1], p[2] + d[2]), Vector3(n[0], n[1], n[2]), position, normal);
+            writeUnit(index, position, normal, bufferPtr[index]);
+            aabbMin.setMin(position);
+            aabbMax.setMax(position);
+        }
+#endif /* VPVL2_VERTEXSTORE_ENABLE_SSE */
+    }
+#ifdef VPVL2_VERTEXSTORE_ENABLE_SSE
+    static inline __m128 transformPoint(const Scalar *m, const __m128 &v) {
+        __m128 value = _mm_add_ps(_mm_mul_ps(_mm_load_ps(m), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0))),
+                                  _mm_mul_ps(_mm_load_ps(m + 4), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+        value = _mm_add_ps(value, _mm_mul_ps(_mm_load_ps(m + 8), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+        return _mm_add_ps(value, _mm_load_ps(m + 12));
+    }
+    template<typename TUnit>
+    inline void writeUnit(int index, const __m128 &position, const __m128 &normal, TUnit &unit) const {
+        const Scalar edgeSize = m_edgeSizes[index] * m_materialEdgeSizes[m_materialIndices[index]];
+        const __m128 edge = _mm_add_ps(position, _mm_mul_ps(normal, _mm_set1_ps(edgeSize)));
+        _mm_storeu_ps(static_cast<Scalar *>(unit.position), position);
+        _mm_storeu_ps(static_cast<Scalar *>(unit.normal), normal);
+        _mm_storeu_ps(static_cast<Scalar *>(unit.edge), edge);
+        unit.normal[3] = edgeSize;
+        unit.edge[3] = Scalar(index);
+        unit.updateMorph(*this, index);
+    }
+#else
+    template<typename TUnit>
+    inline void writeUnit(int index, const Vector3 &position, const Vector3 &normal, TUnit &unit) const {
+        const Scalar edgeSize = m_edgeSizes[index] * m_materialEdgeSizes[m_materialIndices[index]];
+        unit.position = position;
+        unit.normal = normal;
+        unit.edge = position + normal * edgeSize;
+        unit.normal[3] = edgeSize;
+        unit.edge[3] = Scalar(index);
+        unit.updateMorph(*this, index);
+    }
+#endif /* VPVL2_VERTEXSTORE_ENABLE_SSE */
+
+    Array<Scalar> m_positions;
+    Array<Scalar> m_normals;
+    Array<Scalar> m_weights;
+    Array<int> m_boneIndices;
+    Array<Scalar> m_edgeSizes;
+    Array<int> m_materialIndices;
+    Array<Scalar> m_deltas;
+    Array<Scalar> m_uvs;
+    Array<int> m_order;
+    Array<Scalar> m_sdefs;
+    Array<Scalar> m_materialEdgeSizes;
+    int m_offsets[kMaxGroupType + 1];
+    int m_nvertices;
+    int m_nbones;
+    int m_nmaterials;
+    bool m_enabled;
+    bool m_dirty;
+
+    VPVL2_DISABLE_COPY_AND_ASSIGN(VertexStore)
+};
+
+} /* namespace internal */
+} /* namespace vpvl2 */
+
+#endif
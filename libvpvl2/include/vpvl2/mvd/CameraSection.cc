@@ -264,13 +264,13 @@ size_t CameraSection::countKeyframes() const
 
 void CameraSection::addKeyframe(IKeyframe *keyframe)
 {
-    m_context->keyframes.append(keyframe);
+    internal::MotionHelper::insertKeyframe(keyframe, m_context->keyframes);
     setDuration(keyframe);
 }
 
 void CameraSection::deleteKeyframe(IKeyframe *&keyframe)
 {
-    m_context->keyframes.remove(keyframe);
+    internal::MotionHelper::removeKeyframe(keyframe, m_context->keyframes);
     delete keyframe;
     keyframe = 0;
 }
@@ -308,12 +308,9 @@ ICameraKeyframe *CameraSection::findKeyframe(const IKeyframe::TimeIndex &timeInd
                                              const IKeyframe::LayerIndex &layerIndex) const
 {
     const PrivateContext::KeyframeCollection &keyframes = m_context->keyframes;
-    const int nkeyframes = keyframes.count();
-    for (int i = 0; i < nkeyframes; i++) {
-        CameraKeyframe *keyframe = reinterpret_cast<CameraKeyframe *>(keyframes[i]);
-        if (keyframe->timeIndex() == timeIndex && keyframe->layerIndex() == layerIndex) {
-            return keyframe;
-        }
+    const int index = internal::MotionHelper::findKeyframeIndex(timeIndex, layerIndex, keyframes);
+    if (index != -1) {
+        return reinterpret_cast<CameraKeyframe *>(keyframes[index]);
     }
     return 0;
 }
@@ -180,13 +180,13 @@ size_t LightSection::countKeyframes() const
 
 void LightSection::addKeyframe(IKeyframe *keyframe)
 {
-    m_context->keyframes.append(keyframe);
+    internal::MotionHelper::insertKeyframe(keyframe, m_context->keyframes);
     setDuration(keyframe);
 }
 
 void LightSection::deleteKeyframe(IKeyframe *&keyframe)
 {
-    m_context->keyframes.remove(keyframe);
+    internal::MotionHelper::removeKeyframe(keyframe, m_context->keyframes);
     delete keyframe;
     keyframe = 0;
 }
@@ -223,12 +223,9 @@ IKeyframe::LayerIndex LightSection::countLayers() const
 ILightKeyframe *LightSection::findKeyframe(const IKeyframe::TimeIndex &timeIndex,
                                            const IKeyframe::LayerIndex &layerIndex) const
 {
-    const int nkeyframes = m_context->keyframes.count();
-    for (int i = 0; i < nkeyframes; i++) {
-        LightKeyframe *keyframe = reinterpret_cast<LightKeyframe *>(m_context->keyframes[i]);
-        if (keyframe->timeIndex() == timeIndex && keyframe->layerIndex() == layerIndex) {
-            return keyframe;
-        }
+    const int index = internal::MotionHelper::findKeyframeIndex(timeIndex, layerIndex, m_context->keyframes);
+    if (index != -1) {
+        return reinterpret_cast<LightKeyframe *>(m_context->keyframes[index]);
     }
     return 0;
 }
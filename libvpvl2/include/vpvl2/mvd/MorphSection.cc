@@ -289,14 +289,14 @@ void MorphSection::addKeyframe(IKeyframe *keyframe)
     MorphAnimationTrack *const *track = m_context->name2tracks.find(key), *trackPtr = 0;
     if (track) {
         trackPtr = *track;
-        trackPtr->keyframes.append(keyframe);
+        internal::MotionHelper::insertKeyframe(keyframe, trackPtr->keyframes);
         BaseSection::setDuration(keyframe);
         m_context->allKeyframeRefs.append(keyframe);
     }
     else if (m_context->modelRef) {
         trackPtr = m_context->name2tracks.insert(key, new MorphAnimationTrack());
         trackPtr->morphRef = m_context->modelRef->findMorphRef(keyframe->name());
-        trackPtr->keyframes.append(keyframe);
+        internal::MotionHelper::insertKeyframe(keyframe, trackPtr->keyframes);
         BaseSection::setDuration(keyframe);
         m_context->allKeyframeRefs.append(keyframe);
         m_context->track2names.insert(trackPtr, key);
@@ -308,7 +308,7 @@ void MorphSection::deleteKeyframe(IKeyframe *&keyframe)
     int key = m_nameListSectionRef->key(keyframe->name());
     if (MorphAnimationTrack *const *track = m_context->name2tracks.find(key)) {
         MorphAnimationTrack *trackPtr = *track;
-        trackPtr->keyframes.remove(keyframe);
+        internal::MotionHelper::removeKeyframe(keyframe, trackPtr->keyframes);
         m_context->allKeyframeRefs.remove(keyframe);
         if (trackPtr->keyframes.count() == 0) {
             m_context->name2tracks.remove(key);
@@ -356,12 +356,9 @@ IMorphKeyframe *MorphSection::findKeyframe(const IKeyframe::TimeIndex &timeIndex
     MorphAnimationTrack *const *track = m_context->name2tracks.find(m_nameListSectionRef->key(name));
     if (track) {
         const MorphAnimationTrack::KeyframeCollection &keyframes = (*track)->keyframes;
-        const int nkeyframes = keyframes.count();
-        for (int i = 0; i < nkeyframes; i++) {
-            MorphKeyframe *keyframe = reinterpret_cast<MorphKeyframe *>(keyframes[i]);
-            if (keyframe->timeIndex() == timeIndex && keyframe->layerIndex() == layerIndex) {
-                return keyframe;
-            }
+        const int index = internal::MotionHelper::findKeyframeIndex(timeIndex, layerIndex, keyframes);
+        if (index != -1) {
+            return reinterpret_cast<MorphKeyframe *>(keyframes[index]);
         }
     }
     return 0;
@@ -43,7 +43,9 @@
 #include "vpvl2/pmd/Model.h"
 #include "vpvl2/pmd/Morph.h"
 #include "vpvl2/pmd/Vertex.h"
+#include "vpvl2/internal/BonePalette.h"
 #include "vpvl2/internal/ParallelProcessors.h"
+#include "vpvl2/internal/VertexStore.h"
 
 #include <BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
 #include <BulletDynamics/Dynamics/btRigidBody.h>
@@ -100,6 +102,9 @@ struct DefaultStaticVertexBuffer : public IModel::StaticVertexBuffer {
         case kUVA3Stride:
         case kUVA4Stride:
         case kVertexIndexStride:
+        case kSdefCStride:
+        case kSdefR0Stride:
+        case kSdefR1Stride:
         case kIndexStride:
         default:
             return 0;
@@ -108,6 +113,9 @@ struct DefaultStaticVertexBuffer : public IModel::StaticVertexBuffer {
     size_t strideSize() const {
         return sizeof(Unit);
     }
+    ComponentType componentType(StrideType /* type */) const {
+        return kFloatComponent;
+    }
     void update(void *address) const {
         Unit *unitPtr = static_cast<Unit *>(address);
         const Array<IVertex *> &vertices = modelRef->vertices();
@@ -134,7 +142,7 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
             edge[3] = Scalar(index);
             uva0.setValue(0, 0, 0, 1);
         }
-        void update(const IVertex *vertex, const IVertex::EdgeSizePrecision &materialEdgeSize, int index, Vector3 &p) {
+        void update(const IVertex *vertex, const internal::BonePalette * /* palette */, const IVertex::EdgeSizePrecision &materialEdgeSize, int index, Vector3 &p) {
             Vector3 n;
             const IVertex::EdgeSizePrecision &edgeSize = vertex->edgeSize() * materialEdgeSize;
             vertex->performSkinning(p, n);
@@ -145,6 +153,10 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
             edge[3] = Scalar(index);
             uva0.setValue(0, 0, 0, 1);
         }
+        void updateMorph(const internal::VertexStore & /* store */, int /* index */) {
+            delta.setZero();
+            uva0.setValue(0, 0, 0, 1);
+        }
         Vector3 position;
         Vector3 normal;
         Vector3 delta;
@@ -153,9 +165,14 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     };
     static const Unit kIdent;
 
-    DefaultDynamicVertexBuffer(const Model *model, const IModel::IndexBuffer *indexBuffer)
+    DefaultDynamicVertexBuffer(const Model *model,
+                               const IModel::IndexBuffer *indexBuffer,
+                               const internal::BonePalette *palette,
+                               internal::VertexStore *store)
         : modelRef(model),
           indexBufferRef(indexBuffer),
+          paletteRef(palette),
+          storeRef(store),
           enableSkinning(true),
           enableParallelUpdate(false)
     {
@@ -163,6 +180,8 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     ~DefaultDynamicVertexBuffer() {
         modelRef = 0;
         indexBufferRef = 0;
+        paletteRef = 0;
+        storeRef = 0;
         enableSkinning = false;
         enableParallelUpdate = false;
     }
@@ -194,6 +213,9 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
         case kBoneIndexStride:
         case kBoneWeightStride:
         case kTextureCoordStride:
+        case kSdefCStride:
+        case kSdefR0Stride:
+        case kSdefR1Stride:
         case kIndexStride:
         default:
             return 0;
@@ -205,8 +227,15 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     void update(void *address, const Vector3 &cameraPosition, Vector3 &aabbMin, Vector3 &aabbMax) const {
         const Array<IVertex *> &vertices = modelRef->vertices();
         Unit *bufferPtr = static_cast<Unit *>(address);
-        if (enableSkinning) {
-            internal::ParallelSkinningVertexProcessor<pmd::Model, IVertex, Unit> processor(modelRef, &vertices, cameraPosition, bufferPtr);
+        if (enableSkinning && storeRef->isEnabled() && !storeRef->isDirty()) {
+            storeRef->updateMaterialEdgeSizes(modelRef->materials(), modelRef->edgeScaleFactor(cameraPosition));
+            internal::VertexStore::SkinningProcessor<Unit> processor(storeRef, paletteRef, bufferPtr);
+            processor.execute(enableParallelUpdate);
+            aabbMin = processor.aabbMin();
+            aabbMax = processor.aabbMax();
+        }
+        else if (enableSkinning) {
+            internal::ParallelSkinningVertexProcessor<pmd::Model, IVertex, Unit> processor(modelRef, &vertices, 0, cameraPosition, bufferPtr);
             processor.execute(enableParallelUpdate);
             aabbMin = processor.aabbMin();
             aabbMax = processor.aabbMax();
@@ -222,12 +251,18 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     void setParallelUpdateEnable(bool value) {
         enableParallelUpdate = value;
     }
+    bool isDirty(const Vector3 & /* cameraPosition */) const {
+        /* changes of the model are not tracked */
+        return true;
+    }
     const void *ident() const {
         return &kIdent;
     }
 
     const Model *modelRef;
     const IModel::IndexBuffer *indexBufferRef;
+    const internal::BonePalette *paletteRef;
+    internal::VertexStore *storeRef;
     bool enableSkinning;
     bool enableParallelUpdate;
 };
@@ -344,13 +379,22 @@ struct DefaultMatrixBuffer : public IModel::MatrixBuffer {
             buffer.delta = vertex->delta();
         }
     }
-    const float *bytes(int materialIndex) const {
+    int countMeshes(int materialIndex) const {
+        return internal::checkBound(materialIndex, 0, materials.count()) ? 1 : 0;
+    }
+    int countIndices(int materialIndex, int meshIndex) const {
+        return meshIndex == 0 && internal::checkBound(materialIndex, 0, materials.count()) ? materials[materialIndex]->indexRange().count : 0;
+    }
+    const float *bytes(int materialIndex, int meshIndex) const {
         int nmatrices = meshes.matrices.count();
-        return internal::checkBound(materialIndex, 0, nmatrices) ? meshes.matrices[materialIndex] : 0;
+        return meshIndex == 0 && internal::checkBound(materialIndex, 0, nmatrices) ? meshes.matrices[materialIndex] : 0;
     }
-    size_t size(int materialIndex) const {
+    size_t size(int materialIndex, int meshIndex) const {
         int nbones = meshes.bones.size();
-        return internal::checkBound(materialIndex, 0, nbones) ? meshes.bones[materialIndex].size() : 0;
+        return meshIndex == 0 && internal::checkBound(materialIndex, 0, nbones) ? meshes.bones[materialIndex].size() : 0;
+    }
+    bool isDirty() const {
+        return true;
     }
 
     void initialize() {
@@ -416,6 +460,8 @@ Model::Model(IEncoding *encoding)
       m_parentSceneRef(0),
       m_parentModelRef(0),
       m_parentBoneRef(0),
+      m_bonePalette(0),
+      m_vertexStore(0),
       m_aabbMax(kZeroV3),
       m_aabbMin(kZeroV3),
       m_position(kZeroV3),
@@ -429,6 +475,8 @@ Model::Model(IEncoding *encoding)
 {
     m_model.setSoftwareSkinningEnable(false);
     m_edgeColor.setW(1);
+    m_bonePalette = new internal::BonePalette();
+    m_vertexStore = new internal::VertexStore();
 }
 
 Model::~Model()
@@ -438,6 +486,10 @@ Model::~Model()
     m_materials.releaseAll();
     m_morphs.releaseAll();
     m_vertices.releaseAll();
+    delete m_vertexStore;
+    m_vertexStore = 0;
+    delete m_bonePalette;
+    m_bonePalette = 0;
     m_createdBones.releaseAll();
     m_createdMaterials.releaseAll();
     m_createdMorphs.releaseAll();
@@ -554,6 +606,9 @@ void Model::performUpdate()
         bone->updateLocalTransform();
     }
 #endif
+    // snapshot of local transforms for skinning
+    m_bonePalette->update(m_bones);
+    updateVertexStore();
 }
 
 IBone *Model::findBoneRef(const IString *value) const
@@ -774,7 +829,7 @@ void Model::getDynamicVertexBuffer(DynamicVertexBuffer *&dynamicBuffer, const In
 {
     delete dynamicBuffer;
     if (indexBuffer && indexBuffer->ident() == &DefaultIndexBuffer::kIdent) {
-        dynamicBuffer = new DefaultDynamicVertexBuffer(this, indexBuffer);
+        dynamicBuffer = new DefaultDynamicVertexBuffer(this, indexBuffer, m_bonePalette, m_vertexStore);
     }
     else {
         dynamicBuffer = 0;
@@ -914,6 +969,7 @@ void Model::setIndices(const Array<int> &value)
 void Model::addBone(IBone *value)
 {
     internal::ModelHelper::addObject2<Bone>(this, value, m_bones);
+    m_vertexStore->invalidate();
 }
 
 void Model::addJoint(IJoint * /* value */)
@@ -928,6 +984,7 @@ void Model::addLabel(ILabel *value)
 void Model::addMaterial(IMaterial *value)
 {
     internal::ModelHelper::addObject2<Material>(this, value, m_materials);
+    m_vertexStore->invalidate();
 }
 
 void Model::addMorph(IMorph *value)
@@ -942,11 +999,13 @@ void Model::addRigidBody(IRigidBody * /* value */)
 void Model::addVertex(IVertex *value)
 {
     internal::ModelHelper::addObject2<Vertex>(this, value, m_vertices);
+    m_vertexStore->invalidate();
 }
 
 void Model::removeBone(IBone *value)
 {
     internal::ModelHelper::removeObject2<Bone>(this, value, m_bones);
+    m_vertexStore->invalidate();
 }
 
 void Model::removeJoint(IJoint * /* value */)
@@ -961,6 +1020,7 @@ void Model::removeLabel(ILabel *value)
 void Model::removeMaterial(IMaterial *value)
 {
     internal::ModelHelper::removeObject2<Material>(this, value, m_materials);
+    m_vertexStore->invalidate();
 }
 
 void Model::removeMorph(IMorph *value)
@@ -975,6 +1035,31 @@ void Model::removeRigidBody(IRigidBody * /* value */)
 void Model::removeVertex(IVertex *value)
 {
     internal::ModelHelper::removeObject2<Vertex>(this, value, m_vertices);
+    m_vertexStore->invalidate();
+}
+
+void Model::updateVertexStore()
+{
+    const int nvertices = m_vertices.count();
+    if (m_vertexStore->isDirty()) {
+        Array<internal::VertexStore::Description> descriptions;
+        if (!internal::VertexStore::describe(m_vertices, descriptions)) {
+            m_vertexStore->clear();
+            m_vertexStore->setEnable(false);
+            return;
+        }
+        m_vertexStore->build(descriptions, m_bones.count(), m_materials.count());
+        for (int i = 0; i < nvertices; i++) {
+            static_cast<Vertex *>(m_vertices[i])->setVertexStoreRef(m_vertexStore);
+        }
+    }
+    else {
+        /* faces (vertex morphs) of PMD move positions of vertices directly */
+        for (int i = 0; i < nvertices; i++) {
+            const Vertex *vertex = static_cast<const Vertex *>(m_vertices[i]);
+            m_vertexStore->setOrigin(i, vertex->reference()->position());
+        }
+    }
 }
 
 void Model::loadBones(Hash<HashPtr, Bone *> &bone2bone)
@@ -51,6 +51,12 @@ namespace vpvl2
 class IEncoding;
 class IString;
 
+namespace internal
+{
+class BonePalette;
+class VertexStore;
+}
+
 namespace pmd
 {
 
@@ -172,6 +178,7 @@ private:
     void loadMaterials();
     void loadMorphs();
     void loadVertices();
+    void updateVertexStore();
 
     mutable vpvl::PMDModel m_model;
     IEncoding *m_encodingRef;
@@ -193,6 +200,8 @@ private:
     PointerArray<vpvl::Vertex> m_createdVertices;
     Hash<HashString, IBone *> m_name2boneRefs;
     Hash<HashString, IMorph *> m_name2morphRefs;
+    internal::BonePalette *m_bonePalette;
+    internal::VertexStore *m_vertexStore;
     Vector3 m_aabbMax;
     Vector3 m_aabbMin;
     Vector3 m_position;
@@ -51,6 +51,11 @@ namespace vpvl2
 class IEncoding;
 class IString;
 
+namespace internal
+{
+class VertexStore;
+}
+
 namespace pmd
 {
 
@@ -88,9 +93,15 @@ public:
     void setBoneRef(int /* index */, IBone * /* value */) {}
     void setMaterialRef(IMaterial *value);
     void setIndex(int value);
+    void setVertexStoreRef(internal::VertexStore *value);
+
+    vpvl::Vertex *reference() const { return m_vertexRef; }
 
 private:
+    void invalidateStore();
+
     IModel *m_modelRef;
+    internal::VertexStore *m_storeRef;
     vpvl::Vertex *m_vertexRef;
     Array<IBone *> *m_bonesRef;
     IMaterial *m_materialRef;
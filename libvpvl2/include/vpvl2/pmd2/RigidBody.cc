@@ -150,7 +150,7 @@ void RigidBody::read(const uint8_t *data, const Model::DataInfo & /* info */, si
 {
     RigidBodyUnit unit;
     internal::getData(data, unit);
-    internal::setStringDirect(m_encodingRef->toString(unit.name, IString::kShiftJIS, kNameSize), m_name);
+    m_name.setValueDirect(m_encodingRef->toString(unit.name, IString::kShiftJIS, kNameSize));
     m_boneIndex = unit.boneID;
     m_collisionGroupID = btClamped(unit.collisionGroupID, uint8_t(0), uint8_t(15));
     m_collisionGroupMask = unit.collsionMask;
@@ -186,7 +186,7 @@ void RigidBody::write(uint8_t *&data, const Model::DataInfo & /* info */) const
     unit.linearDamping = m_linearDamping;
     unit.mass = m_mass;
     uint8_t *namePtr = unit.name;
-    internal::writeStringAsByteArray(m_name, IString::kShiftJIS, m_encodingRef, sizeof(unit.name), namePtr);
+    internal::writeStringAsByteArray(m_name.value(), IString::kShiftJIS, m_encodingRef, sizeof(unit.name), namePtr);
     internal::getPosition(m_position, unit.position);
     unit.restitution = m_restitution;
     internal::getPositionRaw(m_rotation, unit.rotation);
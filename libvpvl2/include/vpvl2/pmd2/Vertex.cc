@@ -36,6 +36,7 @@
 
 #include "vpvl2/vpvl2.h"
 #include "vpvl2/internal/ModelHelper.h"
+#include "vpvl2/internal/VertexStore.h"
 #include "vpvl2/pmd2/Bone.h"
 #include "vpvl2/pmd2/Vertex.h"
 
@@ -74,6 +75,7 @@ struct Vertex::PrivateContext {
           edgeSize(0),
           weight(0),
           materialRef(Factory::sharedNullMaterialRef()),
+          storeRef(0),
           index(-1)
     {
         for (int i = 0; i < kMaxBones; i++) {
@@ -91,10 +93,19 @@ struct Vertex::PrivateContext {
         texcoord.setZero();
         morphDelta.setZero();
         materialRef = 0;
+        storeRef = 0;
         edgeSize = 0;
         weight = 0;
         index = -1;
     }
+    bool hasStore() const {
+        return storeRef && storeRef->contains(index);
+    }
+    void invalidateStore() {
+        if (storeRef) {
+            storeRef->invalidate();
+        }
+    }
 
     Model *parentModelRef;
     Vector3 origin;
@@ -104,6 +115,7 @@ struct Vertex::PrivateContext {
     EdgeSizePrecision edgeSize;
     WeightPrecision weight;
     IMaterial *materialRef;
+    internal::VertexStore *storeRef;
     IBone *boneRefs[internal::kPMDVertexMaxBoneSize];
     int boneIndices[internal::kPMDVertexMaxBoneSize];
     int index;
@@ -220,7 +232,7 @@ void Vertex::performSkinning(Vector3 &position, Vector3 &normal) const
 {
     const Transform &transformA = m_context->boneRefs[0]->localTransform();
     const Transform &transformB = m_context->boneRefs[1]->localTransform();
-    const Vector3 &vertexPosition = m_context->origin + m_context->morphDelta;
+    const Vector3 &vertexPosition = m_context->origin + delta();
     const Vector3 &v1 = transformA * vertexPosition;
     const Vector3 &n1 = transformA.getBasis() * m_context->normal;
     const Vector3 &v2 = transformB * vertexPosition;
@@ -232,12 +244,20 @@ void Vertex::performSkinning(Vector3 &position, Vector3 &normal) const
 
 void Vertex::reset()
 {
+    if (m_context->hasStore()) {
+        m_context->storeRef->resetMorph(m_context->index);
+        return;
+    }
     m_context->morphDelta.setZero();
 }
 
 void Vertex::mergeMorph(const Vector3 &value, const IMorph::WeightPrecision &weight)
 {
     const Scalar &w = Scalar(weight);
+    if (m_context->hasStore()) {
+        m_context->storeRef->addDelta(m_context->index, value, w);
+        return;
+    }
     m_context->morphDelta += value * w;
 }
 
@@ -268,7 +288,7 @@ Vector4 Vertex::uv(int /* index */) const
 
 Vector3 Vertex::delta() const
 {
-    return m_context->morphDelta;
+    return m_context->hasStore() ? m_context->storeRef->delta(m_context->index) : m_context->morphDelta;
 }
 
 IVertex::Type Vertex::type() const
@@ -304,11 +324,13 @@ int Vertex::index() const
 void Vertex::setOrigin(const Vector3 &value)
 {
     m_context->origin = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setNormal(const Vector3 &value)
 {
     m_context->normal = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setTextureCoord(const Vector3 &value)
@@ -327,12 +349,14 @@ void Vertex::setType(Type /* value */)
 void Vertex::setEdgeSize(const EdgeSizePrecision &value)
 {
     m_context->edgeSize = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setWeight(int index, const WeightPrecision &weight)
 {
     if (index == 0) {
         m_context->weight = weight;
+        m_context->invalidateStore();
     }
 }
 
@@ -340,18 +364,41 @@ void Vertex::setBoneRef(int index, IBone *value)
 {
     if (internal::checkBound(index, 0, kMaxBones)) {
         m_context->boneRefs[index] = value ? value : Factory::sharedNullBoneRef();
+        m_context->invalidateStore();
     }
 }
 
 void Vertex::setMaterialRef(IMaterial *value)
 {
     m_context->materialRef = value ? value : Factory::sharedNullMaterialRef();
+    m_context->invalidateStore();
 }
 
 void Vertex::setIndex(int value)
 {
+    if (m_context->storeRef && m_context->index != value) {
+        internal::VertexStore *storeRef = m_context->storeRef;
+        setVertexStoreRef(0);
+        storeRef->invalidate();
+    }
     m_context->index = value;
 }
 
+void Vertex::setVertexStoreRef(internal::VertexStore *value)
+{
+    if (m_context->storeRef == value) {
+        return;
+    }
+    const int index = m_context->index;
+    /* write back the morph delta of the store to the vertex */
+    if (m_context->hasStore()) {
+        m_context->morphDelta = m_context->storeRef->delta(index);
+    }
+    m_context->storeRef = value;
+    if (m_context->hasStore()) {
+        value->setDelta(index, m_context->morphDelta);
+    }
+}
+
 } /* namespace pmd2 */
 } /* namespace vpvl2 */
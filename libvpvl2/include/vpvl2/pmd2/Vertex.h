@@ -48,6 +48,11 @@ namespace vpvl2
 class IEncoding;
 class IString;
 
+namespace internal
+{
+class VertexStore;
+}
+
 namespace pmd2
 {
 
@@ -83,6 +88,7 @@ public:
     void setBoneRef(int index, IBone *value);
     void setMaterialRef(IMaterial *value);
     void setIndex(int value);
+    void setVertexStoreRef(internal::VertexStore *value);
 
     static bool preparse(uint8_t *&ptr, size_t &rest, Model::DataInfo &info);
     static bool loadVertices(const Array<Vertex *> &vertices, const Array<Bone *> &bones);
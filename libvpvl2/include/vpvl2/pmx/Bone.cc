@@ -35,6 +35,7 @@
 /* ----------------------------------------------------------------- */
 
 #include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/DeferredString.h"
 #include "vpvl2/internal/util.h"
 
 #include "vpvl2/pmx/Bone.h"
@@ -60,6 +61,8 @@ using namespace vpvl2;
 using namespace vpvl2::pmx;
 
 struct IKConstraint {
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     Bone *jointBoneRef;
     int jointBoneIndex;
     bool hasAngleLimit;
@@ -86,14 +89,14 @@ namespace pmx
 {
 
 struct Bone::PrivateContext {
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     PrivateContext(IModel *modelRef)
         : modelRef(modelRef),
           parentBoneRef(0),
           effectorBoneRef(0),
           parentInherentBoneRef(0),
           destinationOriginBoneRef(0),
-          name(0),
-          englishName(0),
           localRotation(Quaternion::getIdentity()),
           localInherentRotation(Quaternion::getIdentity()),
           localMorphRotation(Quaternion::getIdentity()),
@@ -120,15 +123,15 @@ struct Bone::PrivateContext {
           parentInherentBoneIndex(-1),
           globalID(0),
           flags(0),
-          enableInverseKinematics(true)
+          enableInverseKinematics(true),
+          dirty(true),
+          orderDirty(false)
     {
     }
     ~PrivateContext() {
         constraints.releaseAll();
-        delete name;
-        name = 0;
-        delete englishName;
-        englishName = 0;
+        name.release();
+        englishName.release();
         modelRef = 0;
         parentBoneRef = 0;
         effectorBoneRef = 0;
@@ -244,8 +247,8 @@ struct Bone::PrivateContext {
     Bone *effectorBoneRef;
     Bone *parentInherentBoneRef;
     IBone *destinationOriginBoneRef;
-    IString *name;
-    IString *englishName;
+    internal::DeferredString name;
+    internal::DeferredString englishName;
     Quaternion localRotation;
     Quaternion localInherentRotation;
     Quaternion localMorphRotation;
@@ -273,6 +276,8 @@ struct Bone::PrivateContext {
     int globalID;
     uint16_t flags;
     bool enableInverseKinematics;
+    bool dirty;
+    bool orderDirty;
 };
 
 Bone::Bone(IModel *modelRef)
@@ -451,7 +456,11 @@ bool Bone::loadBones(const Array<Bone *> &bones)
     return true;
 }
 
-void Bone::sortBones(const Array<Bone *> &bones, Array<Bone *> &bpsBones, Array<Bone *> &apsBones)
+bool Bone::sortBones(const Array<Bone *> &bones,
+                     Array<Bone *> &bpsBones,
+                     Array<int> &bpsLevelOffsets,
+                     Array<Bone *> &apsBones,
+                     Array<int> &apsLevelOffsets)
 {
     Array<Bone *> orderedBonesRefs;
     orderedBonesRefs.copy(bones);
@@ -468,6 +477,130 @@ void Bone::sortBones(const Array<Bone *> &bones, Array<Bone *> &bpsBones, Array<
             bpsBones.append(bone);
         }
     }
+    /* bones read before physics and written after physics are also referred forward */
+    Array<bool> readBones;
+    readBones.resize(nbones);
+    for (int i = 0; i < nbones; i++) {
+        readBones[i] = false;
+    }
+    const bool hasForwardRefs = sortBonesByLevel(bones, bpsBones, bpsLevelOffsets, readBones);
+    return sortBonesByLevel(bones, apsBones, apsLevelOffsets, readBones) || hasForwardRefs;
+}
+
+bool Bone::sortBonesByLevel(const Array<Bone *> &bones,
+                            Array<Bone *> &orderedBones,
+                            Array<int> &levelOffsets,
+                            Array<bool> &readBones)
+{
+    /*
+     * Assigns each bone (performTransform and solveInverseKinematics as one task) to the
+     * earliest level that keeps the result of sequential evaluation in orderedBones.
+     * A task reads its parent and its inherent parent and writes itself, and a task of
+     * the IK bone also reads/writes all of its joint bones and its effector bone.
+     * Tasks in the same level never touch the same bone, so they can run in parallel.
+     */
+    const int nbones = bones.count(), nOrderedBones = orderedBones.count();
+    Array<int> lastWrittenLevels, lastReadLevels, levels;
+    Array<Bone *> readBoneRefs, writtenBoneRefs;
+    lastWrittenLevels.resize(nbones);
+    lastReadLevels.resize(nbones);
+    levels.resize(nOrderedBones);
+    for (int i = 0; i < nbones; i++) {
+        lastWrittenLevels[i] = lastReadLevels[i] = -1;
+    }
+    bool isSequential = false, hasForwardRefs = false;
+    int nlevels = 0;
+    for (int i = 0; i < nOrderedBones && !isSequential; i++) {
+        Bone *bone = orderedBones[i];
+        const PrivateContext *context = bone->m_context;
+        readBoneRefs.clear();
+        writtenBoneRefs.clear();
+        writtenBoneRefs.append(bone);
+        readBoneRefs.append(context->parentBoneRef);
+        readBoneRefs.append(context->parentInherentBoneRef);
+        if (bone->hasInverseKinematics() && context->effectorBoneRef) {
+            const Array<IKConstraint *> &constraints = context->constraints;
+            const int nconstraints = constraints.count();
+            for (int j = 0; j < nconstraints; j++) {
+                Bone *jointBoneRef = constraints[j]->jointBoneRef;
+                writtenBoneRefs.append(jointBoneRef);
+                readBoneRefs.append(jointBoneRef ? jointBoneRef->m_context->parentBoneRef : 0);
+            }
+            Bone *effectorBoneRef = context->effectorBoneRef;
+            writtenBoneRefs.append(effectorBoneRef);
+            readBoneRefs.append(effectorBoneRef->m_context->parentBoneRef);
+        }
+        int level = 0;
+        const int nreads = readBoneRefs.count(), nwrites = writtenBoneRefs.count();
+        for (int j = 0; j < nreads; j++) {
+            if (const Bone *boneRef = readBoneRefs[j]) {
+                int index = boneRef->index();
+                if (!internal::checkBound(index, 0, nbones) || bones[index] != boneRef) {
+                    isSequential = true;
+                    break;
+                }
+                level = btMax(level, lastWrittenLevels[index] + 1);
+            }
+        }
+        for (int j = 0; j < nwrites && !isSequential; j++) {
+            if (const Bone *boneRef = writtenBoneRefs[j]) {
+                int index = boneRef->index();
+                if (!internal::checkBound(index, 0, nbones) || bones[index] != boneRef) {
+                    isSequential = true;
+                    break;
+                }
+                level = btMax(level, btMax(lastWrittenLevels[index], lastReadLevels[index]) + 1);
+            }
+        }
+        if (isSequential) {
+            break;
+        }
+        for (int j = 0; j < nwrites; j++) {
+            if (const Bone *boneRef = writtenBoneRefs[j]) {
+                /* the bone is already read by the preceding bone */
+                hasForwardRefs |= readBones[boneRef->index()];
+                lastWrittenLevels[boneRef->index()] = level;
+            }
+        }
+        for (int j = 0; j < nreads; j++) {
+            if (const Bone *boneRef = readBoneRefs[j]) {
+                int &lastReadLevel = lastReadLevels[boneRef->index()];
+                lastReadLevel = btMax(lastReadLevel, level);
+                readBones[boneRef->index()] = true;
+            }
+        }
+        levels[i] = level;
+        nlevels = btMax(nlevels, level + 1);
+    }
+    if (isSequential) {
+        /* a bone not owned by the model is referred, fallback to evaluate one by one */
+        VPVL2_LOG(WARNING, "Bone levels are not resolved, bones are evaluated sequentially");
+        for (int i = 0; i < nOrderedBones; i++) {
+            levels[i] = i;
+        }
+        nlevels = nOrderedBones;
+        hasForwardRefs = true;
+    }
+    /* stable counting sort by level keeps the sequential order in each level */
+    levelOffsets.resize(nlevels + 1);
+    for (int i = 0; i <= nlevels; i++) {
+        levelOffsets[i] = 0;
+    }
+    for (int i = 0; i < nOrderedBones; i++) {
+        levelOffsets[levels[i] + 1]++;
+    }
+    for (int i = 0; i < nlevels; i++) {
+        levelOffsets[i + 1] += levelOffsets[i];
+    }
+    Array<int> positions;
+    Array<Bone *> sortedBones;
+    positions.copy(levelOffsets);
+    sortedBones.resize(nOrderedBones);
+    for (int i = 0; i < nOrderedBones; i++) {
+        sortedBones[positions[levels[i]]++] = orderedBones[i];
+    }
+    orderedBones.copy(sortedBones);
+    return hasForwardRefs;
 }
 
 void Bone::writeBones(const Array<Bone *> &bones, const Model::DataInfo &info, uint8_t *&data)
@@ -499,11 +632,11 @@ void Bone::read(const uint8_t *data, const Model::DataInfo &info, size_t &size)
     int32_t nNameSize;
     IEncoding *encoding = info.encoding;
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->name);
-    VPVL2_VLOG(3, "PMXBone: name=" << internal::cstr(m_context->name, "(null)"));
+    m_context->name.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXBone: name=" << internal::cstr(m_context->name.value(), "(null)"));
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->englishName);
-    VPVL2_VLOG(3, "PMXBone: englishName=" << internal::cstr(m_context->englishName, "(null)"));
+    m_context->englishName.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXBone: englishName=" << internal::cstr(m_context->englishName.value(), "(null)"));
     const BoneUnit &unit = *reinterpret_cast<const BoneUnit *>(ptr);
     internal::setPosition(unit.vector3, m_context->origin);
     VPVL2_VLOG(3, "PMXBone: origin=" << m_context->origin.x() << "," << m_context->origin.y() << "," << m_context->origin.z());
@@ -599,8 +732,8 @@ void Bone::write(uint8_t *&data, const Model::DataInfo &info) const
 {
     size_t boneIndexSize = info.boneIndexSize;
     BoneUnit bu;
-    internal::writeString(m_context->name, info.codec, data);
-    internal::writeString(m_context->englishName, info.codec, data);
+    internal::writeString(m_context->name.value(), info.codec, data);
+    internal::writeString(m_context->englishName.value(), info.codec, data);
     internal::getPosition(m_context->origin, &bu.vector3[0]);
     internal::writeBytes(&bu, sizeof(bu), data);
     internal::writeSignedIndex(m_context->parentBoneIndex, boneIndexSize, data);
@@ -655,8 +788,8 @@ void Bone::write(uint8_t *&data, const Model::DataInfo &info) const
 size_t Bone::estimateSize(const Model::DataInfo &info) const
 {
     size_t size = 0, boneIndexSize = info.boneIndexSize;
-    size += internal::estimateSize(m_context->name, info.codec);
-    size += internal::estimateSize(m_context->englishName, info.codec);
+    size += internal::estimateSize(m_context->name.value(), info.codec);
+    size += internal::estimateSize(m_context->englishName.value(), info.codec);
     size += sizeof(BoneUnit);
     size += boneIndexSize;
     size += sizeof(m_context->layerIndex);
@@ -918,12 +1051,18 @@ void Bone::getEffectorBones(Array<IBone *> &value) const
 
 void Bone::setLocalTranslation(const Vector3 &value)
 {
-    m_context->localTranslation = value;
+    if (m_context->localTranslation != value) {
+        m_context->localTranslation = value;
+        m_context->dirty = true;
+    }
 }
 
 void Bone::setLocalRotation(const Quaternion &value)
 {
-    m_context->localRotation = value;
+    if (m_context->localRotation != value) {
+        m_context->localRotation = value;
+        m_context->dirty = true;
+    }
 }
 
 IModel *Bone::parentModelRef() const
@@ -953,12 +1092,12 @@ IBone *Bone::destinationOriginBoneRef() const
 
 const IString *Bone::name() const
 {
-    return m_context->name;
+    return m_context->name.value();
 }
 
 const IString *Bone::englishName() const
 {
-    return m_context->englishName;
+    return m_context->englishName.value();
 }
 
 Quaternion Bone::localRotation() const
@@ -1105,6 +1244,16 @@ bool Bone::isInverseKinematicsEnabled() const
     return m_context->enableInverseKinematics;
 }
 
+bool Bone::isDirty() const
+{
+    return m_context->dirty;
+}
+
+bool Bone::isOrderDirty() const
+{
+    return m_context->orderDirty;
+}
+
 void Bone::setLocalTransform(const Transform &value)
 {
     m_context->localTransform = value;
@@ -1114,6 +1263,8 @@ void Bone::setParentBoneRef(Bone *value)
 {
     m_context->parentBoneRef = value;
     m_context->parentBoneIndex = value ? value->index() : -1;
+    m_context->orderDirty = true;
+    m_context->dirty = true;
 }
 
 void Bone::setParentInherentBoneRef(Bone *value, float weight)
@@ -1121,6 +1272,8 @@ void Bone::setParentInherentBoneRef(Bone *value, float weight)
     m_context->parentInherentBoneRef = value;
     m_context->parentInherentBoneIndex = value ? value->index() : -1;
     m_context->coefficient = weight;
+    m_context->orderDirty = true;
+    m_context->dirty = true;
 }
 
 void Bone::setEffectorBoneRef(Bone *effector, int numIteration, float angleLimit)
@@ -1129,6 +1282,8 @@ void Bone::setEffectorBoneRef(Bone *effector, int numIteration, float angleLimit
     m_context->effectorBoneIndex = effector ? effector->index() : -1;
     m_context->numIteration = numIteration;
     m_context->angleLimit = angleLimit;
+    m_context->orderDirty = true;
+    m_context->dirty = true;
 }
 
 void Bone::setDestinationOriginBoneRef(Bone *value)
@@ -1140,17 +1295,18 @@ void Bone::setDestinationOriginBoneRef(Bone *value)
 
 void Bone::setName(const IString *value)
 {
-    internal::setString(value, m_context->name);
+    m_context->name.setValue(value);
 }
 
 void Bone::setEnglishName(const IString *value)
 {
-    internal::setString(value, m_context->englishName);
+    m_context->englishName.setValue(value);
 }
 
 void Bone::setOrigin(const Vector3 &value)
 {
     m_context->origin = value;
+    m_context->dirty = true;
 }
 
 void Bone::setDestinationOrigin(const Vector3 &value)
@@ -1182,6 +1338,7 @@ void Bone::setIndex(int value)
 void Bone::setLayerIndex(int value)
 {
     m_context->layerIndex = value;
+    m_context->orderDirty = true;
 }
 
 void Bone::setExternalIndex(int value)
@@ -1212,16 +1369,20 @@ void Bone::setInteractive(bool value)
 void Bone::setIKEnable(bool value)
 {
     internal::toggleFlag(kHasInverseKinematics, value, m_context->flags);
+    m_context->orderDirty = true;
+    m_context->dirty = true;
 }
 
 void Bone::setInherentRotationEnable(bool value)
 {
     internal::toggleFlag(kHasInherentTranslation, value, m_context->flags);
+    m_context->dirty = true;
 }
 
 void Bone::setInherentTranslationEnable(bool value)
 {
     internal::toggleFlag(kHasInherentRotation, value, m_context->flags);
+    m_context->dirty = true;
 }
 
 void Bone::setAxisFixedEnable(bool value)
@@ -1237,6 +1398,8 @@ void Bone::setLocalAxesEnable(bool value)
 void Bone::setTransformAfterPhysicsEnable(bool value)
 {
     internal::toggleFlag(kTransformAfterPhysics, value, m_context->flags);
+    m_context->orderDirty = true;
+    m_context->dirty = true;
 }
 
 void Bone::setTransformedByExternalParentEnable(bool value)
@@ -1247,6 +1410,17 @@ void Bone::setTransformedByExternalParentEnable(bool value)
 void Bone::setInverseKinematicsEnable(bool value)
 {
     m_context->enableInverseKinematics = value;
+    m_context->dirty = true;
+}
+
+void Bone::setDirty(bool value)
+{
+    m_context->dirty = value;
+}
+
+void Bone::setOrderDirty(bool value)
+{
+    m_context->orderDirty = value;
 }
 
 } /* namespace pmx */
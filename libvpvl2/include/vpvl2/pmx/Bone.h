@@ -39,6 +39,7 @@
 #define VPVL2_PMX_BONE_H_
 
 #include "vpvl2/IBone.h"
+#include "vpvl2/internal/Arena.h"
 #include "vpvl2/pmx/Model.h"
 #include "vpvl2/pmx/Morph.h"
 
@@ -59,6 +60,8 @@ namespace pmx
 class VPVL2_API Bone : public IBone
 {
 public:
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     enum Flags {
         kHasDestinationOrigin      = 0x1,
         kRotatetable               = 0x2,
@@ -82,7 +85,21 @@ public:
 
     static bool preparse(uint8_t *&ptr, size_t &rest, Model::DataInfo &info);
     static bool loadBones(const Array<Bone *> &bones);
-    static void sortBones(const Array<Bone *> &bones, Array<Bone *> &bpsBones, Array<Bone *> &apsBones);
+    /**
+     * Sorts bones into the bones before physics and the bones after physics.
+     *
+     * Each of them is grouped into levels, bones in the same level don't depend on
+     * each other (parent, inherent parent and IK chain) and can be transformed in parallel.
+     * The level N is [levelOffsets[N], levelOffsets[N + 1]).
+     *
+     * Returns true if a bone refers a bone transformed after it (a child precedes its
+     * parent for example), such a bone gets the value of the last transform.
+     */
+    static bool sortBones(const Array<Bone *> &bones,
+                          Array<Bone *> &bpsBones,
+                          Array<int> &bpsLevelOffsets,
+                          Array<Bone *> &apsBones,
+                          Array<int> &apsLevelOffsets);
     static void writeBones(const Array<Bone *> &bones, const Model::DataInfo &info, uint8_t *&data);
     static size_t estimateTotalSize(const Array<Bone *> &bones, const Model::DataInfo &info);
 
@@ -141,6 +158,21 @@ public:
     bool isTransformedByExternalParent() const;
     bool isInverseKinematicsEnabled() const;
 
+    /**
+     * Returns true if the local transform or the structure of the bone is changed.
+     *
+     * Model#performUpdate is skipped if none of bones and morphs is dirty and
+     * clears the flag after updating.
+     */
+    bool isDirty() const;
+    /**
+     * Returns true if bones referred by the bone (parent, inherent parent and IK chain)
+     * or the phase to be transformed are changed since the bones are sorted.
+     *
+     * Model#performUpdate sorts bones again before transforming them and clears the flag.
+     */
+    bool isOrderDirty() const;
+
     void setParentBoneRef(Bone *value);
     void setParentInherentBoneRef(Bone *value, float32_t weight);
     void setEffectorBoneRef(Bone *effector, int numIteration, float angleLimit);
@@ -167,8 +199,15 @@ public:
     void setTransformAfterPhysicsEnable(bool value);
     void setTransformedByExternalParentEnable(bool value);
     void setInverseKinematicsEnable(bool value);
+    void setDirty(bool value);
+    void setOrderDirty(bool value);
 
 private:
+    static bool sortBonesByLevel(const Array<Bone *> &bones,
+                                 Array<Bone *> &orderedBones,
+                                 Array<int> &levelOffsets,
+                                 Array<bool> &readBones);
+
     struct PrivateContext;
     PrivateContext *m_context;
 
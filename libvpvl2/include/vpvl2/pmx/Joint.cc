@@ -177,11 +177,11 @@ void Joint::read(const uint8_t *data, const Model::DataInfo &info, size_t &size)
     int nNameSize;
     IEncoding *encoding = info.encoding;
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_name);
-    VPVL2_VLOG(3, "PMXJoint: name=" << internal::cstr(m_name, "(null)"));
+    m_name.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXJoint: name=" << internal::cstr(m_name.value(), "(null)"));
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_englishName);
-    VPVL2_VLOG(3, "PMXJoint: englishName=" << internal::cstr(m_englishName, "(null)"));
+    m_englishName.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXJoint: englishName=" << internal::cstr(m_englishName.value(), "(null)"));
     uint8_t type;
     internal::getTyped<uint8_t>(ptr, rest, type);
     m_type = static_cast<Type>(type);
@@ -212,8 +212,8 @@ void Joint::read(const uint8_t *data, const Model::DataInfo &info, size_t &size)
 
 void Joint::write(uint8_t *&data, const Model::DataInfo &info) const
 {
-    internal::writeString(m_name, info.codec, data);
-    internal::writeString(m_englishName, info.codec, data);
+    internal::writeString(m_name.value(), info.codec, data);
+    internal::writeString(m_englishName.value(), info.codec, data);
     uint8_t type = m_type;
     internal::writeBytes(&type, sizeof(type), data);
     size_t rigidBodyIndexSize = info.rigidBodyIndexSize;
@@ -234,8 +234,8 @@ void Joint::write(uint8_t *&data, const Model::DataInfo &info) const
 size_t Joint::estimateSize(const Model::DataInfo &info) const
 {
     size_t size = 0;
-    size += internal::estimateSize(m_name, info.codec);
-    size += internal::estimateSize(m_englishName, info.codec);
+    size += internal::estimateSize(m_name.value(), info.codec);
+    size += internal::estimateSize(m_englishName.value(), info.codec);
     size += sizeof(uint8_t);
     size += info.rigidBodyIndexSize * 2;
     size += sizeof(JointUnit);
@@ -40,6 +40,7 @@
 #ifndef VPVL2_PMX_JOINT_H_
 #define VPVL2_PMX_JOINT_H_
 
+#include "vpvl2/internal/Arena.h"
 #include "vpvl2/internal/BaseJoint.h"
 #include "vpvl2/pmx/RigidBody.h"
 
@@ -64,6 +65,8 @@ namespace pmx
 class VPVL2_API Joint : public internal::BaseJoint
 {
 public:
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     Joint(IModel *modelRef);
     ~Joint();
 
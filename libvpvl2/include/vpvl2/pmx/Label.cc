@@ -35,6 +35,7 @@
 /* ----------------------------------------------------------------- */
 
 #include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/DeferredString.h"
 #include "vpvl2/internal/util.h"
 
 #include "vpvl2/pmx/Bone.h"
@@ -49,6 +50,8 @@ namespace
 #pragma pack(pop)
 
 struct Pair {
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     int id;
     int type;
     vpvl2::IBone *boneRef;
@@ -63,19 +66,17 @@ namespace pmx
 {
 
 struct Label::PrivateContext {
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     PrivateContext(IModel *modelRef)
         : modelRef(modelRef),
-          name(0),
-          englishName(0),
           index(-1),
           special(false)
     {
     }
     ~PrivateContext() {
-        delete name;
-        name = 0;
-        delete englishName;
-        englishName = 0;
+        name.release();
+        englishName.release();
         modelRef = 0;
         pairs.releaseAll();
         index = -1;
@@ -83,8 +84,8 @@ struct Label::PrivateContext {
     }
 
     IModel *modelRef;
-    IString *name;
-    IString *englishName;
+    internal::DeferredString name;
+    internal::DeferredString englishName;
     PointerArray<Pair> pairs;
     int index;
     bool special;
@@ -233,11 +234,11 @@ void Label::read(const uint8_t *data, const Model::DataInfo &info, size_t &size)
     int32_t nNameSize;
     IEncoding *encoding = info.encoding;
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->name);
-    VPVL2_VLOG(3, "PMXLabel: name=" << internal::cstr(m_context->name, "(null)"));
+    m_context->name.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXLabel: name=" << internal::cstr(m_context->name.value(), "(null)"));
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->englishName);
-    VPVL2_VLOG(3, "PMXLabel: englishName=" << internal::cstr(m_context->englishName, "(null)"));
+    m_context->englishName.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXLabel: englishName=" << internal::cstr(m_context->englishName.value(), "(null)"));
     uint8_t type;
     internal::getTyped<uint8_t>(ptr, rest, type);
     m_context->special = type == 1;
@@ -268,8 +269,8 @@ void Label::read(const uint8_t *data, const Model::DataInfo &info, size_t &size)
 
 void Label::write(uint8_t *&data, const Model::DataInfo &info) const
 {
-    internal::writeString(m_context->name, info.codec, data);
-    internal::writeString(m_context->englishName, info.codec, data);
+    internal::writeString(m_context->name.value(), info.codec, data);
+    internal::writeString(m_context->englishName.value(), info.codec, data);
     int32_t npairs = m_context->pairs.count();
     internal::writeBytes(&m_context->special, sizeof(uint8_t), data);
     internal::writeBytes(&npairs, sizeof(npairs), data);
@@ -293,8 +294,8 @@ void Label::write(uint8_t *&data, const Model::DataInfo &info) const
 size_t Label::estimateSize(const Model::DataInfo &info) const
 {
     size_t size = 0;
-    size += internal::estimateSize(m_context->name, info.codec);
-    size += internal::estimateSize(m_context->englishName, info.codec);
+    size += internal::estimateSize(m_context->name.value(), info.codec);
+    size += internal::estimateSize(m_context->englishName.value(), info.codec);
     size += sizeof(uint8_t);
     int32_t npairs = m_context->pairs.count();
     size += sizeof(npairs);
@@ -317,12 +318,12 @@ size_t Label::estimateSize(const Model::DataInfo &info) const
 
 const IString *Label::name() const
 {
-    return m_context->name;
+    return m_context->name.value();
 }
 
 const IString *Label::englishName() const
 {
-    return m_context->englishName;
+    return m_context->englishName.value();
 }
 
 IModel *Label::parentModelRef() const
@@ -357,12 +358,12 @@ int Label::count() const
 
 void Label::setName(const IString *value)
 {
-    internal::setString(value, m_context->name);
+    m_context->name.setValue(value);
 }
 
 void Label::setEnglishName(const IString *value)
 {
-    internal::setString(value, m_context->englishName);
+    m_context->englishName.setValue(value);
 }
 
 void Label::setSpecial(bool value)
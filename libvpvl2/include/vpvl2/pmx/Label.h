@@ -40,6 +40,7 @@
 
 #include "vpvl2/ILabel.h"
 #include "vpvl2/IString.h"
+#include "vpvl2/internal/Arena.h"
 #include "vpvl2/pmx/Model.h"
 
 namespace vpvl2
@@ -59,6 +60,8 @@ namespace pmx
 class VPVL2_API Label : public ILabel
 {
 public:
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     /**
      * Constructor
      */
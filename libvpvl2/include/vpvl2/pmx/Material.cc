@@ -35,6 +35,7 @@
 /* ----------------------------------------------------------------- */
 
 #include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/DeferredString.h"
 #include "vpvl2/internal/util.h"
 
 #include "vpvl2/pmx/Material.h"
@@ -127,11 +128,10 @@ struct RGBA3 {
 };
 
 struct Material::PrivateContext {
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     PrivateContext(Model *modelRef)
         : modelRef(modelRef),
-          name(0),
-          englishName(0),
-          userDataArea(0),
           mainTextureRef(0),
           sphereTextureRef(0),
           toonTextureRef(0),
@@ -153,18 +153,14 @@ struct Material::PrivateContext {
         toonTextureBlend.calculate();
     }
     ~PrivateContext() {
-        delete name;
-        name = 0;
-        delete englishName;
-        englishName = 0;
-        delete userDataArea;
-        userDataArea = 0;
+        name.release();
+        englishName.release();
+        userDataArea.release();
         modelRef = 0;
         mainTextureRef = 0;
         sphereTextureRef = 0;
         toonTextureRef = 0;
         sphereTextureRenderMode = kNone;
-        userDataArea = 0;
         shininess.setZero();
         edgeSize.setZero();
         index = -1;
@@ -176,9 +172,9 @@ struct Material::PrivateContext {
     }
 
     Model *modelRef;
-    IString *name;
-    IString *englishName;
-    IString *userDataArea;
+    internal::DeferredString name;
+    internal::DeferredString englishName;
+    internal::DeferredString userDataArea;
     IString *mainTextureRef;
     IString *sphereTextureRef;
     IString *toonTextureRef;
@@ -353,11 +349,11 @@ void Material::read(const uint8_t *data, const Model::DataInfo &info, size_t &si
     int32_t nNameSize;
     IEncoding *encoding = info.encoding;
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->name);
-    VPVL2_VLOG(3, "PMXMaterial: name=" << internal::cstr(m_context->name, "(null)"));
+    m_context->name.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXMaterial: name=" << internal::cstr(m_context->name.value(), "(null)"));
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->englishName);
-    VPVL2_VLOG(3, "PMXMaterial: englishName=" << internal::cstr(m_context->englishName, "(null)"));
+    m_context->englishName.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXMaterial: englishName=" << internal::cstr(m_context->englishName.value(), "(null)"));
     MaterialUnit unit;
     internal::getData(ptr, unit);
     m_context->ambient.base.setValue(unit.ambient[0], unit.ambient[1], unit.ambient[2]);
@@ -398,7 +394,7 @@ void Material::read(const uint8_t *data, const Model::DataInfo &info, size_t &si
         VPVL2_VLOG(3, "PMXMaterial: toonTextureIndex=" << m_context->toonTextureIndex);
     }
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->userDataArea);
+    m_context->userDataArea.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
     internal::getTyped<int>(ptr, rest, nNameSize);
     m_context->indexRange.count = nNameSize;
     VPVL2_VLOG(3, "PMXMaterial: indexCount=" << m_context->indexRange.count);
@@ -407,8 +403,8 @@ void Material::read(const uint8_t *data, const Model::DataInfo &info, size_t &si
 
 void Material::write(uint8_t *&data, const Model::DataInfo &info) const
 {
-    internal::writeString(m_context->name, info.codec, data);
-    internal::writeString(m_context->englishName, info.codec, data);
+    internal::writeString(m_context->name.value(), info.codec, data);
+    internal::writeString(m_context->englishName.value(), info.codec, data);
     MaterialUnit mu;
     internal::getColor(m_context->ambient.base, mu.ambient);
     internal::getColor(m_context->diffuse.base, mu.diffuse);
@@ -429,20 +425,20 @@ void Material::write(uint8_t *&data, const Model::DataInfo &info) const
     else {
         internal::writeSignedIndex(m_context->toonTextureIndex, textureIndexSize, data);
     }
-    internal::writeString(m_context->userDataArea, info.codec, data);
+    internal::writeString(m_context->userDataArea.value(), info.codec, data);
     internal::writeBytes(&m_context->indexRange.count, sizeof(int), data);
 }
 
 size_t Material::estimateSize(const Model::DataInfo &info) const
 {
     size_t size = 0, textureIndexSize = info.textureIndexSize;
-    size += internal::estimateSize(m_context->name, info.codec);
-    size += internal::estimateSize(m_context->englishName, info.codec);
+    size += internal::estimateSize(m_context->name.value(), info.codec);
+    size += internal::estimateSize(m_context->englishName.value(), info.codec);
     size += sizeof(MaterialUnit);
     size += textureIndexSize * 2;
     size += sizeof(uint16_t);
     size += m_context->useSharedToonTexture ? sizeof(uint8_t) : textureIndexSize;
-    size += internal::estimateSize(m_context->userDataArea, info.codec);
+    size += internal::estimateSize(m_context->userDataArea.value(), info.codec);
     size += sizeof(int);
     return size;
 }
@@ -513,17 +509,17 @@ IModel *Material::parentModelRef() const
 
 const IString *Material::name() const
 {
-    return m_context->name;
+    return m_context->name.value();
 }
 
 const IString *Material::englishName() const
 {
-    return m_context->englishName;
+    return m_context->englishName.value();
 }
 
 const IString *Material::userDataArea() const
 {
-    return m_context->userDataArea;
+    return m_context->userDataArea.value();
 }
 
 const IString *Material::mainTexture() const
@@ -661,17 +657,17 @@ bool Material::isLineDrawEnabled() const
 
 void Material::setName(const IString *value)
 {
-    internal::setString(value, m_context->name);
+    m_context->name.setValue(value);
 }
 
 void Material::setEnglishName(const IString *value)
 {
-    internal::setString(value, m_context->englishName);
+    m_context->englishName.setValue(value);
 }
 
 void Material::setUserDataArea(const IString *value)
 {
-    internal::setString(value, m_context->userDataArea);
+    m_context->userDataArea.setValue(value);
 }
 
 void Material::setMainTexture(const IString *value)
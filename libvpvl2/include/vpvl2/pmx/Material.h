@@ -39,6 +39,7 @@
 #define VPVL2_PMX_MATERIAL_H_
 
 #include "vpvl2/IMaterial.h"
+#include "vpvl2/internal/Arena.h"
 #include "vpvl2/pmx/Model.h"
 #include "vpvl2/pmx/Morph.h"
 
@@ -59,6 +60,8 @@ namespace pmx
 class VPVL2_API Material : public IMaterial
 {
 public:
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     /**
      * Constructor
      */
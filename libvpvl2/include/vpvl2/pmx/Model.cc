@@ -45,7 +45,14 @@
 #include "vpvl2/pmx/Morph.h"
 #include "vpvl2/pmx/RigidBody.h"
 #include "vpvl2/pmx/Vertex.h"
+#include "vpvl2/internal/Arena.h"
+#include "vpvl2/internal/BonePalette.h"
+#include "vpvl2/internal/DeferredString.h"
+#include "vpvl2/internal/MappedFile.h"
 #include "vpvl2/internal/ParallelProcessors.h"
+#include "vpvl2/internal/SkinningMeshes.h"
+#include "vpvl2/internal/VertexCacheOptimizer.h"
+#include "vpvl2/internal/VertexStore.h"
 
 #include <BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
 #include <BulletDynamics/Dynamics/btRigidBody.h>
@@ -95,52 +102,166 @@ struct Flags
     }
 };
 
+struct CompiledSpan
+{
+    vpvl2::uint32_t offset;
+    vpvl2::uint32_t count;
+};
+
+struct CompiledHeader
+{
+    vpvl2::uint8_t signature[8];
+    vpvl2::uint32_t version;
+    vpvl2::uint32_t flags;
+    vpvl2::uint32_t dataSize;
+    vpvl2::uint32_t boneOrdersSize;
+    vpvl2::float32_t modelVersion;
+    Flags dataFlags;
+    CompiledSpan name;
+    CompiledSpan englishName;
+    CompiledSpan comment;
+    CompiledSpan englishComment;
+    CompiledSpan vertices;
+    CompiledSpan indices;
+    CompiledSpan textures;
+    CompiledSpan materials;
+    CompiledSpan bones;
+    CompiledSpan morphs;
+    CompiledSpan labels;
+    CompiledSpan rigidBodies;
+    CompiledSpan joints;
+};
+
 #pragma pack(pop)
 
+static const vpvl2::uint8_t kCompiledSignature[] = "VPVL2PMC";
+static const vpvl2::uint32_t kCompiledVersion = 1;
+static const vpvl2::uint32_t kCompiledVertexCacheOptimizedFlag = 0x1;
+
+static inline void setCompiledSpan(const vpvl2::uint8_t *base, const vpvl2::uint8_t *ptr, size_t count, CompiledSpan &span)
+{
+    span.offset = vpvl2::uint32_t(ptr - base);
+    span.count = vpvl2::uint32_t(count);
+}
+
+static inline bool isSameSpan(const CompiledSpan &span, const vpvl2::uint8_t *base, const vpvl2::uint8_t *ptr, size_t count)
+{
+    CompiledSpan expected;
+    setCompiledSpan(base, ptr, count, expected);
+    return span.offset == expected.offset && span.count == expected.count;
+}
+
+static inline bool isValidIndexSize(vpvl2::uint8_t value)
+{
+    return value == 1 || value == 2 || value == 4;
+}
+
 struct DefaultStaticVertexBuffer : public IModel::StaticVertexBuffer {
-    struct Unit {
-        Unit() {}
-        void update(const IVertex *vertex) {
-            IBone *bone1 = vertex->boneRef(0),
-                    *bone2 = vertex->boneRef(1),
-                    *bone3 = vertex->boneRef(2),
-                    *bone4 = vertex->boneRef(3);
-            boneIndices.setValue(Scalar(bone1 ? bone1->index() : -1),
-                                 Scalar(bone2 ? bone2->index() : -1),
-                                 Scalar(bone3 ? bone3->index() : -1),
-                                 Scalar(bone4 ? bone4->index() : -1));
-            boneWeights.setValue(Scalar(vertex->weight(0)),
-                                 Scalar(vertex->weight(1)),
-                                 Scalar(vertex->weight(2)),
-                                 Scalar(vertex->weight(3)));
-            texcoord = vertex->textureCoord();
-        }
-        Vector3 texcoord;
-        Vector4 boneIndices;
-        Vector4 boneWeights;
-    };
-    static const Unit kIdent;
+    /*
+     * packed layout of a vertex (all fields are 4 bytes aligned):
+     *   float2 texcoord
+     *   uint8x4 or uint16x4 bone indices (float4 only if bone indices don't fit in uint16)
+     *   unorm16x4 bone weights
+     *   float3x3 sdef C/R0/R1 (only if the model has SDEF vertices)
+     */
+    static const vpvl2::uint8_t kIdent;
+    static const size_t kTextureCoordSize = sizeof(float) * 2;
+    static const size_t kBoneWeightSize = sizeof(vpvl2::uint16_t) * 4;
+    static const size_t kSdefSize = sizeof(float) * 3;
 
     DefaultStaticVertexBuffer(const pmx::Model *model)
-        : modelRef(model)
+        : modelRef(model),
+          boneIndexType(kFloatComponent),
+          boneIndexOffset(kTextureCoordSize),
+          boneWeightOffset(0),
+          sdefOffset(0),
+          stride(0)
     {
+        /* bone indices are remapped to the palette of each mesh for vertex shader skinning */
+        meshes.build(model->materials(), model->vertices(), model->indices());
+        const Array<pmx::Vertex *> &vertices = model->vertices();
+        const int nbones = model->bones().count(), nvertices = vertices.count();
+        /* remapped slots are less than SkinningMeshes::kMaxBones so they always fit in uint8 */
+        if (meshes.remappedBoneIndicesAt(0) || nbones <= 0xff) {
+            boneIndexType = kUnsignedByteComponent;
+        }
+        else if (nbones <= 0xffff) {
+            boneIndexType = kUnsignedShortComponent;
+        }
+        boneWeightOffset = boneIndexOffset + componentSize(boneIndexType) * 4;
+        stride = boneWeightOffset + kBoneWeightSize;
+        for (int i = 0; i < nvertices; i++) {
+            if (vertices[i]->type() == IVertex::kSdef) {
+                sdefOffset = stride;
+                stride += kSdefSize * 3;
+                break;
+            }
+        }
     }
     ~DefaultStaticVertexBuffer() {
         modelRef = 0;
     }
 
+    static size_t componentSize(ComponentType type) {
+        switch (type) {
+        case kUnsignedByteComponent:
+            return sizeof(vpvl2::uint8_t);
+        case kUnsignedShortComponent:
+        case kNormalizedUnsignedShortComponent:
+            return sizeof(vpvl2::uint16_t);
+        case kFloatComponent:
+        case kMaxComponentType:
+        default:
+            return sizeof(float);
+        }
+    }
+    static void writeBoneIndices(const int *values, ComponentType type, vpvl2::uint8_t *ptr) {
+        for (int i = 0; i < 4; i++) {
+            /* an unassigned bone has zero weight so it can safely refer the first bone */
+            const int value = btMax(values[i], 0);
+            switch (type) {
+            case kUnsignedByteComponent: {
+                ptr[i] = vpvl2::uint8_t(value);
+                break;
+            }
+            case kUnsignedShortComponent: {
+                const vpvl2::uint16_t v = vpvl2::uint16_t(value);
+                memcpy(ptr + i * sizeof(v), &v, sizeof(v));
+                break;
+            }
+            case kNormalizedUnsignedShortComponent:
+            case kFloatComponent:
+            case kMaxComponentType:
+            default: {
+                const float v = float(value);
+                memcpy(ptr + i * sizeof(v), &v, sizeof(v));
+                break;
+            }
+            }
+        }
+    }
+    static void writeVector3(const Vector3 &value, vpvl2::uint8_t *ptr) {
+        const float v[] = { value.x(), value.y(), value.z() };
+        memcpy(ptr, v, sizeof(v));
+    }
+
     size_t size() const {
         return strideSize() * modelRef->vertices().count();
     }
     size_t strideOffset(StrideType type) const {
-        const vpvl2::uint8_t *base = reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.texcoord);
         switch (type) {
         case kBoneIndexStride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.boneIndices) - base;
+            return boneIndexOffset;
         case kBoneWeightStride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.boneWeights) - base;
+            return boneWeightOffset;
         case kTextureCoordStride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.texcoord) - base;
+            return 0;
+        case kSdefCStride:
+            return sdefOffset;
+        case kSdefR0Stride:
+            return sdefOffset > 0 ? sdefOffset + kSdefSize : 0;
+        case kSdefR1Stride:
+            return sdefOffset > 0 ? sdefOffset + kSdefSize * 2 : 0;
         case kVertexStride:
         case kNormalStride:
         case kMorphDeltaStride:
@@ -158,14 +279,58 @@ struct DefaultStaticVertexBuffer : public IModel::StaticVertexBuffer {
         }
     }
     size_t strideSize() const {
-        return sizeof(kIdent);
+        return stride;
+    }
+    ComponentType componentType(StrideType type) const {
+        switch (type) {
+        case kBoneIndexStride:
+            return boneIndexType;
+        case kBoneWeightStride:
+            return kNormalizedUnsignedShortComponent;
+        default:
+            return kFloatComponent;
+        }
     }
     void update(void *address) const {
-        Unit *unitPtr = static_cast<Unit *>(address);
+        vpvl2::uint8_t *ptr = static_cast<vpvl2::uint8_t *>(address);
         const Array<pmx::Vertex *> &vertices = modelRef->vertices();
         const int nvertices = vertices.count();
         for (int i = 0; i < nvertices; i++) {
-            unitPtr[i].update(vertices[i]);
+            const pmx::Vertex *vertex = vertices[i];
+            const int *remappedBoneIndices = meshes.remappedBoneIndicesAt(i);
+            int boneIndices[4];
+            for (int j = 0; j < 4; j++) {
+                if (remappedBoneIndices) {
+                    boneIndices[j] = remappedBoneIndices[j];
+                }
+                else {
+                    const IBone *bone = vertex->boneRef(j);
+                    boneIndices[j] = bone ? bone->index() : -1;
+                }
+            }
+            const Vector3 &texcoord = vertex->textureCoord();
+            const float uv[] = { texcoord.x(), texcoord.y() };
+            memcpy(ptr, uv, sizeof(uv));
+            writeBoneIndices(boneIndices, boneIndexType, ptr + boneIndexOffset);
+            vpvl2::uint16_t weights[4];
+            for (int j = 0; j < 4; j++) {
+                const IVertex::WeightPrecision weight = btClamped(vertex->weight(j), IVertex::WeightPrecision(0), IVertex::WeightPrecision(1));
+                weights[j] = vpvl2::uint16_t(weight * 0xffff + 0.5);
+            }
+            memcpy(ptr + boneWeightOffset, weights, sizeof(weights));
+            if (sdefOffset > 0) {
+                Vector3 sdefR0(kZeroV3), sdefR1(kZeroV3);
+                if (vertex->type() == IVertex::kSdef) {
+                    internal::ModelHelper::getSdefCenters(vertex->sdefC(), vertex->sdefR0(), vertex->sdefR1(), vertex->weight(0), sdefR0, sdefR1);
+                    writeVector3(vertex->sdefC(), ptr + sdefOffset);
+                }
+                else {
+                    writeVector3(kZeroV3, ptr + sdefOffset);
+                }
+                writeVector3(sdefR0, ptr + sdefOffset + kSdefSize);
+                writeVector3(sdefR1, ptr + sdefOffset + kSdefSize * 2);
+            }
+            ptr += stride;
         }
     }
     const void *ident() const {
@@ -173,10 +338,19 @@ struct DefaultStaticVertexBuffer : public IModel::StaticVertexBuffer {
     }
 
     const pmx::Model *modelRef;
+    internal::SkinningMeshes meshes;
+    ComponentType boneIndexType;
+    size_t boneIndexOffset;
+    size_t boneWeightOffset;
+    size_t sdefOffset;
+    size_t stride;
 };
-const DefaultStaticVertexBuffer::Unit DefaultStaticVertexBuffer::kIdent = DefaultStaticVertexBuffer::Unit();
+const vpvl2::uint8_t DefaultStaticVertexBuffer::kIdent = 0;
 
 struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
+    static const int kMaxAdditionalUVs = 4;
+    /* N is the number of additional UVs (UVA1-4) the model declares; UVA0 (texcoord morph) is always present */
+    template<int N>
     struct Unit {
         Unit() {}
         void update(const IVertex *vertex, int index) {
@@ -186,10 +360,10 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
             edge[3] = Scalar(index);
             updateMorph(vertex);
         }
-        void update(const IVertex *vertex, const IVertex::EdgeSizePrecision &materialEdgeSize, int index, Vector3 &p) {
+        void update(const pmx::Vertex *vertex, const internal::BonePalette *palette, const IVertex::EdgeSizePrecision &materialEdgeSize, int index, Vector3 &p) {
             Vector3 n;
             const IVertex::EdgeSizePrecision &edgeSize = vertex->edgeSize() * materialEdgeSize;
-            vertex->performSkinning(p, n);
+            vertex->performSkinning(*palette, p, n);
             position = p;
             normal = n;
             normal[3] = Scalar(edgeSize);
@@ -199,27 +373,39 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
         }
         void updateMorph(const IVertex *vertex) {
             delta = vertex->delta();
-            uva0 = vertex->uv(0);
-            uva1 = vertex->uv(1);
-            uva2 = vertex->uv(2);
-            uva3 = vertex->uv(3);
-            uva4 = vertex->uv(4);
+            for (int i = 0; i <= N; i++) {
+                uva[i] = vertex->uv(i);
+            }
+        }
+        void updateMorph(const internal::VertexStore &store, int index) {
+            const Scalar *d = store.deltaPtr(index), *uv = store.uvPtr(index);
+            delta.setValue(d[0], d[1], d[2]);
+            for (int i = 0; i <= N; i++) {
+                const Scalar *v = &uv[i * 4];
+                uva[i].setValue(v[0], v[1], v[2], v[3]);
+            }
         }
         Vector3 position;
         Vector3 normal;
         Vector3 delta;
         Vector3 edge;
-        Vector4 uva0;
-        Vector4 uva1;
-        Vector4 uva2;
-        Vector4 uva3;
-        Vector4 uva4;
+        Vector4 uva[N + 1];
     };
-    static const Unit kIdent;
-
-    DefaultDynamicVertexBuffer(const pmx::Model *model, const IModel::IndexBuffer *indexBuffer)
+    typedef Unit<kMaxAdditionalUVs> IdentUnit;
+    static const IdentUnit kIdent;
+
+    DefaultDynamicVertexBuffer(const pmx::Model *model,
+                               const IModel::IndexBuffer *indexBuffer,
+                               const internal::BonePalette *palette,
+                               internal::VertexStore *store,
+                               int nadditionalUVs)
         : modelRef(model),
           indexBufferRef(indexBuffer),
+          paletteRef(palette),
+          storeRef(store),
+          lastCameraPosition(kZeroV3),
+          lastPaletteSerial(-1),
+          nadditionalUVs(btClamped(nadditionalUVs, 0, int(kMaxAdditionalUVs))),
           enableSkinning(true),
           enableParallelUpdate(false)
     {
@@ -227,6 +413,10 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     ~DefaultDynamicVertexBuffer() {
         modelRef = 0;
         indexBufferRef = 0;
+        paletteRef = 0;
+        storeRef = 0;
+        lastPaletteSerial = -1;
+        nadditionalUVs = 0;
         enableSkinning = false;
         enableParallelUpdate = false;
     }
@@ -250,56 +440,137 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
         case kVertexIndexStride:
             return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.edge[3]) - base;
         case kUVA0Stride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.uva0) - base;
         case kUVA1Stride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.uva1) - base;
         case kUVA2Stride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.uva2) - base;
         case kUVA3Stride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.uva3) - base;
-        case kUVA4Stride:
-            return reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.uva4) - base;
+        case kUVA4Stride: {
+            /* channels the model doesn't declare are not stored and share offset 0 like PMD */
+            const int offset = type - kUVA0Stride;
+            return offset <= nadditionalUVs ? reinterpret_cast<const vpvl2::uint8_t *>(&kIdent.uva[offset]) - base : 0;
+        }
         case kBoneIndexStride:
         case kBoneWeightStride:
         case kTextureCoordStride:
+        case kSdefCStride:
+        case kSdefR0Stride:
+        case kSdefR1Stride:
         case kIndexStride:
         default:
             return 0;
         }
     }
     size_t strideSize() const {
-        return sizeof(kIdent);
+        return sizeof(Unit<0>) + sizeof(Vector4) * nadditionalUVs;
     }
     const void *ident() const {
         return &kIdent;
     }
     void update(void *address, const Vector3 &cameraPosition, Vector3 &aabbMin, Vector3 &aabbMax) const {
+        switch (nadditionalUVs) {
+        case 0:
+            writeUnits< Unit<0> >(address, cameraPosition, aabbMin, aabbMax);
+            break;
+        case 1:
+            writeUnits< Unit<1> >(address, cameraPosition, aabbMin, aabbMax);
+            break;
+        case 2:
+            writeUnits< Unit<2> >(address, cameraPosition, aabbMin, aabbMax);
+            break;
+        case 3:
+            writeUnits< Unit<3> >(address, cameraPosition, aabbMin, aabbMax);
+            break;
+        default:
+            writeUnits< Unit<4> >(address, cameraPosition, aabbMin, aabbMax);
+            break;
+        }
+        lastCameraPosition = cameraPosition;
+        lastPaletteSerial = paletteRef->serial();
+    }
+    void updateUnskinnedUnits(void *address) const {
+        switch (nadditionalUVs) {
+        case 0:
+            writeUnskinnedUnits< Unit<0> >(address);
+            break;
+        case 1:
+            writeUnskinnedUnits< Unit<1> >(address);
+            break;
+        case 2:
+            writeUnskinnedUnits< Unit<2> >(address);
+            break;
+        case 3:
+            writeUnskinnedUnits< Unit<3> >(address);
+            break;
+        default:
+            writeUnskinnedUnits< Unit<4> >(address);
+            break;
+        }
+    }
+    void setSkinningEnable(bool value) {
+        if (enableSkinning != value) {
+            lastPaletteSerial = -1;
+        }
+        enableSkinning = value;
+    }
+    void setParallelUpdateEnable(bool value) {
+        enableParallelUpdate = value;
+    }
+    bool isDirty(const Vector3 &cameraPosition) const {
+        /* the palette is updated only if Model#performUpdate is performed (the model is changed) */
+        if (lastPaletteSerial != paletteRef->serial()) {
+            return true;
+        }
+        /* edges of skinned vertices are scaled by the distance from the camera */
+        return enableSkinning && lastCameraPosition != cameraPosition;
+    }
+
+    template<typename TUnit>
+    void writeUnits(void *address, const Vector3 &cameraPosition, Vector3 &aabbMin, Vector3 &aabbMax) const {
         const Array<pmx::Vertex *> &vertices = modelRef->vertices();
-        Unit *bufferPtr = static_cast<Unit *>(address);
-        if (enableSkinning) {
-            internal::ParallelSkinningVertexProcessor<pmx::Model, pmx::Vertex, Unit> processor(modelRef, &vertices, cameraPosition, bufferPtr);
+        TUnit *bufferPtr = static_cast<TUnit *>(address);
+        if (enableSkinning && storeRef->isEnabled() && !storeRef->isDirty()) {
+            storeRef->updateMaterialEdgeSizes(modelRef->materials(), modelRef->edgeScaleFactor(cameraPosition));
+            internal::VertexStore::SkinningProcessor<TUnit> processor(storeRef, paletteRef, bufferPtr);
+            processor.execute(enableParallelUpdate);
+            aabbMin = processor.aabbMin();
+            aabbMax = processor.aabbMax();
+        }
+        else if (enableSkinning) {
+            internal::ParallelSkinningVertexProcessor<pmx::Model, pmx::Vertex, TUnit> processor(modelRef, &vertices, paletteRef, cameraPosition, bufferPtr);
             processor.execute(enableParallelUpdate);
             aabbMin = processor.aabbMin();
             aabbMax = processor.aabbMax();
         }
         else {
-            internal::ParallelInitializeVertexProcessor<pmx::Model, pmx::Vertex, Unit> processor(&vertices, address);
+            internal::ParallelInitializeVertexProcessor<pmx::Model, pmx::Vertex, TUnit> processor(&vertices, address);
             processor.execute(enableParallelUpdate);
         }
     }
-    void setSkinningEnable(bool value) {
-        enableSkinning = value;
-    }
-    void setParallelUpdateEnable(bool value) {
-        enableParallelUpdate = value;
+    template<typename TUnit>
+    void writeUnskinnedUnits(void *address) const {
+        const Array<pmx::Vertex *> &vertices = modelRef->vertices();
+        const int nvertices = vertices.count();
+        TUnit *units = static_cast<TUnit *>(address);
+        for (int i = 0; i < nvertices; i++) {
+            const pmx::Vertex *vertex = vertices[i];
+            TUnit &buffer = units[i];
+            /* morph delta is applied here because the vertex shader skins inPosition only */
+            buffer.update(vertex, i);
+            buffer.position = vertex->origin() + vertex->delta();
+            buffer.position.setW(Scalar(vertex->type()));
+        }
     }
 
     const pmx::Model *modelRef;
     const IModel::IndexBuffer *indexBufferRef;
+    const internal::BonePalette *paletteRef;
+    internal::VertexStore *storeRef;
+    mutable Vector3 lastCameraPosition;
+    mutable int lastPaletteSerial;
+    int nadditionalUVs;
     bool enableSkinning;
     bool enableParallelUpdate;
 };
-const DefaultDynamicVertexBuffer::Unit DefaultDynamicVertexBuffer::kIdent = DefaultDynamicVertexBuffer::Unit();
+const DefaultDynamicVertexBuffer::IdentUnit DefaultDynamicVertexBuffer::kIdent = DefaultDynamicVertexBuffer::IdentUnit();
 
 struct DefaultIndexBuffer : public IModel::IndexBuffer {
     static const int kIdent = 0;
@@ -308,14 +579,15 @@ struct DefaultIndexBuffer : public IModel::IndexBuffer {
           indices32Ptr(0),
           nindices(indices.count())
     {
-        if (nindices < 65536) {
-            indexType = kIndex16;
-            indices16Ptr = new vpvl2::uint16_t[nindices];
-        }
-        else if (nindices < 256) {
+        /* width of an index depends on the largest vertex index, not on the number of indices */
+        if (nvertices < 256) {
             indexType = kIndex8;
             indices8Ptr = new vpvl2::uint8_t[nindices];
         }
+        else if (nvertices < 65536) {
+            indexType = kIndex16;
+            indices16Ptr = new vpvl2::uint16_t[nindices];
+        }
         else {
             indices32Ptr = new int[nindices];
         }
@@ -444,117 +716,256 @@ struct DefaultIndexBuffer : public IModel::IndexBuffer {
 const int DefaultIndexBuffer::kIdent;
 
 struct DefaultMatrixBuffer : public IModel::MatrixBuffer {
-    typedef btAlignedObjectArray<vpvl2::int32_t> BoneIndices;
-    typedef btAlignedObjectArray<BoneIndices> MeshBoneIndices;
-    typedef btAlignedObjectArray<Transform> MeshLocalTransforms;
-    typedef Array<vpvl2::float32_t *> MeshMatrices;
-    struct SkinningMeshes {
-        MeshBoneIndices bones;
-        MeshLocalTransforms transforms;
-        MeshMatrices matrices;
-        BoneIndices bdef1;
-        BoneIndices bdef2;
-        BoneIndices bdef4;
-        BoneIndices sdef;
-        ~SkinningMeshes() { matrices.releaseArrayAll(); }
-    };
+    typedef internal::SkinningMeshes::Mesh Mesh;
 
-    DefaultMatrixBuffer(const IModel *model, const DefaultIndexBuffer *indexBuffer, DefaultDynamicVertexBuffer *dynamicBuffer)
+    DefaultMatrixBuffer(const pmx::Model *model,
+                        const DefaultIndexBuffer *indexBuffer,
+                        const internal::BonePalette *palette,
+                        DefaultDynamicVertexBuffer *dynamicBuffer)
         : modelRef(model),
           indexBufferRef(indexBuffer),
-          dynamicBufferRef(dynamicBuffer)
+          paletteRef(palette),
+          dynamicBufferRef(dynamicBuffer),
+          lastPaletteSerial(-1)
     {
-        model->getBoneRefs(bones);
-        model->getMaterialRefs(materials);
-        model->getVertexRefs(vertices);
-        initialize();
     }
     ~DefaultMatrixBuffer() {
         modelRef = 0;
         indexBufferRef = 0;
+        paletteRef = 0;
         dynamicBufferRef = 0;
+        lastPaletteSerial = -1;
     }
 
     void update(void *address) {
-        const int nbones = bones.count();
-        MeshLocalTransforms &transforms = meshes.transforms;
-        for (int i = 0; i < nbones; i++) {
-            const IBone *bone = bones[i];
-            transforms[i] = bone->localTransform();
-        }
-        const int nmaterials = materials.count();
+        const int nmaterials = modelRef->materials().count();
         for (int i = 0; i < nmaterials; i++) {
-            const BoneIndices &boneIndices = meshes.bones[i];
-            const int nBoneIndices = boneIndices.size();
-            Scalar *matrices = meshes.matrices[i];
-            for (int j = 0; j < nBoneIndices; j++) {
-                const int boneIndex = boneIndices[j];
-                const Transform &transform = transforms[boneIndex];
-                transform.getOpenGLMatrix(&matrices[j * 16]);
+            const int nmeshes = meshes.countMeshes(i);
+            for (int j = 0; j < nmeshes; j++) {
+                const Mesh *mesh = meshes.meshAt(i, j);
+                const int *bones = meshes.bonesAt(mesh), nbones = mesh->nbones;
+                Scalar *matrices = &matrixPalette[mesh->boneOffset * internal::BonePalette::kMatrixSize];
+                for (int k = 0; k < nbones; k++) {
+                    const int boneIndex = bones[k];
+                    memcpy(&matrices[k * internal::BonePalette::kMatrixSize],
+                           paletteRef->matrixAt(boneIndex),
+                           sizeof(Scalar) * internal::BonePalette::kMatrixSize);
+                }
             }
         }
-        const int nvertices = vertices.count();
-        DefaultDynamicVertexBuffer::Unit *units = static_cast<DefaultDynamicVertexBuffer::Unit *>(address);
-        for (int i = 0; i < nvertices; i++) {
-            const IVertex *vertex = vertices[i];
-            DefaultDynamicVertexBuffer::Unit &buffer = units[i];
-            buffer.position = vertex->origin();
-            buffer.position.setW(Scalar(vertex->type()));
-            buffer.delta = vertex->delta();
-        }
+        dynamicBufferRef->updateUnskinnedUnits(address);
+        lastPaletteSerial = paletteRef->serial();
     }
-    const float *bytes(int materialIndex) const {
-        int nmatrices = meshes.matrices.count();
-        return internal::checkBound(materialIndex, 0, nmatrices) ? meshes.matrices[materialIndex] : 0;
+    int countMeshes(int materialIndex) const {
+        return meshes.countMeshes(materialIndex);
     }
-    size_t size(int materialIndex) const {
-        int nbones = meshes.bones.size();
-        return internal::checkBound(materialIndex, 0, nbones) ? meshes.bones[materialIndex].size() : 0;
+    int countIndices(int materialIndex, int meshIndex) const {
+        const Mesh *mesh = meshes.meshAt(materialIndex, meshIndex);
+        return mesh ? mesh->count : 0;
+    }
+    const float *bytes(int materialIndex, int meshIndex) const {
+        const Mesh *mesh = meshes.meshAt(materialIndex, meshIndex);
+        return mesh && mesh->nbones > 0 ? &matrixPalette[mesh->boneOffset * internal::BonePalette::kMatrixSize] : 0;
+    }
+    size_t size(int materialIndex, int meshIndex) const {
+        const Mesh *mesh = meshes.meshAt(materialIndex, meshIndex);
+        return mesh ? mesh->nbones : 0;
+    }
+    bool isDirty() const {
+        return lastPaletteSerial != paletteRef->serial();
     }
 
-    void initialize() {
-        const int nmaterials = materials.count();
-        BoneIndices boneIndices;
-        meshes.transforms.resize(bones.count());
-        int offset = 0;
+    bool initialize() {
+        if (!meshes.build(modelRef->materials(), modelRef->vertices(), modelRef->indices())) {
+            return false;
+        }
+        const int nmaterials = modelRef->materials().count();
+        int nbones = 0;
         for (int i = 0; i < nmaterials; i++) {
-            const IMaterial *material = materials[i];
-            const int nindices = material->indexRange().count;
-            for (int j = 0; j < nindices; j++) {
-                int vertexIndex = indexBufferRef->indexAt(offset + j);
-                IVertex *vertex = vertices[vertexIndex];
-                switch (vertex->type()) {
-                case IVertex::kBdef1:
-                    meshes.bdef1.push_back(vertexIndex);
-                    break;
-                case IVertex::kBdef2:
-                    meshes.bdef2.push_back(vertexIndex);
-                    break;
-                case IVertex::kBdef4:
-                    meshes.bdef4.push_back(vertexIndex);
-                    break;
-                case IVertex::kSdef:
-                    meshes.sdef.push_back(vertexIndex);
-                    break;
-                case IVertex::kMaxType:
-                default:
-                    break;
-                }
+            const int nmeshes = meshes.countMeshes(i);
+            for (int j = 0; j < nmeshes; j++) {
+                const Mesh *mesh = meshes.meshAt(i, j);
+                nbones = btMax(nbones, mesh->boneOffset + mesh->nbones);
             }
-            meshes.matrices.append(new Scalar[boneIndices.size() * 16]);
-            meshes.bones.push_back(boneIndices);
-            boneIndices.clear();
-            offset += nindices;
         }
+        matrixPalette.resize(nbones * internal::BonePalette::kMatrixSize);
+        return true;
     }
 
-    const IModel *modelRef;
+    const pmx::Model *modelRef;
     const DefaultIndexBuffer *indexBufferRef;
+    const internal::BonePalette *paletteRef;
     DefaultDynamicVertexBuffer *dynamicBufferRef;
-    Array<IBone *> bones;
-    Array<IMaterial *> materials;
-    Array<IVertex *> vertices;
-    SkinningMeshes meshes;
+    internal::SkinningMeshes meshes;
+    Array<Scalar> matrixPalette;
+    int lastPaletteSerial;
+};
+
+/**
+ * ParallelReadSectionProcessor reads the sections located by Model::preparse
+ * concurrently. Each unit is a run of consecutive items of a section starting
+ * at ptr; items are allocated before the execution, so a unit only writes
+ * its own items and no lock is needed.
+ */
+class ParallelReadSectionProcessor : public internal::ThreadPool::ITask {
+public:
+    enum SectionType {
+        kVertexSection,
+        kIndexSection,
+        kMaterialSection,
+        kBoneSection,
+        kMorphSection,
+        kLabelSection,
+        kRigidBodySection,
+        kJointSection
+    };
+    static const int kVertexChunkSize = 4096;
+    static const int kIndexChunkSize = 65536;
+    struct Unit {
+        SectionType type;
+        int begin;
+        int end;
+        uint8_t *ptr;
+    };
+
+    static void appendUnit(SectionType type, int begin, int end, uint8_t *ptr, Array<Unit> &units) {
+        if (begin < end) {
+            Unit unit;
+            unit.type = type;
+            unit.begin = begin;
+            unit.end = end;
+            unit.ptr = ptr;
+            units.append(unit);
+        }
+    }
+
+    ParallelReadSectionProcessor(const Array<Unit> *unitsRef,
+                                 internal::Arena *arenaRef,
+                                 const pmx::Model::DataInfo &info,
+                                 Array<pmx::Vertex *> *verticesRef,
+                                 Array<int> *indicesRef,
+                                 Array<pmx::Material *> *materialsRef,
+                                 Array<pmx::Bone *> *bonesRef,
+                                 Array<pmx::Morph *> *morphsRef,
+                                 Array<pmx::Label *> *labelsRef,
+                                 Array<pmx::RigidBody *> *rigidBodiesRef,
+                                 Array<pmx::Joint *> *jointsRef)
+        : m_unitsRef(unitsRef),
+          m_arenaRef(arenaRef),
+          m_info(info),
+          m_verticesRef(verticesRef),
+          m_indicesRef(indicesRef),
+          m_materialsRef(materialsRef),
+          m_bonesRef(bonesRef),
+          m_morphsRef(morphsRef),
+          m_labelsRef(labelsRef),
+          m_rigidBodiesRef(rigidBodiesRef),
+          m_jointsRef(jointsRef)
+    {
+    }
+    ~ParallelReadSectionProcessor() {
+        m_unitsRef = 0;
+        m_arenaRef = 0;
+        m_verticesRef = 0;
+        m_indicesRef = 0;
+        m_materialsRef = 0;
+        m_bonesRef = 0;
+        m_morphsRef = 0;
+        m_labelsRef = 0;
+        m_rigidBodiesRef = 0;
+        m_jointsRef = 0;
+    }
+
+#ifdef VPVL2_LINK_INTEL_TBB
+    void operator()(const tbb::blocked_range<int> &range) const {
+        readUnits(range.begin(), range.end());
+    }
+#endif
+
+    void run(int begin, int end, int /* worker */) {
+        readUnits(begin, end);
+    }
+    void execute(bool enableParallel) {
+        const int nunits = m_unitsRef->count();
+        if (enableParallel) {
+#ifdef VPVL2_LINK_INTEL_TBB
+            tbb::parallel_for(tbb::blocked_range<int>(0, nunits, 1), *this);
+#else /* VPVL2_LINK_INTEL_TBB */
+            internal::ThreadPool::sharedInstance()->execute(this, 0, nunits, 1);
+#endif /* VPVL2_LINK_INTEL_TBB */
+        }
+        else {
+            readUnits(0, nunits);
+        }
+    }
+
+private:
+    template<typename T>
+    void readItems(const Array<T *> *itemRefs, const Unit &unit) const {
+        uint8_t *ptr = unit.ptr;
+        size_t size;
+        for (int i = unit.begin; i < unit.end; i++) {
+            T *item = itemRefs->at(i);
+            item->read(ptr, m_info, size);
+            ptr += size;
+        }
+    }
+    void readIndices(const Unit &unit) const {
+        const int nvertices = m_info.verticesCount;
+        const size_t size = m_info.vertexIndexSize;
+        uint8_t *ptr = unit.ptr;
+        for (int i = unit.begin; i < unit.end; i++) {
+            int index = internal::readUnsignedIndex(ptr, size);
+            (*m_indicesRef)[i] = internal::checkBound(index, 0, nvertices) ? index : 0;
+        }
+    }
+    void readUnits(int begin, int end) const {
+        /* entries of morphs and so on are allocated from the arena of the model on workers too */
+        internal::Arena::Scope scope(m_arenaRef);
+        for (int i = begin; i < end; i++) {
+            const Unit &unit = m_unitsRef->at(i);
+            switch (unit.type) {
+            case kVertexSection:
+                readItems(m_verticesRef, unit);
+                break;
+            case kIndexSection:
+                readIndices(unit);
+                break;
+            case kMaterialSection:
+                readItems(m_materialsRef, unit);
+                break;
+            case kBoneSection:
+                readItems(m_bonesRef, unit);
+                break;
+            case kMorphSection:
+                readItems(m_morphsRef, unit);
+                break;
+            case kLabelSection:
+                readItems(m_labelsRef, unit);
+                break;
+            case kRigidBodySection:
+                readItems(m_rigidBodiesRef, unit);
+                break;
+            case kJointSection:
+                readItems(m_jointsRef, unit);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    const Array<Unit> *m_unitsRef;
+    internal::Arena *m_arenaRef;
+    const pmx::Model::DataInfo &m_info;
+    mutable Array<pmx::Vertex *> *m_verticesRef;
+    mutable Array<int> *m_indicesRef;
+    mutable Array<pmx::Material *> *m_materialsRef;
+    mutable Array<pmx::Bone *> *m_bonesRef;
+    mutable Array<pmx::Morph *> *m_morphsRef;
+    mutable Array<pmx::Label *> *m_labelsRef;
+    mutable Array<pmx::RigidBody *> *m_rigidBodiesRef;
+    mutable Array<pmx::Joint *> *m_jointsRef;
 };
 
 static inline bool VPVL2PMXGetBonePosition(const IModel *modelRef,
@@ -583,10 +994,8 @@ struct Model::PrivateContext {
           parentSceneRef(0),
           parentModelRef(0),
           parentBoneRef(0),
-          name(0),
-          englishName(0),
-          comment(0),
-          englishComment(0),
+          mappedFile(0),
+          arena(0),
           aabbMax(kZeroV3),
           aabbMin(kZeroV3),
           position(kZeroV3),
@@ -595,32 +1004,52 @@ struct Model::PrivateContext {
           scaleFactor(1),
           edgeWidth(0),
           visible(false),
-          enablePhysics(false)
+          enablePhysics(false),
+          enableVertexCacheOptimization(false),
+          nameIndicesDirty(true),
+          boneOrdersDirty(true),
+          hasForwardBoneRefs(false),
+          hasStaleBones(false),
+          vertexCacheOptimized(false),
+          dirty(true)
     {
         internal::zerofill(&dataInfo, sizeof(dataInfo));
+        /* same as release, a model created from scratch is saved as PMX 2.0 */
+        dataInfo.version = 2.0f;
     }
     ~PrivateContext() {
+        if (arena) {
+            arena->retire();
+            arena = 0;
+        }
     }
 
     void release() {
         textures.releaseAll();
         vertices.releaseAll();
+        vertexStore.clear();
         materials.releaseAll();
         bones.releaseAll();
+        bonePalette.update(bones);
         morphs.releaseAll();
+        activeMorphRefs.clear();
         labels.releaseAll();
         rigidBodies.releaseAll();
         joints.releaseAll();
         internal::zerofill(&dataInfo, sizeof(dataInfo));
         dataInfo.version = 2.0f;
-        delete name;
-        name = 0;
-        delete englishName;
-        englishName = 0;
-        delete comment;
-        comment = 0;
-        delete englishComment;
-        englishComment = 0;
+        name.release();
+        englishName.release();
+        comment.release();
+        englishComment.release();
+        /* names of released objects may refer the mapped file */
+        delete mappedFile;
+        mappedFile = 0;
+        /* blocks are freed at once here unless removed objects are still alive */
+        if (arena) {
+            arena->retire();
+            arena = 0;
+        }
         parentSceneRef = 0;
         parentModelRef = 0;
         parentBoneRef = 0;
@@ -628,38 +1057,159 @@ struct Model::PrivateContext {
         rotation.setValue(0, 0, 0, 1);
         opacity = 1;
         scaleFactor = 1;
+        nameIndicesDirty = true;
+        boneOrdersDirty = true;
+        hasForwardBoneRefs = false;
+        hasStaleBones = false;
+        vertexCacheOptimized = false;
+        dirty = true;
+    }
+    bool isDirty() const {
+        return hasStaleBones || isChanged();
+    }
+    bool isChanged() const {
+        /* rigid bodies may be moved by the world even if nothing of the model is changed */
+        if (dirty || (enablePhysics && rigidBodies.count() > 0)) {
+            return true;
+        }
+        const int nbones = bones.count();
+        for (int i = 0; i < nbones; i++) {
+            if (bones[i]->isDirty()) {
+                return true;
+            }
+        }
+        const int nmorphs = morphs.count();
+        for (int i = 0; i < nmorphs; i++) {
+            if (morphs[i]->isDirty()) {
+                return true;
+            }
+        }
+        return false;
     }
-    void parseNamesAndComments(const Model::DataInfo &info) {
-        IEncoding *encoding = info.encoding;
-        internal::setStringDirect(encoding->toString(info.namePtr, info.nameSize, info.codec), name);
-        internal::setStringDirect(encodingRef->toString(info.englishNamePtr, info.englishNameSize, info.codec), englishName);
-        internal::setStringDirect(encodingRef->toString(info.commentPtr, info.commentSize, info.codec), comment);
-        internal::setStringDirect(encodingRef->toString(info.englishCommentPtr, info.englishCommentSize, info.codec), englishComment);
+    void optimizeVertexCache() {
+        const int nvertices = vertices.count(), nindices = indices.count(), nmaterials = materials.count();
+        internal::VertexCacheOptimizer optimizer(nvertices);
+        int offset = 0;
+        for (int i = 0; i < nmaterials; i++) {
+            const int count = btMax(btMin(materials[i]->indexRange().count, nindices - offset), 0);
+            if (!optimizer.reorderTriangles(indices, offset, count)) {
+                VPVL2_LOG(WARNING, "Triangles of the PMX material are not reordered: index=" << i);
+            }
+            offset += count;
+        }
+        Array<int> remap;
+        Array<Vertex *> reorderedVertices;
+        internal::VertexCacheOptimizer::buildVertexRemap(indices, nvertices, remap);
+        for (int i = 0; i < nindices; i++) {
+            int &index = indices[i];
+            if (index >= 0 && index < nvertices) {
+                index = remap[index];
+            }
+        }
+        reorderedVertices.resize(nvertices);
+        for (int i = 0; i < nvertices; i++) {
+            reorderedVertices[remap[i]] = vertices[i];
+        }
+        for (int i = 0; i < nvertices; i++) {
+            Vertex *vertex = reorderedVertices[i];
+            vertex->setIndex(i);
+            vertices[i] = vertex;
+        }
+        /* vertex/UV morphs refer vertices by pointer while updating, indices are saved */
+        const int nmorphs = morphs.count();
+        for (int i = 0; i < nmorphs; i++) {
+            const Morph *morph = morphs[i];
+            const Array<Morph::Vertex *> &vertexMorphs = morph->vertices();
+            const int nvertexMorphs = vertexMorphs.count();
+            for (int j = 0; j < nvertexMorphs; j++) {
+                Morph::Vertex *v = vertexMorphs[j];
+                if (v->vertex) {
+                    v->index = v->vertex->index();
+                }
+            }
+            const Array<Morph::UV *> &uvMorphs = morph->uvs();
+            const int nuvMorphs = uvMorphs.count();
+            for (int j = 0; j < nuvMorphs; j++) {
+                Morph::UV *v = uvMorphs[j];
+                if (v->vertex) {
+                    v->index = v->vertex->index();
+                }
+            }
+        }
     }
-    void parseVertices(const Model::DataInfo &info) {
-        const int nvertices = info.verticesCount;
-        uint8_t *ptr = info.verticesPtr;
-        size_t size;
+    bool buildVertexStore() {
+        Array<internal::VertexStore::Description> descriptions;
+        if (!internal::VertexStore::describe(vertices, descriptions)) {
+            vertexStore.clear();
+            vertexStore.setEnable(false);
+            return false;
+        }
+        const int nvertices = vertices.count();
         for (int i = 0; i < nvertices; i++) {
-            Vertex *vertex = vertices.append(new Vertex(selfRef));
-            vertex->read(ptr, info, size);
-            ptr += size;
+            const pmx::Vertex *vertex = vertices[i];
+            if (vertex->type() == IVertex::kSdef) {
+                internal::VertexStore::Description &description = descriptions[i];
+                description.sdefC = vertex->sdefC();
+                description.sdefR0 = vertex->sdefR0();
+                description.sdefR1 = vertex->sdefR1();
+            }
         }
+        vertexStore.build(descriptions, bones.count(), materials.count());
+        vertexStore.attach(vertices);
+        return true;
     }
-    void parseIndices(const Model::DataInfo &info) {
-        const int nindices = info.indicesCount;
-        const int nvertices = info.verticesCount;
-        uint8_t *ptr = info.indicesPtr;
-        size_t size = info.vertexIndexSize;
-        for (int i = 0; i < nindices; i++) {
-            int index = internal::readUnsignedIndex(ptr, size);
-            if (internal::checkBound(index, 0, nvertices)) {
-                indices.append(index);
+    void updateActiveMorphs() {
+        const int nmorphs = morphs.count();
+        activeMorphRefs.clear();
+        for (int i = 0; i < nmorphs; i++) {
+            Morph *morph = morphs[i];
+            if (morph->hasVertexMorphs() && morph->internalWeight() != 0) {
+                activeMorphRefs.append(morph);
             }
-            else {
-                indices.append(0);
+        }
+    }
+    void syncKinematicRigidBodies() {
+        /* static objects follow bones in the palette without motion state callbacks at the next step */
+        const int nRigidBodies = rigidBodies.count();
+        for (int i = 0; i < nRigidBodies; i++) {
+            RigidBody *rigidBody = rigidBodies[i];
+            rigidBody->syncKinematicTransform(bonePalette.matrixAt(rigidBody->boneIndex()));
+        }
+    }
+    void sortBonesIfNeeded() {
+        /* levels are resolved again not to transform a bone and the bone it refers at once */
+        bool needsSort = boneOrdersDirty;
+        const int nbones = bones.count();
+        for (int i = 0; i < nbones; i++) {
+            Bone *bone = bones[i];
+            if (bone->isOrderDirty()) {
+                bone->setOrderDirty(false);
+                needsSort = true;
             }
         }
+        if (needsSort) {
+            hasForwardBoneRefs = Bone::sortBones(bones, BPSOrderedBones, BPSBoneLevelOffsets, APSOrderedBones, APSBoneLevelOffsets);
+            boneOrdersDirty = false;
+        }
+    }
+    void clearDirty() {
+        const int nbones = bones.count();
+        for (int i = 0; i < nbones; i++) {
+            bones[i]->setDirty(false);
+        }
+        const int nmorphs = morphs.count();
+        for (int i = 0; i < nmorphs; i++) {
+            morphs[i]->setDirty(false);
+        }
+        hasStaleBones = false;
+        dirty = false;
+    }
+    void parseNamesAndComments(const Model::DataInfo &info) {
+        IEncoding *encoding = info.encoding;
+        name.setBytes(encoding, info.namePtr, info.nameSize, info.codec, info.deferStringDecoding);
+        englishName.setBytes(encodingRef, info.englishNamePtr, info.englishNameSize, info.codec, info.deferStringDecoding);
+        comment.setBytes(encodingRef, info.commentPtr, info.commentSize, info.codec, info.deferStringDecoding);
+        englishComment.setBytes(encodingRef, info.englishCommentPtr, info.englishCommentSize, info.codec, info.deferStringDecoding);
     }
     void parseTextures(const Model::DataInfo &info) {
         const int ntextures = info.texturesCount;
@@ -673,14 +1223,127 @@ struct Model::PrivateContext {
             textures.insert(value->toHashString(), value);
         }
     }
-    void parseMaterials(const Model::DataInfo &info) {
-        const int nmaterials = info.materialsCount, nindices = indices.count();
-        uint8_t *ptr = info.materialsPtr;
-        size_t size, offset = 0;
+    void allocateSections(const Model::DataInfo &info) {
+        const int nvertices = info.verticesCount;
+        vertices.reserve(nvertices);
+        for (int i = 0; i < nvertices; i++) {
+            vertices.append(new Vertex(selfRef));
+        }
+        indices.resize(info.indicesCount);
+        const int nmaterials = info.materialsCount;
         for (int i = 0; i < nmaterials; i++) {
-            Material *material = materials.append(new Material(selfRef));
-            material->read(ptr, info, size);
-            ptr += size;
+            materials.append(new Material(selfRef));
+        }
+        const int nbones = info.bonesCount;
+        for (int i = 0; i < nbones; i++) {
+            bones.append(new Bone(selfRef));
+        }
+        const int nmorphs = info.morphsCount;
+        for (int i = 0; i < nmorphs; i++) {
+            morphs.append(new Morph(selfRef));
+        }
+        const int nlabels = info.labelsCount;
+        for (int i = 0; i < nlabels; i++) {
+            labels.append(new Label(selfRef));
+        }
+        const int nRigidBodies = info.rigidBodiesCount;
+        for (int i = 0; i < nRigidBodies; i++) {
+            rigidBodies.append(new RigidBody(selfRef, encodingRef));
+        }
+        const int nJoints = info.jointsCount;
+        for (int i = 0; i < nJoints; i++) {
+            joints.append(new Joint(selfRef));
+        }
+    }
+    void parseSections(const Model::DataInfo &info) {
+#ifdef VPVL2_LINK_GLOG
+        /* verbose logs in read() decode names, that must not be done concurrently */
+        const bool enableParallel = !VLOG_IS_ON(3);
+#else
+        const bool enableParallel = true;
+#endif
+        /* IEncoding is not thread safe, names are decoded after reading all sections */
+        Model::DataInfo readInfo = info;
+        readInfo.deferStringDecoding = enableParallel || info.deferStringDecoding;
+        typedef ParallelReadSectionProcessor Processor;
+        Array<Processor::Unit> units;
+        /* sections consisting of variable length items are read as a whole, put first to be started early */
+        Processor::appendUnit(Processor::kMorphSection, 0, info.morphsCount, info.morphsPtr, units);
+        Processor::appendUnit(Processor::kBoneSection, 0, info.bonesCount, info.bonesPtr, units);
+        Processor::appendUnit(Processor::kMaterialSection, 0, info.materialsCount, info.materialsPtr, units);
+        Processor::appendUnit(Processor::kRigidBodySection, 0, info.rigidBodiesCount, info.rigidBodiesPtr, units);
+        Processor::appendUnit(Processor::kJointSection, 0, info.jointsCount, info.jointsPtr, units);
+        Processor::appendUnit(Processor::kLabelSection, 0, info.labelsCount, info.labelsPtr, units);
+        /* a vertex has variable length, offsets of chunks are found by walking sizes of units */
+        const int nvertices = info.verticesCount;
+        uint8_t *ptr = info.verticesPtr, *chunkPtr = ptr;
+        int chunkBegin = 0;
+        for (int i = 0; i < nvertices; i++) {
+            if (i - chunkBegin == Processor::kVertexChunkSize) {
+                Processor::appendUnit(Processor::kVertexSection, chunkBegin, i, chunkPtr, units);
+                chunkBegin = i;
+                chunkPtr = ptr;
+            }
+            ptr += Vertex::unitSize(ptr, info);
+        }
+        Processor::appendUnit(Processor::kVertexSection, chunkBegin, nvertices, chunkPtr, units);
+        const int nindices = info.indicesCount;
+        for (int i = 0; i < nindices; i += Processor::kIndexChunkSize) {
+            const int end = btMin(i + Processor::kIndexChunkSize, nindices);
+            Processor::appendUnit(Processor::kIndexSection, i, end, info.indicesPtr + i * info.vertexIndexSize, units);
+        }
+        Processor processor(&units, arena, readInfo, &vertices, &indices, &materials,
+                            &bones, &morphs, &labels, &rigidBodies, &joints);
+        processor.execute(enableParallel);
+        if (!info.deferStringDecoding && readInfo.deferStringDecoding) {
+            decodeSectionNames();
+        }
+    }
+    void decodeSectionNames() {
+        /* accessors decode and cache names of deferred strings */
+        const int nmaterials = materials.count();
+        for (int i = 0; i < nmaterials; i++) {
+            const Material *material = materials[i];
+            material->name();
+            material->englishName();
+            material->userDataArea();
+        }
+        const int nbones = bones.count();
+        for (int i = 0; i < nbones; i++) {
+            const Bone *bone = bones[i];
+            bone->name();
+            bone->englishName();
+        }
+        const int nmorphs = morphs.count();
+        for (int i = 0; i < nmorphs; i++) {
+            const Morph *morph = morphs[i];
+            morph->name();
+            morph->englishName();
+        }
+        const int nlabels = labels.count();
+        for (int i = 0; i < nlabels; i++) {
+            const Label *label = labels[i];
+            label->name();
+            label->englishName();
+        }
+        const int nRigidBodies = rigidBodies.count();
+        for (int i = 0; i < nRigidBodies; i++) {
+            const RigidBody *rigidBody = rigidBodies[i];
+            rigidBody->name();
+            rigidBody->englishName();
+        }
+        const int nJoints = joints.count();
+        for (int i = 0; i < nJoints; i++) {
+            const Joint *joint = joints[i];
+            joint->name();
+            joint->englishName();
+        }
+    }
+    void assignMaterialIndexRanges() {
+        const int nmaterials = materials.count(), nindices = indices.count();
+        int offset = 0;
+        for (int i = 0; i < nmaterials; i++) {
+            Material *material = materials[i];
             IMaterial::IndexRange range = material->indexRange();
             int offsetTo = offset + range.count;
             range.start = nindices;
@@ -696,58 +1359,216 @@ struct Model::PrivateContext {
             offset = offsetTo;
         }
     }
-    void parseBones(const Model::DataInfo &info) {
-        const int nbones = info.bonesCount;
-        uint8_t *ptr = info.bonesPtr;
-        size_t size;
-        for (int i = 0; i < nbones; i++) {
-            Bone *bone = bones.append(new Bone(selfRef));
-            bone->read(ptr, info, size);
-            name2boneRefs.insert(bone->name()->toHashString(), bone);
-            name2boneRefs.insert(bone->englishName()->toHashString(), bone);
-            ptr += size;
+    bool parseAll(const Model::DataInfo &info) {
+        if (!arena) {
+            arena = internal::Arena::create();
+        }
+        /* objects of the model are allocated from the arena while loading */
+        internal::Arena::Scope scope(arena);
+        parseNamesAndComments(info);
+        parseTextures(info);
+        allocateSections(info);
+        parseSections(info);
+        assignMaterialIndexRanges();
+        if (!Bone::loadBones(bones)
+                || !Material::loadMaterials(materials, textures, indices.count())
+                || !Vertex::loadVertices(vertices, bones)
+                || !Morph::loadMorphs(morphs, bones, materials, rigidBodies, vertices)
+                || !Label::loadLabels(labels, bones, morphs)
+                || !RigidBody::loadRigidBodies(rigidBodies, bones)
+                || !Joint::loadJoints(joints, rigidBodies)) {
+            dataInfo.error = info.error;
+            return false;
+        }
+        if (enableVertexCacheOptimization && !info.vertexCacheOptimized) {
+            optimizeVertexCache();
+        }
+        vertexCacheOptimized = enableVertexCacheOptimization || info.vertexCacheOptimized;
+        if (readBoneOrders(info)) {
+            /* compiled orders don't record forward references, assumes there are */
+            hasForwardBoneRefs = true;
         }
+        else {
+            hasForwardBoneRefs = Bone::sortBones(bones, BPSOrderedBones, BPSBoneLevelOffsets, APSOrderedBones, APSBoneLevelOffsets);
+        }
+        boneOrdersDirty = false;
+        selfRef->performUpdate();
+        dataInfo = info;
+        return true;
     }
-    void parseMorphs(const Model::DataInfo &info) {
-        const int nmorphs = info.morphsCount;
-        uint8_t *ptr = info.morphsPtr;
-        size_t size;
-        for(int i = 0; i < nmorphs; i++) {
-            Morph *morph = morphs.append(new Morph(selfRef));
-            morph->read(ptr, info, size);
-            name2morphRefs.insert(morph->name()->toHashString(), morph);
-            name2morphRefs.insert(morph->englishName()->toHashString(), morph);
-            ptr += size;
+    void estimateDataInfo(Model::DataInfo &info, Flags &flags) const {
+        /* sizes of indices are decided by counts of objects, not by the loaded data */
+        info = dataInfo;
+        info.codec = IString::kUTF8; // TODO: UTF-16 support
+        flags.codec = 1;
+        flags.additionalUVSize = uint8_t(info.additionalUVSize);
+        flags.boneIndexSize = Flags::estimateSize(bones.count());
+        flags.materialIndexSize = Flags::estimateSize(materials.count());
+        flags.morphIndexSize = Flags::estimateSize(morphs.count());
+        flags.rigidBodyIndexSize = Flags::estimateSize(rigidBodies.count());
+        flags.textureIndexSize = Flags::estimateSize(textures.count());
+        flags.vertexIndexSize = Flags::estimateSize(vertices.count());
+        flags.copy(info);
+    }
+    bool preparseCompiled(const uint8_t *data, size_t size, Model::DataInfo &info) {
+        CompiledHeader header;
+        if (!data || sizeof(header) > size) {
+            VPVL2_LOG(WARNING, "Data is null or compiled PMX header not satisfied: " << size);
+            dataInfo.error = kInvalidHeaderError;
+            return false;
+        }
+        internal::getData(data, header);
+        if (header.version != kCompiledVersion) {
+            VPVL2_LOG(WARNING, "Unsupported compiled PMX version detected: " << header.version);
+            dataInfo.error = kInvalidVersionError;
+            return false;
+        }
+        const size_t rest = size - sizeof(header), dataSize = header.dataSize;
+        if (dataSize > rest || header.boneOrdersSize > rest - dataSize) {
+            VPVL2_LOG(WARNING, "Invalid size of compiled PMX detected: data=" << dataSize << " boneOrders=" << header.boneOrdersSize << " rest=" << rest);
+            dataInfo.error = kInvalidHeaderError;
+            return false;
+        }
+        Flags &flags = header.dataFlags;
+        if (flags.codec > 1 || flags.additionalUVSize >= Vertex::kMaxMorphs
+                || !isValidIndexSize(flags.vertexIndexSize) || !isValidIndexSize(flags.textureIndexSize)
+                || !isValidIndexSize(flags.materialIndexSize) || !isValidIndexSize(flags.boneIndexSize)
+                || !isValidIndexSize(flags.morphIndexSize) || !isValidIndexSize(flags.rigidBodyIndexSize)) {
+            VPVL2_LOG(WARNING, "Invalid flags of compiled PMX detected");
+            dataInfo.error = kInvalidFlagSizeError;
+            return false;
+        }
+        /*
+         * the data is a saved PMX model. items of all sections are validated by the PMX preparser
+         * because readers of items trust it, then sections must be same as the header says
+         */
+        uint8_t *base = const_cast<uint8_t *>(data) + sizeof(header);
+        if (!selfRef->preparse(base, dataSize, info)) {
+            VPVL2_LOG(WARNING, "Invalid data of compiled PMX detected: error=" << dataInfo.error);
+            return false;
         }
+        if (memcmp(&flags, base + sizeof(Header) + sizeof(uint8_t), sizeof(flags)) != 0
+                || header.modelVersion != info.version
+                || !isSameSpan(header.name, base, info.namePtr, info.nameSize)
+                || !isSameSpan(header.englishName, base, info.englishNamePtr, info.englishNameSize)
+                || !isSameSpan(header.comment, base, info.commentPtr, info.commentSize)
+                || !isSameSpan(header.englishComment, base, info.englishCommentPtr, info.englishCommentSize)
+                || !isSameSpan(header.vertices, base, info.verticesPtr, info.verticesCount)
+                || !isSameSpan(header.indices, base, info.indicesPtr, info.indicesCount)
+                || !isSameSpan(header.textures, base, info.texturesPtr, info.texturesCount)
+                || !isSameSpan(header.materials, base, info.materialsPtr, info.materialsCount)
+                || !isSameSpan(header.bones, base, info.bonesPtr, info.bonesCount)
+                || !isSameSpan(header.morphs, base, info.morphsPtr, info.morphsCount)
+                || !isSameSpan(header.labels, base, info.labelsPtr, info.labelsCount)
+                || !isSameSpan(header.rigidBodies, base, info.rigidBodiesPtr, info.rigidBodiesCount)
+                || !isSameSpan(header.joints, base, info.jointsPtr, info.jointsCount)) {
+            VPVL2_LOG(WARNING, "Sections of compiled PMX don't match its data");
+            dataInfo.error = kInvalidHeaderError;
+            return false;
+        }
+        info.boneOrdersPtr = info.endPtr;
+        info.boneOrdersSize = header.boneOrdersSize;
+        info.vertexCacheOptimized = internal::hasFlagBits(header.flags, kCompiledVertexCacheOptimizedFlag);
+        info.encoding = encodingRef;
+        return true;
     }
-    void parseLabels(const Model::DataInfo &info) {
-        const int nlabels = info.labelsCount;
-        uint8_t *ptr = info.labelsPtr;
-        size_t size;
-        for(int i = 0; i < nlabels; i++) {
-            Label *label = labels.append(new Label(selfRef));
-            label->read(ptr, info, size);
-            ptr += size;
+    static void writeBoneOrder(const Array<Bone *> &orderedBones, const Array<int> &levelOffsets, uint8_t *&data) {
+        const int32_t nbones = orderedBones.count();
+        internal::writeBytes(&nbones, sizeof(nbones), data);
+        for (int i = 0; i < nbones; i++) {
+            const int32_t index = orderedBones[i]->index();
+            internal::writeBytes(&index, sizeof(index), data);
+        }
+        const int32_t noffsets = levelOffsets.count();
+        internal::writeBytes(&noffsets, sizeof(noffsets), data);
+        for (int i = 0; i < noffsets; i++) {
+            const int32_t offset = levelOffsets[i];
+            internal::writeBytes(&offset, sizeof(offset), data);
         }
     }
-    void parseRigidBodies(const Model::DataInfo &info) {
-        const int nRigidBodies = info.rigidBodiesCount;
-        uint8_t *ptr = info.rigidBodiesPtr;
-        size_t size;
-        for(int i = 0; i < nRigidBodies; i++) {
-            RigidBody *rigidBody = rigidBodies.append(new RigidBody(selfRef, encodingRef));
-            rigidBody->read(ptr, info, size);
-            ptr += size;
+    bool readBoneOrder(uint8_t *&ptr, size_t &rest, Array<Bone *> &orderedBones, Array<int> &levelOffsets) const {
+        const int nbones = bones.count();
+        int32_t nOrderedBones, noffsets;
+        if (!internal::getTyped(ptr, rest, nOrderedBones) || !internal::checkBound(nOrderedBones, 0, nbones + 1)) {
+            return false;
+        }
+        orderedBones.resize(nOrderedBones);
+        for (int i = 0; i < nOrderedBones; i++) {
+            int32_t index;
+            if (!internal::getTyped(ptr, rest, index) || !internal::checkBound(index, 0, nbones)) {
+                return false;
+            }
+            orderedBones[i] = bones[index];
+        }
+        /* offsets of levels start with 0 and end with the count of bones in ascending order */
+        if (!internal::getTyped(ptr, rest, noffsets) || !internal::checkBound(noffsets, 1, nOrderedBones + 2)) {
+            return false;
+        }
+        levelOffsets.resize(noffsets);
+        for (int i = 0; i < noffsets; i++) {
+            int32_t offset;
+            if (!internal::getTyped(ptr, rest, offset) || offset < (i > 0 ? levelOffsets[i - 1] : 0)) {
+                return false;
+            }
+            levelOffsets[i] = offset;
+        }
+        return levelOffsets[0] == 0 && levelOffsets[noffsets - 1] == nOrderedBones;
+    }
+    bool readBoneOrders(const Model::DataInfo &info) {
+        uint8_t *ptr = info.boneOrdersPtr;
+        size_t rest = info.boneOrdersSize;
+        if (ptr && readBoneOrder(ptr, rest, BPSOrderedBones, BPSBoneLevelOffsets)
+                && readBoneOrder(ptr, rest, APSOrderedBones, APSBoneLevelOffsets)) {
+            if (BPSOrderedBones.count() + APSOrderedBones.count() == bones.count()) {
+                return true;
+            }
         }
+        if (ptr) {
+            VPVL2_LOG(WARNING, "Bone orders of compiled PMX are invalid, bones are sorted again");
+        }
+        return false;
     }
-    void parseJoints(const Model::DataInfo &info) {
-        const int nJoints = info.jointsCount;
-        uint8_t *ptr = info.jointsPtr;
-        size_t size;
-        for(int i = 0; i < nJoints; i++) {
-            Joint *joint = joints.append(new Joint(selfRef));
-            joint->read(ptr, info, size);
-            ptr += size;
+    void writeBoneOrders(uint8_t *&data) const {
+        /* bones are sorted again since orders are updated at the next update after changing links of bones */
+        Array<Bone *> bpsBones, apsBones;
+        Array<int> bpsLevelOffsets, apsLevelOffsets;
+        Bone::sortBones(bones, bpsBones, bpsLevelOffsets, apsBones, apsLevelOffsets);
+        writeBoneOrder(bpsBones, bpsLevelOffsets, data);
+        writeBoneOrder(apsBones, apsLevelOffsets, data);
+    }
+    size_t estimateBoneOrdersSize() const {
+        Array<Bone *> bpsBones, apsBones;
+        Array<int> bpsLevelOffsets, apsLevelOffsets;
+        Bone::sortBones(bones, bpsBones, bpsLevelOffsets, apsBones, apsLevelOffsets);
+        const int nvalues = bpsBones.count() + bpsLevelOffsets.count() + apsBones.count() + apsLevelOffsets.count();
+        return sizeof(int32_t) * (nvalues + 4);
+    }
+    /*
+     * built at the first lookup by name so loading doesn't decode names of bones and morphs.
+     * lookups are const and may be called from threads, nameIndicesLock must be held.
+     */
+    void buildNameIndices() {
+        name2boneRefs.clear();
+        const int nbones = bones.count();
+        for (int i = 0; i < nbones; i++) {
+            Bone *bone = bones[i];
+            insertName(bone->name(), bone, name2boneRefs);
+            insertName(bone->englishName(), bone, name2boneRefs);
+        }
+        name2morphRefs.clear();
+        const int nmorphs = morphs.count();
+        for (int i = 0; i < nmorphs; i++) {
+            Morph *morph = morphs[i];
+            insertName(morph->name(), morph, name2morphRefs);
+            insertName(morph->englishName(), morph, name2morphRefs);
+        }
+        nameIndicesDirty = false;
+    }
+    template<typename TObject, typename TInterface>
+    static void insertName(const IString *name, TObject *value, Hash<HashString, TInterface *> &names) {
+        /* objects created by createBone/createMorph have no names until set */
+        if (name) {
+            names.insert(name->toHashString(), value);
         }
     }
 
@@ -757,22 +1578,30 @@ struct Model::PrivateContext {
     IModel *parentModelRef;
     IBone *parentBoneRef;
     PointerArray<Vertex> vertices;
+    internal::BonePalette bonePalette;
+    internal::VertexStore vertexStore;
     Array<int> indices;
     PointerHash<HashString, IString> textures;
     PointerArray<Material> materials;
     PointerArray<Bone> bones;
     Array<Bone *> BPSOrderedBones;
     Array<Bone *> APSOrderedBones;
+    Array<int> BPSBoneLevelOffsets;
+    Array<int> APSBoneLevelOffsets;
     PointerArray<Morph> morphs;
+    Array<Morph *> activeMorphRefs;
     PointerArray<Label> labels;
     PointerArray<RigidBody> rigidBodies;
     PointerArray<Joint> joints;
     Hash<HashString, IBone *> name2boneRefs;
     Hash<HashString, IMorph *> name2morphRefs;
-    IString *name;
-    IString *englishName;
-    IString *comment;
-    IString *englishComment;
+    internal::Mutex nameIndicesLock;
+    internal::DeferredString name;
+    internal::DeferredString englishName;
+    internal::DeferredString comment;
+    internal::DeferredString englishComment;
+    internal::MappedFile *mappedFile;
+    internal::Arena *arena;
     Vector3 aabbMax;
     Vector3 aabbMin;
     Vector3 position;
@@ -783,6 +1612,13 @@ struct Model::PrivateContext {
     DataInfo dataInfo;
     bool visible;
     bool enablePhysics;
+    bool enableVertexCacheOptimization;
+    bool nameIndicesDirty;
+    bool boneOrdersDirty;
+    bool hasForwardBoneRefs;
+    bool hasStaleBones;
+    bool vertexCacheOptimized;
+    bool dirty;
 };
 
 Model::Model(IEncoding *encoding)
@@ -802,35 +1638,28 @@ bool Model::load(const uint8_t *data, size_t size)
 {
     DataInfo info;
     internal::zerofill(&info, sizeof(info));
-    if (preparse(data, size, info)) {
+    if (isCompiled(data, size) ? m_context->preparseCompiled(data, size, info) : preparse(data, size, info)) {
         m_context->release();
-        m_context->parseNamesAndComments(info);
-        m_context->parseVertices(info);
-        m_context->parseIndices(info);
-        m_context->parseTextures(info);
-        m_context->parseMaterials(info);
-        m_context->parseBones(info);
-        m_context->parseMorphs(info);
-        m_context->parseLabels(info);
-        m_context->parseRigidBodies(info);
-        m_context->parseJoints(info);
-        if (!Bone::loadBones(m_context->bones)
-                || !Material::loadMaterials(m_context->materials, m_context->textures, m_context->indices.count())
-                || !Vertex::loadVertices(m_context->vertices, m_context->bones)
-                || !Morph::loadMorphs(m_context->morphs, m_context->bones, m_context->materials, m_context->rigidBodies, m_context->vertices)
-                || !Label::loadLabels(m_context->labels, m_context->bones, m_context->morphs)
-                || !RigidBody::loadRigidBodies(m_context->rigidBodies, m_context->bones)
-                || !Joint::loadJoints(m_context->joints, m_context->rigidBodies)) {
-            m_context->dataInfo.error = info.error;
-            return false;
-        }
-        Bone::sortBones(m_context->bones, m_context->BPSOrderedBones, m_context->APSOrderedBones);
-        performUpdate();
-        m_context->dataInfo = info;
-        return true;
+        return m_context->parseAll(info);
+    }
+    /* the error is already recorded by the preparser */
+    return false;
+}
+
+bool Model::loadMapped(internal::MappedFile *file)
+{
+    DataInfo info;
+    internal::zerofill(&info, sizeof(info));
+    if (file && (isCompiled(file->data(), file->size())
+                 ? m_context->preparseCompiled(file->data(), file->size(), info)
+                 : preparse(file->data(), file->size(), info))) {
+        m_context->release();
+        m_context->mappedFile = file;
+        info.deferStringDecoding = true;
+        return m_context->parseAll(info);
     }
     else {
-        m_context->dataInfo.error = info.error;
+        delete file;
     }
     return false;
 }
@@ -843,25 +1672,17 @@ void Model::save(uint8_t *data, size_t &written) const
     internal::writeBytes("PMX ", sizeof(header.signature), signature);
     header.version = m_context->dataInfo.version;
     internal::writeBytes(&header, sizeof(header), data);
-    IString::Codec codec = IString::kUTF8; // TODO: UTF-16 support
     Flags flags;
-    DataInfo info = m_context->dataInfo;
-    info.codec = codec;
-    flags.additionalUVSize = 0;
-    flags.boneIndexSize = Flags::estimateSize(m_context->bones.count());
-    flags.codec = codec == IString::kUTF8 ? 1 : 0;
-    flags.materialIndexSize = Flags::estimateSize(m_context->materials.count());
-    flags.morphIndexSize = Flags::estimateSize(m_context->morphs.count());
-    flags.rigidBodyIndexSize = Flags::estimateSize(m_context->rigidBodies.count());
-    flags.textureIndexSize = Flags::estimateSize(m_context->textures.count());
-    flags.vertexIndexSize = Flags::estimateSize(m_context->vertices.count());
+    DataInfo info;
+    m_context->estimateDataInfo(info, flags);
+    const IString::Codec codec = info.codec;
     uint8_t flagSize = sizeof(flags);
     internal::writeBytes(&flagSize, sizeof(flagSize), data);
     internal::writeBytes(&flags, sizeof(flags), data);
-    internal::writeString(m_context->name, codec, data);
-    internal::writeString(m_context->englishName, codec, data);
-    internal::writeString(m_context->comment, codec, data);
-    internal::writeString(m_context->englishComment, codec, data);
+    internal::writeString(m_context->name.value(), codec, data);
+    internal::writeString(m_context->englishName.value(), codec, data);
+    internal::writeString(m_context->comment.value(), codec, data);
+    internal::writeString(m_context->englishComment.value(), codec, data);
     Vertex::writeVertices(m_context->vertices, info, data);
     const int nindices = m_context->indices.count();
     internal::writeBytes(&nindices, sizeof(nindices), data);
@@ -888,19 +1709,20 @@ void Model::save(uint8_t *data, size_t &written) const
 size_t Model::estimateSize() const
 {
     size_t size = 0;
-    IString::Codec codec = IString::kUTF8; // TODO: UTF-16 support
-    DataInfo info = m_context->dataInfo;
-    info.codec = codec;
+    Flags flags;
+    DataInfo info;
+    m_context->estimateDataInfo(info, flags);
+    const IString::Codec codec = info.codec;
     size += sizeof(Header);
     size += sizeof(uint8_t) + sizeof(Flags);
-    size += internal::estimateSize(m_context->name, codec);
-    size += internal::estimateSize(m_context->englishName, codec);
-    size += internal::estimateSize(m_context->comment, codec);
-    size += internal::estimateSize(m_context->englishComment, codec);
-    size += Vertex::estimateTotalSize(m_context->vertices, m_context->dataInfo);
+    size += internal::estimateSize(m_context->name.value(), codec);
+    size += internal::estimateSize(m_context->englishName.value(), codec);
+    size += internal::estimateSize(m_context->comment.value(), codec);
+    size += internal::estimateSize(m_context->englishComment.value(), codec);
+    size += Vertex::estimateTotalSize(m_context->vertices, info);
     const int nindices = m_context->indices.count();
     size += sizeof(nindices);
-    size += m_context->dataInfo.vertexIndexSize * nindices;
+    size += info.vertexIndexSize * nindices;
     const int ntextures = m_context->textures.count();
     size += sizeof(ntextures);
     for (int i = 0; i < ntextures; i++) {
@@ -916,14 +1738,69 @@ size_t Model::estimateSize() const
     return size;
 }
 
+bool Model::saveCompiled(uint8_t *data, size_t &written) const
+{
+    CompiledHeader header;
+    internal::zerofill(&header, sizeof(header));
+    uint8_t *base = data + sizeof(header), *ptr = base;
+    size_t dataSize;
+    save(base, dataSize);
+    /* locates sections of the saved data, this also validates it */
+    DataInfo info;
+    internal::zerofill(&info, sizeof(info));
+    Model model(m_context->encodingRef);
+    if (!model.preparse(base, dataSize, info)) {
+        VPVL2_LOG(WARNING, "The saved PMX is not able to be compiled: error=" << model.error());
+        written = 0;
+        return false;
+    }
+    internal::copyBytes(header.signature, kCompiledSignature, sizeof(header.signature));
+    header.version = kCompiledVersion;
+    header.flags = m_context->vertexCacheOptimized ? kCompiledVertexCacheOptimizedFlag : 0;
+    header.dataSize = uint32_t(dataSize);
+    header.modelVersion = info.version;
+    internal::getData(base + sizeof(Header) + sizeof(uint8_t), header.dataFlags);
+    setCompiledSpan(base, info.namePtr, info.nameSize, header.name);
+    setCompiledSpan(base, info.englishNamePtr, info.englishNameSize, header.englishName);
+    setCompiledSpan(base, info.commentPtr, info.commentSize, header.comment);
+    setCompiledSpan(base, info.englishCommentPtr, info.englishCommentSize, header.englishComment);
+    setCompiledSpan(base, info.verticesPtr, info.verticesCount, header.vertices);
+    setCompiledSpan(base, info.indicesPtr, info.indicesCount, header.indices);
+    setCompiledSpan(base, info.texturesPtr, info.texturesCount, header.textures);
+    setCompiledSpan(base, info.materialsPtr, info.materialsCount, header.materials);
+    setCompiledSpan(base, info.bonesPtr, info.bonesCount, header.bones);
+    setCompiledSpan(base, info.morphsPtr, info.morphsCount, header.morphs);
+    setCompiledSpan(base, info.labelsPtr, info.labelsCount, header.labels);
+    setCompiledSpan(base, info.rigidBodiesPtr, info.rigidBodiesCount, header.rigidBodies);
+    setCompiledSpan(base, info.jointsPtr, info.jointsCount, header.joints);
+    ptr += dataSize;
+    m_context->writeBoneOrders(ptr);
+    header.boneOrdersSize = uint32_t(ptr - base - dataSize);
+    written = ptr - data;
+    internal::writeBytes(&header, sizeof(header), data);
+    return true;
+}
+
+size_t Model::estimateCompiledSize() const
+{
+    return sizeof(CompiledHeader) + estimateSize() + m_context->estimateBoneOrdersSize();
+}
+
+bool Model::isCompiled(const uint8_t *data, size_t size)
+{
+    return data && size >= sizeof(CompiledHeader) && memcmp(data, kCompiledSignature, sizeof(kCompiledSignature) - 1) == 0;
+}
+
 void Model::joinWorld(btDiscreteDynamicsWorld *worldRef)
 {
     if (worldRef && m_context->enablePhysics) {
         const int nRigidBodies = m_context->rigidBodies.count();
         for (int i = 0; i < nRigidBodies; i++) {
             RigidBody *rigidBody = m_context->rigidBodies[i];
+            rigidBody->setBatchSyncEnable(true);
             rigidBody->joinWorld(worldRef);
         }
+        m_context->syncKinematicRigidBodies();
         const int njoints = m_context->joints.count();
         for (int i = 0; i < njoints; i++) {
             Joint *joint = m_context->joints[i];
@@ -954,12 +1831,13 @@ void Model::resetMotionState(btDiscreteDynamicsWorld *worldRef)
         return;
     }
     /* update worldTransform first to use it at RigidBody#setKinematic */
+    m_context->sortBonesIfNeeded();
     const int nbones = m_context->BPSOrderedBones.count();
     for (int i = 0; i < nbones; i++) {
         Bone *bone = m_context->BPSOrderedBones[i];
         bone->resetIKLink();
     }
-    updateLocalTransform(m_context->BPSOrderedBones);
+    updateLocalTransform(m_context->BPSOrderedBones, m_context->BPSBoneLevelOffsets);
     btOverlappingPairCache *cache = worldRef->getPairCache();
     btDispatcher *dispatcher = worldRef->getDispatcher();
     const int nRigidBodies = m_context->rigidBodies.count();
@@ -981,43 +1859,92 @@ void Model::resetMotionState(btDiscreteDynamicsWorld *worldRef)
         Joint *joint = m_context->joints[i];
         joint->updateTransform();
     }
-    updateLocalTransform(m_context->APSOrderedBones);
+    updateLocalTransform(m_context->APSOrderedBones, m_context->APSBoneLevelOffsets);
+    m_context->bonePalette.update(m_context->bones);
+    m_context->syncKinematicRigidBodies();
 }
 
 void Model::performUpdate()
 {
+    if (!m_context->isDirty()) {
+        return;
+    }
+    m_context->sortBonesIfNeeded();
+    /* a bone referring bones transformed after it gets their values at the last update */
+    const bool hasStaleBones = m_context->hasForwardBoneRefs && m_context->isChanged();
     // update local transform matrix
     const int nbones = m_context->bones.count();
     for (int i = 0; i < nbones; i++) {
         Bone *bone = m_context->bones[i];
         bone->resetIKLink();
     }
-    internal::ParallelResetVertexProcessor<pmx::Vertex> processor(&m_context->vertices);
-    processor.execute();
+    internal::VertexStore &store = m_context->vertexStore;
+    if (m_context->dirty) {
+        /* structure of the model may be changed, reset all vertices */
+        if (store.isEnabled() && (!store.isDirty() || m_context->buildVertexStore())) {
+            store.resetMorphs();
+        }
+        else {
+            internal::ParallelResetVertexProcessor<pmx::Vertex> processor(&m_context->vertices);
+            processor.execute();
+        }
+    }
+    else {
+        /* only vertices merged by vertex/UV morphs at the last update have deltas */
+        const Array<Morph *> &activeMorphRefs = m_context->activeMorphRefs;
+        const int nActiveMorphs = activeMorphRefs.count();
+        for (int i = 0; i < nActiveMorphs; i++) {
+            Morph *morph = activeMorphRefs[i];
+            morph->resetVertices();
+        }
+    }
     const int nmorphs = m_context->morphs.count();
     for (int i = 0; i < nmorphs; i++) {
         Morph *morph = m_context->morphs[i];
         morph->syncWeight();
     }
+    for (int i = 0; i < nmorphs; i++) {
+        Morph *morph = m_context->morphs[i];
+        /*
+         * vertex/UV morphs still weighted have to be merged again because their vertices are reset.
+         * children of group morphs are merged again by the parent group morph.
+         */
+        if (!morph->isDirty() && !morph->hasParent() && morph->hasVertexMorphs() && morph->internalWeight() != 0) {
+            morph->setDirty(true);
+        }
+    }
     for (int i = 0; i < nmorphs; i++) {
         Morph *morph = m_context->morphs[i];
         morph->update();
     }
+    m_context->updateActiveMorphs();
     // before physics simulation
-    updateLocalTransform(m_context->BPSOrderedBones);
+    updateLocalTransform(m_context->BPSOrderedBones, m_context->BPSBoneLevelOffsets);
     if (m_context->enablePhysics) {
         // physics simulation
         internal::ParallelUpdateRigidBodyProcessor<pmx::RigidBody> processor(&m_context->rigidBodies);
         processor.execute();
     }
     // after physics simulation
-    updateLocalTransform(m_context->APSOrderedBones);
+    updateLocalTransform(m_context->APSOrderedBones, m_context->APSBoneLevelOffsets);
+    // snapshot of local transforms for skinning
+    m_context->bonePalette.update(m_context->bones);
+    if (m_context->enablePhysics) {
+        m_context->syncKinematicRigidBodies();
+    }
+    m_context->clearDirty();
+    /* so such bones are transformed once again at the next update even if nothing is changed */
+    m_context->hasStaleBones = hasStaleBones;
 }
 
 IBone *Model::findBoneRef(const IString *value) const
 {
     if (value) {
         const HashString &key = value->toHashString();
+        internal::Mutex::ScopedLock lock(m_context->nameIndicesLock);
+        if (m_context->nameIndicesDirty) {
+            m_context->buildNameIndices();
+        }
         IBone *const *bone = m_context->name2boneRefs.find(key);
         return bone ? *bone : 0;
     }
@@ -1028,6 +1955,10 @@ IMorph *Model::findMorphRef(const IString *value) const
 {
     if (value) {
         const HashString &key = value->toHashString();
+        internal::Mutex::ScopedLock lock(m_context->nameIndicesLock);
+        if (m_context->nameIndicesDirty) {
+            m_context->buildNameIndices();
+        }
         IMorph *const *morph = m_context->name2morphRefs.find(key);
         return morph ? *morph : 0;
     }
@@ -1361,22 +2292,22 @@ const Array<Joint *> &Model::joints() const
 
 const IString *Model::name() const
 {
-    return m_context->name;
+    return m_context->name.value();
 }
 
 const IString *Model::englishName() const
 {
-    return m_context->englishName;
+    return m_context->englishName.value();
 }
 
 const IString *Model::comment() const
 {
-    return m_context->comment;
+    return m_context->comment.value();
 }
 
 const IString *Model::englishComment() const
 {
-    return m_context->englishComment;
+    return m_context->englishComment.value();
 }
 
 IModel::ErrorType Model::error() const
@@ -1441,22 +2372,22 @@ IBone *Model::parentBoneRef() const
 
 void Model::setName(const IString *value)
 {
-    internal::setString(value, m_context->name);
+    m_context->name.setValue(value);
 }
 
 void Model::setEnglishName(const IString *value)
 {
-    internal::setString(value, m_context->englishName);
+    m_context->englishName.setValue(value);
 }
 
 void Model::setComment(const IString *value)
 {
-    internal::setString(value, m_context->comment);
+    m_context->comment.setValue(value);
 }
 
 void Model::setEnglishComment(const IString *value)
 {
-    internal::setString(value, m_context->englishComment);
+    m_context->englishComment.setValue(value);
 }
 
 void Model::setWorldPosition(const Vector3 &value)
@@ -1486,6 +2417,7 @@ void Model::setEdgeColor(const Vector3 & /* value */)
 void Model::setEdgeWidth(const IVertex::EdgeSizePrecision &value)
 {
     m_context->edgeWidth = value;
+    m_context->dirty = true;
 }
 
 void Model::setParentSceneRef(Scene *value)
@@ -1510,15 +2442,58 @@ void Model::setParentBoneRef(IBone *value)
 void Model::setPhysicsEnable(bool value)
 {
     m_context->enablePhysics = value;
+    m_context->dirty = true;
 }
 
-void Model::updateLocalTransform(Array<Bone *> &bones)
+bool Model::isDirty() const
 {
-    const int nbones = bones.count();
-    for (int i = 0; i < nbones; i++) {
-        Bone *bone = bones[i];
-        bone->performTransform();
-        bone->solveInverseKinematics();
+    return m_context->isDirty();
+}
+
+void Model::setDirty(bool value)
+{
+    if (value) {
+        m_context->dirty = true;
+    }
+    else {
+        m_context->clearDirty();
+    }
+}
+
+bool Model::isVertexStoreEnabled() const
+{
+    return m_context->vertexStore.isEnabled();
+}
+
+void Model::setVertexStoreEnable(bool value)
+{
+    internal::VertexStore &store = m_context->vertexStore;
+    if (value && !store.isEnabled()) {
+        m_context->buildVertexStore();
+    }
+    else if (!value && store.isEnabled()) {
+        store.release(m_context->vertices);
+    }
+    m_context->dirty = true;
+}
+
+bool Model::isVertexCacheOptimizationEnabled() const
+{
+    return m_context->enableVertexCacheOptimization;
+}
+
+void Model::setVertexCacheOptimizationEnable(bool value)
+{
+    m_context->enableVertexCacheOptimization = value;
+}
+
+void Model::updateLocalTransform(Array<Bone *> &bones, const Array<int> &levelOffsets)
+{
+    /* bones in a level are independent, levels must be transformed in order */
+    internal::ParallelPerformTransformProcessor<pmx::Bone> transformProcessor(&bones);
+    const int nlevels = levelOffsets.count() - 1;
+    for (int i = 0; i < nlevels; i++) {
+        transformProcessor.execute(levelOffsets[i], levelOffsets[i + 1]);
     }
     internal::ParallelUpdateLocalTransformProcessor<pmx::Bone> processor(&bones);
     processor.execute();
@@ -1541,7 +2516,8 @@ void Model::getDynamicVertexBuffer(DynamicVertexBuffer *&dynamicBuffer,
 {
     delete dynamicBuffer;
     if (indexBuffer && indexBuffer->ident() == &DefaultIndexBuffer::kIdent) {
-        dynamicBuffer = new DefaultDynamicVertexBuffer(this, indexBuffer);
+        dynamicBuffer = new DefaultDynamicVertexBuffer(this, indexBuffer, &m_context->bonePalette,
+                                                       &m_context->vertexStore, int(m_context->dataInfo.additionalUVSize));
     }
     else {
         dynamicBuffer = 0;
@@ -1555,9 +2531,18 @@ void Model::getMatrixBuffer(MatrixBuffer *&matrixBuffer,
     delete matrixBuffer;
     if (indexBuffer && indexBuffer->ident() == &DefaultIndexBuffer::kIdent &&
             dynamicBuffer && dynamicBuffer->ident() == &DefaultDynamicVertexBuffer::kIdent) {
-        matrixBuffer = new DefaultMatrixBuffer(this,
-                                               static_cast<const DefaultIndexBuffer *>(indexBuffer),
-                                               static_cast<DefaultDynamicVertexBuffer *>(dynamicBuffer));
+        DefaultMatrixBuffer *buffer = new DefaultMatrixBuffer(this,
+                                                              static_cast<const DefaultIndexBuffer *>(indexBuffer),
+                                                              &m_context->bonePalette,
+                                                              static_cast<DefaultDynamicVertexBuffer *>(dynamicBuffer));
+        if (buffer->initialize()) {
+            matrixBuffer = buffer;
+        }
+        else {
+            VPVL2_LOG(WARNING, "Cannot split materials into meshes within " << internal::SkinningMeshes::kMaxBones << " bones: " << internal::cstr(name(), "(null)"));
+            delete buffer;
+            matrixBuffer = 0;
+        }
     }
     else {
         matrixBuffer = 0;
@@ -1672,12 +2657,17 @@ void Model::setIndices(const Array<int> &value)
             m_context->indices.append(0);
         }
     }
+    m_context->vertexCacheOptimized = false;
+    m_context->dirty = true;
 }
 
 void Model::addBone(IBone *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->bones);
-    Bone::sortBones(m_context->bones, m_context->BPSOrderedBones, m_context->APSOrderedBones);
+    m_context->vertexStore.invalidate();
+    m_context->nameIndicesDirty = true;
+    m_context->boneOrdersDirty = true;
+    m_context->dirty = true;
 }
 
 void Model::addJoint(IJoint *value)
@@ -1693,26 +2683,37 @@ void Model::addLabel(ILabel *value)
 void Model::addMaterial(IMaterial *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->materials);
+    m_context->vertexStore.invalidate();
+    m_context->dirty = true;
 }
 
 void Model::addMorph(IMorph *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->morphs);
+    m_context->nameIndicesDirty = true;
+    m_context->dirty = true;
 }
 
 void Model::addRigidBody(IRigidBody *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->rigidBodies);
+    m_context->dirty = true;
 }
 
 void Model::addVertex(IVertex *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->vertices);
+    m_context->vertexStore.invalidate();
+    m_context->dirty = true;
 }
 
 void Model::removeBone(IBone *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->bones);
+    m_context->vertexStore.invalidate();
+    m_context->nameIndicesDirty = true;
+    m_context->boneOrdersDirty = true;
+    m_context->dirty = true;
 }
 
 void Model::removeJoint(IJoint *value)
@@ -1728,21 +2729,28 @@ void Model::removeLabel(ILabel *value)
 void Model::removeMaterial(IMaterial *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->materials);
+    m_context->vertexStore.invalidate();
+    m_context->dirty = true;
 }
 
 void Model::removeMorph(IMorph *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->morphs);
+    m_context->nameIndicesDirty = true;
+    m_context->dirty = true;
 }
 
 void Model::removeRigidBody(IRigidBody *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->rigidBodies);
+    m_context->dirty = true;
 }
 
 void Model::removeVertex(IVertex *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->vertices);
+    m_context->vertexStore.invalidate();
+    m_context->dirty = true;
 }
 
 void Model::addTexture(const IString *value)
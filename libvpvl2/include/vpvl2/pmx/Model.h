@@ -47,6 +47,10 @@
 
 namespace vpvl2
 {
+namespace internal
+{
+class MappedFile;
+}
 namespace pmx
 {
 
@@ -128,6 +132,10 @@ public:
         uint8_t *jointsPtr;
         size_t jointsCount;
         uint8_t *endPtr;
+        uint8_t *boneOrdersPtr;
+        size_t boneOrdersSize;
+        bool deferStringDecoding;
+        bool vertexCacheOptimized;
     };
 
     /**
@@ -137,8 +145,29 @@ public:
     ~Model();
 
     bool load(const uint8_t *data, size_t size);
+    /**
+     * Loads the model directly from the mapped file and takes the ownership of it.
+     *
+     * Names, comments and user data areas are kept as spans of the mapped file
+     * and decoded when they are accessed at the first time, the file is kept
+     * mapped until the model is released or loaded again. The file is deleted
+     * immediately if it's not a valid PMX data.
+     */
+    bool loadMapped(internal::MappedFile *file);
     void save(uint8_t *data, size_t &written) const;
     size_t estimateSize() const;
+    /**
+     * Saves the model as a compiled model for the fast loading.
+     *
+     * The compiled model is a header locating each section, the PMX data saved with
+     * UTF-8 names and the resolved order of bones. load and loadMapped accept it
+     * without walking the whole data and sorting bones, and triangles reordered by
+     * the vertex cache optimization are not reordered again. Returns false if the
+     * saved data is not able to be parsed.
+     */
+    bool saveCompiled(uint8_t *data, size_t &written) const;
+    size_t estimateCompiledSize() const;
+    static bool isCompiled(const uint8_t *data, size_t size);
 
     void joinWorld(btDiscreteDynamicsWorld *worldRef);
     void leaveWorld(btDiscreteDynamicsWorld *worldRef);
@@ -207,7 +236,36 @@ public:
     void setParentBoneRef(IBone *value);
     void setPhysicsEnable(bool value);
 
-    static void updateLocalTransform(Array<Bone *> &bones);
+    /**
+     * Enables the vertex store that skins all vertices from contiguous arrays.
+     *
+     * It's disabled by default. Vertices still work as IVertex while it's enabled.
+     */
+    bool isVertexStoreEnabled() const;
+    void setVertexStoreEnable(bool value);
+
+    /**
+     * Reorders triangles of each material and vertices for the vertex cache of GPU in load.
+     *
+     * It's disabled by default and must be enabled before load. Indices of vertices and
+     * vertex/UV morphs are remapped, so save writes vertices in the reordered order.
+     */
+    bool isVertexCacheOptimizationEnabled() const;
+    void setVertexCacheOptimizationEnable(bool value);
+
+    /**
+     * Returns true if performUpdate has to transform bones, morphs and vertices.
+     *
+     * Changes of bones (Bone#setLocalTranslation, Bone#setLocalRotation and so on), morph
+     * weights and objects of the model are tracked. The model with physics is always dirty.
+     * The model stays dirty for one more update after changes if a bone refers a bone
+     * transformed after it, such as a child preceding its parent.
+     * Call setDirty(true) after modifying vertices or materials directly.
+     */
+    bool isDirty() const;
+    void setDirty(bool value);
+
+    static void updateLocalTransform(Array<Bone *> &bones, const Array<int> &levelOffsets);
     void getIndexBuffer(IndexBuffer *&indexBuffer) const;
     void getStaticVertexBuffer(StaticVertexBuffer *&staticBuffer) const;
     void getDynamicVertexBuffer(DynamicVertexBuffer *&dynamicBuffer,
@@ -35,6 +35,7 @@
 /* ----------------------------------------------------------------- */
 
 #include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/DeferredString.h"
 #include "vpvl2/internal/util.h"
 
 #include "vpvl2/pmx/Bone.h"
@@ -104,10 +105,10 @@ namespace pmx
 {
 
 struct Morph::PrivateContext {
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     PrivateContext(IModel *modelRef)
         : modelRef(modelRef),
-          name(0),
-          englishName(0),
           weight(0),
           internalWeight(0),
           category(kBase),
@@ -125,10 +126,8 @@ struct Morph::PrivateContext {
         groups.releaseAll();
         flips.releaseAll();
         impulses.releaseAll();
-        delete name;
-        name = 0;
-        delete englishName;
-        englishName = 0;
+        name.release();
+        englishName.release();
         modelRef = 0;
         weight = 0;
         internalWeight = 0;
@@ -490,8 +489,8 @@ struct Morph::PrivateContext {
     PointerArray<Flip> flips;
     PointerArray<Impulse> impulses;
     IModel *modelRef;
-    IString *name;
-    IString *englishName;
+    internal::DeferredString name;
+    internal::DeferredString englishName;
     IMorph::WeightPrecision weight;
     IMorph::WeightPrecision internalWeight;
     IMorph::Category category;
@@ -684,11 +683,11 @@ void Morph::read(const uint8_t *data, const Model::DataInfo &info, size_t &size)
     int32_t nNameSize;
     internal::getText(ptr, rest, namePtr, nNameSize);
     IEncoding *encoding = info.encoding;
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->name);
-    VPVL2_VLOG(3, "PMXMorph: name=" << internal::cstr(m_context->name, "(null)"));
+    m_context->name.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXMorph: name=" << internal::cstr(m_context->name.value(), "(null)"));
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_context->englishName);
-    VPVL2_VLOG(3, "PMXMorph: englishName=" << internal::cstr(m_context->englishName, "(null)"));
+    m_context->englishName.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXMorph: englishName=" << internal::cstr(m_context->englishName.value(), "(null)"));
     MorphUnit unit;
     internal::getData(ptr, unit);
     m_context->category = static_cast<Category>(unit.category);
@@ -729,8 +728,8 @@ void Morph::read(const uint8_t *data, const Model::DataInfo &info, size_t &size)
 
 void Morph::write(uint8_t *&data, const Model::DataInfo &info) const
 {
-    internal::writeString(m_context->name, info.codec, data);
-    internal::writeString(m_context->englishName, info.codec, data);
+    internal::writeString(m_context->name.value(), info.codec, data);
+    internal::writeString(m_context->englishName.value(), info.codec, data);
     MorphUnit mu;
     mu.category = m_context->category;
     mu.type = m_context->type;
@@ -782,8 +781,8 @@ void Morph::write(uint8_t *&data, const Model::DataInfo &info) const
 size_t Morph::estimateSize(const Model::DataInfo &info) const
 {
     size_t size = 0;
-    size += internal::estimateSize(m_context->name, info.codec);
-    size += internal::estimateSize(m_context->englishName, info.codec);
+    size += internal::estimateSize(m_context->name.value(), info.codec);
+    size += internal::estimateSize(m_context->englishName.value(), info.codec);
     size += sizeof(MorphUnit);
     switch (m_context->type) {
     case kGroupMorph:
@@ -824,8 +823,10 @@ IMorph::WeightPrecision Morph::weight() const
 
 void Morph::setWeight(const IMorph::WeightPrecision &value)
 {
-    m_context->weight = value;
-    m_context->dirty = true;
+    if (m_context->weight != value) {
+        m_context->weight = value;
+        m_context->dirty = true;
+    }
 }
 
 void Morph::update()
@@ -895,6 +896,10 @@ void Morph::syncWeight()
 
 void Morph::updateVertexMorphs(const WeightPrecision &value)
 {
+    /* merging zero weight doesn't change vertices */
+    if (value == 0) {
+        return;
+    }
     const int nmorphs = m_context->vertices.count();
     for (int i = 0; i < nmorphs; i++) {
         Vertex *v = m_context->vertices[i];
@@ -904,6 +909,22 @@ void Morph::updateVertexMorphs(const WeightPrecision &value)
     }
 }
 
+void Morph::resetVertices()
+{
+    const int nvertices = m_context->vertices.count();
+    for (int i = 0; i < nvertices; i++) {
+        if (pmx::Vertex *vertex = m_context->vertices[i]->vertex) {
+            vertex->reset();
+        }
+    }
+    const int nuvs = m_context->uvs.count();
+    for (int i = 0; i < nuvs; i++) {
+        if (pmx::Vertex *vertex = m_context->uvs[i]->vertex) {
+            vertex->reset();
+        }
+    }
+}
+
 void Morph::updateBoneMorphs(const WeightPrecision &value)
 {
     const int nmorphs = m_context->bones.count();
@@ -917,6 +938,9 @@ void Morph::updateBoneMorphs(const WeightPrecision &value)
 
 void Morph::updateUVMorphs(const WeightPrecision &value)
 {
+    if (value == 0) {
+        return;
+    }
     const int nmorphs = m_context->uvs.count();
     for (int i = 0; i < nmorphs; i++) {
         UV *v = m_context->uvs[i];
@@ -986,12 +1010,12 @@ void Morph::updateImpluseMorphs(const WeightPrecision &value)
 
 const IString *Morph::name() const
 {
-    return m_context->name;
+    return m_context->name.value();
 }
 
 const IString *Morph::englishName() const
 {
-    return m_context->englishName;
+    return m_context->englishName.value();
 }
 
 IModel *Morph::parentModelRef() const
@@ -1019,6 +1043,31 @@ bool Morph::hasParent() const
     return m_context->hasParent;
 }
 
+bool Morph::isDirty() const
+{
+    return m_context->dirty;
+}
+
+bool Morph::hasVertexMorphs() const
+{
+    switch (m_context->type) {
+    case kVertexMorph:
+    case kTexCoordMorph:
+    case kUVA1Morph:
+    case kUVA2Morph:
+    case kUVA3Morph:
+    case kUVA4Morph:
+        return true;
+    default:
+        return false;
+    }
+}
+
+IMorph::WeightPrecision Morph::internalWeight() const
+{
+    return m_context->internalWeight;
+}
+
 const Array<Morph::Bone *> &Morph::bones() const
 {
     return m_context->bones;
@@ -1056,12 +1105,12 @@ const Array<Morph::Impulse *> &Morph::impulses() const
 
 void Morph::setName(const IString *value)
 {
-    internal::setString(value, m_context->name);
+    m_context->name.setValue(value);
 }
 
 void Morph::setEnglishName(const IString *value)
 {
-    internal::setString(value, m_context->englishName);
+    m_context->englishName.setValue(value);
 }
 
 void Morph::addBoneMorph(Bone *value)
@@ -1072,6 +1121,9 @@ void Morph::addBoneMorph(Bone *value)
 void Morph::addGroupMorph(Group *value)
 {
     m_context->groups.append(value);
+    if (value && value->morph) {
+        value->morph->m_context->hasParent = true;
+    }
 }
 
 void Morph::addMaterialMorph(Material *value)
@@ -1120,6 +1172,11 @@ void Morph::setInternalWeight(const WeightPrecision &value)
     m_context->dirty = true;
 }
 
+void Morph::setDirty(bool value)
+{
+    m_context->dirty = value;
+}
+
 } /* namespace pmx */
 } /* namespace vpvl2 */
 
@@ -39,6 +39,7 @@
 #define VPVL2_PMX_MORPH_H_
 
 #include "vpvl2/IMorph.h"
+#include "vpvl2/internal/Arena.h"
 #include "vpvl2/pmx/Model.h"
 
 namespace vpvl2
@@ -58,7 +59,10 @@ namespace pmx
 class VPVL2_API Morph : public IMorph
 {
 public:
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     struct Bone {
+        VPVL2_DECLARE_ARENA_ALLOCATOR()
         Bone()
             : bone(0),
               index(-1)
@@ -70,6 +74,7 @@ public:
         int index;
     };
     struct Group {
+        VPVL2_DECLARE_ARENA_ALLOCATOR()
         Group()
             : morph(0),
               fixedWeight(0),
@@ -81,6 +86,7 @@ public:
         int index;
     };
     struct Material {
+        VPVL2_DECLARE_ARENA_ALLOCATOR()
         Material()
             : materials(0),
               shininess(0),
@@ -107,6 +113,7 @@ public:
         uint8_t operation;
     };
     struct UV {
+        VPVL2_DECLARE_ARENA_ALLOCATOR()
         UV()
             : vertex(0),
               index(-1),
@@ -119,6 +126,7 @@ public:
         int offset;
     };
     struct Vertex {
+        VPVL2_DECLARE_ARENA_ALLOCATOR()
         Vertex()
             : vertex(0),
               index(-1)
@@ -129,6 +137,7 @@ public:
         uint32_t index;
     };
     struct Flip {
+        VPVL2_DECLARE_ARENA_ALLOCATOR()
         Flip()
             : morph(0),
               fixedWeight(0),
@@ -140,6 +149,7 @@ public:
         int index;
     };
     struct Impulse {
+        VPVL2_DECLARE_ARENA_ALLOCATOR()
         Impulse()
             : rigidBody(0),
               velocity(kZeroV3),
@@ -175,6 +185,7 @@ public:
     void setWeight(const WeightPrecision &value);
     void update();
     void syncWeight();
+    void resetVertices();
     void updateVertexMorphs(const WeightPrecision &value);
     void updateBoneMorphs(const WeightPrecision &value);
     void updateUVMorphs(const WeightPrecision &value);
@@ -190,6 +201,9 @@ public:
     Type type() const;
     int index() const;
     bool hasParent() const;
+    bool isDirty() const;
+    bool hasVertexMorphs() const;
+    WeightPrecision internalWeight() const;
     const Array<Bone *> &bones() const;
     const Array<Group *> &groups() const;
     const Array<Material *> &materials() const;
@@ -211,6 +225,7 @@ public:
     void setType(Type value);
     void setIndex(int value);
     void setInternalWeight(const WeightPrecision &value);
+    void setDirty(bool value);
 
 private:
     struct PrivateContext;
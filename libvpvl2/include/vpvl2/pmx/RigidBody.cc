@@ -164,11 +164,11 @@ void RigidBody::read(const uint8_t *data, const Model::DataInfo &info, size_t &s
     int32_t nNameSize;
     IEncoding *encoding = info.encoding;
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_name);
-    VPVL2_VLOG(3, "PMXRigidBody: name=" << internal::cstr(m_name, "(null)"));
+    m_name.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXRigidBody: name=" << internal::cstr(m_name.value(), "(null)"));
     internal::getText(ptr, rest, namePtr, nNameSize);
-    internal::setStringDirect(encoding->toString(namePtr, nNameSize, info.codec), m_englishName);
-    VPVL2_VLOG(3, "PMXRigidBody: englishName=" << internal::cstr(m_englishName, "(null)"));
+    m_englishName.setBytes(encoding, namePtr, nNameSize, info.codec, info.deferStringDecoding);
+    VPVL2_VLOG(3, "PMXRigidBody: englishName=" << internal::cstr(m_englishName.value(), "(null)"));
     m_boneIndex = internal::readSignedIndex(ptr, info.boneIndexSize);
     RigidBodyUnit unit;
     internal::getData(ptr, unit);
@@ -194,8 +194,8 @@ void RigidBody::read(const uint8_t *data, const Model::DataInfo &info, size_t &s
 
 void RigidBody::write(uint8_t *&data, const Model::DataInfo &info) const
 {
-    internal::writeString(m_name, info.codec, data);
-    internal::writeString(m_englishName, info.codec, data);
+    internal::writeString(m_name.value(), info.codec, data);
+    internal::writeString(m_englishName.value(), info.codec, data);
     internal::writeSignedIndex(m_boneIndex, info.boneIndexSize, data);
     RigidBodyUnit rbu;
     rbu.angularDamping = m_angularDamping;
@@ -216,8 +216,8 @@ void RigidBody::write(uint8_t *&data, const Model::DataInfo &info) const
 size_t RigidBody::estimateSize(const Model::DataInfo &info) const
 {
     size_t size = 0;
-    size += internal::estimateSize(m_name, info.codec);
-    size += internal::estimateSize(m_englishName, info.codec);
+    size += internal::estimateSize(m_name.value(), info.codec);
+    size += internal::estimateSize(m_englishName.value(), info.codec);
     size += info.boneIndexSize;
     size += sizeof(RigidBodyUnit);
     return size;
@@ -40,6 +40,7 @@
 #ifndef VPVL2_PMX_RIGIDBODY_H_
 #define VPVL2_PMX_RIGIDBODY_H_
 
+#include "vpvl2/internal/Arena.h"
 #include "vpvl2/internal/BaseRigidBody.h"
 #include "vpvl2/pmx/Model.h"
 #include "vpvl2/pmx/Morph.h"
@@ -66,6 +67,8 @@ namespace pmx
 class VPVL2_API RigidBody : public internal::BaseRigidBody
 {
 public:
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     RigidBody(IModel *modelRef, IEncoding *encodingRef);
     ~RigidBody();
 
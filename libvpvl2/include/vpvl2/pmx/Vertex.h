@@ -39,6 +39,7 @@
 #define VPVL2_PMX_VERTEX_H_
 
 #include "vpvl2/IVertex.h"
+#include "vpvl2/internal/Arena.h"
 #include "vpvl2/pmx/Model.h"
 #include "vpvl2/pmx/Morph.h"
 
@@ -47,6 +48,12 @@ namespace vpvl2
 
 class IBone;
 
+namespace internal
+{
+class BonePalette;
+class VertexStore;
+}
+
 namespace pmx
 {
 
@@ -62,6 +69,8 @@ namespace pmx
 class VPVL2_API Vertex : public IVertex
 {
 public:
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     static const int kMaxBones = 4;
     static const int kMaxMorphs = 5; /* TexCoord + UVA1-4 */
 
@@ -72,6 +81,15 @@ public:
     ~Vertex();
 
     static bool preparse(uint8_t *&data, size_t &rest, Model::DataInfo &info);
+    /**
+     * Returns size of the vertex unit at data without parsing it.
+     *
+     * The data must be validated by preparse before.
+     *
+     * @param data The buffer of the vertex unit
+     * @param info Model information
+     */
+    static size_t unitSize(const uint8_t *data, const Model::DataInfo &info);
     static bool loadVertices(const Array<Vertex *> &vertices, const Array<Bone *> &bones);
     static void writeVertices(const Array<Vertex *> &vertices, const Model::DataInfo &info, uint8_t *&data);
     static size_t estimateTotalSize(const Array<Vertex *> &vertices, const Model::DataInfo &info);
@@ -90,6 +108,7 @@ public:
     void mergeMorph(const Morph::UV *morph, const IMorph::WeightPrecision &weight);
     void mergeMorph(const Morph::Vertex *morph, const IMorph::WeightPrecision &weight);
     void performSkinning(Vector3 &position, Vector3 &normal) const;
+    void performSkinning(const internal::BonePalette &palette, Vector3 &position, Vector3 &normal) const;
 
     IModel *parentModelRef() const;
     Vector3 origin() const;
@@ -120,6 +139,7 @@ public:
     void setSdefR0(const Vector3 &value);
     void setSdefR1(const Vector3 &value);
     void setIndex(int value);
+    void setVertexStoreRef(internal::VertexStore *value);
 
 private:
     struct PrivateContext;
@@ -0,0 +1,232 @@
+/* ----------------------------------------------------------------- */
+/*                                                                   */
+/*  Copyright (c) 2010-2013  hkrn                                    */
+/*                                                                   */
+/* All rights reserved.                                              */
+/*                                                                   */
+/* Redistribution and use in source and binary forms, with or        */
+/* without modification, are permitted provided that the following   */
+/* conditions are met:                                               */
+/*                                                                   */
+/* - Redistributions of source code must retain the above copyright  */
+/*   notice, this list of conditions and the following disclaimer.   */
+/* - Redistributions in binary form must reproduce the above         */
+/*   copyright notice, this list of conditions and the following     */
+/*   disclaimer in the documentation and/or other materials provided */
+/*   with the distribution.                                          */
+/* - Neither the name of the MMDAI project team nor the names of     */
+/*   its contributors may be used to endorse or promote products     */
+/*   derived from this software without specific prior written       */
+/*   permission.                                                     */
+/*                                                                   */
+/* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND            */
+/* CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,       */
+/* INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF          */
+/* MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE          */
+/* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS */
+/* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,          */
+/* EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED   */
+/* TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,     */
+/* DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON */
+/* ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,   */
+/* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY    */
+/* OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE           */
+/* POSSIBILITY OF SUCH DAMAGE.                                       */
+/* ----------------------------------------------------------------- */
+
+#include "vpvl2/vpvl2.h"
+#include "vpvl2/internal/Arena.h"
+#include "vpvl2/internal/ThreadPool.h"
+
+#include <LinearMath/btAlignedAllocator.h>
+#include <new>
+
+namespace
+{
+
+using namespace vpvl2;
+using namespace vpvl2::internal;
+
+/* Vector3 and Quaternion of Bullet require 16 bytes alignment */
+static const size_t kAlignment = 16;
+
+struct Header {
+    Arena *arenaRef;
+    uint8_t padding[kAlignment - sizeof(Arena *)];
+};
+
+#if defined(VPVL2_HAS_STATIC_TLS_GNU) || defined(VPVL2_HAS_STATIC_TLS_MSVC)
+#define VPVL2_ARENA_ENABLE_SCOPE
+VPVL2_STATIC_TLS(static Arena *g_currentArenaRef = 0);
+#endif
+
+static inline size_t alignSize(size_t size)
+{
+    return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+}
+
+namespace vpvl2
+{
+namespace internal
+{
+
+struct Arena::PrivateContext {
+    PrivateContext(size_t blockSize)
+        : blockSize(alignSize(blockSize)),
+          ptr(0),
+          rest(0),
+          nallocations(0),
+          retired(false)
+    {
+    }
+    ~PrivateContext() {
+        const int nblocks = blocks.count();
+        for (int i = 0; i < nblocks; i++) {
+            btAlignedFree(blocks[i]);
+        }
+    }
+
+    Mutex mutex;
+    Array<uint8_t *> blocks;
+    size_t blockSize;
+    uint8_t *ptr;
+    size_t rest;
+    int nallocations;
+    bool retired;
+};
+
+#ifndef _MSC_VER
+const size_t Arena::kDefaultBlockSize;
+#endif
+
+Arena::Scope::Scope(Arena *arenaRef)
+    : m_previousArenaRef(0)
+{
+#ifdef VPVL2_ARENA_ENABLE_SCOPE
+    m_previousArenaRef = g_currentArenaRef;
+    g_currentArenaRef = arenaRef;
+#else
+    (void) arenaRef;
+#endif
+}
+
+Arena::Scope::~Scope()
+{
+#ifdef VPVL2_ARENA_ENABLE_SCOPE
+    g_currentArenaRef = m_previousArenaRef;
+#endif
+    m_previousArenaRef = 0;
+}
+
+Arena *Arena::create(size_t blockSize)
+{
+    return new Arena(blockSize);
+}
+
+void *Arena::allocate(size_t size)
+{
+    const size_t allocationSize = sizeof(Header) + alignSize(size);
+    Arena *arenaRef = 0;
+    uint8_t *ptr = 0;
+#ifdef VPVL2_ARENA_ENABLE_SCOPE
+    if ((arenaRef = g_currentArenaRef)) {
+        ptr = static_cast<uint8_t *>(arenaRef->allocateFromBlocks(allocationSize));
+    }
+#endif
+    if (!ptr) {
+        arenaRef = 0;
+        ptr = static_cast<uint8_t *>(btAlignedAlloc(allocationSize, kAlignment));
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+    }
+    reinterpret_cast<Header *>(ptr)->arenaRef = arenaRef;
+    return ptr + sizeof(Header);
+}
+
+void Arena::deallocate(void *ptr)
+{
+    if (ptr) {
+        uint8_t *base = static_cast<uint8_t *>(ptr) - sizeof(Header);
+        if (Arena *arenaRef = reinterpret_cast<Header *>(base)->arenaRef) {
+            if (arenaRef->deallocateFromBlocks()) {
+                delete arenaRef;
+            }
+        }
+        else {
+            btAlignedFree(base);
+        }
+    }
+}
+
+Arena::Arena(size_t blockSize)
+    : m_context(0)
+{
+    m_context = new PrivateContext(blockSize);
+}
+
+Arena::~Arena()
+{
+    delete m_context;
+    m_context = 0;
+}
+
+void Arena::retire()
+{
+    bool unused = false;
+    {
+        Mutex::ScopedLock lock(m_context->mutex);
+        m_context->retired = true;
+        unused = m_context->nallocations == 0;
+    }
+    if (unused) {
+        delete this;
+    }
+}
+
+int Arena::countBlocks() const
+{
+    Mutex::ScopedLock lock(m_context->mutex);
+    return m_context->blocks.count();
+}
+
+int Arena::countAllocations() const
+{
+    Mutex::ScopedLock lock(m_context->mutex);
+    return m_context->nallocations;
+}
+
+void *Arena::allocateFromBlocks(size_t size)
+{
+    /* a large object is allocated from the heap not to waste the rest of the block */
+    if (size > m_context->blockSize / 4) {
+        return 0;
+    }
+    Mutex::ScopedLock lock(m_context->mutex);
+    if (m_context->rest < size) {
+        uint8_t *block = static_cast<uint8_t *>(btAlignedAlloc(m_context->blockSize, kAlignment));
+        if (!block) {
+            return 0;
+        }
+        m_context->blocks.append(block);
+        m_context->ptr = block;
+        m_context->rest = m_context->blockSize;
+    }
+    void *ptr = m_context->ptr;
+    m_context->ptr += size;
+    m_context->rest -= size;
+    m_context->nallocations++;
+    return ptr;
+}
+
+bool Arena::deallocateFromBlocks()
+{
+    Mutex::ScopedLock lock(m_context->mutex);
+    m_context->nallocations--;
+    return m_context->retired && m_context->nallocations == 0;
+}
+
+} /* namespace internal */
+} /* namespace vpvl2 */
@@ -64,8 +64,6 @@ BaseJoint::BaseJoint(IModel *modelRef)
       m_parentModelRef(modelRef),
       m_rigidBody1Ref(0),
       m_rigidBody2Ref(0),
-      m_name(0),
-      m_englishName(0),
       m_position(kZeroV3),
       m_rotation(kZeroV3),
       m_positionLowerLimit(kZeroV3),
@@ -87,10 +85,8 @@ BaseJoint::~BaseJoint()
     m_constraint = 0;
     delete m_ptr;
     m_ptr = 0;
-    delete m_name;
-    m_name = 0;
-    delete m_englishName;
-    m_englishName = 0;
+    m_name.release();
+    m_englishName.release();
     m_parentModelRef = 0;
     m_rigidBody1Ref = 0;
     m_rigidBody2Ref = 0;
@@ -151,12 +147,12 @@ void BaseJoint::setRigidBody2Ref(IRigidBody *value)
 
 void BaseJoint::setName(const IString *value)
 {
-    internal::setString(value, m_name);
+    m_name.setValue(value);
 }
 
 void BaseJoint::setEnglishName(const IString *value)
 {
-    internal::setString(value, m_englishName);
+    m_englishName.setValue(value);
 }
 
 void BaseJoint::setPosition(const Vector3 &value)
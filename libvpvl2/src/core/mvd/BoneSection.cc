@@ -318,14 +318,14 @@ void BoneSection::addKeyframe(IKeyframe *keyframe)
     BoneAnimationTrack *const *track = m_context->name2tracks.find(key), *trackPtr = 0;
     if (track) {
         trackPtr = *track;
-        trackPtr->keyframes.append(keyframe);
+        internal::MotionHelper::insertKeyframe(keyframe, trackPtr->keyframes);
         setDuration(keyframe);
         m_context->allKeyframeRefs.append(keyframe);
     }
     else if (m_context->modelRef) {
         trackPtr = m_context->name2tracks.insert(key, new BoneAnimationTrack());
         trackPtr->boneRef = m_context->modelRef->findBoneRef(keyframe->name());
-        trackPtr->keyframes.append(keyframe);
+        internal::MotionHelper::insertKeyframe(keyframe, trackPtr->keyframes);
         setDuration(keyframe);
         m_context->allKeyframeRefs.append(keyframe);
         m_context->name2tracks.insert(key, trackPtr);
@@ -338,7 +338,7 @@ void BoneSection::deleteKeyframe(IKeyframe *&keyframe)
     int key = m_nameListSectionRef->key(keyframe->name());
     if (BoneAnimationTrack *const *track = m_context->name2tracks.find(key)) {
         BoneAnimationTrack *trackPtr = *track;
-        trackPtr->keyframes.remove(keyframe);
+        internal::MotionHelper::removeKeyframe(keyframe, trackPtr->keyframes);
         m_context->allKeyframeRefs.remove(keyframe);
         if (trackPtr->keyframes.count() == 0) {
             m_context->name2tracks.remove(key);
@@ -380,12 +380,9 @@ IBoneKeyframe *BoneSection::findKeyframe(const IKeyframe::TimeIndex &timeIndex,
 {
     if (BoneAnimationTrack *const *track = m_context->name2tracks.find(m_nameListSectionRef->key(name))) {
         const BoneAnimationTrack::KeyframeCollection &keyframes = (*track)->keyframes;
-        const int nkeyframes = keyframes.count();
-        for (int i = 0; i < nkeyframes; i++) {
-            BoneKeyframe *keyframe = reinterpret_cast<BoneKeyframe *>(keyframes[i]);
-            if (keyframe->timeIndex() == timeIndex && keyframe->layerIndex() == layerIndex) {
-                return keyframe;
-            }
+        const int index = internal::MotionHelper::findKeyframeIndex(timeIndex, layerIndex, keyframes);
+        if (index != -1) {
+            return reinterpret_cast<BoneKeyframe *>(keyframes[index]);
         }
     }
     return 0;
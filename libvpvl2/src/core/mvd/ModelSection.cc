@@ -213,6 +213,7 @@ void ModelSection::read(const uint8_t *data)
         setDuration(keyframe);
         ptr += sizeOfKeyframe;
     }
+    m_context->keyframes.sort(internal::MotionHelper::KeyframeTimeIndexPredication());
 }
 
 void ModelSection::seek(const IKeyframe::TimeIndex &timeIndex)
@@ -280,13 +281,13 @@ size_t ModelSection::countKeyframes() const
 
 void ModelSection::addKeyframe(IKeyframe *keyframe)
 {
-    m_context->keyframes.append(keyframe);
+    internal::MotionHelper::insertKeyframe(keyframe, m_context->keyframes);
     setDuration(keyframe);
 }
 
 void ModelSection::deleteKeyframe(IKeyframe *&keyframe)
 {
-    m_context->keyframes.remove(keyframe);
+    internal::MotionHelper::removeKeyframe(keyframe, m_context->keyframes);
     delete keyframe;
     keyframe = 0;
 }
@@ -327,12 +328,9 @@ IModelKeyframe *ModelSection::findKeyframe(const IKeyframe::TimeIndex &timeIndex
                                            const IKeyframe::LayerIndex &layerIndex) const
 {
     const PrivateContext::KeyframeCollection &keyframes = m_context->keyframes;
-    const int nkeyframes = keyframes.count();
-    for (int i = 0; i < nkeyframes; i++) {
-        ModelKeyframe *keyframe = reinterpret_cast<ModelKeyframe *>(keyframes[i]);
-        if (keyframe->timeIndex() == timeIndex && keyframe->layerIndex() == layerIndex) {
-            return keyframe;
-        }
+    const int index = internal::MotionHelper::findKeyframeIndex(timeIndex, layerIndex, keyframes);
+    if (index != -1) {
+        return reinterpret_cast<ModelKeyframe *>(keyframes[index]);
     }
     return 0;
 }
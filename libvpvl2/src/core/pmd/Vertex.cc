@@ -38,6 +38,7 @@
 
 #include "vpvl2/vpvl2.h"
 #include "vpvl2/internal/ModelHelper.h"
+#include "vpvl2/internal/VertexStore.h"
 #include "vpvl2/pmd/Vertex.h"
 
 #include "vpvl/Vertex.h"
@@ -49,6 +50,7 @@ namespace pmd
 
 Vertex::Vertex(IModel *modelRef, vpvl::Vertex *vertexRef, Array<IBone *> *bonesRef, int index)
     : m_modelRef(modelRef),
+      m_storeRef(0),
       m_vertexRef(vertexRef),
       m_bonesRef(bonesRef),
       m_materialRef(0),
@@ -59,6 +61,7 @@ Vertex::Vertex(IModel *modelRef, vpvl::Vertex *vertexRef, Array<IBone *> *bonesR
 
 Vertex::~Vertex()
 {
+    m_storeRef = 0;
     m_vertexRef = 0;
     m_bonesRef = 0;
     m_materialRef = 0;
@@ -145,6 +148,7 @@ void Vertex::setOrigin(const Vector3 &value)
 void Vertex::setNormal(const Vector3 &value)
 {
     m_vertexRef->setNormal(value);
+    invalidateStore();
 }
 
 void Vertex::setTextureCoord(const Vector3 &value)
@@ -155,24 +159,44 @@ void Vertex::setTextureCoord(const Vector3 &value)
 void Vertex::setEdgeSize(const EdgeSizePrecision &value)
 {
     m_vertexRef->setEdgeEnable(btFuzzyZero(Scalar(value)));
+    invalidateStore();
 }
 
 void Vertex::setWeight(int index, const WeightPrecision &weight)
 {
     if (index == 0) {
         m_vertexRef->setWeight(float(weight));
+        invalidateStore();
     }
 }
 
 void Vertex::setMaterialRef(IMaterial *value)
 {
     m_materialRef = value;
+    invalidateStore();
 }
 
 void Vertex::setIndex(int value)
 {
+    if (m_storeRef && m_index != value) {
+        invalidateStore();
+        m_storeRef = 0;
+    }
     m_index = value;
 }
 
+void Vertex::setVertexStoreRef(internal::VertexStore *value)
+{
+    /* PMD morphs are applied to the position of the vertex directly, so the store has no morph states to sync */
+    m_storeRef = value;
+}
+
+void Vertex::invalidateStore()
+{
+    if (m_storeRef) {
+        m_storeRef->invalidate();
+    }
+}
+
 } /* namespace pmd */
 } /* namespace vpvl2 */
@@ -149,7 +149,7 @@ void Joint::read(const uint8_t *data, const Model::DataInfo & /* info */, size_t
 {
     JointUnit unit;
     internal::getData(data, unit);
-    internal::setStringDirect(m_encodingRef->toString(unit.name, IString::kShiftJIS, kNameSize), m_name);
+    m_name.setValueDirect(m_encodingRef->toString(unit.name, IString::kShiftJIS, kNameSize));
     m_rigidBodyIndex1 = unit.bodyIDA;
     m_rigidBodyIndex2 = unit.bodyIDB;
     internal::setPositionRaw(unit.position, m_position);
@@ -176,7 +176,7 @@ void Joint::write(uint8_t *&data, const Model::DataInfo & /* info */) const
     unit.bodyIDA = m_rigidBodyIndex1;
     unit.bodyIDB = m_rigidBodyIndex2;
     uint8_t *namePtr = unit.name;
-    internal::writeStringAsByteArray(m_name, IString::kShiftJIS, m_encodingRef, sizeof(unit.name), namePtr);
+    internal::writeStringAsByteArray(m_name.value(), IString::kShiftJIS, m_encodingRef, sizeof(unit.name), namePtr);
     internal::getPositionRaw(m_position, unit.position);
     internal::getPositionRaw(m_rotation, unit.rotation);
     internal::getPositionRaw(m_positionLowerLimit, unit.positionLowerLimit);
@@ -44,7 +44,9 @@
 #include "vpvl2/pmd2/Morph.h"
 #include "vpvl2/pmd2/RigidBody.h"
 #include "vpvl2/pmd2/Vertex.h"
+#include "vpvl2/internal/BonePalette.h"
 #include "vpvl2/internal/ParallelProcessors.h"
+#include "vpvl2/internal/VertexStore.h"
 
 #include <BulletCollision/CollisionDispatch/btCollisionObject.h>
 #include <BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
@@ -135,6 +137,9 @@ struct DefaultStaticVertexBuffer : public IModel::StaticVertexBuffer {
         case kUVA3Stride:
         case kUVA4Stride:
         case kVertexIndexStride:
+        case kSdefCStride:
+        case kSdefR0Stride:
+        case kSdefR1Stride:
         case kIndexStride:
         default:
             return 0;
@@ -143,6 +148,9 @@ struct DefaultStaticVertexBuffer : public IModel::StaticVertexBuffer {
     size_t strideSize() const {
         return sizeof(Unit);
     }
+    ComponentType componentType(StrideType /* type */) const {
+        return kFloatComponent;
+    }
     void update(void *address) const {
         Unit *unitPtr = static_cast<Unit *>(address);
         const PointerArray<Vertex> &vertices = modelRef->vertices();
@@ -169,7 +177,7 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
             edge[3] = Scalar(index);
             uva0.setValue(0, 0, 0, 1);
         }
-        void update(const IVertex *vertex, const IVertex::EdgeSizePrecision &materialEdgeSize, int index, Vector3 &p) {
+        void update(const IVertex *vertex, const internal::BonePalette * /* palette */, const IVertex::EdgeSizePrecision &materialEdgeSize, int index, Vector3 &p) {
             Vector3 n;
             const IVertex::EdgeSizePrecision &edgeSize = vertex->edgeSize() * materialEdgeSize;
             vertex->performSkinning(p, n);
@@ -180,6 +188,11 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
             edge[3] = Scalar(index);
             uva0.setValue(0, 0, 0, 1);
         }
+        void updateMorph(const internal::VertexStore &store, int index) {
+            const Scalar *d = store.deltaPtr(index);
+            delta.setValue(d[0], d[1], d[2]);
+            uva0.setValue(0, 0, 0, 1);
+        }
         Vector3 position;
         Vector3 normal;
         Vector3 delta;
@@ -188,9 +201,14 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     };
     static const Unit kIdent;
 
-    DefaultDynamicVertexBuffer(const Model *model, const IModel::IndexBuffer *indexBuffer)
+    DefaultDynamicVertexBuffer(const Model *model,
+                               const IModel::IndexBuffer *indexBuffer,
+                               const internal::BonePalette *palette,
+                               internal::VertexStore *store)
         : modelRef(model),
           indexBufferRef(indexBuffer),
+          paletteRef(palette),
+          storeRef(store),
           enableSkinning(true),
           enableParallelUpdate(false)
     {
@@ -198,6 +216,8 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     ~DefaultDynamicVertexBuffer() {
         modelRef = 0;
         indexBufferRef = 0;
+        paletteRef = 0;
+        storeRef = 0;
         enableSkinning = false;
         enableParallelUpdate = false;
     }
@@ -229,6 +249,9 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
         case kBoneIndexStride:
         case kBoneWeightStride:
         case kTextureCoordStride:
+        case kSdefCStride:
+        case kSdefR0Stride:
+        case kSdefR1Stride:
         case kIndexStride:
         default:
             return 0;
@@ -240,8 +263,15 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     void update(void *address, const Vector3 &cameraPosition, Vector3 &aabbMin, Vector3 &aabbMax) const {
         const PointerArray<Vertex> &vertices = modelRef->vertices();
         Unit *bufferPtr = static_cast<Unit *>(address);
-        if (enableSkinning) {
-            internal::ParallelSkinningVertexProcessor<pmd2::Model, pmd2::Vertex, Unit> processor(modelRef, &vertices, cameraPosition, bufferPtr);
+        if (enableSkinning && storeRef->isEnabled() && !storeRef->isDirty()) {
+            storeRef->updateMaterialEdgeSizes(modelRef->materials(), modelRef->edgeScaleFactor(cameraPosition));
+            internal::VertexStore::SkinningProcessor<Unit> processor(storeRef, paletteRef, bufferPtr);
+            processor.execute(enableParallelUpdate);
+            aabbMin = processor.aabbMin();
+            aabbMax = processor.aabbMax();
+        }
+        else if (enableSkinning) {
+            internal::ParallelSkinningVertexProcessor<pmd2::Model, pmd2::Vertex, Unit> processor(modelRef, &vertices, 0, cameraPosition, bufferPtr);
             processor.execute(enableParallelUpdate);
             aabbMin = processor.aabbMin();
             aabbMax = processor.aabbMax();
@@ -257,12 +287,18 @@ struct DefaultDynamicVertexBuffer : public IModel::DynamicVertexBuffer {
     void setParallelUpdateEnable(bool value) {
         enableParallelUpdate = value;
     }
+    bool isDirty(const Vector3 & /* cameraPosition */) const {
+        /* changes of the model are not tracked */
+        return true;
+    }
     const void *ident() const {
         return &kIdent;
     }
 
     const Model *modelRef;
     const IModel::IndexBuffer *indexBufferRef;
+    const internal::BonePalette *paletteRef;
+    internal::VertexStore *storeRef;
     bool enableSkinning;
     bool enableParallelUpdate;
 };
@@ -381,13 +417,22 @@ struct DefaultMatrixBuffer : public IModel::MatrixBuffer {
             buffer.delta = vertex->delta();
         }
     }
-    const float *bytes(int materialIndex) const {
+    int countMeshes(int materialIndex) const {
+        return internal::checkBound(materialIndex, 0, materials.count()) ? 1 : 0;
+    }
+    int countIndices(int materialIndex, int meshIndex) const {
+        return meshIndex == 0 && internal::checkBound(materialIndex, 0, materials.count()) ? materials[materialIndex]->indexRange().count : 0;
+    }
+    const float *bytes(int materialIndex, int meshIndex) const {
         int nmatrices = meshes.matrices.count();
-        return internal::checkBound(materialIndex, 0, nmatrices) ? meshes.matrices[materialIndex] : 0;
+        return meshIndex == 0 && internal::checkBound(materialIndex, 0, nmatrices) ? meshes.matrices[materialIndex] : 0;
     }
-    size_t size(int materialIndex) const {
+    size_t size(int materialIndex, int meshIndex) const {
         int nbones = meshes.bones.size();
-        return internal::checkBound(materialIndex, 0, nbones) ? meshes.bones[materialIndex].size() : 0;
+        return meshIndex == 0 && internal::checkBound(materialIndex, 0, nbones) ? meshes.bones[materialIndex].size() : 0;
+    }
+    bool isDirty() const {
+        return true;
     }
 
     void initialize() {
@@ -523,8 +568,10 @@ struct Model::PrivateContext {
         internal::zerofill(&dataInfo, sizeof(dataInfo));
         textures.releaseAll();
         vertices.releaseAll();
+        vertexStore.clear();
         materials.releaseAll();
         bones.releaseAll();
+        bonePalette.update(bones);
         rawConstraints.releaseAll();
         morphs.releaseAll();
         labels.releaseAll();
@@ -769,6 +816,8 @@ struct Model::PrivateContext {
     Array<Bone *> sortedBoneRefs;
     Hash<HashString, IBone *> name2boneRefs;
     Hash<HashString, IMorph *> name2morphRefs;
+    internal::BonePalette bonePalette;
+    internal::VertexStore vertexStore;
     DataInfo dataInfo;
     Vector3 position;
     Quaternion rotation;
@@ -1155,7 +1204,11 @@ void Model::solveInverseKinematics()
 
 void Model::performUpdate()
 {
-    {
+    internal::VertexStore &store = m_context->vertexStore;
+    if (!store.isDirty() || store.build(m_context->vertices, m_context->bones.count(), m_context->materials.count())) {
+        store.resetMorphs();
+    }
+    else {
         internal::ParallelResetVertexProcessor<pmd2::Vertex> processor(&m_context->vertices);
         processor.execute();
     }
@@ -1174,6 +1227,8 @@ void Model::performUpdate()
         internal::ParallelUpdateRigidBodyProcessor<pmd2::RigidBody> processor(&m_context->rigidBodies);
         processor.execute();
     }
+    // snapshot of local transforms for skinning
+    m_context->bonePalette.update(m_context->bones);
 }
 
 void Model::joinWorld(btDiscreteDynamicsWorld *worldRef)
@@ -1627,6 +1682,7 @@ void Model::setIndices(const Array<int> &value)
 void Model::addBone(IBone *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->bones);
+    m_context->vertexStore.invalidate();
 }
 
 void Model::addJoint(IJoint *value)
@@ -1642,6 +1698,7 @@ void Model::addLabel(ILabel *value)
 void Model::addMaterial(IMaterial *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->materials);
+    m_context->vertexStore.invalidate();
 }
 
 void Model::addMorph(IMorph *value)
@@ -1657,6 +1714,7 @@ void Model::addRigidBody(IRigidBody *value)
 void Model::addVertex(IVertex *value)
 {
     internal::ModelHelper::addObject(this, value, m_context->vertices);
+    m_context->vertexStore.invalidate();
 }
 
 void Model::addTexture(const IString *value)
@@ -1672,6 +1730,7 @@ void Model::addTexture(const IString *value)
 void Model::removeBone(IBone *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->bones);
+    m_context->vertexStore.invalidate();
 }
 
 void Model::removeJoint(IJoint *value)
@@ -1687,6 +1746,7 @@ void Model::removeLabel(ILabel *value)
 void Model::removeMaterial(IMaterial *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->materials);
+    m_context->vertexStore.invalidate();
 }
 
 void Model::removeMorph(IMorph *value)
@@ -1702,6 +1762,7 @@ void Model::removeRigidBody(IRigidBody *value)
 void Model::removeVertex(IVertex *value)
 {
     internal::ModelHelper::removeObject(this, value, m_context->vertices);
+    m_context->vertexStore.invalidate();
 }
 
 void Model::getIndexBuffer(IndexBuffer *&indexBuffer) const
@@ -1721,7 +1782,7 @@ void Model::getDynamicVertexBuffer(DynamicVertexBuffer *&dynamicBuffer,
 {
     delete dynamicBuffer;
     if (indexBuffer && indexBuffer->ident() == &DefaultIndexBuffer::kIdent) {
-        dynamicBuffer = new DefaultDynamicVertexBuffer(this, indexBuffer);
+        dynamicBuffer = new DefaultDynamicVertexBuffer(this, indexBuffer, &m_context->bonePalette, &m_context->vertexStore);
     }
     else {
         dynamicBuffer = 0;
@@ -36,6 +36,8 @@
 
 #include "vpvl2/vpvl2.h"
 #include "vpvl2/internal/ModelHelper.h"
+#include "vpvl2/internal/BonePalette.h"
+#include "vpvl2/internal/VertexStore.h"
 
 #include "vpvl2/pmx/Bone.h"
 #include "vpvl2/pmx/Vertex.h"
@@ -74,6 +76,29 @@ struct SdefUnit {
 
 #pragma pack(pop)
 
+static inline bool getBoneUnitSize(vpvl2::uint8_t type, const Model::DataInfo &info, size_t &size)
+{
+    switch (type) {
+    case 0: /* BDEF1 */
+        size = info.boneIndexSize;
+        break;
+    case 1: /* BDEF2 */
+        size = info.boneIndexSize * 2 + sizeof(Bdef2Unit);
+        break;
+    case 2: /* BDEF4 */
+    case 4: /* QDEF */
+        size = info.boneIndexSize * 4 + sizeof(Bdef4Unit);
+        break;
+    case 3: /* SDEF */
+        size = info.boneIndexSize * 2 + sizeof(SdefUnit);
+        break;
+    default: /* unexpected value */
+        return false;
+    }
+    size += sizeof(float); /* edge */
+    return true;
+}
+
 }
 
 namespace vpvl2
@@ -87,8 +112,11 @@ const int Vertex::kMaxMorphs;
 #endif
 
 struct Vertex::PrivateContext {
+    VPVL2_DECLARE_ARENA_ALLOCATOR()
+
     PrivateContext(IModel *modelRef)
         : modelRef(modelRef),
+          storeRef(0),
           materialRef(Factory::sharedNullMaterialRef()),
           origin(kZeroV3),
           morphDelta(kZeroV3),
@@ -113,6 +141,7 @@ struct Vertex::PrivateContext {
     }
     ~PrivateContext() {
         modelRef = 0;
+        storeRef = 0;
         materialRef = 0;
         origin.setZero();
         morphDelta.setZero();
@@ -134,7 +163,16 @@ struct Vertex::PrivateContext {
             morphUVs[i].setZero();
         }
     }
+    bool hasStore() const {
+        return storeRef && storeRef->contains(index);
+    }
+    void invalidateStore() {
+        if (storeRef) {
+            storeRef->invalidate();
+        }
+    }
     IModel *modelRef;
+    internal::VertexStore *storeRef;
     IBone *boneRefs[kMaxBones];
     IMaterial *materialRef;
     Vector4 originUVs[kMaxMorphs];
@@ -190,25 +228,10 @@ bool Vertex::preparse(uint8_t *&ptr, size_t &rest, Model::DataInfo &info)
             return false;
         }
         size_t boneSize = 0;
-        switch (type) {
-        case 0: /* BDEF1 */
-            boneSize = info.boneIndexSize;
-            break;
-        case 1: /* BDEF2 */
-            boneSize = info.boneIndexSize * 2 + sizeof(Bdef2Unit);
-            break;
-        case 2: /* BDEF4 */
-        case 4: /* QDEF */
-            boneSize = info.boneIndexSize * 4 + sizeof(Bdef4Unit);
-            break;
-        case 3: /* SDEF */
-            boneSize = info.boneIndexSize * 2 + sizeof(SdefUnit);
-            break;
-        default: /* unexpected value */
+        if (!getBoneUnitSize(type, info, boneSize)) {
             VPVL2_LOG(WARNING, "Unexpected vertex type detected: index=" << i << " type=" << int(type) <<  " rest=" << rest);
             return false;
         }
-        boneSize += sizeof(float); /* edge */
         if (!internal::validateSize(ptr, boneSize, rest)) {
             VPVL2_LOG(WARNING, "Invalid size of PMX vertex unit of bone detected: index=" << i << " size=" << boneSize <<  " rest=" << rest);
             return false;
@@ -218,6 +241,14 @@ bool Vertex::preparse(uint8_t *&ptr, size_t &rest, Model::DataInfo &info)
     return rest > 0;
 }
 
+size_t Vertex::unitSize(const uint8_t *data, const Model::DataInfo &info)
+{
+    const size_t baseSize = sizeof(VertexUnit) + sizeof(AdditinalUVUnit) * info.additionalUVSize;
+    size_t boneSize = 0;
+    getBoneUnitSize(data[baseSize], info, boneSize);
+    return baseSize + sizeof(uint8_t) + boneSize;
+}
+
 bool Vertex::loadVertices(const Array<Vertex *> &vertices, const Array<Bone *> &bones)
 {
     const int nvertices = vertices.count();
@@ -373,9 +404,9 @@ void Vertex::read(const uint8_t *data, const Model::DataInfo &info, size_t &size
         }
         SdefUnit unit;
         internal::getData(ptr, unit);
-        m_context->c.setValue(unit.c[0], unit.c[1], unit.c[2]);
-        m_context->r0.setValue(unit.r0[0], unit.r0[1], unit.r0[2]);
-        m_context->r1.setValue(unit.r1[0], unit.r1[1], unit.r1[2]);
+        internal::setPosition(unit.c, m_context->c);
+        internal::setPosition(unit.r0, m_context->r0);
+        internal::setPosition(unit.r1, m_context->r1);
         m_context->weight[0] = btClamped(unit.weight, 0.0f, 1.0f);
         VPVL2_VLOG(3, "PMXVertex: type=" << m_context->type << " bone=" << m_context->boneIndices[0] << "," << m_context->boneIndices[1] << " weight=" << m_context->weight[0]);
         VPVL2_VLOG(3, "PMXVertex: C=" << m_context->c.x() << "," << m_context->c.y() << "," << m_context->c.z());
@@ -444,15 +475,9 @@ void Vertex::write(uint8_t *&data, const Model::DataInfo &info) const
             internal::writeSignedIndex(m_context->boneIndices[i], boneIndexSize, data);
         }
         SdefUnit unit;
-        unit.c[0] = m_context->c.x();
-        unit.c[1] = m_context->c.y();
-        unit.c[2] = m_context->c.z();
-        unit.r0[0] = m_context->r0.x();
-        unit.r0[1] = m_context->r0.y();
-        unit.r0[2] = m_context->r0.z();
-        unit.r1[0] = m_context->r1.x();
-        unit.r1[1] = m_context->r1.y();
-        unit.r1[2] = m_context->r1.z();
+        internal::getPosition(m_context->c, unit.c);
+        internal::getPosition(m_context->r0, unit.r0);
+        internal::getPosition(m_context->r1, unit.r1);
         unit.weight = float(m_context->weight[0]);
         internal::writeBytes(&unit, sizeof(unit), data);
         break;
@@ -493,6 +518,10 @@ size_t Vertex::estimateSize(const Model::DataInfo &info) const
 
 void Vertex::reset()
 {
+    if (m_context->hasStore()) {
+        m_context->storeRef->resetMorph(m_context->index);
+        return;
+    }
     m_context->morphDelta.setZero();
     for (int i = 0; i < kMaxMorphs; i++) {
         m_context->morphUVs[i].setZero();
@@ -503,6 +532,10 @@ void Vertex::mergeMorph(const Morph::UV *morph, const IMorph::WeightPrecision &w
 {
     int offset = morph->offset;
     if (internal::checkBound(offset, 0, kMaxMorphs)) {
+        if (m_context->hasStore()) {
+            m_context->storeRef->addUV(m_context->index, offset, morph->position, Scalar(weight));
+            return;
+        }
         const Vector4 &m = morph->position, &o = m_context->morphUVs[offset];
         Vector4 v(Scalar(o.x() + m.x() * weight),
                   Scalar(o.y() + m.y() * weight),
@@ -514,19 +547,22 @@ void Vertex::mergeMorph(const Morph::UV *morph, const IMorph::WeightPrecision &w
 
 void Vertex::mergeMorph(const Morph::Vertex *morph, const IMorph::WeightPrecision &weight)
 {
+    if (m_context->hasStore()) {
+        m_context->storeRef->addDelta(m_context->index, morph->position, Scalar(weight));
+        return;
+    }
     m_context->morphDelta += morph->position * Scalar(weight);
 }
 
 void Vertex::performSkinning(Vector3 &position, Vector3 &normal) const
 {
-    const Vector3 &vertexPosition = m_context->origin + m_context->morphDelta;
+    const Vector3 &vertexPosition = m_context->origin + delta();
     switch (m_context->type) {
     case kBdef1: {
         internal::ModelHelper::transformVertex(m_context->boneRefs[0]->localTransform(), vertexPosition, m_context->normal, position, normal);
         break;
     }
-    case kBdef2:
-    case kSdef: {
+    case kBdef2: {
         const WeightPrecision &weight = m_context->weight[0];
         if (btFuzzyZero(Scalar(1 - weight))) {
             const Transform &transform = m_context->boneRefs[0]->localTransform();
@@ -543,6 +579,19 @@ void Vertex::performSkinning(Vector3 &position, Vector3 &normal) const
         }
         break;
     }
+    case kSdef: {
+        const Transform &transformA = m_context->boneRefs[0]->localTransform();
+        const Transform &transformB = m_context->boneRefs[1]->localTransform();
+        const Quaternion &rotationA = transformA.getRotation(), &rotationB = transformB.getRotation();
+        Scalar matrixA[internal::BonePalette::kMatrixSize], matrixB[internal::BonePalette::kMatrixSize];
+        Vector3 sdefCR0, sdefCR1;
+        transformA.getOpenGLMatrix(matrixA);
+        transformB.getOpenGLMatrix(matrixB);
+        internal::ModelHelper::getSdefCenters(m_context->c, m_context->r0, m_context->r1, m_context->weight[0], sdefCR0, sdefCR1);
+        internal::BonePalette::transformSdef(matrixA, rotationA, matrixB, rotationB, Scalar(m_context->weight[0]),
+                                             m_context->c, sdefCR0, sdefCR1, vertexPosition, m_context->normal, position, normal);
+        break;
+    }
     case kBdef4: {
         const Transform &transformA = m_context->boneRefs[0]->localTransform();
         const Transform &transformB = m_context->boneRefs[1]->localTransform();
@@ -568,6 +617,48 @@ void Vertex::performSkinning(Vector3 &position, Vector3 &normal) const
     }
 }
 
+void Vertex::performSkinning(const internal::BonePalette &palette, Vector3 &position, Vector3 &normal) const
+{
+    const Vector3 &vertexPosition = m_context->origin + delta();
+    const int *boneIndices = m_context->boneIndices;
+    switch (m_context->type) {
+    case kBdef1: {
+        palette.transform(boneIndices[0], vertexPosition, m_context->normal, position, normal);
+        break;
+    }
+    case kBdef2: {
+        const WeightPrecision &weight = m_context->weight[0];
+        if (btFuzzyZero(Scalar(1 - weight))) {
+            palette.transform(boneIndices[0], vertexPosition, m_context->normal, position, normal);
+        }
+        else if (btFuzzyZero(Scalar(weight))) {
+            palette.transform(boneIndices[1], vertexPosition, m_context->normal, position, normal);
+        }
+        else {
+            palette.transform(boneIndices[0], boneIndices[1], Scalar(weight), vertexPosition, m_context->normal, position, normal);
+        }
+        break;
+    }
+    case kSdef: {
+        Vector3 sdefCR0, sdefCR1;
+        internal::ModelHelper::getSdefCenters(m_context->c, m_context->r0, m_context->r1, m_context->weight[0], sdefCR0, sdefCR1);
+        palette.transformSdef(boneIndices[0], boneIndices[1], Scalar(m_context->weight[0]),
+                              m_context->c, sdefCR0, sdefCR1, vertexPosition, m_context->normal, position, normal);
+        break;
+    }
+    case kBdef4: {
+        const WeightPrecision &w1 = m_context->weight[0], &w2 = m_context->weight[1], &w3 = m_context->weight[2], &w4 = m_context->weight[3];
+        const WeightPrecision &s = w1 + w2 + w3 + w4;
+        const Scalar weights[] = { Scalar(w1 / s), Scalar(w2 / s), Scalar(w3 / s), Scalar(w4 / s) };
+        palette.transform(boneIndices, weights, kMaxBones, vertexPosition, m_context->normal, position, normal);
+        break;
+    }
+    case kMaxType:
+    default:
+        break;
+    }
+}
+
 IModel *Vertex::parentModelRef() const
 {
     return m_context->modelRef;
@@ -580,7 +671,7 @@ Vector3 Vertex::origin() const
 
 Vector3 Vertex::delta() const
 {
-    return m_context->morphDelta;
+    return m_context->hasStore() ? m_context->storeRef->delta(m_context->index) : m_context->morphDelta;
 }
 
 Vector3 Vertex::normal() const
@@ -625,7 +716,10 @@ Vector3 Vertex::sdefR1() const
 
 Vector4 Vertex::uv(int index) const
 {
-    return internal::checkBound(index, 0, kMaxMorphs) ? m_context->morphUVs[index] : kZeroV4;
+    if (internal::checkBound(index, 0, kMaxMorphs)) {
+        return m_context->hasStore() ? m_context->storeRef->uv(m_context->index, index) : m_context->morphUVs[index];
+    }
+    return kZeroV4;
 }
 
 IVertex::WeightPrecision Vertex::weight(int index) const
@@ -646,11 +740,13 @@ IMaterial *Vertex::materialRef() const
 void Vertex::setOrigin(const Vector3 &value)
 {
     m_context->origin = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setNormal(const Vector3 &value)
 {
     m_context->normal = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setTextureCoord(const Vector3 &value)
@@ -668,17 +764,20 @@ void Vertex::setUV(int index, const Vector4 &value)
 void Vertex::setType(Type value)
 {
     m_context->type = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setEdgeSize(const EdgeSizePrecision &value)
 {
     m_context->edgeSize = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setWeight(int index, const WeightPrecision &weight)
 {
     if (internal::checkBound(index, 0, kMaxBones)) {
         m_context->weight[index] = weight;
+        m_context->invalidateStore();
     }
 }
 
@@ -693,34 +792,67 @@ void Vertex::setBoneRef(int index, IBone *value)
             m_context->boneRefs[index] = Factory::sharedNullBoneRef();
             m_context->boneIndices[index] = -1;
         }
+        m_context->invalidateStore();
     }
 }
 
 void Vertex::setMaterialRef(IMaterial *value)
 {
     m_context->materialRef = value ? value : Factory::sharedNullMaterialRef();
+    m_context->invalidateStore();
 }
 
 void Vertex::setSdefC(const Vector3 &value)
 {
     m_context->c = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setSdefR0(const Vector3 &value)
 {
     m_context->r0 = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setSdefR1(const Vector3 &value)
 {
     m_context->r1 = value;
+    m_context->invalidateStore();
 }
 
 void Vertex::setIndex(int value)
 {
+    if (m_context->storeRef && m_context->index != value) {
+        internal::VertexStore *storeRef = m_context->storeRef;
+        setVertexStoreRef(0);
+        storeRef->invalidate();
+    }
     m_context->index = value;
 }
 
+void Vertex::setVertexStoreRef(internal::VertexStore *value)
+{
+    if (m_context->storeRef == value) {
+        return;
+    }
+    const int index = m_context->index;
+    /* write back morph states of the store to the vertex */
+    if (m_context->hasStore()) {
+        internal::VertexStore *storeRef = m_context->storeRef;
+        m_context->morphDelta = storeRef->delta(index);
+        for (int i = 0; i < kMaxMorphs; i++) {
+            m_context->morphUVs[i] = storeRef->uv(index, i);
+        }
+    }
+    m_context->storeRef = value;
+    if (m_context->hasStore()) {
+        value->setDelta(index, m_context->morphDelta);
+        for (int i = 0; i < kMaxMorphs; i++) {
+            value->setUV(index, i, m_context->morphUVs[i]);
+        }
+    }
+}
+
 } /* namespace pmx */
 } /* namespace vpvl2 */
 
@@ -103,7 +103,7 @@ CameraKeyframe::~CameraKeyframe()
     delete m_ptr;
     m_ptr = 0;
     for (int i = 0; i < kCameraMaxInterpolationType; i++) {
-        delete[] m_interpolationTable[i];
+        internal::InterpolationTableCache::release(m_interpolationTable[i]);
         m_interpolationTable[i] = 0;
     }
     internal::zerofill(m_linear, sizeof(m_linear));
@@ -229,19 +229,16 @@ void CameraKeyframe::setInterpolationTable(const int8_t *table)
     QuadWord v;
     for (int i = 0; i < kCameraMaxInterpolationType; i++) {
         getValueFromTable(table, i, v);
-        delete[] m_interpolationTable[i];
+        const IKeyframe::SmoothPrecision *previousTable = m_interpolationTable[i];
         if (m_linear[i]) {
             m_interpolationTable[i] = 0;
+            internal::InterpolationTableCache::release(previousTable);
             setInterpolationParameterInternal(static_cast<InterpolationType>(i), v);
             continue;
         }
-        m_interpolationTable[i] = new IKeyframe::SmoothPrecision[kTableSize + 1];
-        internal::InterpolationTable::build(v.x() / 127.0, // x1
-                                                              v.z() / 127.0, // x2
-                                                              v.y() / 127.0, // y1
-                                                              v.w() / 127.0, // y2
-                                                              kTableSize,
-                                                              m_interpolationTable[i]);
+        /* tables are immutable and shared between keyframes having the same curve */
+        m_interpolationTable[i] = internal::InterpolationTableCache::acquire(v, kTableSize);
+        internal::InterpolationTableCache::release(previousTable);
     }
 }
 
@@ -56,8 +56,9 @@ namespace {
 
 enum VertexBufferObjectType
 {
-    kModelDynamicVertexBufferEven,
-    kModelDynamicVertexBufferOdd,
+    kModelDynamicVertexBuffer0,
+    kModelDynamicVertexBuffer1,
+    kModelDynamicVertexBuffer2,
     kModelStaticVertexBuffer,
     kModelIndexBuffer,
     kMaxVertexBufferObjectType
@@ -65,13 +66,18 @@ enum VertexBufferObjectType
 
 enum VertexArrayObjectType
 {
-    kVertexArrayObjectEven,
-    kVertexArrayObjectOdd,
-    kEdgeVertexArrayObjectEven,
-    kEdgeVertexArrayObjectOdd,
+    kVertexArrayObject0,
+    kVertexArrayObject1,
+    kVertexArrayObject2,
+    kEdgeVertexArrayObject0,
+    kEdgeVertexArrayObject1,
+    kEdgeVertexArrayObject2,
     kMaxVertexArrayObjectType
 };
 
+/* dynamic vertex buffers are rotated as a ring of stream buffers */
+static const int kMaxDynamicVertexBuffers = VertexBundle::kMaxStreamBuffers;
+
 struct MaterialTextureRefs
 {
     MaterialTextureRefs()
@@ -111,6 +117,9 @@ protected:
         ZPlotProgram::bindAttributeLocations();
         glBindAttribLocation(m_program, IModel::Buffer::kBoneIndexStride, "inBoneIndices");
         glBindAttribLocation(m_program, IModel::Buffer::kBoneWeightStride, "inBoneWeights");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefCStride, "inSdefC");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR0Stride, "inSdefR0");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR1Stride, "inSdefR1");
     }
     virtual void getUniformLocations() {
         ZPlotProgram::getUniformLocations();
@@ -158,6 +167,9 @@ protected:
         glBindAttribLocation(m_program, IModel::Buffer::kEdgeSizeStride, "inEdgeSize");
         glBindAttribLocation(m_program, IModel::Buffer::kBoneIndexStride, "inBoneIndices");
         glBindAttribLocation(m_program, IModel::Buffer::kBoneWeightStride, "inBoneWeights");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefCStride, "inSdefC");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR0Stride, "inSdefR0");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR1Stride, "inSdefR1");
     }
     virtual void getUniformLocations() {
         BaseShaderProgram::getUniformLocations();
@@ -199,6 +211,9 @@ protected:
     virtual void bindAttributeLocations() {
         glBindAttribLocation(m_program, IModel::Buffer::kBoneIndexStride, "inBoneIndices");
         glBindAttribLocation(m_program, IModel::Buffer::kBoneWeightStride, "inBoneWeights");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefCStride, "inSdefC");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR0Stride, "inSdefR0");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR1Stride, "inSdefR1");
     }
     virtual void getUniformLocations() {
         ObjectProgram::getUniformLocations();
@@ -333,6 +348,9 @@ protected:
         glBindAttribLocation(m_program, IModel::Buffer::kUVA1Stride, "inUVA1");
         glBindAttribLocation(m_program, IModel::Buffer::kBoneIndexStride, "inBoneIndices");
         glBindAttribLocation(m_program, IModel::Buffer::kBoneWeightStride, "inBoneWeights");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefCStride, "inSdefC");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR0Stride, "inSdefR0");
+        glBindAttribLocation(m_program, IModel::Buffer::kSdefR1Stride, "inSdefR1");
     }
     virtual void getUniformLocations() {
         ObjectProgram::getUniformLocations();
@@ -380,6 +398,45 @@ private:
     GLint m_boneMatricesUniformLocation;
 };
 
+static bool hasAdditionalUV1(const IModel::DynamicVertexBuffer *dynamicBuffer)
+{
+    /* channels the model doesn't declare are not stored and report offset 0 (the vertex position) */
+    return dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kUVA1Stride) > 0;
+}
+
+static void setAdditionalUV1Constant()
+{
+    glDisableVertexAttribArray(IModel::Buffer::kUVA1Stride);
+    glVertexAttrib4f(IModel::Buffer::kUVA1Stride, 0, 0, 0, 0);
+}
+
+static void setStaticVertexAttributePointer(const IModel::StaticVertexBuffer *staticBuffer,
+                                            IModel::Buffer::StrideType type,
+                                            GLint ncomponents)
+{
+    GLenum componentType = GL_FLOAT;
+    GLboolean normalized = GL_FALSE;
+    switch (staticBuffer->componentType(type)) {
+    case IModel::StaticVertexBuffer::kUnsignedByteComponent:
+        componentType = GL_UNSIGNED_BYTE;
+        break;
+    case IModel::StaticVertexBuffer::kUnsignedShortComponent:
+        componentType = GL_UNSIGNED_SHORT;
+        break;
+    case IModel::StaticVertexBuffer::kNormalizedUnsignedShortComponent:
+        componentType = GL_UNSIGNED_SHORT;
+        normalized = GL_TRUE;
+        break;
+    case IModel::StaticVertexBuffer::kFloatComponent:
+    case IModel::StaticVertexBuffer::kMaxComponentType:
+    default:
+        break;
+    }
+    const size_t offset = staticBuffer->strideOffset(type);
+    glVertexAttribPointer(type, ncomponents, componentType, normalized,
+                          staticBuffer->strideSize(), reinterpret_cast<const GLvoid *>(offset));
+}
+
 }
 
 namespace vpvl2
@@ -404,13 +461,18 @@ public:
           aabbMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY),
           cullFaceState(true),
           isVertexShaderSkinning(isVertexShaderSkinning),
-          updateEven(true)
+          updateIndex(0)
     {
         model->getIndexBuffer(indexBuffer);
         model->getStaticVertexBuffer(staticBuffer);
         model->getDynamicVertexBuffer(dynamicBuffer, indexBuffer);
-        if (isVertexShaderSkinning)
+        if (isVertexShaderSkinning) {
             model->getMatrixBuffer(matrixBuffer, dynamicBuffer, indexBuffer);
+            if (!matrixBuffer) {
+                VPVL2_LOG(WARNING, "Vertex shader skinning is not available, falling back to CPU skinning: " << internal::cstr(model->name(), "(null)"));
+                this->isVertexShaderSkinning = false;
+            }
+        }
         switch (indexBuffer->type()) {
         case IModel::IndexBuffer::kIndex32:
             indexType = GL_UNSIGNED_INT;
@@ -435,6 +497,8 @@ public:
         dynamicBuffer = 0;
         delete staticBuffer;
         staticBuffer = 0;
+        delete matrixBuffer;
+        matrixBuffer = 0;
         delete edgeProgram;
         edgeProgram = 0;
         delete modelProgram;
@@ -449,25 +513,19 @@ public:
         isVertexShaderSkinning = false;
     }
 
+    /* the last written buffer is drawn */
+    int drawIndex() const {
+        return (updateIndex + kMaxDynamicVertexBuffers - 1) % kMaxDynamicVertexBuffers;
+    }
     void getVertexBundleType(VertexArrayObjectType &vao, VertexBufferObjectType &vbo) {
-        if (updateEven) {
-            vao = kVertexArrayObjectOdd;
-            vbo = kModelDynamicVertexBufferOdd;
-        }
-        else {
-            vao = kVertexArrayObjectEven;
-            vbo = kModelDynamicVertexBufferEven;
-        }
+        const int index = drawIndex();
+        vao = VertexArrayObjectType(kVertexArrayObject0 + index);
+        vbo = VertexBufferObjectType(kModelDynamicVertexBuffer0 + index);
     }
     void getEdgeBundleType(VertexArrayObjectType &vao, VertexBufferObjectType &vbo) {
-        if (updateEven) {
-            vao = kEdgeVertexArrayObjectOdd;
-            vbo = kModelDynamicVertexBufferOdd;
-        }
-        else {
-            vao = kEdgeVertexArrayObjectEven;
-            vbo = kModelDynamicVertexBufferEven;
-        }
+        const int index = drawIndex();
+        vao = VertexArrayObjectType(kEdgeVertexArrayObject0 + index);
+        vbo = VertexBufferObjectType(kModelDynamicVertexBuffer0 + index);
     }
 
     const IModel *modelRef;
@@ -491,7 +549,7 @@ public:
 #endif
     bool cullFaceState;
     bool isVertexShaderSkinning;
-    bool updateEven;
+    int updateIndex;
 };
 
 PMXRenderEngine::PMXRenderEngine(IRenderContext *renderContext,
@@ -507,7 +565,7 @@ PMXRenderEngine::PMXRenderEngine(IRenderContext *renderContext,
     bool vss = m_sceneRef->accelerationType() == Scene::kVertexShaderAccelerationType1;
     m_context = new PrivateContext(modelRef, vss);
 #ifdef VPVL2_ENABLE_OPENCL
-    if (vss || (m_accelerator && m_accelerator->isAvailable()))
+    if (m_context->isVertexShaderSkinning || (m_accelerator && m_accelerator->isAvailable()))
         m_context->dynamicBuffer->setSkinningEnable(false);
 #endif
 }
@@ -542,7 +600,8 @@ bool PMXRenderEngine::upload(const IString *dir)
     if (!m_context) {
         vss = m_sceneRef->accelerationType() == Scene::kVertexShaderAccelerationType1;
         m_context = new PrivateContext(m_modelRef, vss);
-        m_context->dynamicBuffer->setSkinningEnable(false);
+        if (m_context->isVertexShaderSkinning)
+            m_context->dynamicBuffer->setSkinningEnable(false);
     }
     vss = m_context->isVertexShaderSkinning;
     m_renderContextRef->allocateUserData(m_modelRef, userData);
@@ -583,8 +642,9 @@ bool PMXRenderEngine::upload(const IString *dir)
         return releaseUserData0(userData);
     }
     VertexBundle &buffer = m_context->buffer;
-    buffer.create(VertexBundle::kVertexBuffer, kModelDynamicVertexBufferEven, GL_DYNAMIC_DRAW, 0, m_context->dynamicBuffer->size());
-    buffer.create(VertexBundle::kVertexBuffer, kModelDynamicVertexBufferOdd, GL_DYNAMIC_DRAW, 0, m_context->dynamicBuffer->size());
+    for (int i = 0; i < kMaxDynamicVertexBuffers; i++) {
+        buffer.createStream(kModelDynamicVertexBuffer0 + i, m_context->dynamicBuffer->size());
+    }
     VPVL2_VLOG(2, "Binding model dynamic vertex buffer to the vertex buffer object: size=" << m_context->dynamicBuffer->size());
     const IModel::StaticVertexBuffer *staticBuffer = m_context->staticBuffer;
     buffer.create(VertexBundle::kVertexBuffer, kModelStaticVertexBuffer, GL_STATIC_DRAW, 0, staticBuffer->size());
@@ -597,25 +657,17 @@ bool PMXRenderEngine::upload(const IString *dir)
     const IModel::IndexBuffer *indexBuffer = m_context->indexBuffer;
     buffer.create(VertexBundle::kIndexBuffer, kModelIndexBuffer, GL_STATIC_DRAW, indexBuffer->bytes(), indexBuffer->size());
     VPVL2_VLOG(2, "Binding indices to the vertex buffer object: ptr=" << indexBuffer->bytes() << " size=" << indexBuffer->size());
-    VertexBundleLayout &bundleME = m_context->bundles[kVertexArrayObjectEven];
-    if (bundleME.create() && bundleME.bind()) {
-        VPVL2_VLOG(2, "Binding an vertex array object for even frame: " << bundleME.name());
-        createVertexBundle(kModelDynamicVertexBufferEven);
-    }
-    VertexBundleLayout &bundleMO = m_context->bundles[kVertexArrayObjectOdd];
-    if (bundleMO.create() && bundleMO.bind()) {
-        VPVL2_VLOG(2, "Binding an vertex array object for odd frame: " << bundleMO.name());
-        createVertexBundle(kModelDynamicVertexBufferOdd);
-    }
-    VertexBundleLayout &bundleEE = m_context->bundles[kEdgeVertexArrayObjectEven];
-    if (bundleEE.create() && bundleEE.bind()) {
-        VPVL2_VLOG(2, "Binding an edge vertex array object for even frame: " << bundleEE.name());
-        createEdgeBundle(kModelDynamicVertexBufferEven);
-    }
-    VertexBundleLayout &bundleEO = m_context->bundles[kEdgeVertexArrayObjectOdd];
-    if (bundleEO.create() && bundleEO.bind()) {
-        VPVL2_VLOG(2, "Binding an edge vertex array object for odd frame: " << bundleEO.name());
-        createEdgeBundle(kModelDynamicVertexBufferOdd);
+    for (int i = 0; i < kMaxDynamicVertexBuffers; i++) {
+        VertexBundleLayout &bundleM = m_context->bundles[kVertexArrayObject0 + i];
+        if (bundleM.create() && bundleM.bind()) {
+            VPVL2_VLOG(2, "Binding an vertex array object for frame " << i << ": " << bundleM.name());
+            createVertexBundle(kModelDynamicVertexBuffer0 + i);
+        }
+        VertexBundleLayout &bundleE = m_context->bundles[kEdgeVertexArrayObject0 + i];
+        if (bundleE.create() && bundleE.bind()) {
+            VPVL2_VLOG(2, "Binding an edge vertex array object for frame " << i << ": " << bundleE.name());
+            createEdgeBundle(kModelDynamicVertexBuffer0 + i);
+        }
     }
     buffer.unbind(VertexBundle::kVertexBuffer);
     buffer.unbind(VertexBundle::kIndexBuffer);
@@ -625,14 +677,14 @@ bool PMXRenderEngine::upload(const IString *dir)
         const VertexBundle &buffer = m_context->buffer;
         cl::PMXAccelerator::Buffers &buffers = m_context->buffers;
         m_accelerator->release(buffers);
-        buffers.append(cl::PMXAccelerator::Buffer(buffer.findName(kModelDynamicVertexBufferEven)));
-        buffers.append(cl::PMXAccelerator::Buffer(buffer.findName(kModelDynamicVertexBufferOdd)));
+        for (int i = 0; i < kMaxDynamicVertexBuffers; i++) {
+            buffers.append(cl::PMXAccelerator::Buffer(buffer.findName(kModelDynamicVertexBuffer0 + i)));
+        }
         m_accelerator->upload(buffers, m_context->indexBuffer);
     }
 #endif
     m_modelRef->setVisible(true);
-    update(); // for updating even frame
-    update(); // for updating odd frame
+    update(); // for updating the first frame
     VPVL2_VLOG(2, "Created the model: " << internal::cstr(m_modelRef->name(), 0));
     m_renderContextRef->stopProfileSession(IRenderContext::kProfileUploadModelProcess, m_modelRef);
     m_renderContextRef->releaseUserData(m_modelRef, userData);
@@ -643,30 +695,36 @@ void PMXRenderEngine::update()
 {
     if (!m_modelRef || !m_modelRef->isVisible() || !m_context)
         return;
-    m_renderContextRef->startProfileSession(IRenderContext::kProfileUpdateModelProcess, m_modelRef);
-    VertexBufferObjectType vbo = m_context->updateEven
-            ? kModelDynamicVertexBufferEven : kModelDynamicVertexBufferOdd;
     IModel::DynamicVertexBuffer *dynamicBuffer = m_context->dynamicBuffer;
-    m_context->buffer.bind(VertexBundle::kVertexBuffer, vbo);
-    if (void *address = m_context->buffer.map(VertexBundle::kVertexBuffer, 0, dynamicBuffer->size())) {
+    const Vector3 &cameraPosition = m_sceneRef->camera()->position();
+    /* the last written buffer is still valid, so neither map nor swap buffers */
+    if (m_context->isVertexShaderSkinning ? !m_context->matrixBuffer->isDirty() : !dynamicBuffer->isDirty(cameraPosition)) {
+        return;
+    }
+    m_renderContextRef->startProfileSession(IRenderContext::kProfileUpdateModelProcess, m_modelRef);
+    VertexBundle &buffer = m_context->buffer;
+    const int updateIndex = m_context->updateIndex;
+    /* all draw commands reading the last written buffer are issued before updating the next one */
+    buffer.fenceStream(kModelDynamicVertexBuffer0 + m_context->drawIndex());
+    /* skinning writes into the persistently mapped buffer directly if it's available */
+    const GLuint vbo = kModelDynamicVertexBuffer0 + updateIndex;
+    if (void *address = buffer.mapStream(vbo)) {
         if (m_context->isVertexShaderSkinning) {
             m_context->matrixBuffer->update(address);
         }
         else {
-            const ICamera *camera = m_sceneRef->camera();
-            dynamicBuffer->update(address, camera->position(), m_context->aabbMin, m_context->aabbMax);
+            dynamicBuffer->update(address, cameraPosition, m_context->aabbMin, m_context->aabbMax);
         }
-        m_context->buffer.unmap(VertexBundle::kVertexBuffer, address);
+        buffer.unmapStream(vbo);
     }
-    m_context->buffer.unbind(VertexBundle::kVertexBuffer);
 #ifdef VPVL2_ENABLE_OPENCL
     if (m_accelerator && m_accelerator->isAvailable()) {
-        const cl::PMXAccelerator::Buffer &buffer = m_context->buffers[m_context->updateEven ? 0 : 1];
+        const cl::PMXAccelerator::Buffer &buffer = m_context->buffers[updateIndex];
         m_accelerator->update(dynamicBuffer, m_sceneRef, buffer, m_context->aabbMin, m_context->aabbMax);
     }
 #endif
     m_modelRef->setAabb(m_context->aabbMin, m_context->aabbMax);
-    m_context->updateEven = m_context->updateEven ? false :true;
+    m_context->updateIndex = (updateIndex + 1) % kMaxDynamicVertexBuffers;
     m_renderContextRef->stopProfileSession(IRenderContext::kProfileUpdateModelProcess, m_modelRef);
 }
 
@@ -745,10 +803,6 @@ void PMXRenderEngine::renderModel()
             modelProgram->setDepthTexture(textureID);
         else
             modelProgram->setDepthTexture(0);
-        if (isVertexShaderSkinning) {
-            IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
-            modelProgram->setBoneMatrices(matrixBuffer->bytes(i), matrixBuffer->size(i));
-        }
         if (!hasModelTransparent && cullFaceState && material->isCullingDisabled()) {
             glDisable(GL_CULL_FACE);
             cullFaceState = false;
@@ -757,11 +811,23 @@ void PMXRenderEngine::renderModel()
             glEnable(GL_CULL_FACE);
             cullFaceState = true;
         }
-        const int nindices = material->indexRange().count;
         m_renderContextRef->startProfileSession(IRenderContext::kProfileRenderModelMaterialDrawCall, material);
-        glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
+        if (isVertexShaderSkinning) {
+            const IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
+            const int nmeshes = matrixBuffer->countMeshes(i);
+            for (int j = 0; j < nmeshes; j++) {
+                const int nindices = matrixBuffer->countIndices(i, j);
+                modelProgram->setBoneMatrices(matrixBuffer->bytes(i, j), matrixBuffer->size(i, j));
+                glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
+                offset += nindices * size;
+            }
+        }
+        else {
+            const int nindices = material->indexRange().count;
+            glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
+            offset += nindices * size;
+        }
         m_renderContextRef->stopProfileSession(IRenderContext::kProfileRenderModelMaterialDrawCall, material);
-        offset += nindices * size;
     }
     unbindVertexBundle();
     modelProgram->unbind();
@@ -800,12 +866,21 @@ void PMXRenderEngine::renderShadow()
         const IMaterial *material = materials[i];
         const int nindices = material->indexRange().count;
         if (material->hasShadow()) {
+            m_renderContextRef->startProfileSession(IRenderContext::kProfileRenderShadowMaterialDrawCall, material);
             if (isVertexShaderSkinning) {
-                IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
-                shadowProgram->setBoneMatrices(matrixBuffer->bytes(i), matrixBuffer->size(i));
+                const IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
+                const int nmeshes = matrixBuffer->countMeshes(i);
+                size_t meshOffset = offset;
+                for (int j = 0; j < nmeshes; j++) {
+                    const int nMeshIndices = matrixBuffer->countIndices(i, j);
+                    shadowProgram->setBoneMatrices(matrixBuffer->bytes(i, j), matrixBuffer->size(i, j));
+                    glDrawElements(GL_TRIANGLES, nMeshIndices, m_context->indexType, reinterpret_cast<const GLvoid *>(meshOffset));
+                    meshOffset += nMeshIndices * size;
+                }
+            }
+            else {
+                glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
             }
-            m_renderContextRef->startProfileSession(IRenderContext::kProfileRenderShadowMaterialDrawCall, material);
-            glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
             m_renderContextRef->stopProfileSession(IRenderContext::kProfileRenderShadowMaterialDrawCall, material);
         }
         offset += nindices * size;
@@ -852,13 +927,22 @@ void PMXRenderEngine::renderEdge()
         const int nindices = material->indexRange().count;
         edgeProgram->setColor(material->edgeColor());
         if (material->isEdgeEnabled()) {
+            m_renderContextRef->startProfileSession(IRenderContext::kProfileRenderEdgeMateiralDrawCall, material);
             if (isVertexShaderSkinning) {
-                IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
-                edgeProgram->setBoneMatrices(matrixBuffer->bytes(i), matrixBuffer->size(i));
+                const IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
+                const int nmeshes = matrixBuffer->countMeshes(i);
+                size_t meshOffset = offset;
                 edgeProgram->setSize(Scalar(material->edgeSize() * edgeScaleFactor));
+                for (int j = 0; j < nmeshes; j++) {
+                    const int nMeshIndices = matrixBuffer->countIndices(i, j);
+                    edgeProgram->setBoneMatrices(matrixBuffer->bytes(i, j), matrixBuffer->size(i, j));
+                    glDrawElements(GL_TRIANGLES, nMeshIndices, m_context->indexType, reinterpret_cast<const GLvoid *>(meshOffset));
+                    meshOffset += nMeshIndices * size;
+                }
+            }
+            else {
+                glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
             }
-            m_renderContextRef->startProfileSession(IRenderContext::kProfileRenderEdgeMateiralDrawCall, material);
-            glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
             m_renderContextRef->stopProfileSession(IRenderContext::kProfileRenderEdgeMateiralDrawCall, material);
         }
         offset += nindices * size;
@@ -896,12 +980,21 @@ void PMXRenderEngine::renderZPlot()
         const IMaterial *material = materials[i];
         const int nindices = material->indexRange().count;
         if (material->hasShadowMap()) {
+            m_renderContextRef->startProfileSession(IRenderContext::kProfileRenderZPlotMaterialDrawCall, material);
             if (isVertexShaderSkinning) {
-                IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
-                zplotProgram->setBoneMatrices(matrixBuffer->bytes(i), matrixBuffer->size(i));
+                const IModel::MatrixBuffer *matrixBuffer = m_context->matrixBuffer;
+                const int nmeshes = matrixBuffer->countMeshes(i);
+                size_t meshOffset = offset;
+                for (int j = 0; j < nmeshes; j++) {
+                    const int nMeshIndices = matrixBuffer->countIndices(i, j);
+                    zplotProgram->setBoneMatrices(matrixBuffer->bytes(i, j), matrixBuffer->size(i, j));
+                    glDrawElements(GL_TRIANGLES, nMeshIndices, m_context->indexType, reinterpret_cast<const GLvoid *>(meshOffset));
+                    meshOffset += nMeshIndices * size;
+                }
+            }
+            else {
+                glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
             }
-            m_renderContextRef->startProfileSession(IRenderContext::kProfileRenderZPlotMaterialDrawCall, material);
-            glDrawElements(GL_TRIANGLES, nindices, m_context->indexType, reinterpret_cast<const GLvoid *>(offset));
             m_renderContextRef->stopProfileSession(IRenderContext::kProfileRenderZPlotMaterialDrawCall, material);
         }
         offset += nindices * size;
@@ -1060,7 +1153,15 @@ void PMXRenderEngine::createVertexBundle(GLuint dvbo)
     glEnableVertexAttribArray(IModel::Buffer::kNormalStride);
     glEnableVertexAttribArray(IModel::Buffer::kTextureCoordStride);
     glEnableVertexAttribArray(IModel::Buffer::kUVA0Stride);
-    glEnableVertexAttribArray(IModel::Buffer::kUVA1Stride);
+    if (hasAdditionalUV1(m_context->dynamicBuffer)) {
+        glEnableVertexAttribArray(IModel::Buffer::kUVA1Stride);
+    }
+    else {
+        setAdditionalUV1Constant();
+    }
+    if (m_context->isVertexShaderSkinning) {
+        enableSkinningVertexAttributeArrays();
+    }
     VertexBundleLayout::unbindVertexArrayObject();
 }
 
@@ -1073,6 +1174,11 @@ void PMXRenderEngine::createEdgeBundle(GLuint dvbo)
     bindStaticVertexAttributePointers();
     buffer.bind(VertexBundle::kIndexBuffer, kModelIndexBuffer);
     glEnableVertexAttribArray(IModel::Buffer::kVertexStride);
+    if (m_context->isVertexShaderSkinning) {
+        glEnableVertexAttribArray(IModel::Buffer::kNormalStride);
+        glEnableVertexAttribArray(IModel::Buffer::kEdgeSizeStride);
+        enableSkinningVertexAttributeArrays();
+    }
     VertexBundleLayout::unbindVertexArrayObject();
 }
 
@@ -1089,6 +1195,10 @@ void PMXRenderEngine::bindVertexBundle()
         bindStaticVertexAttributePointers();
         buffer.bind(VertexBundle::kIndexBuffer, kModelIndexBuffer);
     }
+    if (!hasAdditionalUV1(m_context->dynamicBuffer)) {
+        /* the constant is a context state and not stored in the vertex array object */
+        setAdditionalUV1Constant();
+    }
 }
 
 void PMXRenderEngine::bindEdgeBundle()
@@ -1129,9 +1239,11 @@ void PMXRenderEngine::bindDynamicVertexAttributePointers()
     offset = dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kUVA0Stride);
     glVertexAttribPointer(IModel::Buffer::kUVA0Stride, 4, GL_FLOAT, GL_FALSE,
                           size, reinterpret_cast<const GLvoid *>(offset));
-    offset = dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kUVA1Stride);
-    glVertexAttribPointer(IModel::Buffer::kUVA1Stride, 4, GL_FLOAT, GL_FALSE,
-                          size, reinterpret_cast<const GLvoid *>(offset));
+    if (hasAdditionalUV1(dynamicBuffer)) {
+        offset = dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kUVA1Stride);
+        glVertexAttribPointer(IModel::Buffer::kUVA1Stride, 4, GL_FLOAT, GL_FALSE,
+                              size, reinterpret_cast<const GLvoid *>(offset));
+    }
 }
 
 void PMXRenderEngine::bindEdgeVertexAttributePointers()
@@ -1146,26 +1258,32 @@ void PMXRenderEngine::bindEdgeVertexAttributePointers()
         offset = dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kNormalStride);
         glVertexAttribPointer(IModel::Buffer::kNormalStride, 3, GL_FLOAT, GL_FALSE,
                               size, reinterpret_cast<const GLvoid *>(offset));
-        glVertexAttribPointer(IModel::Buffer::kEdgeSizeStride, 4, GL_FLOAT, GL_FALSE,
+        offset = dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kEdgeSizeStride);
+        glVertexAttribPointer(IModel::Buffer::kEdgeSizeStride, 1, GL_FLOAT, GL_FALSE,
                               size, reinterpret_cast<const GLvoid *>(offset));
     }
 }
 
+void PMXRenderEngine::enableSkinningVertexAttributeArrays()
+{
+    glEnableVertexAttribArray(IModel::Buffer::kBoneIndexStride);
+    glEnableVertexAttribArray(IModel::Buffer::kBoneWeightStride);
+    glEnableVertexAttribArray(IModel::Buffer::kSdefCStride);
+    glEnableVertexAttribArray(IModel::Buffer::kSdefR0Stride);
+    glEnableVertexAttribArray(IModel::Buffer::kSdefR1Stride);
+}
+
 void PMXRenderEngine::bindStaticVertexAttributePointers()
 {
     const IModel::StaticVertexBuffer *staticBuffer = m_context->staticBuffer;
-    size_t offset, size;
-    offset = staticBuffer->strideOffset(IModel::StaticVertexBuffer::kTextureCoordStride);
-    size   = staticBuffer->strideSize();
-    glVertexAttribPointer(IModel::Buffer::kTextureCoordStride, 2, GL_FLOAT, GL_FALSE,
-                          size, reinterpret_cast<const GLvoid *>(offset));
+    setStaticVertexAttributePointer(staticBuffer, IModel::Buffer::kTextureCoordStride, 2);
     if (m_context->isVertexShaderSkinning) {
-        offset = staticBuffer->strideOffset(IModel::StaticVertexBuffer::kBoneIndexStride);
-        glVertexAttribPointer(IModel::Buffer::kBoneIndexStride, 4, GL_FLOAT, GL_FALSE,
-                              size, reinterpret_cast<const GLvoid *>(offset));
-        offset = staticBuffer->strideOffset(IModel::StaticVertexBuffer::kBoneWeightStride);
-        glVertexAttribPointer(IModel::Buffer::kBoneWeightStride, 4, GL_FLOAT, GL_FALSE,
-                              size, reinterpret_cast<const GLvoid *>(offset));
+        /* bone indices and weights may be packed as integers so they are converted to float by GL */
+        setStaticVertexAttributePointer(staticBuffer, IModel::Buffer::kBoneIndexStride, 4);
+        setStaticVertexAttributePointer(staticBuffer, IModel::Buffer::kBoneWeightStride, 4);
+        setStaticVertexAttributePointer(staticBuffer, IModel::Buffer::kSdefCStride, 3);
+        setStaticVertexAttributePointer(staticBuffer, IModel::Buffer::kSdefR0Stride, 3);
+        setStaticVertexAttributePointer(staticBuffer, IModel::Buffer::kSdefR1Stride, 3);
     }
 }
 
@@ -1,8 +1,22 @@
 #include "Common.h"
+
+#include <btBulletDynamicsCommon.h>
+
 #include "vpvl2/extensions/icu4c/String.h"
+#include "vpvl2/internal/Arena.h"
+#include "vpvl2/internal/BaseRigidBody.h"
 #include "vpvl2/internal/MotionHelper.h"
+#include "vpvl2/internal/ThreadPool.h"
+#include "vpvl2/internal/VertexCacheOptimizer.h"
 #include "vpvl2/internal/util.h"
+#include "vpvl2/pmx/Morph.h"
+#include "vpvl2/vmd/LightKeyframe.h"
+#include <algorithm>
+#include <functional>
 #include <limits>
+#include <vector>
+
+#include "mock/Bone.h"
 
 using namespace ::testing;
 using namespace vpvl2;
@@ -16,6 +30,374 @@ TEST(InternalTest, Lerp)
     ASSERT_EQ(3.0, vpvl2::internal::MotionHelper::lerp(4, 2, 0.5));
 }
 
+TEST(InternalTest, FindKeyframeIndices)
+{
+    PointerArray<IKeyframe> keyframes;
+    const IKeyframe::TimeIndex timeIndices[] = { 20, 0, 40, 10, 30 };
+    for (int i = 0; i < 5; i++) {
+        vmd::LightKeyframe *keyframe = new vmd::LightKeyframe();
+        keyframe->setTimeIndex(timeIndices[i]);
+        vpvl2::internal::MotionHelper::insertKeyframe<IKeyframe>(keyframe, keyframes);
+    }
+    for (int i = 0; i < 5; i++) {
+        ASSERT_FLOAT_EQ(IKeyframe::TimeIndex(i * 10), keyframes[i]->timeIndex());
+    }
+    ASSERT_EQ(3, vpvl2::internal::MotionHelper::findKeyframeIndex(30, 0, keyframes));
+    ASSERT_EQ(-1, vpvl2::internal::MotionHelper::findKeyframeIndex(31, 0, keyframes));
+    ASSERT_EQ(-1, vpvl2::internal::MotionHelper::findKeyframeIndex(30, 1, keyframes));
+    IKeyframe::TimeIndex currentTimeIndex;
+    int lastIndex = 0, fromIndex, toIndex;
+    /* sequential playback advances the cursor */
+    vpvl2::internal::MotionHelper::findKeyframeIndices(15, currentTimeIndex, lastIndex, fromIndex, toIndex, keyframes);
+    ASSERT_EQ(1, fromIndex);
+    ASSERT_EQ(2, toIndex);
+    vpvl2::internal::MotionHelper::findKeyframeIndices(16, currentTimeIndex, lastIndex, fromIndex, toIndex, keyframes);
+    ASSERT_EQ(1, fromIndex);
+    ASSERT_EQ(2, toIndex);
+    vpvl2::internal::MotionHelper::findKeyframeIndices(35, currentTimeIndex, lastIndex, fromIndex, toIndex, keyframes);
+    ASSERT_EQ(3, fromIndex);
+    ASSERT_EQ(4, toIndex);
+    /* seeking backward and beyond the last keyframe */
+    vpvl2::internal::MotionHelper::findKeyframeIndices(5, currentTimeIndex, lastIndex, fromIndex, toIndex, keyframes);
+    ASSERT_EQ(0, fromIndex);
+    ASSERT_EQ(1, toIndex);
+    vpvl2::internal::MotionHelper::findKeyframeIndices(100, currentTimeIndex, lastIndex, fromIndex, toIndex, keyframes);
+    ASSERT_FLOAT_EQ(40, currentTimeIndex);
+    ASSERT_EQ(3, fromIndex);
+    ASSERT_EQ(4, toIndex);
+    /* a stale cursor must not be used after removing keyframes */
+    lastIndex = 4;
+    IKeyframe *keyframe = keyframes[1];
+    vpvl2::internal::MotionHelper::removeKeyframe<IKeyframe>(keyframe, keyframes);
+    delete keyframe;
+    ASSERT_EQ(4, keyframes.count());
+    ASSERT_FLOAT_EQ(20, keyframes[1]->timeIndex());
+    vpvl2::internal::MotionHelper::findKeyframeIndices(25, currentTimeIndex, lastIndex, fromIndex, toIndex, keyframes);
+    ASSERT_EQ(1, fromIndex);
+    ASSERT_EQ(2, toIndex);
+    keyframes.releaseAll();
+}
+
+static int CountCacheMisses(const Array<int> &indices, int cacheSize)
+{
+    std::vector<int> cache;
+    int nmisses = 0;
+    for (int i = 0; i < indices.count(); i++) {
+        const int index = indices[i];
+        std::vector<int>::iterator it = std::find(cache.begin(), cache.end(), index);
+        if (it != cache.end()) {
+            cache.erase(it);
+        }
+        else {
+            nmisses++;
+        }
+        cache.insert(cache.begin(), index);
+        if (int(cache.size()) > cacheSize) {
+            cache.pop_back();
+        }
+    }
+    return nmisses;
+}
+
+TEST(InternalTest, VertexCacheOptimizer)
+{
+    static const int kGridSize = 16, kStride = kGridSize + 1;
+    const int nvertices = kStride * kStride, ntriangles = kGridSize * kGridSize * 2;
+    Array<int> indices, sortedTriangles, reorderedTriangles;
+    /* triangles of the grid are scattered so that neighbor triangles are far in the order */
+    for (int i = 0; i < ntriangles; i++) {
+        const int triangle = (i * 37) % ntriangles, quad = triangle / 2;
+        const int base = (quad / kGridSize) * kStride + quad % kGridSize;
+        if (triangle % 2 == 0) {
+            indices.append(base);
+            indices.append(base + 1);
+            indices.append(base + kStride);
+        }
+        else {
+            indices.append(base + 1);
+            indices.append(base + kStride + 1);
+            indices.append(base + kStride);
+        }
+        sortedTriangles.append((indices[i * 3] * nvertices + indices[i * 3 + 1]) * nvertices + indices[i * 3 + 2]);
+    }
+    const int nmissesBefore = CountCacheMisses(indices, VertexCacheOptimizer::kCacheSize);
+    VertexCacheOptimizer optimizer(nvertices);
+    ASSERT_TRUE(optimizer.reorderTriangles(indices, 0, indices.count()));
+    ASSERT_LT(CountCacheMisses(indices, VertexCacheOptimizer::kCacheSize), nmissesBefore);
+    /* same triangles keeping the winding are emitted */
+    for (int i = 0; i < ntriangles; i++) {
+        reorderedTriangles.append((indices[i * 3] * nvertices + indices[i * 3 + 1]) * nvertices + indices[i * 3 + 2]);
+    }
+    sortedTriangles.sort(std::less<int>());
+    reorderedTriangles.sort(std::less<int>());
+    for (int i = 0; i < ntriangles; i++) {
+        ASSERT_EQ(sortedTriangles[i], reorderedTriangles[i]);
+    }
+    /* a range referring an invalid vertex is kept as it is */
+    indices[0] = nvertices;
+    const int second = indices[3];
+    ASSERT_FALSE(optimizer.reorderTriangles(indices, 0, 6));
+    ASSERT_EQ(nvertices, indices[0]);
+    ASSERT_EQ(second, indices[3]);
+}
+
+TEST(InternalTest, BuildVertexRemap)
+{
+    Array<int> indices, remap;
+    indices.append(2);
+    indices.append(0);
+    indices.append(2);
+    indices.append(1);
+    VertexCacheOptimizer::buildVertexRemap(indices, 4, remap);
+    ASSERT_EQ(4, remap.count());
+    ASSERT_EQ(1, remap[0]);
+    ASSERT_EQ(2, remap[1]);
+    ASSERT_EQ(0, remap[2]);
+    /* unreferred vertices follow referred vertices */
+    ASSERT_EQ(3, remap[3]);
+}
+
+namespace {
+
+class VisitRangeTask : public ThreadPool::ITask {
+public:
+    VisitRangeTask(ThreadPool *pool, int size, bool nested)
+        : m_poolRef(pool),
+          m_nested(nested),
+          m_invalidWorkers(0)
+    {
+        m_visits.resize(size);
+        std::fill(&m_visits[0], &m_visits[0] + size, 0);
+        std::fill(m_sums, m_sums + ThreadPool::kMaxWorkers, 0);
+    }
+
+    void run(int begin, int end, int worker) {
+        if (worker < 0 || worker >= m_poolRef->countWorkers()) {
+            m_invalidWorkers++;
+            return;
+        }
+        if (m_nested) {
+            /* executed inline on the current worker */
+            VisitRangeTask task(m_poolRef, end - begin, false);
+            m_poolRef->execute(&task, 0, end - begin, 1);
+            for (int i = 0; i < end - begin; i++) {
+                m_visits[begin + i] += task.m_visits[i];
+            }
+            m_sums[worker] += task.sum();
+        }
+        else {
+            for (int i = begin; i < end; i++) {
+                m_visits[i]++;
+                m_sums[worker] += i;
+            }
+        }
+    }
+    int visitsAt(int index) const { return m_visits[index]; }
+    int invalidWorkers() const { return m_invalidWorkers; }
+    int sum() const {
+        int value = 0;
+        for (int i = 0; i < ThreadPool::kMaxWorkers; i++) {
+            value += m_sums[i];
+        }
+        return value;
+    }
+
+private:
+    ThreadPool *m_poolRef;
+    Array<int> m_visits;
+    int m_sums[ThreadPool::kMaxWorkers];
+    bool m_nested;
+    int m_invalidWorkers;
+};
+
+}
+
+TEST(InternalTest, ThreadPool)
+{
+    static const int kSize = 10007;
+    ThreadPool pool;
+    ASSERT_GE(pool.countWorkers(), 1);
+    for (int nworkers = 1; nworkers <= 8; nworkers *= 2) {
+        pool.setup(nworkers, false);
+        ASSERT_EQ(nworkers, pool.countWorkers());
+        ASSERT_FALSE(pool.isAffinityEnabled());
+        for (int grainSize = 0; grainSize <= 64; grainSize += 16) {
+            VisitRangeTask task(&pool, kSize, false);
+            pool.execute(&task, 0, kSize, grainSize);
+            ASSERT_EQ(0, task.invalidWorkers());
+            ASSERT_EQ(kSize * (kSize - 1) / 2, task.sum());
+            for (int i = 0; i < kSize; i++) {
+                ASSERT_EQ(1, task.visitsAt(i));
+            }
+        }
+        VisitRangeTask nestedTask(&pool, kSize, true);
+        pool.execute(&nestedTask, 0, kSize, 100);
+        ASSERT_EQ(0, nestedTask.invalidWorkers());
+        for (int i = 0; i < kSize; i++) {
+            ASSERT_EQ(1, nestedTask.visitsAt(i));
+        }
+    }
+    /* out of range is clamped */
+    pool.setup(0, true);
+    ASSERT_EQ(1, pool.countWorkers());
+    ASSERT_TRUE(pool.isAffinityEnabled());
+    pool.setup(ThreadPool::kMaxWorkers + 1, false);
+    ASSERT_EQ(int(ThreadPool::kMaxWorkers), pool.countWorkers());
+    VisitRangeTask task(&pool, 16, false);
+    pool.execute(&task, 4, 4, 0);
+    pool.execute(&task, 0, 16, 1);
+    ASSERT_EQ(16 * 15 / 2, task.sum());
+}
+
+namespace {
+
+class CountRunTask : public ThreadPool::ITask {
+public:
+    CountRunTask()
+        : m_count(0),
+          m_invalidRanges(0)
+    {
+    }
+
+    void run(int begin, int end, int worker) {
+        if (begin != 0 || end != 1 || worker != 0) {
+            m_invalidRanges++;
+        }
+        m_count++;
+    }
+    int count() const { return m_count; }
+    int invalidRanges() const { return m_invalidRanges; }
+
+private:
+    int m_count;
+    int m_invalidRanges;
+};
+
+}
+
+TEST(InternalTest, WorkerThread)
+{
+    WorkerThread thread;
+    ASSERT_FALSE(thread.isRunning());
+    thread.wait();
+    CountRunTask task;
+    for (int i = 0; i < 100; i++) {
+        /* the previous run is waited at start */
+        thread.start(&task);
+    }
+    thread.wait();
+    ASSERT_FALSE(thread.isRunning());
+    ASSERT_EQ(100, task.count());
+    ASSERT_EQ(0, task.invalidRanges());
+    thread.start(0);
+    thread.wait();
+    ASSERT_EQ(100, task.count());
+}
+
+TEST(InternalTest, KinematicMotionStateBuffer)
+{
+    MockIBone bone;
+    const Transform first(Matrix3x3::getIdentity(), Vector3(1, 2, 3)),
+            second(Matrix3x3::getIdentity(), Vector3(4, 5, 6)),
+            third(Matrix3x3::getIdentity(), Vector3(7, 8, 9));
+    EXPECT_CALL(bone, getLocalTransform(_))
+            .WillOnce(SetArgReferee<0>(first))
+            .WillOnce(SetArgReferee<0>(second))
+            .WillOnce(SetArgReferee<0>(third));
+    BaseRigidBody::KinematicMotionState state(Transform::getIdentity(), &bone);
+    Transform transform;
+    /* both buffers are filled with the current bone transform */
+    state.setBufferEnable(true);
+    state.getWorldTransform(transform);
+    ASSERT_EQ(first.getOrigin(), transform.getOrigin());
+    /* the captured transform is not visible until swapped */
+    state.captureBoneTransform();
+    state.getWorldTransform(transform);
+    ASSERT_EQ(first.getOrigin(), transform.getOrigin());
+    state.swapBuffers();
+    state.getWorldTransform(transform);
+    ASSERT_EQ(second.getOrigin(), transform.getOrigin());
+    /* nothing is captured, keeps the last captured transform */
+    state.swapBuffers();
+    state.getWorldTransform(transform);
+    ASSERT_EQ(second.getOrigin(), transform.getOrigin());
+    /* reads the bone directly */
+    state.setBufferEnable(false);
+    state.getWorldTransform(transform);
+    ASSERT_EQ(third.getOrigin(), transform.getOrigin());
+}
+
+class BatchSyncRigidBody : public BaseRigidBody {
+public:
+    BatchSyncRigidBody()
+        : BaseRigidBody(0, 0)
+    {
+    }
+    void build(IBone *boneRef) {
+        BaseRigidBody::build(boneRef, 0);
+    }
+};
+
+TEST(InternalTest, BatchSyncKinematicTransform)
+{
+    MockIBone bone;
+    EXPECT_CALL(bone, index()).WillRepeatedly(Return(0));
+    EXPECT_CALL(bone, setInverseKinematicsEnable(true)).Times(1);
+    EXPECT_CALL(bone, getLocalTransform(_)).WillRepeatedly(SetArgReferee<0>(Transform::getIdentity()));
+    BatchSyncRigidBody rigidBody;
+    rigidBody.setType(IRigidBody::kStaticObject);
+    rigidBody.setShapeType(IRigidBody::kSphereShape);
+    rigidBody.setSize(Vector3(1, 1, 1));
+    rigidBody.setPosition(Vector3(1, 2, 3));
+    rigidBody.build(&bone);
+    Scalar matrix[16];
+    Transform(Matrix3x3::getIdentity(), Vector3(4, 5, 6)).getOpenGLMatrix(matrix);
+    /* ignored unless the batched sync is enabled */
+    rigidBody.syncKinematicTransform(matrix);
+    ASSERT_TRUE(rigidBody.body()->getMotionState());
+    ASSERT_EQ(Vector3(1, 2, 3), rigidBody.body()->getWorldTransform().getOrigin());
+    rigidBody.setBatchSyncEnable(true);
+    ASSERT_FALSE(rigidBody.body()->getMotionState());
+    rigidBody.syncKinematicTransform(matrix);
+    ASSERT_EQ(Vector3(5, 7, 9), rigidBody.body()->getWorldTransform().getOrigin());
+    /* the motion state is attached again and the transform is kept */
+    rigidBody.setBatchSyncEnable(false);
+    ASSERT_TRUE(rigidBody.body()->getMotionState());
+    ASSERT_EQ(Vector3(5, 7, 9), rigidBody.body()->getWorldTransform().getOrigin());
+}
+
+TEST(InternalTest, Arena)
+{
+    Arena *arena = Arena::create(1024);
+    Array<pmx::Morph::Vertex *> vertices;
+    {
+        Arena::Scope scope(arena);
+        for (int i = 0; i < 100; i++) {
+            pmx::Morph::Vertex *vertex = new pmx::Morph::Vertex();
+            vertices.append(vertex);
+            ASSERT_EQ(size_t(0), reinterpret_cast<size_t>(vertex) % 16);
+            ASSERT_EQ(-1, int(vertex->index));
+        }
+    }
+    /* allocated from the heap out of the scope */
+    QScopedPointer<pmx::Morph::Vertex> vertex(new pmx::Morph::Vertex());
+#if defined(VPVL2_HAS_STATIC_TLS_GNU) || defined(VPVL2_HAS_STATIC_TLS_MSVC)
+    ASSERT_EQ(100, arena->countAllocations());
+    ASSERT_GT(arena->countBlocks(), 1);
+    ASSERT_LT(arena->countBlocks(), 100);
+    delete vertices[0];
+    ASSERT_EQ(99, arena->countAllocations());
+#else
+    ASSERT_EQ(0, arena->countAllocations());
+    delete vertices[0];
+#endif
+    /* the arena is deleted by the last object after retiring */
+    arena->retire();
+    for (int i = 1; i < 100; i++) {
+        delete vertices[i];
+    }
+}
+
 TEST(InternalTest, Size32)
 {
     QByteArray bytes;
@@ -134,6 +134,57 @@ TEST(PMDVertexTest, NullRef)
     ASSERT_EQ(vertex.materialRef(), Factory::sharedNullMaterialRef());
 }
 
+TEST(PMDModelTest, VertexStoreSkinning)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *bone1 = static_cast<Bone *>(model.createBone()), *bone2 = static_cast<Bone *>(model.createBone());
+    model.addBone(bone1);
+    model.addBone(bone2);
+    bone1->setLocalTranslation(Vector3(1, 2, 3));
+    bone1->performTransform();
+    bone2->setLocalRotation(Quaternion(Vector3(0, 1, 0), SIMD_HALF_PI));
+    bone2->performTransform();
+    /* weights of 0 and 1 are skinned by one bone and the other is blended */
+    const Scalar weights[] = { 0, 0.25, 1 };
+    for (int i = 0; i < 3; i++) {
+        Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+        model.addVertex(vertex);
+        vertex->setBoneRef(0, bone1);
+        vertex->setBoneRef(1, bone2);
+        vertex->setWeight(0, weights[i]);
+        vertex->setOrigin(Vector3(0.1 * (i + 1), 0.2 * (i + 1), 0.3 * (i + 1)));
+        vertex->setNormal(Vector3(0, 1, 0));
+    }
+    QScopedPointer<IModel::IndexBuffer> indexBuffer;
+    QScopedPointer<IModel::DynamicVertexBuffer> dynamicBuffer;
+    IModel::IndexBuffer *indexBufferPtr = 0;
+    IModel::DynamicVertexBuffer *dynamicBufferPtr = 0;
+    model.getIndexBuffer(indexBufferPtr);
+    indexBuffer.reset(indexBufferPtr);
+    model.getDynamicVertexBuffer(dynamicBufferPtr, indexBufferPtr);
+    dynamicBuffer.reset(dynamicBufferPtr);
+    model.performUpdate();
+    model.vertices()[1]->mergeMorph(Vector3(1, 2, 3), 0.5);
+    QByteArray bytes(dynamicBuffer->size(), 0);
+    Vector3 aabbMin, aabbMax;
+    dynamicBuffer->update(bytes.data(), kZeroV3, aabbMin, aabbMax);
+    const size_t stride = dynamicBuffer->strideSize(),
+            offset = dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kVertexStride);
+    Vector3 expectedMin(SIMD_INFINITY, SIMD_INFINITY, SIMD_INFINITY),
+            expectedMax(-SIMD_INFINITY, -SIMD_INFINITY, -SIMD_INFINITY);
+    for (int i = 0; i < 3; i++) {
+        Vector3 position, normal;
+        model.vertices()[i]->performSkinning(position, normal);
+        const float *actual = reinterpret_cast<const float *>(bytes.constData() + stride * i + offset);
+        ASSERT_TRUE(CompareVector(position, Vector3(actual[0], actual[1], actual[2])));
+        expectedMin.setMin(position);
+        expectedMax.setMax(position);
+    }
+    ASSERT_TRUE(CompareVector(expectedMin, aabbMin));
+    ASSERT_TRUE(CompareVector(expectedMax, aabbMax));
+}
+
 #endif
 
 TEST(PMDModelTest, AddAndRemoveBone)
@@ -4,6 +4,9 @@
 
 #include "vpvl2/vpvl2.h"
 #include "vpvl2/extensions/icu4c/Encoding.h"
+#include "vpvl2/internal/BonePalette.h"
+#include "vpvl2/internal/SkinningMeshes.h"
+#include "vpvl2/internal/ThreadPool.h"
 #include "vpvl2/pmx/Bone.h"
 #include "vpvl2/pmx/Joint.h"
 #include "vpvl2/pmx/Label.h"
@@ -635,6 +638,58 @@ TEST(PMXBoneTest, DefaultFlags)
     ASSERT_FALSE(bone.isTransformedByExternalParent());
 }
 
+TEST(PMXBoneTest, SortBonesByLevel)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    const Array<Bone *> &bones = model.bones();
+    const int nbones = 6;
+    for (int i = 0; i < nbones; i++) {
+        Bone *bone = static_cast<Bone *>(model.createBone());
+        bone->setLocalTranslation(Vector3(0, Scalar(i + 1), 0));
+        switch (i) {
+        case 1:
+        case 3:
+            bone->setParentBoneRef(bones[0]);
+            break;
+        case 2:
+            bone->setParentBoneRef(bones[1]);
+            break;
+        case 4:
+            bone->setParentBoneRef(bones[0]);
+            bone->setParentInherentBoneRef(bones[2], 1);
+            break;
+        case 5:
+            bone->setParentBoneRef(bones[0]);
+            bone->setIKEnable(true);
+            bone->setEffectorBoneRef(bones[2], 1, 1);
+            break;
+        default:
+            break;
+        }
+        model.addBone(bone);
+    }
+    Array<Bone *> bpsBones, apsBones;
+    Array<int> bpsLevelOffsets, apsLevelOffsets;
+    Bone::sortBones(bones, bpsBones, bpsLevelOffsets, apsBones, apsLevelOffsets);
+    /* {0}, {1, 3}, {2}, {4}, {5} (IK bone writes its effector after the inherent bone reads it) */
+    ASSERT_EQ(6, bpsLevelOffsets.count());
+    const int expectedOffsets[] = { 0, 1, 3, 4, 5, 6 };
+    const int expectedIndices[] = { 0, 1, 3, 2, 4, 5 };
+    for (int i = 0; i < bpsLevelOffsets.count(); i++) {
+        ASSERT_EQ(expectedOffsets[i], bpsLevelOffsets[i]);
+    }
+    ASSERT_EQ(nbones, bpsBones.count());
+    for (int i = 0; i < nbones; i++) {
+        ASSERT_EQ(expectedIndices[i], bpsBones[i]->index());
+    }
+    ASSERT_EQ(0, apsBones.count());
+    ASSERT_EQ(1, apsLevelOffsets.count());
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(0, 6, 0), bones[2]->worldTransform().getOrigin()));
+    ASSERT_TRUE(CompareVector(Vector3(0, 5, 0), bones[3]->worldTransform().getOrigin()));
+}
+
 TEST(PMXVertexTest, Boundary)
 {
     Vertex vertex(0);
@@ -1278,6 +1333,526 @@ TEST(PMXModelTest, AddAndRemoveVertex)
     ASSERT_EQ(0, model.vertices().count());
 }
 
+TEST(PMXModelTest, VertexStoreKeepsVertexView)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+    model.addVertex(vertex);
+    model.setVertexStoreEnable(true);
+    ASSERT_TRUE(model.isVertexStoreEnabled());
+    Morph::Vertex morph;
+    morph.position.setValue(1, 2, 3);
+    vertex->mergeMorph(&morph, 0.5);
+    ASSERT_TRUE(CompareVector(Vector3(0.5, 1.0, 1.5), vertex->delta()));
+    /* morph states should be written back to the vertex */
+    model.setVertexStoreEnable(false);
+    ASSERT_FALSE(model.isVertexStoreEnabled());
+    ASSERT_TRUE(CompareVector(Vector3(0.5, 1.0, 1.5), vertex->delta()));
+    model.setVertexStoreEnable(true);
+    vertex->reset();
+    ASSERT_TRUE(CompareVector(kZeroV3, vertex->delta()));
+}
+
+TEST(PMXModelTest, VertexStoreSkinning)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    model.addBone(bone);
+    for (int i = 0; i < 3; i++) {
+        Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+        model.addVertex(vertex);
+        vertex->setType(Vertex::kBdef1);
+        vertex->setBoneRef(0, bone);
+        vertex->setOrigin(Vector3(0.1 * i, 0.2 * i, 0.3 * i));
+        vertex->setNormal(Vector3(0, 1, 0));
+    }
+    Morph::Vertex morph;
+    morph.position.setValue(1, 2, 3);
+    QScopedPointer<IModel::IndexBuffer> indexBuffer;
+    QScopedPointer<IModel::DynamicVertexBuffer> dynamicBuffer;
+    IModel::IndexBuffer *indexBufferPtr = 0;
+    IModel::DynamicVertexBuffer *dynamicBufferPtr = 0;
+    model.getIndexBuffer(indexBufferPtr);
+    indexBuffer.reset(indexBufferPtr);
+    model.getDynamicVertexBuffer(dynamicBufferPtr, indexBufferPtr);
+    dynamicBuffer.reset(dynamicBufferPtr);
+    QByteArray expected(dynamicBuffer->size(), 0), actual(dynamicBuffer->size(), 0);
+    Vector3 expectedMin, expectedMax, actualMin, actualMax;
+    model.performUpdate();
+    model.vertices()[1]->mergeMorph(&morph, 1.0);
+    dynamicBuffer->update(expected.data(), kZeroV3, expectedMin, expectedMax);
+    model.setVertexStoreEnable(true);
+    model.performUpdate();
+    model.vertices()[1]->mergeMorph(&morph, 1.0);
+    dynamicBuffer->update(actual.data(), kZeroV3, actualMin, actualMax);
+    ASSERT_TRUE(expected == actual);
+    ASSERT_TRUE(CompareVector(expectedMin, actualMin));
+    ASSERT_TRUE(CompareVector(expectedMax, actualMax));
+}
+
+TEST(PMXModelTest, CompactDynamicVertexBuffer)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    model.addBone(bone);
+    for (int i = 0; i < 2; i++) {
+        Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+        model.addVertex(vertex);
+        vertex->setType(Vertex::kBdef1);
+        vertex->setBoneRef(0, bone);
+    }
+    Morph::UV morph;
+    morph.position.setValue(0.1, 0.2, 0.3, 0.4);
+    QScopedPointer<IModel::IndexBuffer> indexBuffer;
+    QScopedPointer<IModel::DynamicVertexBuffer> dynamicBuffer;
+    IModel::IndexBuffer *indexBufferPtr = 0;
+    IModel::DynamicVertexBuffer *dynamicBufferPtr = 0;
+    model.getIndexBuffer(indexBufferPtr);
+    indexBuffer.reset(indexBufferPtr);
+    model.getDynamicVertexBuffer(dynamicBufferPtr, indexBufferPtr);
+    dynamicBuffer.reset(dynamicBufferPtr);
+    /* the model declares no additional UVs, so only UVA0 follows position/normal/delta/edge */
+    const size_t stride = dynamicBuffer->strideSize(),
+            uva0Offset = dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kUVA0Stride);
+    ASSERT_EQ(5 * sizeof(Vector4), stride);
+    ASSERT_EQ(4 * sizeof(Vector4), uva0Offset);
+    ASSERT_EQ(size_t(0), dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kUVA1Stride));
+    ASSERT_EQ(size_t(0), dynamicBuffer->strideOffset(IModel::DynamicVertexBuffer::kUVA4Stride));
+    ASSERT_EQ(stride * 2, dynamicBuffer->size());
+    QByteArray bytes(dynamicBuffer->size(), 0);
+    Vector3 aabbMin, aabbMax;
+    model.performUpdate();
+    model.vertices()[1]->mergeMorph(&morph, 1.0);
+    dynamicBuffer->update(bytes.data(), kZeroV3, aabbMin, aabbMax);
+    const float *uva = reinterpret_cast<const float *>(bytes.constData() + stride + uva0Offset);
+    ASSERT_FLOAT_EQ(0.1f, uva[0]);
+    ASSERT_FLOAT_EQ(0.2f, uva[1]);
+    ASSERT_FLOAT_EQ(0.3f, uva[2]);
+    ASSERT_FLOAT_EQ(0.4f, uva[3]);
+}
+
+TEST(PMXModelTest, IndexBufferTypeFollowsVertexCount)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Array<int> indices;
+    indices.append(0);
+    indices.append(1);
+    indices.append(2);
+    model.setIndices(indices);
+    const int counts[] = { 3, 256, 65536 };
+    const IModel::IndexBuffer::Type types[] = { IModel::IndexBuffer::kIndex8, IModel::IndexBuffer::kIndex16, IModel::IndexBuffer::kIndex32 };
+    for (int i = 0; i < 3; i++) {
+        while (model.vertices().count() < counts[i]) {
+            model.addVertex(model.createVertex());
+        }
+        /* the last vertex must be addressable even if the model has only a few indices */
+        indices[2] = counts[i] - 1;
+        model.setIndices(indices);
+        QScopedPointer<IModel::IndexBuffer> indexBuffer;
+        IModel::IndexBuffer *indexBufferPtr = 0;
+        model.getIndexBuffer(indexBufferPtr);
+        indexBuffer.reset(indexBufferPtr);
+        ASSERT_EQ(types[i], indexBuffer->type());
+        ASSERT_EQ(counts[i] - 1, indexBuffer->indexAt(2));
+    }
+}
+
+TEST(PMXModelTest, PackedStaticVertexBuffer)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *bone1 = static_cast<Bone *>(model.createBone());
+    model.addBone(bone1);
+    Bone *bone2 = static_cast<Bone *>(model.createBone());
+    model.addBone(bone2);
+    Array<int> indices;
+    for (int i = 0; i < 3; i++) {
+        Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+        model.addVertex(vertex);
+        vertex->setType(Vertex::kBdef2);
+        vertex->setBoneRef(0, bone1);
+        vertex->setBoneRef(1, bone2);
+        vertex->setWeight(0, 0.25);
+        vertex->setTextureCoord(Vector3(0.5, 0.75, 0));
+        indices.append(i);
+    }
+    model.setIndices(indices);
+    Material *material = static_cast<Material *>(model.createMaterial());
+    IMaterial::IndexRange range;
+    range.count = indices.count();
+    material->setIndexRange(range);
+    model.addMaterial(material);
+    QScopedPointer<IModel::StaticVertexBuffer> staticBuffer;
+    IModel::StaticVertexBuffer *staticBufferPtr = 0;
+    model.getStaticVertexBuffer(staticBufferPtr);
+    staticBuffer.reset(staticBufferPtr);
+    /* float2 texcoord + uint8x4 bone indices + unorm16x4 bone weights without SDEF */
+    const size_t stride = staticBuffer->strideSize(),
+            boneIndexOffset = staticBuffer->strideOffset(IModel::StaticVertexBuffer::kBoneIndexStride),
+            boneWeightOffset = staticBuffer->strideOffset(IModel::StaticVertexBuffer::kBoneWeightStride);
+    ASSERT_EQ(size_t(20), stride);
+    ASSERT_EQ(stride * 3, staticBuffer->size());
+    ASSERT_EQ(size_t(0), staticBuffer->strideOffset(IModel::StaticVertexBuffer::kTextureCoordStride));
+    ASSERT_EQ(size_t(8), boneIndexOffset);
+    ASSERT_EQ(size_t(12), boneWeightOffset);
+    ASSERT_EQ(size_t(0), staticBuffer->strideOffset(IModel::StaticVertexBuffer::kSdefCStride));
+    ASSERT_EQ(IModel::StaticVertexBuffer::kFloatComponent, staticBuffer->componentType(IModel::StaticVertexBuffer::kTextureCoordStride));
+    ASSERT_EQ(IModel::StaticVertexBuffer::kUnsignedByteComponent, staticBuffer->componentType(IModel::StaticVertexBuffer::kBoneIndexStride));
+    ASSERT_EQ(IModel::StaticVertexBuffer::kNormalizedUnsignedShortComponent, staticBuffer->componentType(IModel::StaticVertexBuffer::kBoneWeightStride));
+    QByteArray bytes(staticBuffer->size(), 0);
+    staticBuffer->update(bytes.data());
+    const float *texcoord = reinterpret_cast<const float *>(bytes.constData());
+    ASSERT_FLOAT_EQ(0.5f, texcoord[0]);
+    ASSERT_FLOAT_EQ(0.75f, texcoord[1]);
+    const uint8_t *boneIndices = reinterpret_cast<const uint8_t *>(bytes.constData() + boneIndexOffset);
+    /* bone indices are remapped to the slots of the mesh */
+    ASSERT_LT(boneIndices[0], 2);
+    ASSERT_LT(boneIndices[1], 2);
+    ASSERT_NE(boneIndices[0], boneIndices[1]);
+    const uint16_t *boneWeights = reinterpret_cast<const uint16_t *>(bytes.constData() + boneWeightOffset);
+    ASSERT_NEAR(0.25f, boneWeights[0] / 65535.0f, 1.0f / 65535.0f);
+    /* SDEF parameters are appended only when the model has SDEF vertices */
+    model.vertices()[0]->setType(Vertex::kSdef);
+    staticBufferPtr = staticBuffer.take();
+    model.getStaticVertexBuffer(staticBufferPtr);
+    staticBuffer.reset(staticBufferPtr);
+    ASSERT_EQ(size_t(20 + 36), staticBuffer->strideSize());
+    ASSERT_EQ(size_t(20), staticBuffer->strideOffset(IModel::StaticVertexBuffer::kSdefCStride));
+    ASSERT_EQ(size_t(32), staticBuffer->strideOffset(IModel::StaticVertexBuffer::kSdefR0Stride));
+    ASSERT_EQ(size_t(44), staticBuffer->strideOffset(IModel::StaticVertexBuffer::kSdefR1Stride));
+}
+
+TEST(PMXModelTest, SkipUpdateUnlessDirty)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    model.addBone(bone);
+    Morph *morph = static_cast<Morph *>(model.createMorph());
+    model.addMorph(morph);
+    Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+    model.addVertex(vertex);
+    vertex->setType(Vertex::kBdef1);
+    vertex->setBoneRef(0, bone);
+    QScopedPointer<IModel::IndexBuffer> indexBuffer;
+    QScopedPointer<IModel::DynamicVertexBuffer> dynamicBuffer;
+    IModel::IndexBuffer *indexBufferPtr = 0;
+    IModel::DynamicVertexBuffer *dynamicBufferPtr = 0;
+    model.getIndexBuffer(indexBufferPtr);
+    indexBuffer.reset(indexBufferPtr);
+    model.getDynamicVertexBuffer(dynamicBufferPtr, indexBufferPtr);
+    dynamicBuffer.reset(dynamicBufferPtr);
+    QByteArray bytes(dynamicBuffer->size(), 0);
+    Vector3 aabbMin, aabbMax;
+    ASSERT_TRUE(model.isDirty());
+    ASSERT_TRUE(dynamicBuffer->isDirty(kZeroV3));
+    model.performUpdate();
+    ASSERT_FALSE(model.isDirty());
+    dynamicBuffer->update(bytes.data(), kZeroV3, aabbMin, aabbMax);
+    ASSERT_FALSE(dynamicBuffer->isDirty(kZeroV3));
+    /* the edge size depends on the camera position */
+    ASSERT_TRUE(dynamicBuffer->isDirty(Vector3(0, 0, 1)));
+    /* setting the same value doesn't change anything */
+    bone->setLocalTranslation(kZeroV3);
+    bone->setLocalRotation(Quaternion::getIdentity());
+    ASSERT_FALSE(model.isDirty());
+    bone->setLocalTranslation(Vector3(1, 2, 3));
+    ASSERT_TRUE(model.isDirty());
+    ASSERT_FALSE(dynamicBuffer->isDirty(kZeroV3));
+    model.performUpdate();
+    ASSERT_FALSE(model.isDirty());
+    ASSERT_TRUE(dynamicBuffer->isDirty(kZeroV3));
+    dynamicBuffer->update(bytes.data(), kZeroV3, aabbMin, aabbMax);
+    ASSERT_FALSE(dynamicBuffer->isDirty(kZeroV3));
+    morph->setWeight(1);
+    ASSERT_TRUE(model.isDirty());
+    model.performUpdate();
+    ASSERT_FALSE(model.isDirty());
+    /* motions set the same weight every frame */
+    morph->setWeight(1);
+    ASSERT_FALSE(model.isDirty());
+    model.setDirty(true);
+    ASSERT_TRUE(model.isDirty());
+    /* rigid bodies are moved by the world */
+    model.setDirty(false);
+    model.setPhysicsEnable(true);
+    model.addRigidBody(model.createRigidBody());
+    model.performUpdate();
+    ASSERT_TRUE(model.isDirty());
+}
+
+TEST(PMXModelTest, RelinkBonesInParallel)
+{
+    vpvl2::internal::ThreadPool *pool = vpvl2::internal::ThreadPool::sharedInstance();
+    const int nworkers = pool->countWorkers();
+    const bool enableAffinity = pool->isAffinityEnabled();
+    pool->setup(8, false);
+    Encoding encoding(0);
+    Model model(&encoding);
+    static const int kNumBones = 256;
+    Array<Bone *> bones;
+    for (int i = 0; i < kNumBones; i++) {
+        Bone *bone = static_cast<Bone *>(model.createBone());
+        bone->setLocalTranslation(Vector3(1, 0, 0));
+        model.addBone(bone);
+        bones.append(bone);
+    }
+    model.performUpdate();
+    /* bones linked after adding them are sorted again not to be transformed with their parents at once */
+    for (int i = 1; i < kNumBones; i++) {
+        bones[i]->setParentBoneRef(bones[i - 1]);
+    }
+    ASSERT_TRUE(bones[1]->isOrderDirty());
+    model.performUpdate();
+    ASSERT_FALSE(bones[1]->isOrderDirty());
+    const Vector3 position = bones[kNumBones - 1]->worldTransform().getOrigin();
+    pool->setup(nworkers, enableAffinity);
+    ASSERT_TRUE(CompareVector(Vector3(kNumBones, 0, 0), position));
+}
+
+TEST(PMXModelTest, UpdateChildPrecedingParent)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *child = static_cast<Bone *>(model.createBone());
+    Bone *root = static_cast<Bone *>(model.createBone());
+    model.addBone(child);
+    model.addBone(root);
+    child->setParentBoneRef(root);
+    model.performUpdate();
+    model.performUpdate();
+    ASSERT_FALSE(model.isDirty());
+    /* the child gets the transform of its parent at the last update, so the model stays dirty once */
+    root->setLocalTranslation(Vector3(1, 0, 0));
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(1, 0, 0), root->worldTransform().getOrigin()));
+    ASSERT_TRUE(CompareVector(kZeroV3, child->worldTransform().getOrigin()));
+    ASSERT_TRUE(model.isDirty());
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(1, 0, 0), child->worldTransform().getOrigin()));
+    ASSERT_FALSE(model.isDirty());
+    /* the parent precedes the child by the layer */
+    child->setLayerIndex(1);
+    root->setLocalTranslation(Vector3(2, 0, 0));
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(2, 0, 0), child->worldTransform().getOrigin()));
+    ASSERT_FALSE(model.isDirty());
+}
+
+TEST(PMXModelTest, KeepVertexMorphsWhileWeighted)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    model.addBone(bone);
+    for (int i = 0; i < 2; i++) {
+        Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+        model.addVertex(vertex);
+        vertex->setType(Vertex::kBdef1);
+        vertex->setBoneRef(0, bone);
+    }
+    const Array<Vertex *> &vertices = model.vertices();
+    Morph *morph = static_cast<Morph *>(model.createMorph());
+    morph->setType(Morph::kVertexMorph);
+    Morph::Vertex *vertexMorph = new Morph::Vertex();
+    vertexMorph->vertex = vertices[0];
+    vertexMorph->index = 0;
+    vertexMorph->position.setValue(1, 2, 3);
+    morph->addVertexMorph(vertexMorph);
+    model.addMorph(morph);
+    morph->setWeight(0.5);
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(0.5, 1.0, 1.5), vertices[0]->delta()));
+    ASSERT_TRUE(CompareVector(kZeroV3, vertices[1]->delta()));
+    /* the morph is merged again even if only the bone is changed */
+    bone->setLocalTranslation(Vector3(1, 0, 0));
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(0.5, 1.0, 1.5), vertices[0]->delta()));
+    morph->setWeight(1.0);
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(1, 2, 3), vertices[0]->delta()));
+    morph->setWeight(0);
+    model.performUpdate();
+    ASSERT_TRUE(CompareVector(kZeroV3, vertices[0]->delta()));
+}
+
+TEST(PMXModelTest, PerformSkinningWithBonePalette)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    for (int i = 0; i < 4; i++) {
+        Bone *bone = static_cast<Bone *>(model.createBone());
+        model.addBone(bone);
+        Transform transform(Quaternion(Vector3(i, 1, 0).normalized(), 0.25 * i), Vector3(i, 2 * i, 3 * i));
+        bone->setLocalTransform(transform);
+    }
+    const Array<Bone *> &bones = model.bones();
+    vpvl2::internal::BonePalette palette;
+    palette.update(bones);
+    ASSERT_EQ(bones.count(), palette.count());
+    Vertex vertex(&model);
+    vertex.setOrigin(Vector3(0.1, 0.2, 0.3));
+    vertex.setNormal(Vector3(0, 1, 0));
+    for (int i = 0; i < Vertex::kMaxBones; i++) {
+        vertex.setBoneRef(i, bones[Vertex::kMaxBones - i - 1]);
+        vertex.setWeight(i, 0.1 * (i + 1));
+    }
+    vertex.setSdefC(Vector3(0.2, 0.3, 0.4));
+    vertex.setSdefR0(Vector3(0.5, 0.4, 0.3));
+    vertex.setSdefR1(Vector3(0.1, 0.2, 0.1));
+    Vector3 expectedPosition, expectedNormal, actualPosition, actualNormal;
+    const Vertex::Type types[] = { Vertex::kBdef1, Vertex::kBdef2, Vertex::kBdef4, Vertex::kSdef };
+    for (int i = 0; i < int(sizeof(types) / sizeof(types[0])); i++) {
+        vertex.setType(types[i]);
+        vertex.performSkinning(expectedPosition, expectedNormal);
+        vertex.performSkinning(palette, actualPosition, actualNormal);
+        ASSERT_TRUE(CompareVector(expectedPosition, actualPosition));
+        ASSERT_TRUE(CompareVector(expectedNormal, actualNormal));
+    }
+    /* invalid bone index should be treated as identity */
+    vertex.setBoneRef(0, 0);
+    vertex.setType(Vertex::kBdef1);
+    vertex.performSkinning(palette, actualPosition, actualNormal);
+    ASSERT_TRUE(CompareVector(Vector3(0.1, 0.2, 0.3), actualPosition));
+    ASSERT_TRUE(CompareVector(Vector3(0, 1, 0), actualNormal));
+}
+
+TEST(PMXModelTest, PerformSdefSkinning)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    const Transform transform(Quaternion(Vector3(1, 1, 0).normalized(), 0.5), Vector3(1, 2, 3));
+    for (int i = 0; i < 2; i++) {
+        Bone *bone = static_cast<Bone *>(model.createBone());
+        model.addBone(bone);
+        bone->setLocalTransform(transform);
+    }
+    const Array<Bone *> &bones = model.bones();
+    vpvl2::internal::BonePalette palette;
+    palette.update(bones);
+    Vertex vertex(&model);
+    vertex.setType(Vertex::kSdef);
+    vertex.setOrigin(Vector3(0.1, 0.2, 0.3));
+    vertex.setNormal(Vector3(0, 1, 0));
+    vertex.setBoneRef(0, bones[0]);
+    vertex.setBoneRef(1, bones[1]);
+    vertex.setWeight(0, 0.3);
+    vertex.setSdefC(Vector3(0.2, 0.3, 0.4));
+    vertex.setSdefR0(Vector3(0.5, 0.4, 0.3));
+    vertex.setSdefR1(Vector3(0.1, 0.2, 0.1));
+    /* SDEF should be same as rigid transform if both bones are same */
+    const Vector3 &expectedPosition = transform * vertex.origin();
+    const Vector3 &expectedNormal = transform.getBasis() * vertex.normal();
+    Vector3 position, normal;
+    vertex.performSkinning(position, normal);
+    ASSERT_TRUE(CompareVector(expectedPosition, position));
+    ASSERT_TRUE(CompareVector(expectedNormal, normal));
+    vertex.performSkinning(palette, position, normal);
+    ASSERT_TRUE(CompareVector(expectedPosition, position));
+    ASSERT_TRUE(CompareVector(expectedNormal, normal));
+    /* rotation of SDEF is interpolated spherically so the normal keeps its length */
+    bones[1]->setLocalTransform(Transform(Quaternion(Vector3(0, 0, 1), 1.5), kZeroV3));
+    palette.update(bones);
+    vertex.performSkinning(palette, position, normal);
+    ASSERT_NEAR(1.0f, normal.length(), 0.0001f);
+}
+
+TEST(PMXModelTest, MatrixBufferSplitsMeshesWithinMaxBones)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    const int nbones = vpvl2::internal::SkinningMeshes::kMaxBones * 2;
+    for (int i = 0; i < nbones; i++) {
+        Bone *bone = static_cast<Bone *>(model.createBone());
+        model.addBone(bone);
+        bone->setLocalTranslation(Vector3(Scalar(i + 1), 0, 0));
+    }
+    const Array<Bone *> &bones = model.bones();
+    for (int i = 0; i < nbones; i++) {
+        Vertex *vertex = static_cast<Vertex *>(model.createVertex());
+        model.addVertex(vertex);
+        vertex->setType(Vertex::kBdef2);
+        vertex->setBoneRef(0, bones[i]);
+        vertex->setBoneRef(1, bones[(i + 1) % nbones]);
+        vertex->setWeight(0, 0.5);
+    }
+    Array<int> indices;
+    for (int i = 0; i < nbones - 2; i++) {
+        indices.append(i);
+        indices.append(i + 1);
+        indices.append(i + 2);
+    }
+    model.setIndices(indices);
+    Material *material = static_cast<Material *>(model.createMaterial());
+    IMaterial::IndexRange range;
+    range.count = indices.count();
+    material->setIndexRange(range);
+    model.addMaterial(material);
+    QScopedPointer<IModel::IndexBuffer> indexBuffer;
+    QScopedPointer<IModel::StaticVertexBuffer> staticBuffer;
+    QScopedPointer<IModel::DynamicVertexBuffer> dynamicBuffer;
+    QScopedPointer<IModel::MatrixBuffer> matrixBuffer;
+    IModel::IndexBuffer *indexBufferPtr = 0;
+    IModel::StaticVertexBuffer *staticBufferPtr = 0;
+    IModel::DynamicVertexBuffer *dynamicBufferPtr = 0;
+    IModel::MatrixBuffer *matrixBufferPtr = 0;
+    model.getIndexBuffer(indexBufferPtr);
+    indexBuffer.reset(indexBufferPtr);
+    model.getStaticVertexBuffer(staticBufferPtr);
+    staticBuffer.reset(staticBufferPtr);
+    model.getDynamicVertexBuffer(dynamicBufferPtr, indexBufferPtr);
+    dynamicBuffer.reset(dynamicBufferPtr);
+    model.getMatrixBuffer(matrixBufferPtr, dynamicBufferPtr, indexBufferPtr);
+    matrixBuffer.reset(matrixBufferPtr);
+    ASSERT_TRUE(matrixBufferPtr);
+    const int nmeshes = matrixBuffer->countMeshes(0);
+    ASSERT_GT(nmeshes, 1);
+    ASSERT_EQ(0, matrixBuffer->countMeshes(1));
+    model.performUpdate();
+    QByteArray staticBytes(staticBuffer->size(), 0), dynamicBytes(dynamicBuffer->size(), 0);
+    staticBuffer->update(staticBytes.data());
+    matrixBuffer->update(dynamicBytes.data());
+    const size_t stride = staticBuffer->strideSize(),
+            boneIndexOffset = staticBuffer->strideOffset(IModel::StaticVertexBuffer::kBoneIndexStride);
+    /* remapped slots always fit in uint8 */
+    ASSERT_EQ(IModel::StaticVertexBuffer::kUnsignedByteComponent, staticBuffer->componentType(IModel::StaticVertexBuffer::kBoneIndexStride));
+    int offset = 0;
+    for (int i = 0; i < nmeshes; i++) {
+        const int nindices = matrixBuffer->countIndices(0, i);
+        const size_t nslots = matrixBuffer->size(0, i);
+        const float *matrices = matrixBuffer->bytes(0, i);
+        ASSERT_LE(nslots, size_t(vpvl2::internal::SkinningMeshes::kMaxBones));
+        ASSERT_TRUE(matrices);
+        for (int j = offset; j < offset + nindices; j++) {
+            const int vertexIndex = indexBuffer->indexAt(j);
+            const IVertex *vertex = model.vertices()[vertexIndex];
+            const uint8_t *boneIndices = reinterpret_cast<const uint8_t *>(staticBytes.constData() + stride * vertexIndex + boneIndexOffset);
+            for (int k = 0; k < 2; k++) {
+                /* remapped slot refers the matrix of the original bone in this mesh */
+                const size_t slot = size_t(boneIndices[k]);
+                ASSERT_LT(slot, nslots);
+                ASSERT_FLOAT_EQ(vertex->boneRef(k)->localTransform().getOrigin().x(), matrices[slot * 16 + 12]);
+            }
+        }
+        offset += nindices;
+    }
+    ASSERT_EQ(indices.count(), offset);
+}
+
+TEST(PMXModelTest, CountSkinningBoneRefs)
+{
+    ASSERT_EQ(1, vpvl2::internal::SkinningMeshes::countBoneRefs(IVertex::kBdef1));
+    ASSERT_EQ(2, vpvl2::internal::SkinningMeshes::countBoneRefs(IVertex::kBdef2));
+    ASSERT_EQ(4, vpvl2::internal::SkinningMeshes::countBoneRefs(IVertex::kBdef4));
+    ASSERT_EQ(2, vpvl2::internal::SkinningMeshes::countBoneRefs(IVertex::kSdef));
+    /* QDEF is skinned as BDEF4 */
+    ASSERT_EQ(4, vpvl2::internal::SkinningMeshes::countBoneRefs(IVertex::kQdef));
+}
+
 TEST(PMXModelTest, ParseEmpty)
 {
     Encoding encoding(0);
@@ -1287,6 +1862,227 @@ TEST(PMXModelTest, ParseEmpty)
     ASSERT_EQ(Model::kInvalidHeaderError, model.error());
 }
 
+TEST(PMXModelTest, SaveAndLoadCompiled)
+{
+    Encoding encoding(0);
+    String name("Model"), rootName("Root"), childName("Child");
+    Model model(&encoding);
+    model.setName(&name);
+    Bone *child = static_cast<Bone *>(model.createBone());
+    Bone *root = static_cast<Bone *>(model.createBone());
+    root->setName(&rootName);
+    child->setName(&childName);
+    child->setOrigin(Vector3(0, 1, 0));
+    /* the child bone precedes its parent so bones must be ordered to be transformed */
+    model.addBone(child);
+    model.addBone(root);
+    child->setParentBoneRef(root);
+    for (int i = 0; i < 3; i++) {
+        IVertex *vertex = model.createVertex();
+        vertex->setBoneRef(0, child);
+        model.addVertex(vertex);
+    }
+    Array<int> indices;
+    indices.append(0);
+    indices.append(1);
+    indices.append(2);
+    model.setIndices(indices);
+    IMaterial *material = model.createMaterial();
+    IMaterial::IndexRange range;
+    range.count = 3;
+    material->setIndexRange(range);
+    material->setMainTextureIndex(-1);
+    material->setSphereTextureIndex(-1);
+    material->setToonTextureIndex(-1);
+    model.addMaterial(material);
+    model.performUpdate();
+    QByteArray bytes;
+    bytes.resize(model.estimateCompiledSize());
+    size_t written;
+    ASSERT_TRUE(model.saveCompiled(reinterpret_cast<uint8_t *>(bytes.data()), written));
+    ASSERT_EQ(size_t(bytes.size()), written);
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(bytes.constData());
+    ASSERT_TRUE(Model::isCompiled(data, written));
+    ASSERT_FALSE(Model::isCompiled(data, 4));
+    ASSERT_EQ(IModel::kPMXModel, Factory::findModelType(data, written));
+    Model model2(&encoding);
+    ASSERT_TRUE(model2.load(data, written));
+    ASSERT_TRUE(model2.name()->equals(&name));
+    ASSERT_EQ(3, model2.vertices().count());
+    ASSERT_EQ(1, model2.materials().count());
+    IBone *root2 = model2.findBoneRef(&rootName), *child2 = model2.findBoneRef(&childName);
+    ASSERT_TRUE(root2);
+    ASSERT_TRUE(child2);
+    ASSERT_EQ(root2, child2->parentBoneRef());
+    root2->setLocalTranslation(Vector3(1, 0, 0));
+    model2.performUpdate();
+    /* the child gets the transform of its parent at the last update and follows it at the next */
+    ASSERT_TRUE(CompareVector(Vector3(0, 1, 0), child2->worldTransform().getOrigin()));
+    ASSERT_TRUE(model2.isDirty());
+    model2.performUpdate();
+    ASSERT_TRUE(CompareVector(Vector3(1, 1, 0), child2->worldTransform().getOrigin()));
+    ASSERT_FALSE(model2.isDirty());
+    /* the compiled model is rejected if the version is not matched */
+    QByteArray bytes2(bytes);
+    bytes2[8] = 0x7f;
+    Model model3(&encoding);
+    ASSERT_FALSE(model3.load(reinterpret_cast<const uint8_t *>(bytes2.constData()), written));
+    ASSERT_EQ(IModel::kInvalidVersionError, model3.error());
+    ASSERT_FALSE(model3.load(data, written / 2));
+}
+
+TEST(PMXModelTest, LoadTruncatedCompiled)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    model.addBone(bone);
+    for (int i = 0; i < 3; i++) {
+        IVertex *vertex = model.createVertex();
+        vertex->setBoneRef(0, bone);
+        model.addVertex(vertex);
+    }
+    IMaterial *material = model.createMaterial();
+    material->setMainTextureIndex(-1);
+    material->setSphereTextureIndex(-1);
+    material->setToonTextureIndex(-1);
+    model.addMaterial(material);
+    QByteArray bytes;
+    bytes.resize(model.estimateCompiledSize());
+    size_t written;
+    ASSERT_TRUE(model.saveCompiled(reinterpret_cast<uint8_t *>(bytes.data()), written));
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(bytes.constData());
+    for (size_t size = 0; size < written; size++) {
+        Model model2(&encoding);
+        ASSERT_FALSE(model2.load(data, size)) << size;
+    }
+    /*
+     * the header claims more vertices than the data has. the count of vertices is at 72 bytes
+     * (signature, version, flags, sizes, model version, PMX flags and spans of names and comments)
+     */
+    QByteArray bytes2(bytes);
+    const uint32_t nvertices = 4;
+    memcpy(bytes2.data() + 72, &nvertices, sizeof(nvertices));
+    Model model3(&encoding);
+    ASSERT_FALSE(model3.load(reinterpret_cast<const uint8_t *>(bytes2.constData()), written));
+    ASSERT_EQ(IModel::kInvalidHeaderError, model3.error());
+    Model model4(&encoding);
+    ASSERT_TRUE(model4.load(data, written));
+    ASSERT_EQ(3, model4.vertices().count());
+}
+
+TEST(PMXModelTest, FindUnnamedObjects)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    String name("Bone");
+    model.addBone(model.createBone());
+    model.addMorph(model.createMorph());
+    /* name indices are built lazily and objects without names are not indexed */
+    ASSERT_FALSE(model.findBoneRef(&name));
+    ASSERT_FALSE(model.findMorphRef(&name));
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    bone->setName(&name);
+    model.addBone(bone);
+    ASSERT_EQ(bone, model.findBoneRef(&name));
+    model.removeBone(bone);
+    ASSERT_FALSE(model.findBoneRef(&name));
+    delete bone;
+}
+
+TEST(PMXModelTest, LoadMappedFile)
+{
+    Encoding encoding(0);
+    String name("Japanese"), englishName("English"), comment("Comment");
+    Model model(&encoding);
+    model.setName(&name);
+    model.setComment(&comment);
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    bone->setName(&name);
+    bone->setEnglishName(&englishName);
+    model.addBone(bone);
+    QByteArray bytes;
+    bytes.resize(model.estimateSize());
+    size_t written;
+    model.save(reinterpret_cast<uint8_t *>(bytes.data()), written);
+    QTemporaryFile file;
+    ASSERT_TRUE(file.open());
+    file.write(bytes.constData(), written);
+    file.close();
+    Factory factory(&encoding);
+    String path(UnicodeString::fromUTF8(file.fileName().toUtf8().constData()));
+    bool ok = false;
+    QScopedPointer<IModel> loaded(factory.createModel(&path, ok));
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(IModel::kPMXModel, loaded->type());
+    /* names are decoded from the mapped file at the first access */
+    ASSERT_TRUE(loaded->name()->equals(&name));
+    ASSERT_TRUE(loaded->comment()->equals(&comment));
+    IBone *loadedBone = loaded->findBoneRef(&englishName);
+    ASSERT_TRUE(loadedBone);
+    ASSERT_EQ(loadedBone, loaded->findBoneRef(&name));
+    ASSERT_TRUE(loadedBone->name()->equals(&name));
+    String missing("/path/to/missing.pmx");
+    ASSERT_EQ(static_cast<IModel *>(0), factory.createModel(&missing, ok));
+    ASSERT_FALSE(ok);
+}
+
+TEST(PMXModelTest, LoadSectionsInParallel)
+{
+    Encoding encoding(0);
+    String name("Bone");
+    Model model(&encoding);
+    Bone *bone = static_cast<Bone *>(model.createBone());
+    bone->setName(&name);
+    model.addBone(bone);
+    /* more than two chunks of vertices having different sizes */
+    const int nvertices = 4096 * 2 + 1;
+    const IVertex::Type types[] = { IVertex::kBdef1, IVertex::kBdef2, IVertex::kSdef };
+    Array<int> indices;
+    for (int i = 0; i < nvertices; i++) {
+        IVertex *vertex = model.createVertex();
+        vertex->setType(types[i % 3]);
+        vertex->setOrigin(Vector3(i, 0, 0));
+        vertex->setBoneRef(0, bone);
+        model.addVertex(vertex);
+        indices.append(nvertices - i - 1);
+    }
+    model.setIndices(indices);
+    IMaterial *material = model.createMaterial();
+    IMaterial::IndexRange range;
+    range.count = nvertices;
+    material->setIndexRange(range);
+    /* the model has no textures */
+    material->setMainTextureIndex(-1);
+    material->setSphereTextureIndex(-1);
+    material->setToonTextureIndex(-1);
+    model.addMaterial(material);
+    QByteArray bytes;
+    bytes.resize(model.estimateSize());
+    size_t written;
+    model.save(reinterpret_cast<uint8_t *>(bytes.data()), written);
+    Model model2(&encoding);
+    ASSERT_TRUE(model2.load(reinterpret_cast<const uint8_t *>(bytes.constData()), written));
+    /* names must be decoded while loading unless the data is mapped by the model */
+    bytes.fill(0);
+    ASSERT_TRUE(model2.findBoneRef(&name));
+    const Array<Vertex *> &vertices = model2.vertices();
+    ASSERT_EQ(nvertices, vertices.count());
+    const IMaterial *material2 = model2.materials()[0];
+    for (int i = 0; i < nvertices; i++) {
+        const Vertex *vertex = vertices[i];
+        ASSERT_EQ(types[i % 3], vertex->type());
+        ASSERT_EQ(Scalar(i), vertex->origin().x());
+        ASSERT_EQ(material2, vertex->materialRef());
+    }
+    Array<int> indices2;
+    model2.getIndices(indices2);
+    ASSERT_EQ(nvertices, indices2.count());
+    for (int i = 0; i < nvertices; i++) {
+        ASSERT_EQ(nvertices - i - 1, indices2[i]);
+    }
+}
+
 TEST(PMXModelTest, ParseRealPMX)
 {
     QFile file("miku.pmx");
@@ -248,6 +248,26 @@ TEST(SceneTest, Update)
     }
 }
 
+TEST(SceneTest, UpdateMultipleModels)
+{
+    /* each model is updated exactly once even if models are updated in parallel */
+    static const int kNumModels = 8;
+    String s(UnicodeString::fromUTF8("This is a test model."));
+    Scene scene(true);
+    for (int i = 0; i < kNumModels; i++) {
+        QScopedPointer<MockIRenderEngine> engine(new MockIRenderEngine());
+        QScopedPointer<MockIModel> model(new MockIModel());
+        EXPECT_CALL(*engine, update()).Times(1);
+        /* ignore setting setParentSceneRef */
+        EXPECT_CALL(*model, type()).WillRepeatedly(Return(IModel::kMaxModelType));
+        EXPECT_CALL(*model, performUpdate()).Times(1);
+        EXPECT_CALL(*model, joinWorld(0)).Times(1);
+        EXPECT_CALL(*model, name()).WillRepeatedly(Return(&s));
+        scene.addModel(model.take(), engine.take(), 0);
+    }
+    scene.update(Scene::kUpdateAll);
+}
+
 TEST(SceneTest, AdvanceMotions)
 {
     Scene scene(true);
@@ -2,6 +2,7 @@
 
 #include "vpvl2/vpvl2.h"
 #include "vpvl2/extensions/icu4c/Encoding.h"
+#include "vpvl2/internal/Keyframe.h"
 #include "vpvl2/pmx/Model.h"
 #include "vpvl2/vmd/BoneAnimation.h"
 #include "vpvl2/vmd/BoneKeyframe.h"
@@ -446,6 +447,31 @@ TEST(VMDMotionTest, CameraInterpolation)
     CompareCameraInterpolationMatrix(p, frame);
 }
 
+TEST(VMDMotionTest, ShareInterpolationTable)
+{
+    Encoding encoding(0);
+    const int ntables = vpvl2::internal::InterpolationTableCache::countTables();
+    const QuadWord p(33, 34, 35, 36), p2(37, 38, 39, 40);
+    {
+        vmd::BoneKeyframe frame(&encoding), frame2(&encoding);
+        frame.setInterpolationParameter(vmd::BoneKeyframe::kBonePositionX, p);
+        frame2.setInterpolationParameter(vmd::BoneKeyframe::kBonePositionY, p);
+        ASSERT_EQ(ntables + 1, vpvl2::internal::InterpolationTableCache::countTables());
+        ASSERT_EQ(frame.interpolationTable()[vmd::BoneKeyframe::kBonePositionX],
+                  frame2.interpolationTable()[vmd::BoneKeyframe::kBonePositionY]);
+        frame2.setInterpolationParameter(vmd::BoneKeyframe::kBonePositionY, p2);
+        ASSERT_EQ(ntables + 2, vpvl2::internal::InterpolationTableCache::countTables());
+        ASSERT_NE(frame.interpolationTable()[vmd::BoneKeyframe::kBonePositionX],
+                  frame2.interpolationTable()[vmd::BoneKeyframe::kBonePositionY]);
+        QScopedPointer<IBoneKeyframe> cloned(frame.clone());
+        ASSERT_EQ(ntables + 2, vpvl2::internal::InterpolationTableCache::countTables());
+        vmd::CameraKeyframe frame3;
+        frame3.setInterpolationParameter(vmd::CameraKeyframe::kCameraLookAtX, p);
+        ASSERT_EQ(ntables + 3, vpvl2::internal::InterpolationTableCache::countTables());
+    }
+    ASSERT_EQ(ntables, vpvl2::internal::InterpolationTableCache::countTables());
+}
+
 TEST(VMDMotionTest, AddAndRemoveBoneKeyframes)
 {
     Encoding encoding(0);
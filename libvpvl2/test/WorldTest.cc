@@ -0,0 +1,213 @@
+#include "Common.h"
+
+#include <btBulletDynamicsCommon.h>
+
+#include "vpvl2/vpvl2.h"
+#include "vpvl2/extensions/World.h"
+#include "vpvl2/extensions/icu4c/Encoding.h"
+#include "vpvl2/pmx/Bone.h"
+#include "vpvl2/pmx/Model.h"
+#include "vpvl2/pmx/RigidBody.h"
+
+using namespace ::testing;
+using namespace std::tr1;
+using namespace vpvl2;
+using namespace vpvl2::extensions;
+using namespace vpvl2::extensions::icu4c;
+using namespace vpvl2::pmx;
+
+namespace
+{
+
+/* rigid bodies of a PMX model are built while loading, so the model is saved and loaded */
+static void LoadModel(IEncoding *encoding, Model &model, const Vector3 &position)
+{
+    Model source(encoding);
+    Bone *bone = static_cast<Bone *>(source.createBone());
+    source.addBone(bone);
+    RigidBody *rigidBody = static_cast<RigidBody *>(source.createRigidBody());
+    rigidBody->setBoneRef(bone);
+    rigidBody->setType(IRigidBody::kDynamicObject);
+    rigidBody->setShapeType(IRigidBody::kSphereShape);
+    rigidBody->setSize(Vector3(1, 1, 1));
+    rigidBody->setMass(1);
+    rigidBody->setCollisionMask(0xffff);
+    rigidBody->setPosition(position);
+    source.addRigidBody(rigidBody);
+    QByteArray bytes;
+    bytes.resize(source.estimateSize());
+    size_t written;
+    source.save(reinterpret_cast<uint8_t *>(bytes.data()), written);
+    ASSERT_TRUE(model.load(reinterpret_cast<const uint8_t *>(bytes.constData()), written));
+    model.setPhysicsEnable(true);
+}
+
+static btRigidBody *FindBody(const Model &model)
+{
+    return model.rigidBodies()[0]->body();
+}
+
+}
+
+TEST(WorldTest, IsolateModels)
+{
+    Encoding encoding(0);
+    Model model(&encoding), model2(&encoding);
+    LoadModel(&encoding, model, Vector3(0, 0, 0));
+    LoadModel(&encoding, model2, Vector3(0.5, 0, 0));
+    btRigidBody *body = FindBody(model), *body2 = FindBody(model2);
+    World world;
+    world.setGravity(kZeroV3);
+    world.addModel(&model);
+    world.addModel(&model2);
+    const btDiscreteDynamicsWorld *worldRef = world.dynamicWorldRef();
+    ASSERT_EQ(2, worldRef->getNumCollisionObjects());
+    world.setModelIsolationEnable(true);
+    ASSERT_TRUE(world.isModelIsolationEnabled());
+    ASSERT_EQ(0, worldRef->getNumCollisionObjects());
+    /* isolated models pass through each other */
+    world.stepSimulation(world.fixedTimeStep());
+    ASSERT_TRUE(CompareVector(Vector3(0, 0, 0), body->getCenterOfMassPosition()));
+    ASSERT_TRUE(CompareVector(Vector3(0.5, 0, 0), body2->getCenterOfMassPosition()));
+    /* shared models join the world and collide with each other */
+    world.setModelShared(&model, true);
+    ASSERT_TRUE(world.isModelShared(&model));
+    ASSERT_FALSE(world.isModelShared(&model2));
+    ASSERT_EQ(1, worldRef->getNumCollisionObjects());
+    world.setModelShared(&model2, true);
+    ASSERT_EQ(2, worldRef->getNumCollisionObjects());
+    world.stepSimulation(world.fixedTimeStep());
+    ASSERT_GT(body2->getCenterOfMassPosition().x() - body->getCenterOfMassPosition().x(), Scalar(0.5));
+    /* and leave it */
+    world.setModelShared(&model, false);
+    world.setModelShared(&model2, false);
+    ASSERT_FALSE(world.isModelShared(&model));
+    ASSERT_EQ(0, worldRef->getNumCollisionObjects());
+    world.setModelIsolationEnable(false);
+    ASSERT_EQ(2, worldRef->getNumCollisionObjects());
+    world.removeModel(&model);
+    world.removeModel(&model2);
+    ASSERT_EQ(0, worldRef->getNumCollisionObjects());
+}
+
+TEST(WorldTest, RecordAndRestoreCheckpoints)
+{
+    Encoding encoding(0);
+    Model model(&encoding);
+    LoadModel(&encoding, model, Vector3(0, 10, 0));
+    btRigidBody *body = FindBody(model);
+    World world;
+    world.addModel(&model);
+    /* disabled by default */
+    ASSERT_FALSE(world.recordCheckpoint(0));
+    world.setCheckpointInterval(10);
+    Vector3 positions[31], velocities[31];
+    for (int i = 1; i <= 30; i++) {
+        world.stepSimulation(world.fixedTimeStep());
+        positions[i] = body->getCenterOfMassPosition();
+        velocities[i] = body->getLinearVelocity();
+        world.recordCheckpoint(i);
+    }
+    /* one checkpoint per interval (1, 10, 20 and 30) */
+    ASSERT_EQ(4, world.countCheckpoints());
+    ASSERT_LT(positions[30].y(), positions[20].y());
+    IKeyframe::TimeIndex restoredTimeIndex = 0;
+    ASSERT_FALSE(world.restoreCheckpoint(0.5, restoredTimeIndex));
+    ASSERT_TRUE(world.restoreCheckpoint(25, restoredTimeIndex));
+    ASSERT_EQ(IKeyframe::TimeIndex(20), restoredTimeIndex);
+    ASSERT_TRUE(CompareVector(positions[20], body->getCenterOfMassPosition()));
+    ASSERT_TRUE(CompareVector(velocities[20], body->getLinearVelocity()));
+    /* serialized checkpoints are restored as recorded */
+    QByteArray bytes;
+    bytes.resize(world.estimateCheckpointsSize());
+    world.saveCheckpoints(reinterpret_cast<uint8_t *>(bytes.data()));
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(bytes.constData());
+    world.clearCheckpoints();
+    ASSERT_EQ(0, world.countCheckpoints());
+    ASSERT_FALSE(world.loadCheckpoints(data, bytes.size() - 1));
+    ASSERT_TRUE(world.loadCheckpoints(data, bytes.size()));
+    ASSERT_EQ(4, world.countCheckpoints());
+    ASSERT_EQ(IKeyframe::TimeIndex(10), world.checkpointInterval());
+    ASSERT_TRUE(world.restoreCheckpoint(10, restoredTimeIndex));
+    ASSERT_EQ(IKeyframe::TimeIndex(10), restoredTimeIndex);
+    ASSERT_TRUE(CompareVector(positions[10], body->getCenterOfMassPosition()));
+    ASSERT_TRUE(CompareVector(velocities[10], body->getLinearVelocity()));
+    /* counts in the header (ncheckpoints at 20 bytes and nRigidBodies at 24 bytes) are too large */
+    const int32_t count = 0x7fffffff;
+    QByteArray bytes2(bytes);
+    memcpy(bytes2.data() + 20, &count, sizeof(count));
+    ASSERT_FALSE(world.loadCheckpoints(reinterpret_cast<const uint8_t *>(bytes2.constData()), bytes2.size()));
+    QByteArray bytes3(bytes);
+    memcpy(bytes3.data() + 24, &count, sizeof(count));
+    ASSERT_FALSE(world.loadCheckpoints(reinterpret_cast<const uint8_t *>(bytes3.constData()), bytes3.size()));
+    /* checkpoints are bound to rigid bodies of models */
+    Model model2(&encoding);
+    LoadModel(&encoding, model2, Vector3(0, 20, 0));
+    world.addModel(&model2);
+    ASSERT_EQ(0, world.countCheckpoints());
+    ASSERT_TRUE(world.recordCheckpoint(0));
+    world.removeModel(&model2);
+    ASSERT_EQ(0, world.countCheckpoints());
+    world.removeModel(&model);
+}
+
+TEST(WorldTest, SetModelLevelOfDetail)
+{
+    /* resetting the motion state finds the root bone by the dictionary */
+    Encoding::Dictionary dict;
+    Encoding encoding(&dict);
+    Model model(&encoding);
+    LoadModel(&encoding, model, Vector3(0, 10, 0));
+    btRigidBody *body = FindBody(model);
+    World world;
+    world.addModel(&model);
+    const btDiscreteDynamicsWorld *worldRef = world.dynamicWorldRef();
+    ASSERT_EQ(World::kFullLevel, world.modelLevelOfDetail(&model));
+    world.setModelLevelOfDetail(&model, World::kReducedLevel);
+    ASSERT_EQ(World::kReducedLevel, world.modelLevelOfDetail(&model));
+    ASSERT_FALSE(body->isKinematicObject());
+    world.setModelLevelOfDetail(&model, World::kKinematicLevel);
+    ASSERT_EQ(World::kKinematicLevel, world.modelLevelOfDetail(&model));
+    ASSERT_TRUE(body->isKinematicObject());
+    /* the kinematic level is applied again after resetting the motion state */
+    model.resetMotionState(world.dynamicWorldRef());
+    ASSERT_FALSE(body->isKinematicObject());
+    world.stepSimulation(world.fixedTimeStep());
+    ASSERT_TRUE(body->isKinematicObject());
+    world.setModelLevelOfDetail(&model, World::kDisabledLevel);
+    ASSERT_EQ(World::kDisabledLevel, world.modelLevelOfDetail(&model));
+    ASSERT_EQ(0, worldRef->getNumCollisionObjects());
+    ASSERT_FALSE(model.isPhysicsEnabled());
+    world.setModelLevelOfDetail(&model, World::kFullLevel);
+    ASSERT_EQ(1, worldRef->getNumCollisionObjects());
+    ASSERT_TRUE(model.isPhysicsEnabled());
+    ASSERT_FALSE(body->isKinematicObject());
+    /* levels out of range are ignored */
+    world.setModelLevelOfDetail(&model, World::kMaxLevelOfDetail);
+    ASSERT_EQ(World::kFullLevel, world.modelLevelOfDetail(&model));
+    world.removeModel(&model);
+}
+
+TEST(WorldTest, SetStepBudget)
+{
+    Encoding encoding(0);
+    Model model(&encoding), model2(&encoding);
+    LoadModel(&encoding, model, Vector3(0, 10, 0));
+    LoadModel(&encoding, model2, Vector3(0, 10, 0));
+    World world, world2;
+    ASSERT_EQ(Scalar(0), world.stepBudget());
+    world.setStepBudget(-1);
+    ASSERT_EQ(Scalar(0), world.stepBudget());
+    /* far less than the cost of a substep */
+    world.setStepBudget(0.000000001f);
+    world.addModel(&model);
+    world2.addModel(&model2);
+    for (int i = 0; i < 10; i++) {
+        world.stepSimulation(world.fixedTimeStep() * 2);
+        world2.stepSimulation(world2.fixedTimeStep() * 2);
+    }
+    /* substeps are reduced to one, the simulation slows down instead */
+    ASSERT_GT(FindBody(model)->getCenterOfMassPosition().y(), FindBody(model2)->getCenterOfMassPosition().y());
+    world.removeModel(&model);
+    world2.removeModel(&model2);
+}